@@ -0,0 +1,509 @@
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <string>
+#include <valarray>
+#include <vector>
+
+#include "ccd.hpp"
+#include "cti.hpp"
+#include "roe.hpp"
+#include "traps.hpp"
+#include "util.hpp"
+
+/*
+    Benchmark suite for arctic, to track the runtime of typical configurations.
+
+    Each benchmark adds (or removes) CTI to a synthetic image of sky noise with
+    a sprinkling of bright sources, repeated several times, and the timings are
+    written to a JSON file. Starting from a base configuration, each sweep
+    varies one aspect at a time: the image size, express, trap family, CCD
+    phases, ROE mode, clocking direction, operation, and number of threads.
+
+    Run with `make bench`, or ./bench_arctic -h for the options.
+*/
+
+static const char* output_filename = "bench_results.json";
+static bool quick_mode = false;
+static int n_repeats = 3;
+static std::string filter;
+static std::vector<int> thread_counts;
+
+enum BenchTrapFamily {
+    bench_traps_ic = 0,
+    bench_traps_sc = 1,
+    bench_traps_ic_co = 2,
+    bench_traps_sc_co = 3,
+    bench_traps_ic_non_uniform = 4
+};
+static const char* bench_trap_family_names[] = {
+    "instant_capture", "slow_capture", "instant_capture_continuum",
+    "slow_capture_continuum", "instant_capture_non_uniform"};
+
+static const char* bench_roe_type_names[] = {
+    "standard", "charge_injection", "trap_pumping"};
+
+class BenchConfig {
+   public:
+    BenchConfig(){};
+
+    std::string sweep;
+    int n_rows = 512;
+    int n_columns = 512;
+    int express = 5;
+    int trap_family = bench_traps_ic;
+    int n_phases = 1;
+    int roe_type = roe_type_standard;
+    int transfer_axis = transfer_axis_parallel;
+    int n_iterations = 0;
+    int n_threads = 0;
+
+    std::string name() const;
+};
+
+/*
+    A unique, readable name for a benchmark configuration.
+*/
+std::string BenchConfig::name() const {
+    char name[256];
+    snprintf(
+        name, sizeof(name), "%s/%s/%dx%d/express_%d/%s/%d_phase/%s/%s/%d_threads",
+        sweep.c_str(), n_iterations > 0 ? "remove" : "add", n_rows, n_columns,
+        express, bench_trap_family_names[trap_family], n_phases,
+        bench_roe_type_names[roe_type],
+        transfer_axis == transfer_axis_parallel ? "parallel" : "serial", n_threads);
+
+    return name;
+}
+
+/*
+    A synthetic image: sky background with pseudo-random noise plus bright
+    sources, reproducible for every run.
+*/
+std::valarray<double> make_bench_image(int n_rows, int n_columns) {
+    std::valarray<double> image(0.0, n_rows * n_columns);
+    unsigned int state = 12345;
+
+    for (int i_pixel = 0; i_pixel < n_rows * n_columns; i_pixel++) {
+        state = state * 1103515245 + 12345;
+        image[i_pixel] = 20.0 + 10.0 * ((state >> 16) & 0x7fff) / 32768.0;
+        if (((state >> 8) & 0x3ff) == 0) image[i_pixel] += 5000.0;
+    }
+
+    return image;
+}
+
+/*
+    Time one benchmark configuration.
+
+    Parameters
+    ----------
+    config : BenchConfig
+        The configuration to run.
+
+    times : std::valarray<double>&
+        Set to the runtime of each repeat, in seconds.
+*/
+void run_bench_config(const BenchConfig& config, std::valarray<double>& times) {
+    int n_rows = config.n_rows;
+    int n_columns = config.n_columns;
+
+    // Traps, only passing the chosen family
+    std::valarray<TrapInstantCapture> traps_ic = {
+        TrapInstantCapture(0.5, 1.2), TrapInstantCapture(1.5, 10.0)};
+    std::valarray<TrapInstantCapture> traps_ic_non_uniform = {
+        TrapInstantCapture(0.5, 1.2, 0.1, 0.3), TrapInstantCapture(1.5, 10.0, 0.2, 0.2)};
+    std::valarray<TrapSlowCapture> traps_sc = {
+        TrapSlowCapture(0.5, 1.2, 0.1), TrapSlowCapture(1.5, 10.0, 0.2)};
+    std::valarray<TrapInstantCaptureContinuum> traps_ic_co = {
+        TrapInstantCaptureContinuum(0.5, 1.2, 0.2),
+        TrapInstantCaptureContinuum(1.5, 10.0, 0.3)};
+    std::valarray<TrapSlowCaptureContinuum> traps_sc_co = {
+        TrapSlowCaptureContinuum(0.5, 1.2, 0.2, 0.1),
+        TrapSlowCaptureContinuum(1.5, 10.0, 0.3, 0.2)};
+    std::valarray<TrapInstantCapture>* chosen_traps_ic = nullptr;
+    std::valarray<TrapSlowCapture>* chosen_traps_sc = nullptr;
+    std::valarray<TrapInstantCaptureContinuum>* chosen_traps_ic_co = nullptr;
+    std::valarray<TrapSlowCaptureContinuum>* chosen_traps_sc_co = nullptr;
+    switch (config.trap_family) {
+        case bench_traps_ic:
+            chosen_traps_ic = &traps_ic;
+            break;
+        case bench_traps_sc:
+            chosen_traps_sc = &traps_sc;
+            break;
+        case bench_traps_ic_co:
+            chosen_traps_ic_co = &traps_ic_co;
+            break;
+        case bench_traps_sc_co:
+            chosen_traps_sc_co = &traps_sc_co;
+            break;
+        case bench_traps_ic_non_uniform:
+            chosen_traps_ic = &traps_ic_non_uniform;
+            break;
+    }
+
+    // CCD, with the traps spread over the phases
+    CCDPhase phase(1e4, 1e-7, 0.5);
+    std::valarray<CCDPhase> phases(phase, config.n_phases);
+    std::valarray<double> fraction_of_traps_per_phase(
+        1.0 / config.n_phases, config.n_phases);
+    CCD ccd(phases, fraction_of_traps_per_phase);
+
+    // ROE, with one step per phase (or two for trap pumping)
+    std::valarray<double> dwell_times(1.0 / config.n_phases, config.n_phases);
+    std::valarray<double> dwell_times_pumping(
+        0.5 / config.n_phases, 2 * config.n_phases);
+    ROE roe_standard(dwell_times, 0, -1, true, false, true, false);
+    ROEChargeInjection roe_charge_injection(dwell_times, 0, -1, true, true, false);
+    ROETrapPumping roe_trap_pumping(dwell_times_pumping, 100, true, false);
+    ROE* roe = &roe_standard;
+    if (config.roe_type == roe_type_charge_injection) roe = &roe_charge_injection;
+    if (config.roe_type == roe_type_trap_pumping) roe = &roe_trap_pumping;
+
+    // Trap pumping is for a single active row
+    int window_start = 0;
+    int window_stop = -1;
+    if (config.roe_type == roe_type_trap_pumping) {
+        window_start = n_rows / 2;
+        window_stop = n_rows / 2 + 1;
+    }
+
+    // Only the chosen direction
+    bool is_parallel = (config.transfer_axis == transfer_axis_parallel);
+    std::valarray<TrapInstantCapture>* parallel_traps_ic =
+        is_parallel ? chosen_traps_ic : nullptr;
+    std::valarray<TrapSlowCapture>* parallel_traps_sc =
+        is_parallel ? chosen_traps_sc : nullptr;
+    std::valarray<TrapInstantCaptureContinuum>* parallel_traps_ic_co =
+        is_parallel ? chosen_traps_ic_co : nullptr;
+    std::valarray<TrapSlowCaptureContinuum>* parallel_traps_sc_co =
+        is_parallel ? chosen_traps_sc_co : nullptr;
+    std::valarray<TrapInstantCapture>* serial_traps_ic =
+        is_parallel ? nullptr : chosen_traps_ic;
+    std::valarray<TrapSlowCapture>* serial_traps_sc =
+        is_parallel ? nullptr : chosen_traps_sc;
+    std::valarray<TrapInstantCaptureContinuum>* serial_traps_ic_co =
+        is_parallel ? nullptr : chosen_traps_ic_co;
+    std::valarray<TrapSlowCaptureContinuum>* serial_traps_sc_co =
+        is_parallel ? nullptr : chosen_traps_sc_co;
+
+#ifdef _OPENMP
+    int n_threads_default = omp_get_max_threads();
+    if (config.n_threads > 0) omp_set_num_threads(config.n_threads);
+#endif
+
+    std::valarray<double> image_pre_cti = make_bench_image(n_rows, n_columns);
+    std::valarray<double> image(n_rows * n_columns);
+    struct timeval time_start, time_stop;
+    times.resize(n_repeats);
+    for (int i_repeat = 0; i_repeat < n_repeats; i_repeat++) {
+        image = image_pre_cti;
+
+        gettimeofday(&time_start, nullptr);
+        if (config.n_iterations > 0)
+            remove_cti(
+                &image[0], n_rows, n_columns, n_columns, 1, config.n_iterations,
+                roe, &ccd, parallel_traps_ic, parallel_traps_sc, parallel_traps_ic_co,
+                parallel_traps_sc_co, config.express, 0, window_start, window_stop, 0,
+                -1, 1e-10, 20, roe, &ccd, serial_traps_ic, serial_traps_sc,
+                serial_traps_ic_co, serial_traps_sc_co, config.express, 0,
+                window_start, window_stop, 0, -1);
+        else
+            add_cti(
+                &image[0], n_rows, n_columns, n_columns, 1, roe, &ccd,
+                parallel_traps_ic, parallel_traps_sc, parallel_traps_ic_co,
+                parallel_traps_sc_co, config.express, 0, window_start, window_stop, 0,
+                -1, 1e-10, 20, roe, &ccd, serial_traps_ic, serial_traps_sc,
+                serial_traps_ic_co, serial_traps_sc_co, config.express, 0,
+                window_start, window_stop, 0, -1);
+        gettimeofday(&time_stop, nullptr);
+
+        times[i_repeat] = gettimelapsed(time_start, time_stop);
+    }
+
+#ifdef _OPENMP
+    omp_set_num_threads(n_threads_default);
+#endif
+}
+
+/*
+    The list of benchmark configurations: the base configuration, then sweeps
+    that each vary one of its parameters.
+*/
+std::vector<BenchConfig> make_bench_configs() {
+    std::vector<BenchConfig> configs;
+    BenchConfig base;
+    BenchConfig config;
+    int n_small = quick_mode ? 64 : 256;
+    base.n_rows = quick_mode ? 128 : 512;
+    base.n_columns = base.n_rows;
+    base.n_threads = get_n_threads_max();
+
+    base.sweep = "base";
+    configs.push_back(base);
+
+    // Image sizes
+    std::vector<int> sizes = {n_small, base.n_rows, base.n_rows * 4};
+    for (int size : sizes) {
+        config = base;
+        config.sweep = "size";
+        config.n_rows = size;
+        config.n_columns = size;
+        configs.push_back(config);
+    }
+
+    // Express, on a smaller image for the slow no-express case
+    for (int express : {1, 2, 5, 20, 0}) {
+        config = base;
+        config.sweep = "express";
+        config.n_rows = n_small;
+        config.n_columns = n_small;
+        config.express = express;
+        configs.push_back(config);
+    }
+
+    // Trap families
+    for (int trap_family = bench_traps_ic; trap_family <= bench_traps_ic_non_uniform;
+         trap_family++) {
+        config = base;
+        config.sweep = "traps";
+        config.trap_family = trap_family;
+        configs.push_back(config);
+    }
+
+    // CCD phases
+    for (int n_phases : {1, 3}) {
+        config = base;
+        config.sweep = "phases";
+        config.n_phases = n_phases;
+        configs.push_back(config);
+    }
+
+    // ROE modes, with slow-capture traps for trap pumping
+    for (int roe_type : {roe_type_standard, roe_type_charge_injection,
+                         roe_type_trap_pumping}) {
+        config = base;
+        config.sweep = "roe";
+        config.roe_type = roe_type;
+        if (roe_type == roe_type_trap_pumping) {
+            config.trap_family = bench_traps_sc;
+            config.n_phases = 3;
+        }
+        configs.push_back(config);
+    }
+
+    // Parallel and serial clocking
+    for (int transfer_axis : {transfer_axis_parallel, transfer_axis_serial}) {
+        config = base;
+        config.sweep = "direction";
+        config.transfer_axis = transfer_axis;
+        configs.push_back(config);
+    }
+
+    // Removing CTI
+    config = base;
+    config.sweep = "remove";
+    config.n_iterations = 3;
+    configs.push_back(config);
+
+    // Threads
+    std::vector<int> n_threads_list = thread_counts;
+    if (n_threads_list.empty()) {
+        for (int n_threads = 1; n_threads < base.n_threads; n_threads *= 2)
+            n_threads_list.push_back(n_threads);
+        n_threads_list.push_back(base.n_threads);
+    }
+    for (int n_threads : n_threads_list) {
+        config = base;
+        config.sweep = "threads";
+        config.n_threads = n_threads;
+        configs.push_back(config);
+    }
+
+    return configs;
+}
+
+/*
+    Write the results of all benchmarks as JSON.
+*/
+void write_bench_results(
+    const char* filename, std::vector<BenchConfig>& configs,
+    std::vector<std::valarray<double> >& times) {
+    FILE* f = fopen(filename, "w");
+    if (!f) error("Failed to open %s", filename);
+
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"version\": \"%s\",\n", version_arctic().c_str());
+    fprintf(f, "  \"date\": \"%s\",\n", date);
+    fprintf(f, "  \"n_threads_max\": %d,\n", get_n_threads_max());
+    fprintf(f, "  \"n_repeats\": %d,\n", n_repeats);
+    fprintf(f, "  \"benchmarks\": [\n");
+    for (int i_config = 0; i_config < (int)configs.size(); i_config++) {
+        BenchConfig& config = configs[i_config];
+        std::valarray<double>& time = times[i_config];
+        double time_mean = time.sum() / time.size();
+        double n_mpixels = config.n_rows * config.n_columns * 1e-6;
+
+        fprintf(f, "    {\n");
+        fprintf(f, "      \"name\": \"%s\",\n", config.name().c_str());
+        fprintf(f, "      \"sweep\": \"%s\",\n", config.sweep.c_str());
+        fprintf(
+            f, "      \"operation\": \"%s\",\n",
+            config.n_iterations > 0 ? "remove_cti" : "add_cti");
+        fprintf(f, "      \"n_iterations\": %d,\n", config.n_iterations);
+        fprintf(f, "      \"n_rows\": %d,\n", config.n_rows);
+        fprintf(f, "      \"n_columns\": %d,\n", config.n_columns);
+        fprintf(f, "      \"express\": %d,\n", config.express);
+        fprintf(
+            f, "      \"trap_family\": \"%s\",\n",
+            bench_trap_family_names[config.trap_family]);
+        fprintf(f, "      \"n_phases\": %d,\n", config.n_phases);
+        fprintf(f, "      \"roe\": \"%s\",\n", bench_roe_type_names[config.roe_type]);
+        fprintf(
+            f, "      \"direction\": \"%s\",\n",
+            config.transfer_axis == transfer_axis_parallel ? "parallel" : "serial");
+        fprintf(f, "      \"n_threads\": %d,\n", config.n_threads);
+        fprintf(f, "      \"times_s\": [");
+        for (int i_repeat = 0; i_repeat < (int)time.size(); i_repeat++)
+            fprintf(f, "%s%.6f", i_repeat == 0 ? "" : ", ", time[i_repeat]);
+        fprintf(f, "],\n");
+        fprintf(f, "      \"time_min_s\": %.6f,\n", time.min());
+        fprintf(f, "      \"time_mean_s\": %.6f,\n", time_mean);
+        fprintf(f, "      \"mpixels_per_s\": %.6g\n", n_mpixels / time.min());
+        fprintf(f, "    }%s\n", i_config == (int)configs.size() - 1 ? "" : ",");
+    }
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+
+    fclose(f);
+}
+
+/*
+    Print help information.
+*/
+void print_help() {
+    printf(
+        "ArCTIc benchmarks \n"
+        "================= \n"
+        "Time adding and removing CTI for sweeps of configurations around a base \n"
+        "case, and write the results to a JSON file. \n"
+        "\n"
+        "-h, --help \n"
+        "    Print help information and exit. \n"
+        "-o <file>, --output=<file> \n"
+        "    The JSON output file. Default bench_results.json. \n"
+        "-q, --quick \n"
+        "    Use smaller images, e.g. for a quick check. \n"
+        "-r <int>, --repeats=<int> \n"
+        "    The number of times to repeat each benchmark. Default 3. \n"
+        "-f <str>, --filter=<str> \n"
+        "    Only run benchmarks whose names contain this string, e.g. \"traps/\". \n"
+        "-t <list>, --threads=<list> \n"
+        "    Comma-separated thread counts for the threads sweep, e.g. 1,2,4. \n"
+        "    Default powers of 2 up to the maximum. \n"
+        "\n");
+}
+
+/*
+    Parse input parameters. See print_help().
+*/
+void parse_parameters(int argc, char** argv) {
+    // Short options
+    const char* const short_opts = ":ho:qr:f:t:";
+    // Full options
+    const option long_opts[] = {
+        {"help", no_argument, nullptr, 'h'},
+        {"output", required_argument, nullptr, 'o'},
+        {"quick", no_argument, nullptr, 'q'},
+        {"repeats", required_argument, nullptr, 'r'},
+        {"filter", required_argument, nullptr, 'f'},
+        {"threads", required_argument, nullptr, 't'},
+        {0, 0, 0, 0}};
+
+    // Parse options
+    while (true) {
+        const auto opt = getopt_long(argc, argv, short_opts, long_opts, nullptr);
+
+        if (opt == -1) break;
+
+        switch (opt) {
+            case 'h':
+                print_help();
+                exit(0);
+            case 'o':
+                output_filename = optarg;
+                break;
+            case 'q':
+                quick_mode = true;
+                break;
+            case 'r':
+                n_repeats = atoi(optarg);
+                if (n_repeats < 1) error("Need at least one repeat (%d)", n_repeats);
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 't':
+                for (char* token = strtok(optarg, ","); token;
+                     token = strtok(nullptr, ","))
+                    thread_counts.push_back(atoi(token));
+                break;
+            case ':':
+                printf(
+                    "Error: Option %s requires a value. Run with -h for help. \n",
+                    argv[optind - 1]);
+                exit(1);
+            case '?':
+                printf(
+                    "Error: Option %s not recognised. Run with -h for help. \n",
+                    argv[optind - 1]);
+                exit(1);
+        }
+    }
+}
+
+/*
+    Run the benchmarks and write the results. See print_help().
+*/
+int main(int argc, char** argv) {
+
+    parse_parameters(argc, argv);
+    set_verbosity(0);
+
+    std::vector<BenchConfig> configs_all = make_bench_configs();
+    std::vector<BenchConfig> configs;
+    std::vector<std::valarray<double> > times;
+    std::valarray<double> time;
+    for (BenchConfig& config : configs_all) {
+        if (config.name().find(filter) == std::string::npos) continue;
+
+        run_bench_config(config, time);
+        configs.push_back(config);
+        times.push_back(time);
+
+        printf(
+            "%-92s %10.4f s (min of %d) \n", config.name().c_str(), time.min(),
+            n_repeats);
+        fflush(stdout);
+    }
+
+    write_bench_results(output_filename, configs, times);
+    printf("Results written to %s \n", output_filename);
+
+    return 0;
+}
@@ -2,10 +2,152 @@
 #ifndef ARCTIC_CTI_HPP
 #define ARCTIC_CTI_HPP
 
+#include <valarray>
+#include <vector>
+
 #include "ccd.hpp"
+#include "pixel_bounce.hpp"
 #include "roe.hpp"
+#include "trap_managers.hpp"
 #include "traps.hpp"
 
+enum TransferAxis {
+    transfer_axis_parallel = 0,
+    transfer_axis_serial = 1
+};
+
+enum ColumnSchedule {
+    column_schedule_static = 0,
+    column_schedule_dynamic = 1,
+    column_schedule_guided = 2,
+    column_schedule_cost = 3
+};
+
+std::valarray<double> estimate_tile_costs(
+    double* image, long row_stride, long column_stride, int row_start,
+    int n_active_rows, int column_start, int n_active_columns, CCD* ccd);
+
+class ColumnCheckpoints {
+   public:
+    ColumnCheckpoints();
+    ~ColumnCheckpoints(){};
+
+    int interval;
+    int n_checkpoints;
+    int i_restart;
+    int i_stop;
+    int i_first_kept;
+    bool is_recorded;
+    std::vector<std::vector<double> > states;
+    std::vector<bool> use_restart_states;
+    std::valarray<double> pixels_in;
+    std::valarray<double> pixels_out;
+
+    void reset(int interval, int n_express_passes, int n_active_rows);
+    void reset_window(int interval, int n_express_passes);
+    void advance_window();
+    std::vector<double>& state(int express_index, int i_checkpoint);
+};
+
+class TrapStateSnapshot {
+   public:
+    TrapStateSnapshot();
+    ~TrapStateSnapshot(){};
+
+    int time;
+    int n_images;
+    int n_columns;
+    std::vector<std::vector<double> > states;
+
+    void reset(int time, int n_images, int n_columns);
+    std::vector<double>& state(int i_image, int column_index);
+    const std::vector<double>& state(int i_image, int column_index) const;
+    void write(const char* filename) const;
+    void read(const char* filename);
+};
+
+typedef void (*ColumnClocker)(
+    double* column, long row_stride, int column_index, int n_rows, int row_start,
+    int n_active_rows, ROE* roe, CCD* ccd, TrapManagerManager& trap_manager_manager,
+    double prune_n_electrons, int prune_frequency, int allow_negative_pixels,
+    ColumnCheckpoints* checkpoints, int buffer_row_start);
+
+ColumnClocker select_column_clocker(
+    TrapManagerManager& trap_manager_manager, ROE* roe, CCD* ccd);
+
+void clock_charge_in_one_column(
+    double* column, long row_stride, int column_index, int n_rows, int row_start,
+    int n_active_rows, ROE* roe, CCD* ccd, TrapManagerManager& trap_manager_manager,
+    double prune_n_electrons, int prune_frequency, int allow_negative_pixels,
+    ColumnCheckpoints* checkpoints = nullptr, int buffer_row_start = 0);
+
+void prepare_roe(
+    ROE* roe, CCD* ccd, int n_rows, int n_active_rows, int express, int row_offset,
+    int time_start = 0, int time_stop = -1);
+
+TrapManagerManager prepare_clocking(
+    ROE* roe, CCD* ccd, std::valarray<TrapInstantCapture>* traps_ic,
+    std::valarray<TrapSlowCapture>* traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* traps_sc_co, int n_rows, int n_active_rows,
+    int express, int row_offset, int time_start = 0, int time_stop = -1);
+
+void print_clocking_inputs(
+    ROE* roe, CCD* ccd, TrapManagerManager& trap_manager_manager, int express,
+    int row_offset);
+
+void clock_charge_in_images(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, ROE* roe, CCD* ccd, TrapManagerManager& trap_manager_manager,
+    int row_start, int row_stop, int column_start, int column_stop,
+    double prune_n_electrons, int prune_frequency, int allow_negative_pixels,
+    TrapManagerManagerPool* pool = nullptr,
+    int column_schedule = column_schedule_static,
+    int transfer_axis = transfer_axis_parallel,
+    std::vector<ColumnCheckpoints>* column_checkpoints = nullptr,
+    const std::vector<PixelBounce>* pixel_bounces = nullptr,
+    const TrapStateSnapshot* snapshot_in = nullptr,
+    TrapStateSnapshot* snapshot_out = nullptr, int buffer_row_start = 0);
+
+void clock_charge_in_images(
+    float** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, ROE* roe, CCD* ccd, TrapManagerManager& trap_manager_manager,
+    int row_start, int row_stop, int column_start, int column_stop,
+    double prune_n_electrons, int prune_frequency, int allow_negative_pixels,
+    TrapManagerManagerPool* pool = nullptr,
+    int column_schedule = column_schedule_static,
+    int transfer_axis = transfer_axis_parallel,
+    std::vector<ColumnCheckpoints>* column_checkpoints = nullptr,
+    const std::vector<PixelBounce>* pixel_bounces = nullptr,
+    const TrapStateSnapshot* snapshot_in = nullptr,
+    TrapStateSnapshot* snapshot_out = nullptr);
+
+void clock_charge_in_images_ensemble(
+    double** images, int n_models, int n_rows, long row_stride, long column_stride,
+    ROE* roe, CCD* ccd, std::vector<TrapManagerManager>& trap_manager_managers,
+    int row_start, int row_stop, int column_start, int column_stop,
+    double prune_n_electrons, int prune_frequency, int allow_negative_pixels);
+
+template <typename real>
+void clock_charge_in_one_direction(
+    real* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    ROE* roe, CCD* ccd,
+    std::valarray<TrapInstantCapture>* traps_ic,
+    std::valarray<TrapSlowCapture>* traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* traps_sc_co, 
+    int express = 0, int row_offset = 0, 
+    int row_start = 0, int row_stop = -1, 
+    int column_start = 0, int column_stop = -1, 
+    int time_start = 0, int time_stop = -1,
+    double prune_n_electrons = 1e-10, int prune_frequency = 20, 
+    int allow_negative_pixels = 1, int print_inputs = -1,
+    int transfer_axis = transfer_axis_parallel,
+    TrapManagerManagerPool* pool = nullptr,
+    int column_schedule = column_schedule_static,
+    const TrapStateSnapshot* snapshot_in = nullptr,
+    TrapStateSnapshot* snapshot_out = nullptr);
+
 std::valarray<std::valarray<double> > clock_charge_in_one_direction(
     std::valarray<std::valarray<double> >& image_in, ROE* roe, CCD* ccd,
     std::valarray<TrapInstantCapture>* traps_ic,
@@ -17,7 +159,40 @@ std::valarray<std::valarray<double> > clock_charge_in_one_direction(
     int column_start = 0, int column_stop = -1, 
     int time_start = 0, int time_stop = -1,
     double prune_n_electrons = 1e-10, int prune_frequency = 20, 
-    int allow_negative_pixels = 1, int print_inputs = -1);
+    int allow_negative_pixels = 1, int print_inputs = -1,
+    int transfer_axis = transfer_axis_parallel,
+    int column_schedule = column_schedule_static);
+
+template <typename real>
+void add_cti(
+    real* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    // Parallel
+    ROE* parallel_roe = nullptr, CCD* parallel_ccd = nullptr,
+    std::valarray<TrapInstantCapture>* parallel_traps_ic = nullptr,
+    std::valarray<TrapSlowCapture>* parallel_traps_sc = nullptr,
+    std::valarray<TrapInstantCaptureContinuum>* parallel_traps_ic_co = nullptr,
+    std::valarray<TrapSlowCaptureContinuum>* parallel_traps_sc_co = nullptr,
+    int parallel_express = 0, int parallel_window_offset = 0, 
+    int parallel_window_start = 0, int parallel_window_stop = -1,
+    int parallel_time_start = 0, int parallel_time_stop = -1,
+    double parallel_prune_n_electrons = 1e-10, int parallel_prune_frequency = 20,
+    // Serial
+    ROE* serial_roe = nullptr, CCD* serial_ccd = nullptr,
+    std::valarray<TrapInstantCapture>* serial_traps_ic = nullptr,
+    std::valarray<TrapSlowCapture>* serial_traps_sc = nullptr,
+    std::valarray<TrapInstantCaptureContinuum>* serial_traps_ic_co = nullptr,
+    std::valarray<TrapSlowCaptureContinuum>* serial_traps_sc_co = nullptr,
+    int serial_express = 0, int serial_window_offset = 0, 
+    int serial_window_start = 0, int serial_window_stop = -1, 
+    int serial_time_start = 0, int serial_time_stop = -1,
+    double serial_prune_n_electrons = 1e-10, int serial_prune_frequency = 20, 
+    // Combined
+    int allow_negative_pixels = 1,
+    int verbosity = 0, int iteration = 0,
+    int column_schedule = column_schedule_static,
+    // Workspaces
+    TrapManagerManagerPool* parallel_pool = nullptr,
+    TrapManagerManagerPool* serial_pool = nullptr);
 
 std::valarray<std::valarray<double> > add_cti(
     std::valarray<std::valarray<double> >& image_in,
@@ -43,7 +218,36 @@ std::valarray<std::valarray<double> > add_cti(
     double serial_prune_n_electrons = 1e-10, int serial_prune_frequency = 20, 
     // Combined
     int allow_negative_pixels = 1,
-    int verbosity = 0, int iteration = 0);
+    int verbosity = 0, int iteration = 0,
+    int column_schedule = column_schedule_static);
+
+template <typename real>
+void remove_cti(
+    real* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations,
+    // Parallel
+    ROE* parallel_roe = nullptr, CCD* parallel_ccd = nullptr,
+    std::valarray<TrapInstantCapture>* parallel_traps_ic = nullptr,
+    std::valarray<TrapSlowCapture>* parallel_traps_sc = nullptr,
+    std::valarray<TrapInstantCaptureContinuum>* parallel_traps_ic_co = nullptr,
+    std::valarray<TrapSlowCaptureContinuum>* parallel_traps_sc_co = nullptr,
+    int parallel_express = 0, int parallel_window_offset = 0, 
+    int parallel_window_start = 0, int parallel_window_stop = -1,
+    int parallel_time_start = 0, int parallel_time_stop = -1,
+    double parallel_prune_n_electrons = 1e-10, int parallel_prune_frequency = 20,
+    // Serial
+    ROE* serial_roe = nullptr, CCD* serial_ccd = nullptr,
+    std::valarray<TrapInstantCapture>* serial_traps_ic = nullptr,
+    std::valarray<TrapSlowCapture>* serial_traps_sc = nullptr,
+    std::valarray<TrapInstantCaptureContinuum>* serial_traps_ic_co = nullptr,
+    std::valarray<TrapSlowCaptureContinuum>* serial_traps_sc_co = nullptr,
+    int serial_express = 0, int serial_window_offset = 0, 
+    int serial_window_start = 0, int serial_window_stop = -1, 
+    int serial_time_start = 0, int serial_time_stop = -1,
+    double serial_prune_n_electrons = 1e-10, int serial_prune_frequency = 20, 
+    // Combined
+    int allow_negative_pixels = 1,
+    int column_schedule = column_schedule_static);
 
 std::valarray<std::valarray<double> > remove_cti(
     std::valarray<std::valarray<double> >& image_in, int n_iterations,
@@ -68,6 +272,7 @@ std::valarray<std::valarray<double> > remove_cti(
     int serial_time_start = 0, int serial_time_stop = -1,
     double serial_prune_n_electrons = 1e-10, int serial_prune_frequency = 20, 
     // Combined
-    int allow_negative_pixels = 1);
+    int allow_negative_pixels = 1,
+    int column_schedule = column_schedule_static);
 
 #endif  // ARCTIC_CTI_HPP
@@ -0,0 +1,178 @@
+
+#ifndef ARCTIC_MODEL_HPP
+#define ARCTIC_MODEL_HPP
+
+#include <functional>
+#include <valarray>
+#include <vector>
+
+#include "ccd.hpp"
+#include "cti.hpp"
+#include "pixel_bounce.hpp"
+#include "roe.hpp"
+#include "trap_managers.hpp"
+#include "traps.hpp"
+
+enum RemoveCTIUpdate {
+    remove_cti_update_fixed_point = 0,
+    remove_cti_update_anderson = 1
+};
+
+class ClockingModel {
+   public:
+    ClockingModel(
+        ROE* roe = nullptr, CCD* ccd = nullptr,
+        std::valarray<TrapInstantCapture>* traps_ic = nullptr,
+        std::valarray<TrapSlowCapture>* traps_sc = nullptr,
+        std::valarray<TrapInstantCaptureContinuum>* traps_ic_co = nullptr,
+        std::valarray<TrapSlowCaptureContinuum>* traps_sc_co = nullptr,
+        int express = 0, int window_offset = 0,
+        int window_start = 0, int window_stop = -1,
+        int time_start = 0, int time_stop = -1,
+        double prune_n_electrons = 1e-10, int prune_frequency = 20,
+        int checkpoint_interval = 0, double checkpoint_tolerance = 0.0);
+    ~ClockingModel(){};
+
+    ROE* roe;
+    CCD* ccd;
+    std::valarray<TrapInstantCapture> traps_ic;
+    std::valarray<TrapSlowCapture> traps_sc;
+    std::valarray<TrapInstantCaptureContinuum> traps_ic_co;
+    std::valarray<TrapSlowCaptureContinuum> traps_sc_co;
+    int express;
+    int window_offset;
+    int window_start;
+    int window_stop;
+    int time_start;
+    int time_stop;
+    double prune_n_electrons;
+    int prune_frequency;
+    bool roe_is_shared;
+    int checkpoint_interval;
+    double checkpoint_tolerance;
+
+    bool is_prepared;
+    int prepared_n_rows;
+    int prepared_n_columns;
+    int prepared_n_active_rows;
+    int prepared_window_offset;
+    TrapManagerManager trap_manager_manager;
+    TrapManagerManagerPool pool;
+
+    std::vector<ColumnCheckpoints> column_checkpoints;
+    int checkpoints_n_images;
+    int checkpoints_n_rows;
+    int checkpoints_n_columns;
+    int checkpoints_n_express_passes;
+    long n_rows_reused;
+
+    bool is_active();
+    int trail_length(double trail_fraction, int max_trail_length);
+    void prepare(int n_rows, int n_columns, int n_active_rows);
+    template <typename real>
+    void prepare_checkpoints(
+        real** images, int n_images, int n_rows, int n_columns, long row_stride,
+        long column_stride, int row_start, int n_active_rows, int column_start,
+        int column_stop);
+    template <typename real>
+    void record_checkpoints(
+        real** images, int n_images, int n_columns, long row_stride,
+        long column_stride, int row_start, int n_active_rows, int column_start,
+        int column_stop);
+    template <typename real>
+    void clock(
+        real** images, int n_images, int n_rows, int n_columns, long row_stride,
+        long column_stride, int column_start, int column_stop, int transfer_axis,
+        int allow_negative_pixels, int print_inputs, int column_schedule,
+        const std::vector<PixelBounce>* pixel_bounces = nullptr);
+    void clock_density_sweep(
+        double** images, int n_models, int n_rows, int n_columns, long row_stride,
+        long column_stride, int column_start, int column_stop, int transfer_axis,
+        int allow_negative_pixels, int print_inputs, const double* trap_densities);
+};
+
+class RegionOfInterest {
+   public:
+    RegionOfInterest(
+        int row_start = 0, int row_stop = 0, int column_start = 0,
+        int column_stop = 0);
+    ~RegionOfInterest(){};
+
+    int row_start;
+    int row_stop;
+    int column_start;
+    int column_stop;
+};
+
+class CTIModel {
+   public:
+    CTIModel(
+        ClockingModel parallel = ClockingModel(),
+        ClockingModel serial = ClockingModel(), int allow_negative_pixels = 1,
+        int column_schedule = column_schedule_static,
+        std::vector<PixelBounce> pixel_bounces = std::vector<PixelBounce>());
+    ~CTIModel(){};
+
+    ClockingModel parallel;
+    ClockingModel serial;
+    int allow_negative_pixels;
+    int column_schedule;
+    std::vector<PixelBounce> pixel_bounces;
+};
+
+template <typename real>
+void add_cti_batch(
+    real** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, CTIModel& model, int verbosity = 0, int iteration = 0);
+
+template <typename real>
+void add_cti(
+    real* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    CTIModel& model, int verbosity = 0, int iteration = 0);
+
+void add_cti_density_sweep(
+    double** images, int n_models, int n_rows, int n_columns, long row_stride,
+    long column_stride, CTIModel& model,
+    const double* parallel_trap_densities = nullptr,
+    const double* serial_trap_densities = nullptr, int verbosity = 0);
+
+template <typename real>
+void remove_cti_batch(
+    real** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int n_iterations, CTIModel& model);
+
+template <typename real>
+void remove_cti(
+    real* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations, CTIModel& model);
+
+std::valarray<int> remove_cti_batch_until_converged(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int max_n_iterations, double tolerance, CTIModel& model,
+    int update = remove_cti_update_fixed_point);
+
+std::valarray<int> remove_cti_until_converged(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int max_n_iterations, double tolerance, CTIModel& model,
+    int update = remove_cti_update_fixed_point);
+
+typedef std::function<void(double* rows, int row_start, int n_rows)> RowReader;
+typedef std::function<void(const double* rows, int row_start, int n_rows)> RowWriter;
+
+void add_cti_streaming(
+    RowReader read_rows, RowWriter write_rows, int n_rows, int n_columns,
+    int n_rows_per_chunk, CTIModel& model, int verbosity = 0);
+
+void add_cti_regions(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    std::vector<RegionOfInterest>& regions, CTIModel& model,
+    double trail_fraction = 1e-4, int parallel_trail_length = -1,
+    int serial_trail_length = -1);
+
+void remove_cti_regions(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations, std::vector<RegionOfInterest>& regions, CTIModel& model,
+    double trail_fraction = 1e-4, int parallel_trail_length = -1,
+    int serial_trail_length = -1);
+
+#endif  // ARCTIC_MODEL_HPP
@@ -0,0 +1,27 @@
+
+#ifndef ARCTIC_MPI_CTI_HPP
+#define ARCTIC_MPI_CTI_HPP
+
+#ifdef ARCTIC_MPI
+
+#include <mpi.h>
+
+#include <vector>
+
+#include "model.hpp"
+
+std::vector<int> mpi_block_starts(int n, int n_ranks);
+
+void add_cti_batch_mpi(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, CTIModel& model, MPI_Comm comm = MPI_COMM_WORLD,
+    int root = 0);
+
+void remove_cti_batch_mpi(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int n_iterations, CTIModel& model,
+    MPI_Comm comm = MPI_COMM_WORLD, int root = 0);
+
+#endif  // ARCTIC_MPI
+
+#endif  // ARCTIC_MPI_CTI_HPP
@@ -0,0 +1,32 @@
+
+#ifndef ARCTIC_PIXEL_BOUNCE_HPP
+#define ARCTIC_PIXEL_BOUNCE_HPP
+
+#include <vector>
+
+class PixelBounce {
+   public:
+    PixelBounce(double kA = 0.0, double kv = 0.0, double gamma = 1.0, double omega = 1.0);
+    ~PixelBounce(){};
+
+    double kA;
+    double kv;
+    double gamma;
+    double omega;
+
+    double coeff_A;
+    double coeff_B;
+};
+
+template <typename real>
+void add_pixel_bounce_to_lines(
+    real* image, long line_stride, long pixel_stride, int n_lines, int pixel_start,
+    int pixel_stop, const std::vector<PixelBounce>& pixel_bounces);
+
+template <typename real>
+void add_pixel_bounce(
+    real** images, int n_images, long line_stride, long pixel_stride, int line_start,
+    int line_stop, int pixel_start, int pixel_stop,
+    const std::vector<PixelBounce>& pixel_bounces);
+
+#endif  // ARCTIC_PIXEL_BOUNCE_HPP
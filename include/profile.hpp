@@ -0,0 +1,58 @@
+
+#ifndef ARCTIC_PROFILE_HPP
+#define ARCTIC_PROFILE_HPP
+
+#include <vector>
+
+class ClockingProfile {
+   public:
+    ClockingProfile();
+    ~ClockingProfile(){};
+
+    int transfer_axis;
+    int n_images;
+    int n_active_rows;
+    int n_active_columns;
+    int n_express_passes;
+    long n_express_passes_clocked;
+    double wall_time;
+
+    std::vector<int> thread_n_columns;
+    std::vector<double> thread_times;
+
+    std::vector<int> n_watermarks_ic;
+    std::vector<int> n_watermarks_sc;
+    std::vector<int> n_watermarks_ic_co;
+    std::vector<int> n_watermarks_sc_co;
+    std::vector<int> max_n_active_watermarks_ic;
+    std::vector<int> max_n_active_watermarks_sc;
+    std::vector<int> max_n_active_watermarks_ic_co;
+    std::vector<int> max_n_active_watermarks_sc_co;
+
+    long n_prunes;
+    long n_pruned_watermarks;
+    long n_stores;
+    long n_restores;
+    double store_time;
+    double restore_time;
+    int n_workspace_copies;
+};
+
+class CTIProfile {
+   public:
+    CTIProfile(){};
+    ~CTIProfile(){};
+
+    std::vector<ClockingProfile> clockings;
+};
+
+extern int profiling;
+void set_profiling(int p);
+
+void reset_profile();
+
+CTIProfile get_profile();
+
+void add_clocking_profile(const ClockingProfile& clocking_profile);
+
+#endif  // ARCTIC_PROFILE_HPP
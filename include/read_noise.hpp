@@ -2,14 +2,31 @@
 #ifndef ARCTIC_READ_NOISE_HPP
 #define ARCTIC_READ_NOISE_HPP
 
+#include "model.hpp"
+
 void determine_read_noise_model(
-    const double* imageIn, 
-    const double* imageOut, 
-    const int rows, 
-    const int cols, 
-    const double readNoiseAmp, 
-    const double readNoiseAmpFraction, 
-    const int smoothCol, 
-    double* output);
+    const double* image_in, const double* image_out, const int rows, const int cols,
+    const double read_noise_amp, const double read_noise_amp_fraction,
+    const int smooth_col, double* output);
+
+double generate_sr_frames(
+    const double* image_in, const int rows, const int cols,
+    const double read_noise_amp, const double read_noise_amp_fraction,
+    const int smooth_col, const double out_scale, const int n_iterations,
+    double* image_out, double* image_noise, double* scratch = nullptr);
+
+void covariance_matrix_from_image(
+    const double* image, const int n_rows, const int n_columns,
+    const int matrix_n_rows, const int matrix_n_columns, const int border_bottom,
+    const int border_left, const int border_top, const int border_right,
+    double* covariance);
+
+void estimate_residual_covariances(
+    const double* sky_frames, const double* noise_frames, const int n_realisations,
+    const int n_rows, const int n_columns, CTIModel& model,
+    const double read_noise_amp, const double read_noise_amp_fraction,
+    const int smooth_col, const double out_scale, const int n_sr_iterations,
+    const double* sr_fractions, const int n_sr_fractions, const int matrix_size,
+    const int fpr_size, double* covariances, double* covariance_benchmark);
 
 #endif  // ARCTIC_READ_NOISE_HPP
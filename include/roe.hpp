@@ -3,6 +3,7 @@
 #define ARCTIC_ROE_HPP
 
 #include <valarray>
+#include <vector>
 
 enum ROEType {
     roe_type_standard = 0,
@@ -31,6 +32,17 @@ class ROEStepPhase {
     int n_release_pixels;
 };
 
+class ROEExpressTransfer {
+   public:
+    ROEExpressTransfer(){};
+    ROEExpressTransfer(int row_index, double express_multiplier, bool store_trap_states);
+    ~ROEExpressTransfer(){};
+
+    int row_index;
+    double express_multiplier;
+    bool store_trap_states;
+};
+
 class ROE {
    public:
     ROE(std::valarray<double>& dwell_times = dwell_times_default,
@@ -40,6 +52,7 @@ class ROE {
         bool empty_traps_for_first_transfers = false,
         bool force_release_away_from_readout = true,
         bool use_integer_express_matrix = false);
+    ROE(const ROE& roe) = default;
     virtual ~ROE(){};
 
     ROE& operator=(const ROE& roe);
@@ -54,17 +67,26 @@ class ROE {
 
     std::valarray<double> express_matrix;
     std::valarray<bool> store_trap_states_matrix;
+    std::vector<ROEExpressTransfer> express_schedule;
+    std::vector<int> express_schedule_starts;
     std::valarray<std::valarray<ROEStepPhase> > clock_sequence;
 
     ROEType type;
     int n_steps;
     int n_phases;
     int n_express_passes;
+    int express_pass_start;
+    int express_pass_stop;
     int n_pumps;
 
     virtual void set_express_matrix_from_rows_and_express(
         int n_rows, int express = 0, int window_offset = 0);
     virtual void set_store_trap_states_matrix();
+    void set_express_schedule();
+    void set_express_pass_range(int time_start = 0, int time_stop = -1);
+    int express_schedule_first(int express_index, int row_index) const;
+    bool express_pass_depends_on_rows(
+        int express_index, int row_index_start, int row_index_stop) const;
     virtual void set_clock_sequence();
 };
 
@@ -0,0 +1,42 @@
+
+#ifndef ARCTIC_TABLE_CACHE_HPP
+#define ARCTIC_TABLE_CACHE_HPP
+
+#include <valarray>
+
+enum TableKind {
+    table_kind_fill_fraction_from_time_elapsed = 0,
+    table_kind_fill_fraction_after_slow_capture = 1
+};
+
+class TableKey {
+   public:
+    TableKey(
+        int kind, double release_timescale, double release_timescale_sigma,
+        double capture_timescale, double dwell_time, double time_min,
+        double time_max, double tolerance, int n_intp);
+    ~TableKey(){};
+
+    int kind;
+    double release_timescale;
+    double release_timescale_sigma;
+    double capture_timescale;
+    double dwell_time;
+    double time_min;
+    double time_max;
+    double tolerance;
+    int n_intp;
+
+    bool operator<(const TableKey& other) const;
+    unsigned long long hash() const;
+};
+
+void set_table_cache_dir(const char* dir);
+
+void clear_table_cache();
+
+bool load_cached_table(const TableKey& key, std::valarray<double>& values);
+
+void store_cached_table(const TableKey& key, const std::valarray<double>& values);
+
+#endif  // ARCTIC_TABLE_CACHE_HPP
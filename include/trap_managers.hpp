@@ -3,10 +3,14 @@
 #define ARCTIC_TRAP_MANAGERS_HPP
 
 #include <valarray>
+#include <vector>
 
 #include "ccd.hpp"
 #include "traps.hpp"
 
+extern double watermark_memory_limit;
+void set_watermark_memory_limit(double n_bytes);
+
 class TrapManagerBase {
    public:
     TrapManagerBase(){};
@@ -31,15 +35,27 @@ class TrapManagerBase {
     int n_watermarks;
     int stored_n_active_watermarks;
     int stored_i_first_active_wmk;
+    int n_used_watermarks;
+    int stored_n_used_watermarks;
+    int max_n_watermarks;
+    int max_n_active_watermarks;
+    long n_pruned_watermarks;
     void prune_watermarks(double min_n_electrons = 0);
     void lower_zeroth_watermark(double min_n_electrons = 0);
 
     std::valarray<double> trap_densities;
 
     void initialise_trap_states();
+    void update_n_used_watermarks();
     void reset_trap_states();
     void store_trap_states();
     void restore_trap_states();
+    void save_trap_states(std::vector<double>& states);
+    const double* load_trap_states(const double* states);
+    void resize_watermarks(int n_watermarks_new);
+    void move_watermarks_to_start();
+    void merge_smallest_watermark();
+    void ensure_watermark_capacity(int n_transfers);
     virtual void setup();
 
     virtual double n_trapped_electrons_in_watermark(int i_wmk);
@@ -148,7 +164,7 @@ class TrapManagerSlowCaptureContinuum : public TrapManagerBase {
 
 class TrapManagerManager {
    public:
-    TrapManagerManager(){};
+    TrapManagerManager() : setup_id(0){};
     TrapManagerManager(
         std::valarray<TrapInstantCapture>& traps_ic,
         std::valarray<TrapSlowCapture>& traps_sc,
@@ -173,10 +189,39 @@ class TrapManagerManager {
     std::valarray<TrapManagerInstantCaptureContinuum> trap_managers_ic_co;
     std::valarray<TrapManagerSlowCaptureContinuum> trap_managers_sc_co;
 
+    long n_prunes;
+    long n_stores;
+    long n_restores;
+    double store_time;
+    double restore_time;
+    bool watermarks_on_demand;
+    long setup_id;
+
+    void limit_watermark_memory(int n_steps);
+    void ensure_watermark_capacity(int n_transfers);
+    void set_trap_densities(const double* densities_ic, const double* densities_sc);
     void reset_trap_states();
+    void reset_counters();
     void store_trap_states();
     void restore_trap_states();
+    void save_trap_states(std::vector<double>& states);
+    void load_trap_states(const std::vector<double>& states);
     void prune_watermarks(double min_n_electrons = 0);
+    bool any_active_watermarks();
+    void update_max_n_active_watermarks();
+};
+
+class TrapManagerManagerPool {
+   public:
+    TrapManagerManagerPool(){};
+    ~TrapManagerManagerPool(){};
+
+    std::vector<TrapManagerManager> workspaces;
+
+    void reserve(int n_threads);
+    TrapManagerManager& thread_workspace(
+        int i_thread, TrapManagerManager& trap_manager_manager,
+        bool* is_copied = nullptr);
 };
 
 #endif  // ARCTIC_TRAP_MANAGERS_HPP
@@ -40,10 +40,12 @@ class TrapSlowCapture : public TrapInstantCapture {
 class TrapInstantCaptureContinuum : public TrapInstantCapture {
    public:
     TrapInstantCaptureContinuum(
-        double density, double release_timescale, double release_timescale_sigma);
+        double density, double release_timescale, double release_timescale_sigma,
+        double table_tolerance = 1e-6);
     ~TrapInstantCaptureContinuum(){};
 
     double release_timescale_sigma;
+    double table_tolerance;
 
     virtual double fill_fraction_from_time_elapsed(
         double time_elapsed, gsl_integration_workspace* workspace = nullptr);
@@ -52,15 +54,19 @@ class TrapInstantCaptureContinuum : public TrapInstantCapture {
         gsl_integration_workspace* workspace = nullptr);
 
     std::valarray<double> fill_fraction_table;
+    std::valarray<double> fill_fraction_slopes;
     int n_intp;
     double time_min;
     double time_max;
     double fill_min;
     double fill_max;
     double d_log_time;
+    double inv_d_log_time;
+    double log_time_max;
+    double table_max_error;
 
-    void prep_fill_fraction_and_time_elapsed_tables(
-        double time_min, double time_max, int n_intp = 1000);
+    double prep_fill_fraction_and_time_elapsed_tables(
+        double time_min, double time_max, int n_intp = 1000, double tolerance = 0.0);
     double fill_fraction_from_time_elapsed_table(double time_elapsed);
     double time_elapsed_from_fill_fraction_table(double fill_fraction);
 };
@@ -69,12 +75,13 @@ class TrapSlowCaptureContinuum : public TrapInstantCapture {
    public:
     TrapSlowCaptureContinuum(
         double density, double release_timescale, double release_timescale_sigma,
-        double capture_timescale);
+        double capture_timescale, double table_tolerance = 1e-6);
     ~TrapSlowCaptureContinuum(){};
 
     double release_timescale_sigma;
     double capture_timescale;
     double capture_rate;
+    double table_tolerance;
 
     virtual double fill_fraction_from_time_elapsed(
         double time_elapsed, gsl_integration_workspace* workspace = nullptr);
@@ -83,15 +90,19 @@ class TrapSlowCaptureContinuum : public TrapInstantCapture {
         gsl_integration_workspace* workspace = nullptr);
 
     std::valarray<double> fill_fraction_table;
+    std::valarray<double> fill_fraction_slopes;
     int n_intp;
     double time_min;
     double time_max;
     double fill_min;
     double fill_max;
     double d_log_time;
+    double inv_d_log_time;
+    double log_time_max;
+    double table_max_error;
 
-    void prep_fill_fraction_and_time_elapsed_tables(
-        double time_min, double time_max, int n_intp);
+    double prep_fill_fraction_and_time_elapsed_tables(
+        double time_min, double time_max, int n_intp, double tolerance = 0.0);
     double fill_fraction_from_time_elapsed_table(double time_elapsed);
     double time_elapsed_from_fill_fraction_table(double fill_fraction);
 
@@ -100,12 +111,19 @@ class TrapSlowCaptureContinuum : public TrapInstantCapture {
         gsl_integration_workspace* workspace = nullptr);
 
     std::valarray<double> fill_fraction_capture_table;
+    std::valarray<double> fill_fraction_capture_slopes;
+    int n_intp_capture;
+    double d_log_time_capture;
+    double inv_d_log_time_capture;
+    double log_time_max_capture;
+    double capture_table_max_error;
     double fill_capture_min;
     double fill_capture_max;
     double fill_capture_long_time;
 
-    void prep_fill_fraction_after_slow_capture_tables(
-        double dwell_time, double time_min, double time_max, int n_intp);
+    double prep_fill_fraction_after_slow_capture_tables(
+        double dwell_time, double time_min, double time_max, int n_intp,
+        double tolerance = 0.0);
     double fill_fraction_after_slow_capture_table(double time_elapsed);
 };
 
@@ -72,6 +72,12 @@ std::valarray<double> arange(double start, double stop, double step = 1);
 std::valarray<std::valarray<double> > transpose(
     std::valarray<std::valarray<double> >& array);
 
+void copy_image_to_buffer(
+    std::valarray<std::valarray<double> >& image, double* buffer);
+
+void copy_buffer_to_image(
+    const double* buffer, std::valarray<std::valarray<double> >& image);
+
 // ========
 // I/O
 // ========
@@ -80,6 +86,32 @@ std::valarray<std::valarray<double> > load_image_from_txt(const char* filename);
 void save_image_to_txt(
     const char* filename, std::valarray<std::valarray<double> > image);
 
+enum ImageFormat {
+    image_format_txt = 0,
+    image_format_binary = 1,
+    image_format_fits = 2
+};
+
+int image_format_from_filename(const char* filename);
+
+std::vector<double> load_image_from_binary(
+    const char* filename, int& n_rows, int& n_columns);
+
+void save_image_to_binary(
+    const char* filename, const double* image, int n_rows, int n_columns);
+
+bool fits_logical_value(const char* value);
+
+std::vector<double> load_image_from_fits(
+    const char* filename, int& n_rows, int& n_columns);
+
+void save_image_to_fits(
+    const char* filename, const double* image, int n_rows, int n_columns);
+
+std::vector<double> load_image(const char* filename, int& n_rows, int& n_columns);
+
+void save_image(const char* filename, const double* image, int n_rows, int n_columns);
+
 // ========
 // Misc
 // ========
@@ -87,4 +119,8 @@ double clamp(double value, double minimum, double maximum);
 
 double gettimelapsed(struct timeval start, struct timeval end);
 
+int get_n_threads_max();
+
+int get_thread_index();
+
 #endif  // ARCTIC_UTIL_HPP
@@ -1,4 +1,11 @@
-from arcticpy.cti import add_cti, remove_cti, CTI_model_for_HST_ACS
+from arcticpy.cti import (
+    add_cti,
+    remove_cti,
+    add_cti_batch,
+    remove_cti_batch,
+    CTIModel,
+    CTI_model_for_HST_ACS,
+)
 from arcticpy.pixel_bounce import PixelBounce, add_pixel_bounce, remove_pixel_bounce
 from arcticpy.ccd import CCDPhase, CCD
 from arcticpy.roe import ROE, ROEChargeInjection, ROETrapPumping
@@ -12,11 +19,23 @@ from arcticpy.read_noise import ReadNoise, CovarianceMatrix
 from arcticpy.vv_test import VVTestBench, VVResult
 try:
     from arcticpy.wrapper import (
+        cy_set_table_cache_dir as set_table_cache_dir,
+        cy_clear_table_cache as clear_table_cache,
+        cy_set_watermark_memory_limit as set_watermark_memory_limit,
+        cy_set_profiling as set_profiling,
+        cy_reset_profile as reset_profile,
+        cy_get_profile as get_profile,
         cy_print_array as print_array,
         cy_print_array_2D as print_array_2D,
     )
 except ModuleNotFoundError:
     from wrapper import (
+        cy_set_table_cache_dir as set_table_cache_dir,
+        cy_clear_table_cache as clear_table_cache,
+        cy_set_watermark_memory_limit as set_watermark_memory_limit,
+        cy_set_profiling as set_profiling,
+        cy_reset_profile as reset_profile,
+        cy_get_profile as get_profile,
         cy_print_array as print_array,
         cy_print_array_2D as print_array_2D,
     )
@@ -1,4 +1,5 @@
 import numpy as np
+import threading
 from typing import List, Optional
 
 try:
@@ -14,10 +15,41 @@ from arcticpy.traps import (
     TrapInstantCaptureContinuum,
     TrapSlowCaptureContinuum,
 )
-from arcticpy.pixel_bounce import PixelBounce, add_pixel_bounce
+from arcticpy.pixel_bounce import (
+    PixelBounce,
+    add_pixel_bounce,
+    _add_pixel_bounce_in_place,
+    _pixel_bounce_parameters,
+)
 from arcticpy.vv_test import VVTestBench
 from arcticpy.read_noise import ReadNoise
 
+# The ColumnSchedule options for sharing columns between threads, in cti.hpp
+_column_schedules = {"static": 0, "dynamic": 1, "guided": 2, "cost": 3}
+
+
+def _image_dtype(image):
+    """
+    The floating-point type of the array for arctic to clock: float32 images
+    stay float32, which arctic clocks in double via a temporary copy, see
+    clock_charge_in_images() in src/cti.cpp, otherwise double.
+    """
+    return np.float32 if np.asarray(image).dtype == np.float32 else np.double
+
+
+def _output_array(image, out):
+    """
+    The array in which to model the image(s): either a new copy, or the given
+    out array after copying the image into it, unless it is the image itself to
+    modify in place. arctic then clocks this array directly in its memory, see
+    _add_cti_images().
+    """
+    if out is None:
+        return np.array(image, dtype=_image_dtype(image))
+    if out is not image:
+        out[...] = image
+    return out
+
 
 class ndarray_plus(np.ndarray):
     """
@@ -85,12 +117,14 @@ def add_cti(
     serial_prune_frequency=20,
     # Combined
     allow_negative_pixels=1,
+    column_schedule="static",
     # Pixel bounce
     pixel_bounce_list : Optional[List[PixelBounce]] = None,
     # Output
     vv_test=False,
     verbosity=1,
     iteration=0,
+    out=None,
 ):
     """
     Wrapper for arctic's add_cti() in src/cti.cpp, see its documentation.
@@ -99,8 +133,8 @@ def add_cti(
     along their independent columns, for parallel and/or serial clocking.
 
     This wrapper extracts individual numbers and arrays from the user-input
-    objects to pass to the C++ via Cython. See cy_add_cti() in wrapper.pyx and
-    add_cti() in interface.cpp.
+    objects to pass to the C++ via Cython. See CTIModel, which can instead be
+    kept and reused for many images.
 
     Parameters (where different to add_cti() in src/cti.cpp)
     ----------
@@ -111,6 +145,16 @@ def add_cti(
         traps to be provided in separate arrays. Here, mutliple trap types can
         be passed in a single array, which will be separated by the wrapper.
 
+    column_schedule : str (opt.)
+        How to share the columns between OpenMP threads (if compiled with
+        OpenMP), see clock_charge_in_one_direction() in src/cti.cpp:
+            "static"    (default) Equal blocks of columns.
+            "dynamic"   Each thread takes the next few columns when free.
+            "guided"    As dynamic, but in decreasing-size chunks.
+            "cost"      As dynamic, but start with the columns with the most
+                        charge above the notch depth, e.g. for images with
+                        sparse bright sources.
+
     verbosity : int (opt.)
         The verbosity parameter to control the amount of printed information:
             0   No printing (except errors etc).
@@ -121,78 +165,28 @@ def add_cti(
         If True, run a "Verification & Validation" test by fitting exponential
         curves to pixels in overscan regions (if available). The results can 
         be accessed as image.vv_test.results[-1].parallel.best_fit_trap_density
+
+    out : numpy.ndarray (opt.)
+        An array with the same shape as the image in which to put the result,
+        instead of a new array, e.g. the image itself to add CTI in place. Any
+        float32 or float64 array or view (e.g. a cutout of a larger image) is
+        modified directly without copying it, otherwise via a temporary copy.
     
     Inputs
     ------
     image : 2D numpy.ndarray of pixel values
+        A float32 image stays float32, but is clocked in double via a
+        temporary copy, and any other type is converted to double. See
+        clock_charge_in_images() in src/cti.cpp.
     
     Outputs
     -------
     image : 
         is not just a numpy.ndarray, but has additional properties vv_test and
-        covariance
+        covariance. A view of out, if provided.
     """
-    # ========
-    # Extract inputs and/or set dummy variables to pass to the wrapper
-    # ========
-    # Parallel
-    if parallel_traps is not None:
-        (
-            parallel_trap_densities,
-            parallel_trap_release_timescales,
-            parallel_trap_third_params,
-            parallel_trap_fourth_params,
-            parallel_n_traps_ic,
-            parallel_n_traps_sc,
-            parallel_n_traps_ic_co,
-            parallel_n_traps_sc_co,
-        ) = _extract_trap_parameters(parallel_traps)
-    else:
-        # No parallel clocking, set dummy variables instead
-        (
-            parallel_roe,
-            parallel_ccd,
-            parallel_trap_densities,
-            parallel_trap_release_timescales,
-            parallel_trap_third_params,
-            parallel_trap_fourth_params,
-            parallel_n_traps_ic,
-            parallel_n_traps_sc,
-            parallel_n_traps_ic_co,
-            parallel_n_traps_sc_co,
-        ) = _set_dummy_parameters()
-    parallel_prune_n_es = np.array([parallel_prune_n_electrons], dtype=np.double)
-
-    # Serial
-    if serial_traps is not None:
-        (
-            serial_trap_densities,
-            serial_trap_release_timescales,
-            serial_trap_third_params,
-            serial_trap_fourth_params,
-            serial_n_traps_ic,
-            serial_n_traps_sc,
-            serial_n_traps_ic_co,
-            serial_n_traps_sc_co,
-        ) = _extract_trap_parameters(serial_traps)
-    else:
-        # No serial clocking, set dummy variables instead
-        (
-            serial_roe,
-            serial_ccd,
-            serial_trap_densities,
-            serial_trap_release_timescales,
-            serial_trap_third_params,
-            serial_trap_fourth_params,
-            serial_n_traps_ic,
-            serial_n_traps_sc,
-            serial_n_traps_ic_co,
-            serial_n_traps_sc_co,
-        ) = _set_dummy_parameters()
-    serial_prune_n_es = np.array([serial_prune_n_electrons], dtype=np.double)
-    
-    image = np.copy(image).astype(np.double)
-
+    image = np.asarray(image)
+    image_trailed = _output_array(image, out)
 
     # ========
     # V&V test
@@ -214,113 +208,53 @@ def add_cti(
     # ========
     # Add CTI
     # ========
-    # Pass the extracted inputs to C++ via the cython wrapper
-    image_trailed = w.cy_add_cti(
-        image,
-        # ========
+    image_trailed = _add_cti_images(
+        image_trailed,
+        0,
         # Parallel
-        # ========
-        # ROE
-        parallel_roe.dwell_times,
-        parallel_roe.prescan_offset,
-        parallel_roe.overscan_start,
-        parallel_roe.empty_traps_between_columns,
-        parallel_roe.empty_traps_for_first_transfers,
-        parallel_roe.force_release_away_from_readout,
-        parallel_roe.use_integer_express_matrix,
-        parallel_roe.n_pumps,
-        parallel_roe.type,
-        # CCD
-        parallel_ccd.fraction_of_traps_per_phase,
-        parallel_ccd.full_well_depths,
-        parallel_ccd.well_notch_depths,
-        parallel_ccd.well_fill_powers,
-        parallel_ccd.first_electron_fills,
-        # Traps
-        parallel_trap_densities,
-        parallel_trap_release_timescales,
-        parallel_trap_third_params,
-        parallel_trap_fourth_params,
-        parallel_n_traps_ic,
-        parallel_n_traps_sc,
-        parallel_n_traps_ic_co,
-        parallel_n_traps_sc_co,
-        # Misc
-        parallel_express,
-        parallel_window_offset,
-        parallel_window_start,
-        parallel_window_stop,
-        parallel_time_start,
-        parallel_time_stop,
-        parallel_prune_n_es,
-        parallel_prune_frequency,
-        # ========
+        parallel_ccd=parallel_ccd,
+        parallel_roe=parallel_roe,
+        parallel_traps=parallel_traps,
+        parallel_express=parallel_express,
+        parallel_window_offset=parallel_window_offset,
+        parallel_window_start=parallel_window_start,
+        parallel_window_stop=parallel_window_stop,
+        parallel_time_start=parallel_time_start,
+        parallel_time_stop=parallel_time_stop,
+        parallel_prune_n_electrons=parallel_prune_n_electrons,
+        parallel_prune_frequency=parallel_prune_frequency,
         # Serial
-        # ========
-        # ROE
-        serial_roe.dwell_times,
-        serial_roe.prescan_offset,
-        serial_roe.overscan_start,
-        serial_roe.empty_traps_between_columns,
-        serial_roe.empty_traps_for_first_transfers,
-        serial_roe.force_release_away_from_readout,
-        serial_roe.use_integer_express_matrix,
-        serial_roe.n_pumps,
-        serial_roe.type,
-        # CCD
-        serial_ccd.fraction_of_traps_per_phase,
-        serial_ccd.full_well_depths,
-        serial_ccd.well_notch_depths,
-        serial_ccd.well_fill_powers,
-        serial_ccd.first_electron_fills,
-        # Traps
-        serial_trap_densities,
-        serial_trap_release_timescales,
-        serial_trap_third_params,
-        serial_trap_fourth_params,
-        serial_n_traps_ic,
-        serial_n_traps_sc,
-        serial_n_traps_ic_co,
-        serial_n_traps_sc_co,
-        # Misc
-        serial_express,
-        serial_window_offset,
-        serial_window_start,
-        serial_window_stop,
-        serial_time_start,
-        serial_time_stop,
-        serial_prune_n_es,
-        serial_prune_frequency,
-        # ========
+        serial_ccd=serial_ccd,
+        serial_roe=serial_roe,
+        serial_traps=serial_traps,
+        serial_express=serial_express,
+        serial_window_offset=serial_window_offset,
+        serial_window_start=serial_window_start,
+        serial_window_stop=serial_window_stop,
+        serial_time_start=serial_time_start,
+        serial_time_stop=serial_time_stop,
+        serial_prune_n_electrons=serial_prune_n_electrons,
+        serial_prune_frequency=serial_prune_frequency,
         # Combined
-        # ========
-        allow_negative_pixels,
-        # ========
+        allow_negative_pixels=allow_negative_pixels,
+        column_schedule=column_schedule,
         # Output
-        # ========
-        verbosity,
-        iteration,
+        verbosity=verbosity,
+        iteration=iteration,
     )
 
     # ================
     # Add pixel bounce
     # ================
     if pixel_bounce_list is not None:
-
-        bias_total = np.zeros(image.shape)
-        
-        for pixel_bounce in pixel_bounce_list:
-            bias = pixel_bounce.bias_from(
-                image_trailed,
-                parallel_window_start=parallel_window_start,
-                parallel_window_stop=parallel_window_stop,
-                serial_window_start=serial_window_start,
-                serial_window_stop=serial_window_stop,
-                verbosity=verbosity,
-            )
-            bias_total += bias
-
-        image_trailed -= bias_total[:, :]
+        _add_pixel_bounce_in_place(
+            image_trailed,
+            pixel_bounce_list,
+            parallel_window_start=parallel_window_start,
+            parallel_window_stop=parallel_window_stop,
+            serial_window_start=serial_window_start,
+            serial_window_stop=serial_window_stop,
+        )
 
     # ========
     # V&V test
@@ -381,6 +315,7 @@ def remove_cti(
     serial_prune_frequency=20,
     # Combined
     allow_negative_pixels=1,
+    column_schedule="static",
     # Pixel bounce
     pixel_bounce_list : Optional[List[PixelBounce]] = None,
     # Optional: read noise de-amplification
@@ -389,6 +324,7 @@ def remove_cti(
     vv_test=False,
     # Output
     verbosity=1,
+    out=None,
 ):
     """
     Wrapper for arctic's remove_cti() in src/cti.cpp, see its documentation.
@@ -405,6 +341,16 @@ def remove_cti(
         traps to be provided in separate arrays. Here, mutliple trap types can
         be passed in a single array, which will be separated by the wrapper.
 
+    column_schedule : str (opt.)
+        How to share the columns between OpenMP threads (if compiled with
+        OpenMP), see clock_charge_in_one_direction() in src/cti.cpp:
+            "static"    (default) Equal blocks of columns.
+            "dynamic"   Each thread takes the next few columns when free.
+            "guided"    As dynamic, but in decreasing-size chunks.
+            "cost"      As dynamic, but start with the columns with the most
+                        charge above the notch depth, e.g. for images with
+                        sparse bright sources.
+
     verbosity : int (opt.)
         The verbosity parameter to control the amount of printed information:
             0   No printing (except errors etc).
@@ -420,19 +366,33 @@ def remove_cti(
         If True, estimate and remove the white readout noise in the image
         before doing CTI correction, to prevent its being amplified. 
         Add the noise back afterwards.
+
+    out : numpy.ndarray (opt.)
+        An array in which to put the result, as for add_cti(), e.g. the image
+        itself to correct it in place.
         
     Inputs
     ------
     image : 2D numpy.ndarray of pixel values
+        A float32 image stays float32, but is clocked in double via a
+        temporary copy, and any other type is converted to double. See
+        clock_charge_in_images() in src/cti.cpp.
     
     Outputs
     -------
     image : 
         is not just a numpy.ndarray, but has additional properties vv_test and
-        covariance
+        covariance. A view of out, if provided.
     """
-    image = np.copy(image).astype(np.double)
-    image_remove_cti = np.copy(image).astype(np.double)
+    # Keep the input image to compare with each iteration's model, unless out
+    # will overwrite it
+    image = np.asarray(image)
+    if out is not None and np.shares_memory(out, image):
+        image = image.copy()
+    image_remove_cti = _output_array(image, out)
+
+    # The buffer for each iteration's model of adding CTI
+    image_add_cti = np.empty_like(image_remove_cti)
 
     if verbosity >= 1:
         w.cy_print_version()
@@ -462,7 +422,8 @@ def remove_cti(
         sigma_readnoise = 1. * remove_read_noise
         read_noise = ReadNoise(sigma_readnoise=sigma_readnoise)
         print(read_noise.sigmaRN)
-        image_remove_cti,image_read_noise = read_noise.generate_SR_frames_from_image(image_remove_cti)
+        image_smoothed,image_read_noise = read_noise.generate_SR_frames_from_image(image_remove_cti)
+        image_remove_cti[...] = image_smoothed
         print("\nMean and rms of modelled read noise:",np.mean(image_read_noise),np.std(image_read_noise))        
 
     # =======================
@@ -473,7 +434,7 @@ def remove_cti(
             print("Iter %d: " % iteration, end="", flush=True)
 
         # Model the effect of adding CTI trails
-        image_add_cti = add_cti(
+        add_cti(
             image=image_remove_cti,
             header=header,
             # Parallel
@@ -502,16 +463,18 @@ def remove_cti(
             serial_prune_frequency=serial_prune_frequency,
             # Combined
             allow_negative_pixels=allow_negative_pixels,
+            column_schedule=column_schedule,
             # Pixel bounce
             pixel_bounce_list=pixel_bounce_list,
             # Output
             verbosity=verbosity,
             vv_test=False,
-            iteration=iteration
+            iteration=iteration,
+            out=image_add_cti,
         )
 
         # Improve the estimate of the image with CTI trails removed
-        delta = image - image_add_cti
+        delta = np.subtract(image, image_add_cti, out=image_add_cti)
         if remove_read_noise > 0:
             delta -= image_read_noise
             # Doing the following ought to be right, but turns out to bias the
@@ -572,6 +535,206 @@ def remove_cti(
 
 
 
+def add_cti_batch(
+    images,
+    # Parallel
+    parallel_ccd=None,
+    parallel_roe=None,
+    parallel_traps=None,
+    parallel_express=0,
+    parallel_window_offset=0,
+    parallel_window_start=0,
+    parallel_window_stop=-1,
+    parallel_time_start=0,
+    parallel_time_stop=-1,
+    parallel_prune_n_electrons=1e-10,
+    parallel_prune_frequency=20,
+    # Serial
+    serial_ccd=None,
+    serial_roe=None,
+    serial_traps=None,
+    serial_express=0,
+    serial_window_offset=0,
+    serial_window_start=0,
+    serial_window_stop=-1,
+    serial_time_start=0,
+    serial_time_stop=-1,
+    serial_prune_n_electrons=1e-10,
+    serial_prune_frequency=20,
+    # Combined
+    allow_negative_pixels=1,
+    column_schedule="dynamic",
+    # Output
+    verbosity=1,
+    out=None,
+):
+    """
+    Add CTI trails to a batch of images that all use the same model.
+
+    The ROE, CCD, and trap managers are prepared once in C++ for all of the
+    images, instead of for every add_cti() call, and the columns of all the
+    images are shared between threads together, which helps for many small
+    images.
+
+    Parameters (where different to add_cti())
+    ----------
+    images : 3D numpy.ndarray, or [2D numpy.ndarray]
+        The images, with the same shape, as either a stack or a list.
+
+    column_schedule : str (opt.)
+        See add_cti(). Defaults to "dynamic" to balance the threads between
+        images with different numbers of bright pixels.
+
+    out : 3D numpy.ndarray (opt.)
+        An array in which to put the results, as for add_cti(), e.g. the stack
+        of images itself to add CTI in place.
+
+    Pixel bounce, V&V tests, and header updates are not available in batches.
+
+    Outputs
+    -------
+    images : 3D numpy.ndarray
+        The images with CTI added, stacked along the first axis. out, if
+        provided.
+    """
+    images = _output_array(images, out)
+    if images.ndim != 3:
+        raise Exception("Expected a stack of 2D images, not %d dimensions" % images.ndim)
+
+    return _add_cti_images(
+        images,
+        0,
+        # Parallel
+        parallel_ccd=parallel_ccd,
+        parallel_roe=parallel_roe,
+        parallel_traps=parallel_traps,
+        parallel_express=parallel_express,
+        parallel_window_offset=parallel_window_offset,
+        parallel_window_start=parallel_window_start,
+        parallel_window_stop=parallel_window_stop,
+        parallel_time_start=parallel_time_start,
+        parallel_time_stop=parallel_time_stop,
+        parallel_prune_n_electrons=parallel_prune_n_electrons,
+        parallel_prune_frequency=parallel_prune_frequency,
+        # Serial
+        serial_ccd=serial_ccd,
+        serial_roe=serial_roe,
+        serial_traps=serial_traps,
+        serial_express=serial_express,
+        serial_window_offset=serial_window_offset,
+        serial_window_start=serial_window_start,
+        serial_window_stop=serial_window_stop,
+        serial_time_start=serial_time_start,
+        serial_time_stop=serial_time_stop,
+        serial_prune_n_electrons=serial_prune_n_electrons,
+        serial_prune_frequency=serial_prune_frequency,
+        # Combined
+        allow_negative_pixels=allow_negative_pixels,
+        column_schedule=column_schedule,
+        # Output
+        verbosity=verbosity,
+    )
+
+
+def remove_cti_batch(
+    images,
+    n_iterations,
+    # Parallel
+    parallel_ccd=None,
+    parallel_roe=None,
+    parallel_traps=None,
+    parallel_express=0,
+    parallel_window_offset=0,
+    parallel_window_start=0,
+    parallel_window_stop=-1,
+    parallel_time_start=0,
+    parallel_time_stop=-1,
+    parallel_prune_n_electrons=1e-10,
+    parallel_prune_frequency=20,
+    # Serial
+    serial_ccd=None,
+    serial_roe=None,
+    serial_traps=None,
+    serial_express=0,
+    serial_window_offset=0,
+    serial_window_start=0,
+    serial_window_stop=-1,
+    serial_time_start=0,
+    serial_time_stop=-1,
+    serial_prune_n_electrons=1e-10,
+    serial_prune_frequency=20,
+    # Combined
+    allow_negative_pixels=1,
+    column_schedule="dynamic",
+    # Output
+    verbosity=1,
+    out=None,
+):
+    """
+    Remove CTI trails from a batch of images that all use the same model.
+
+    As for add_cti_batch(), with the iterative forward modelling for each image
+    as for remove_cti() but all done in C++ with the model prepared only once.
+
+    Parameters (where different to remove_cti())
+    ----------
+    images : 3D numpy.ndarray, or [2D numpy.ndarray]
+        The images, with the same shape, as either a stack or a list.
+
+    out : 3D numpy.ndarray (opt.)
+        An array in which to put the results, as for add_cti(), e.g. the stack
+        of images itself to correct them in place.
+
+    Pixel bounce, read noise removal, V&V tests, and header updates are not
+    available in batches.
+
+    Outputs
+    -------
+    images : 3D numpy.ndarray
+        The images with CTI removed, stacked along the first axis. out, if
+        provided.
+    """
+    images = _output_array(images, out)
+    if images.ndim != 3:
+        raise Exception("Expected a stack of 2D images, not %d dimensions" % images.ndim)
+    if n_iterations < 1:
+        raise Exception("n_iterations must be at least 1, not %d" % n_iterations)
+
+    return _add_cti_images(
+        images,
+        n_iterations,
+        # Parallel
+        parallel_ccd=parallel_ccd,
+        parallel_roe=parallel_roe,
+        parallel_traps=parallel_traps,
+        parallel_express=parallel_express,
+        parallel_window_offset=parallel_window_offset,
+        parallel_window_start=parallel_window_start,
+        parallel_window_stop=parallel_window_stop,
+        parallel_time_start=parallel_time_start,
+        parallel_time_stop=parallel_time_stop,
+        parallel_prune_n_electrons=parallel_prune_n_electrons,
+        parallel_prune_frequency=parallel_prune_frequency,
+        # Serial
+        serial_ccd=serial_ccd,
+        serial_roe=serial_roe,
+        serial_traps=serial_traps,
+        serial_express=serial_express,
+        serial_window_offset=serial_window_offset,
+        serial_window_start=serial_window_start,
+        serial_window_stop=serial_window_stop,
+        serial_time_start=serial_time_start,
+        serial_time_stop=serial_time_stop,
+        serial_prune_n_electrons=serial_prune_n_electrons,
+        serial_prune_frequency=serial_prune_frequency,
+        # Combined
+        allow_negative_pixels=allow_negative_pixels,
+        column_schedule=column_schedule,
+        # Output
+        verbosity=verbosity,
+    )
+
+
 def CTI_model_for_HST_ACS(date):
     """
     Return arcticpy objects that provide a preset CTI model for the Hubble Space
@@ -659,8 +822,453 @@ def CTI_model_for_HST_ACS(date):
 
     return parallel_roe, parallel_ccd, parallel_traps, serial_roe, serial_ccd, serial_traps
 
+
+class CTIModel:
+    """
+    A CTI model that is prepared once in C++ to add or remove CTI for many
+    images, e.g. millions of small postage stamps.
+
+    The ROE, CCD, and trap objects are converted into arctic's C++ objects when
+    the model is created, instead of for every add_cti() call, and the C++
+    keeps its trap managers etc. prepared for the last image size. See
+    cy_CTIModel in wrapper.pyx.
+
+    Parameters
+    ----------
+    As for add_cti(), with column_schedule defaulting to "dynamic" as for
+    add_cti_batch(). Read noise removal, V&V tests, and header updates are not
+    available, as for the batch functions.
+
+    Any pixel bounce is added to each row in C++ as it is clocked in the
+    serial direction (or afterwards if there is no serial CTI), and is also
+    included in the forward modelling to remove CTI.
+
+    A model clocks only one image (or stack of images) at a time, so calls from
+    other threads wait for the current one to finish. Use a separate model for
+    each thread (e.g. Dask worker) to clock images at the same time.
+
+    Methods
+    -------
+    add(image, out=None, verbosity=0)
+        Add CTI trails to an image, or a 3D stack of images.
+
+    remove(image, n_iterations, out=None, verbosity=0)
+        Remove CTI trails from an image, or a 3D stack of images, with the
+        iterative forward modelling all done in C++.
+
+    add_density_sweep(image, parallel_trap_densities=None,
+                      serial_trap_densities=None, verbosity=0)
+        Add CTI trails to an image for each of many sets of trap densities,
+        e.g. to fit them, all clocked together.
+    """
+
+    def __init__(
+        self,
+        # Parallel
+        parallel_ccd=None,
+        parallel_roe=None,
+        parallel_traps=None,
+        parallel_express=0,
+        parallel_window_offset=0,
+        parallel_window_start=0,
+        parallel_window_stop=-1,
+        parallel_time_start=0,
+        parallel_time_stop=-1,
+        parallel_prune_n_electrons=1e-10,
+        parallel_prune_frequency=20,
+        # Serial
+        serial_ccd=None,
+        serial_roe=None,
+        serial_traps=None,
+        serial_express=0,
+        serial_window_offset=0,
+        serial_window_start=0,
+        serial_window_stop=-1,
+        serial_time_start=0,
+        serial_time_stop=-1,
+        serial_prune_n_electrons=1e-10,
+        serial_prune_frequency=20,
+        # Combined
+        allow_negative_pixels=1,
+        column_schedule="dynamic",
+        # Pixel bounce
+        pixel_bounce_list : Optional[List[PixelBounce]] = None,
+    ):
+        # ========
+        # Extract inputs and/or set dummy variables to pass to the wrapper
+        # ========
+        # Parallel
+        if parallel_traps is not None:
+            (
+                parallel_trap_densities,
+                parallel_trap_release_timescales,
+                parallel_trap_third_params,
+                parallel_trap_fourth_params,
+                parallel_n_traps_ic,
+                parallel_n_traps_sc,
+                parallel_n_traps_ic_co,
+                parallel_n_traps_sc_co,
+            ) = _extract_trap_parameters(parallel_traps)
+        else:
+            # No parallel clocking, set dummy variables instead
+            (
+                parallel_roe,
+                parallel_ccd,
+                parallel_trap_densities,
+                parallel_trap_release_timescales,
+                parallel_trap_third_params,
+                parallel_trap_fourth_params,
+                parallel_n_traps_ic,
+                parallel_n_traps_sc,
+                parallel_n_traps_ic_co,
+                parallel_n_traps_sc_co,
+            ) = _set_dummy_parameters()
+        parallel_prune_n_es = np.array([parallel_prune_n_electrons], dtype=np.double)
+
+        # Serial
+        if serial_traps is not None:
+            (
+                serial_trap_densities,
+                serial_trap_release_timescales,
+                serial_trap_third_params,
+                serial_trap_fourth_params,
+                serial_n_traps_ic,
+                serial_n_traps_sc,
+                serial_n_traps_ic_co,
+                serial_n_traps_sc_co,
+            ) = _extract_trap_parameters(serial_traps)
+        else:
+            # No serial clocking, set dummy variables instead
+            (
+                serial_roe,
+                serial_ccd,
+                serial_trap_densities,
+                serial_trap_release_timescales,
+                serial_trap_third_params,
+                serial_trap_fourth_params,
+                serial_n_traps_ic,
+                serial_n_traps_sc,
+                serial_n_traps_ic_co,
+                serial_n_traps_sc_co,
+            ) = _set_dummy_parameters()
+        serial_prune_n_es = np.array([serial_prune_n_electrons], dtype=np.double)
+
+        self._model = w.cy_CTIModel(
+            # ========
+            # Parallel
+            # ========
+            # ROE
+            parallel_roe.dwell_times,
+            parallel_roe.prescan_offset,
+            parallel_roe.overscan_start,
+            parallel_roe.empty_traps_between_columns,
+            parallel_roe.empty_traps_for_first_transfers,
+            parallel_roe.force_release_away_from_readout,
+            parallel_roe.use_integer_express_matrix,
+            parallel_roe.n_pumps,
+            parallel_roe.type,
+            # CCD
+            parallel_ccd.fraction_of_traps_per_phase,
+            parallel_ccd.full_well_depths,
+            parallel_ccd.well_notch_depths,
+            parallel_ccd.well_fill_powers,
+            parallel_ccd.first_electron_fills,
+            # Traps
+            parallel_trap_densities,
+            parallel_trap_release_timescales,
+            parallel_trap_third_params,
+            parallel_trap_fourth_params,
+            parallel_n_traps_ic,
+            parallel_n_traps_sc,
+            parallel_n_traps_ic_co,
+            parallel_n_traps_sc_co,
+            # Misc
+            parallel_express,
+            parallel_window_offset,
+            parallel_window_start,
+            parallel_window_stop,
+            parallel_time_start,
+            parallel_time_stop,
+            parallel_prune_n_es,
+            parallel_prune_frequency,
+            # ========
+            # Serial
+            # ========
+            # ROE
+            serial_roe.dwell_times,
+            serial_roe.prescan_offset,
+            serial_roe.overscan_start,
+            serial_roe.empty_traps_between_columns,
+            serial_roe.empty_traps_for_first_transfers,
+            serial_roe.force_release_away_from_readout,
+            serial_roe.use_integer_express_matrix,
+            serial_roe.n_pumps,
+            serial_roe.type,
+            # CCD
+            serial_ccd.fraction_of_traps_per_phase,
+            serial_ccd.full_well_depths,
+            serial_ccd.well_notch_depths,
+            serial_ccd.well_fill_powers,
+            serial_ccd.first_electron_fills,
+            # Traps
+            serial_trap_densities,
+            serial_trap_release_timescales,
+            serial_trap_third_params,
+            serial_trap_fourth_params,
+            serial_n_traps_ic,
+            serial_n_traps_sc,
+            serial_n_traps_ic_co,
+            serial_n_traps_sc_co,
+            # Misc
+            serial_express,
+            serial_window_offset,
+            serial_window_start,
+            serial_window_stop,
+            serial_time_start,
+            serial_time_stop,
+            serial_prune_n_es,
+            serial_prune_frequency,
+            # ========
+            # Combined
+            # ========
+            allow_negative_pixels,
+            # ========
+            # Threads
+            # ========
+            _column_schedules[column_schedule],
+        )
+        if pixel_bounce_list is not None:
+            self._model.set_pixel_bounces(*_pixel_bounce_parameters(pixel_bounce_list))
+        self._lock = threading.Lock()
+
+        # The number of trap species whose densities can be swept
+        self._parallel_n_swept_traps = parallel_n_traps_ic + parallel_n_traps_sc
+        self._serial_n_swept_traps = serial_n_traps_ic + serial_n_traps_sc
+
+    def add(self, image, out=None, verbosity=0):
+        """
+        Add CTI trails to an image, or a 3D stack of images.
+
+        Parameters
+        ----------
+        image : 2D or 3D numpy.ndarray
+            The image, or a stack of images with the same shape along the first
+            axis. A float32 image stays float32, but is clocked in double, see
+            add_cti().
+
+        out : numpy.ndarray (opt.)
+            An array in which to put the result, see add_cti(), e.g. the image
+            itself to add CTI in place.
+
+        verbosity : int (opt.)
+            See add_cti(). Default no printing.
+
+        Returns
+        -------
+        image : numpy.ndarray
+            The image(s) with CTI added, out if provided.
+        """
+        return self._clock(_output_array(image, out), 0, verbosity, 0)
+
+    def remove(self, image, n_iterations, out=None, verbosity=0):
+        """
+        Remove CTI trails from an image, or a 3D stack of images.
+
+        Parameters
+        ----------
+        image : 2D or 3D numpy.ndarray
+            As for add().
+
+        n_iterations : int
+            The number of iterations of forward modelling, see remove_cti().
+
+        out : numpy.ndarray (opt.)
+            As for add(), e.g. the image itself to correct it in place.
+
+        verbosity : int (opt.)
+            See add_cti(). Default no printing.
+
+        Returns
+        -------
+        image : numpy.ndarray
+            The image(s) with CTI removed, out if provided.
+        """
+        if n_iterations < 1:
+            raise Exception("n_iterations must be at least 1, not %d" % n_iterations)
+
+        return self._clock(_output_array(image, out), n_iterations, verbosity, 0)
+
+    def add_density_sweep(
+        self,
+        image,
+        parallel_trap_densities=None,
+        serial_trap_densities=None,
+        verbosity=0,
+    ):
+        """
+        Add CTI trails to an image for each of many models that only differ in
+        the densities of their TrapInstantCapture and TrapSlowCapture traps.
+
+        All the models are clocked together, in one pass through the image and
+        the express and clock sequence for each direction, which is faster
+        than calling add() for a separate model with each set of densities,
+        e.g. when fitting the densities to warm-pixel trails. The results are
+        the same.
+
+        Parameters
+        ----------
+        image : 2D numpy.ndarray
+            The input image, modelled in double precision.
+
+        parallel_trap_densities, serial_trap_densities : 2D numpy.ndarray (opt.)
+            The densities of each model's instant-capture then slow-capture
+            traps (in the same order as they were given for this model), with
+            shape (n_models, n_traps_ic + n_traps_sc). Default None to use this
+            model's own densities in that direction. The other traps' and all
+            other parameters are this model's.
+
+        verbosity : int (opt.)
+            See add_cti(). Default no printing.
+
+        Returns
+        -------
+        images : 3D numpy.ndarray
+            The image with CTI added by each model, shape (n_models, n_rows,
+            n_columns).
+        """
+        image = np.asarray(image, dtype=np.double)
+        if image.ndim != 2:
+            raise Exception("Expected a 2D image, not %d dimensions" % image.ndim)
+
+        # Check the shapes of the densities
+        n_models = None
+        densities = []
+        for trap_densities, n_swept_traps in [
+            (parallel_trap_densities, self._parallel_n_swept_traps),
+            (serial_trap_densities, self._serial_n_swept_traps),
+        ]:
+            if trap_densities is not None:
+                trap_densities = np.atleast_2d(
+                    np.asarray(trap_densities, dtype=np.double)
+                )
+                if n_models is None:
+                    n_models = trap_densities.shape[0]
+                if trap_densities.shape != (n_models, n_swept_traps):
+                    raise Exception(
+                        "Expected trap densities with shape (%d, %d), not %s"
+                        % (n_models, n_swept_traps, trap_densities.shape)
+                    )
+            densities.append(trap_densities)
+        if n_models is None:
+            raise Exception("Expected parallel and/or serial trap densities")
+
+        with self._lock:
+            return self._model.add_density_sweep(
+                image, n_models, densities[0], densities[1], verbosity
+            )
+
+    def _clock(self, images, n_iterations, verbosity, iteration):
+        """
+        Add CTI, or remove CTI if n_iterations > 0, for one 2D image or a 3D
+        stack of images, modified in place and returned.
+
+        If possible then arctic clocks them directly in their memory, with the
+        GIL released, otherwise in a contiguous double or float32 copy that is
+        then copied back. See check_clockable() in wrapper.pyx.
+        """
+        if images.ndim not in (2, 3):
+            raise Exception(
+                "Expected an image or a stack of images, not %d dimensions" % images.ndim
+            )
+
+        if w.check_clockable(images):
+            images_clocked = images
+        else:
+            images_clocked = np.ascontiguousarray(images, dtype=_image_dtype(images))
+
+        with self._lock:
+            self._model.clock(images_clocked, verbosity, iteration, n_iterations)
+
+        if images_clocked is not images:
+            images[...] = images_clocked
+
+        return images
+
+
 ################################################ INTERNAL FUNCTIONS
 
+def _add_cti_images(
+    images,
+    n_iterations,
+    # Parallel
+    parallel_ccd=None,
+    parallel_roe=None,
+    parallel_traps=None,
+    parallel_express=0,
+    parallel_window_offset=0,
+    parallel_window_start=0,
+    parallel_window_stop=-1,
+    parallel_time_start=0,
+    parallel_time_stop=-1,
+    parallel_prune_n_electrons=1e-10,
+    parallel_prune_frequency=20,
+    # Serial
+    serial_ccd=None,
+    serial_roe=None,
+    serial_traps=None,
+    serial_express=0,
+    serial_window_offset=0,
+    serial_window_start=0,
+    serial_window_stop=-1,
+    serial_time_start=0,
+    serial_time_stop=-1,
+    serial_prune_n_electrons=1e-10,
+    serial_prune_frequency=20,
+    # Combined
+    allow_negative_pixels=1,
+    column_schedule="static",
+    # Output
+    verbosity=1,
+    iteration=0,
+):
+    """Add CTI, or remove CTI if n_iterations > 0, with a new CTIModel.
+
+    For either one 2D image or a 3D stack of images that share the same
+    prepared model, modified in place and returned. See CTIModel.
+    """
+    model = CTIModel(
+        # Parallel
+        parallel_ccd=parallel_ccd,
+        parallel_roe=parallel_roe,
+        parallel_traps=parallel_traps,
+        parallel_express=parallel_express,
+        parallel_window_offset=parallel_window_offset,
+        parallel_window_start=parallel_window_start,
+        parallel_window_stop=parallel_window_stop,
+        parallel_time_start=parallel_time_start,
+        parallel_time_stop=parallel_time_stop,
+        parallel_prune_n_electrons=parallel_prune_n_electrons,
+        parallel_prune_frequency=parallel_prune_frequency,
+        # Serial
+        serial_ccd=serial_ccd,
+        serial_roe=serial_roe,
+        serial_traps=serial_traps,
+        serial_express=serial_express,
+        serial_window_offset=serial_window_offset,
+        serial_window_start=serial_window_start,
+        serial_window_stop=serial_window_stop,
+        serial_time_start=serial_time_start,
+        serial_time_stop=serial_time_stop,
+        serial_prune_n_electrons=serial_prune_n_electrons,
+        serial_prune_frequency=serial_prune_frequency,
+        # Combined
+        allow_negative_pixels=allow_negative_pixels,
+        column_schedule=column_schedule,
+    )
+
+    return model._clock(images, n_iterations, verbosity, iteration)
+
+
 def _extract_trap_parameters(traps):
     """Extract trap parameters for add/remove_cti() to pass to the wrapper.
 
@@ -1,5 +1,6 @@
 
 #include "cti.hpp"
+#include "model.hpp"
 #include "roe.hpp"
 #include "trap_managers.hpp"
 #include "traps.hpp"
@@ -9,8 +10,23 @@ void print_array(double* array, int length);
 
 void print_array_2D(double* array, int n_rows, int n_columns);
 
-void add_cti(
-    double* image, int n_rows, int n_columns,
+class InterfaceModel {
+   public:
+    InterfaceModel() : parallel_roe(nullptr), serial_roe(nullptr), model(nullptr){};
+    InterfaceModel(const InterfaceModel&) = delete;
+    InterfaceModel& operator=(const InterfaceModel&) = delete;
+    ~InterfaceModel();
+
+    std::valarray<double> parallel_dwell_times;
+    std::valarray<double> serial_dwell_times;
+    ROE* parallel_roe;
+    ROE* serial_roe;
+    CCD parallel_ccd;
+    CCD serial_ccd;
+    CTIModel* model;
+};
+
+InterfaceModel* new_cti_model(
     // ========
     // Parallel
     // ========
@@ -69,5 +85,10 @@ void add_cti(
     // Combined
     // ========
     int allow_negative_pixels,
-    // Output
-    int verbosity, int iteration);
+    // Threads
+    int column_schedule);
+
+void clock_images(
+    InterfaceModel* interface_model, void* image, bool image_is_float, int n_images,
+    int n_rows, int n_columns, long image_stride, long row_stride,
+    long column_stride, int verbosity, int iteration, int n_iterations);
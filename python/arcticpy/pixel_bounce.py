@@ -1,5 +1,10 @@
 import numpy as np
 
+try:
+    from arcticpy import wrapper as w
+except ImportError:
+    import wrapper as w
+
 
 class PixelBounce:
 
@@ -177,10 +182,9 @@ class PixelBounce:
             The output array of pixel values.
         """
 
-        # Correlated double sampling
-        image_bounced = np.copy(image).astype(np.double)
-        image_bounced -= self.perturb_bias(
+        return add_pixel_bounce(
             image,
+            pixel_bounce_list=[self],
             parallel_window_start=parallel_window_start,
             parallel_window_stop=parallel_window_stop,
             serial_window_start=serial_window_start,
@@ -188,8 +192,6 @@ class PixelBounce:
             verbosity=verbosity,
         )
 
-        return image_bounced
-
     def remove_pixel_bounce(
         self,
         image,
@@ -292,27 +294,72 @@ def add_pixel_bounce(
     if pixel_bounce_list is None:
         raise Exception("Must provide a list of pixel bounce objects")
 
-    # Idea bias level
-    bias = np.zeros(image.shape)
+    # Avoid overwriting input image
+    image_bounced = np.array(image, dtype=np.double)
 
-    # Compute bias after it has been perturbed by capacitance with the image signal
-    # Apply each pixel bounce capaitance separately, so their order has no effect
-    for pixel_bounce in pixel_bounce_list:
-        bias += pixel_bounce.perturb_bias(
-            image,
-            parallel_window_start=parallel_window_start,
-            parallel_window_stop=parallel_window_stop,
-            serial_window_start=serial_window_start,
-            serial_window_stop=serial_window_stop,
-            verbosity=verbosity,
-        )
-
-    # The effect of correlated double sampling (avoid overwriting input image)
-    image_bounced = np.copy(image).astype(np.double) - bias
+    _add_pixel_bounce_in_place(
+        image_bounced,
+        pixel_bounce_list,
+        parallel_window_start=parallel_window_start,
+        parallel_window_stop=parallel_window_stop,
+        serial_window_start=serial_window_start,
+        serial_window_stop=serial_window_stop,
+    )
 
     return image_bounced
 
 
+def _pixel_bounce_parameters(pixel_bounce_list):
+    """
+    Extract the arrays of each parameter from a list of PixelBounce objects,
+    for the C++ PixelBounce models, see wrapper.pyx.
+    """
+    return tuple(
+        np.array([getattr(pixel_bounce, name) for pixel_bounce in pixel_bounce_list],
+                 dtype=np.double)
+        for name in ("kA", "kv", "gamma", "omega")
+    )
+
+
+def _add_pixel_bounce_in_place(
+    image,
+    pixel_bounce_list,
+    parallel_window_start=0,
+    parallel_window_stop=-1,
+    serial_window_start=0,
+    serial_window_stop=-1,
+):
+    """
+    Add pixel bounce to an image (or a 3D stack of images) in place, with all
+    the models advanced together along each row in C++, see add_pixel_bounce()
+    in src/pixel_bounce.cpp. The bias from each model is driven by the input
+    image, and their sum is subtracted, so their order has no effect.
+
+    If possible then this works directly in the image's memory, otherwise in
+    a contiguous double copy that is then copied back.
+    """
+    n_y, n_x = image.shape[-2:]
+    if parallel_window_stop == -1: parallel_window_stop = n_y
+    if serial_window_stop == -1: serial_window_stop = n_x
+
+    if w.check_clockable(image):
+        image_bounced = image
+    else:
+        image_bounced = np.ascontiguousarray(image, dtype=np.double)
+
+    w.cy_add_pixel_bounce(
+        image_bounced,
+        *_pixel_bounce_parameters(pixel_bounce_list),
+        parallel_window_start,
+        parallel_window_stop,
+        serial_window_start,
+        serial_window_stop,
+    )
+
+    if image_bounced is not image:
+        image[...] = image_bounced
+
+
 
 def remove_pixel_bounce(
     image,
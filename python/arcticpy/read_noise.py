@@ -109,6 +109,7 @@ class ReadNoise:
         self.arcKwargs = {}
         self.covarianceMatrices = {}
         self.dataFrames = {}
+        self._scratch = None
 
     #        self._sr_fraction = sr_fraction
     #        self._sr_fraction_optimised = None
@@ -202,57 +203,22 @@ class ReadNoise:
             if sr_fraction == None:
                 sr_fraction = 1.0
 
-        imageIn = image
-        imageAdj = np.zeros_like(imageIn)  # adjustment image (for read noise modeling)
-        imageOut = imageIn.copy()  # output ("smoothed") image
-
-        nrows = imageIn.shape[0]
-        ncols = imageIn.shape[1]
-
-        rmsGlobal = 0.0
-        nrmsGlobal = 0.0
-
-        smoother = 1
-        print("iter", "model_rms", "target_rms", "residual")
-        for s in range(self.n_iter):
-            oldchk = ampReadNoise - rmsGlobal
-            imageAdj = self._determine_noise_model(imageIn, imageOut)
-
-            if (ampReadNoise - rmsGlobal) > 0:
-                imageOut += imageAdj * self.outScale / smoother
-                noiseImage = imageIn - imageOut
-            else:
-                imageOut -= imageAdj * self.outScale / smoother
-                noiseImage = imageIn - imageOut
-
-            cond = abs(imageIn > 0.1) | abs(imageOut > 0.1)
-            rmsGlobal = np.sum(noiseImage[cond] ** 2)
-            nrmsGlobal = noiseImage[cond].size
-
-            rmsGlobal = np.sqrt(rmsGlobal / nrmsGlobal)
-            print("\033[K", end="\r")
-            print(
-                "%4d  %f    %5.2f    %f"
-                % (s, rmsGlobal, self.sigmaRN, (ampReadNoise - rmsGlobal)),
-                end="",
-            )
-
-            chk = ampReadNoise - rmsGlobal
-            if chk * oldchk < 0:
-                smoother += 1
-
-            if type(ampReadNoise) == np.ndarray:
-                if np.max(ampReadNoise - rmsGlobal) < 0.0001:
-                    break
-            else:
-                if abs(ampReadNoise - rmsGlobal) < 0.0001:
-                    break
+        # iterate natively, reusing the adjustment buffer between calls
+        imageIn = np.ascontiguousarray(image, dtype=np.float64)
+        if self._scratch is None or self._scratch.shape != imageIn.shape:
+            self._scratch = np.empty(imageIn.shape, dtype=np.float64)
+        imageOut, noiseImage, rmsGlobal = w.cy_generate_sr_frames(
+            imageIn,
+            ampReadNoise,
+            self.ampScale,
+            self.smoothCol,
+            self.outScale,
+            self.n_iter,
+            self._scratch,
+        )
 
         # scale the smooth and noise frames if <sr_fraction> != 1
-        if sr_fraction != 1:
-            imageOut += noiseImage
-            noiseImage *= sr_fraction
-            imageOut -= noiseImage
+        imageOut, noiseImage = self._scale_SR_frames(imageOut, noiseImage, sr_fraction)
 
         return imageOut, noiseImage  # These are the "S" and "R" frames, respectively
 
@@ -346,25 +312,24 @@ class ReadNoise:
 
         self.optVals["pre-benchmark"] = sim_matrix
 
-        # run S+R routine at 0% and 100% S+R fraction
-        result_array = np.array([])
-        matrix_array = np.zeros((2, matrix_size, matrix_size))
+        # run S+R routine at 0% and 100% S+R fraction, together in C++
         sr_frac = np.array([0.0, 1.0])
-        for frac in sr_frac:
-            print("\nestimating S+R covariance at %d percent level" % (100 * frac))
-            raw_matrix, correction_matrix = self._estimate_residual_covariance(
-                self.skyFrameSim,
-                self.readnoiseFrameSim,
-                frac,
-                matrix_size=matrix_size,
-                **self.arcKwargs,
-                **kwargs
-            )
-            matrix_array[int(frac)] = correction_matrix
-            result = self.figure_of_merit(
-                correction_matrix, fom_method=fom_method
-            )  # TODO: check to see if changing subgrid_size actually matters
-            result_array = np.append(result_array, result)
+        print("\nestimating S+R covariance at 0 and 100 percent levels")
+        raw_matrices, correction_matrices = self._estimate_residual_covariance(
+            self.skyFrameSim,
+            self.readnoiseFrameSim,
+            sr_frac,
+            matrix_size=matrix_size,
+            **self.arcKwargs,
+            **kwargs
+        )
+        matrix_array = np.array(correction_matrices)
+        result_array = np.array(
+            [
+                self.figure_of_merit(correction_matrix, fom_method=fom_method)
+                for correction_matrix in correction_matrices
+            ]
+        )  # TODO: check to see if changing subgrid_size actually matters
         # interpolate between the results to determine the point of minimum residual covariance
         a_fit, cov = curve_fit(
             self._fitter_function, sr_frac, result_array, absolute_sigma=True
@@ -428,6 +393,17 @@ class ReadNoise:
             **kwargs
         )
 
+    ###############
+    ###############
+    def covariance_matrix_from_image(self, image, matrix_size=5, fprSize=5):
+        """
+        Calculate the pixel-to-pixel covariance matrix of an image, ignoring <fprSize> rows
+        and columns nearest the readout (e.g. the first-pixel-response decrement)
+        """
+        return CovarianceMatrix().from_image(
+            image, matrix_size=matrix_size, border=[fprSize, fprSize, 0, 0]
+        )
+
     ###############
     ###############
     def covariance_matrix_in_corners_of_image(
@@ -740,6 +716,17 @@ class ReadNoise:
 
         return
 
+    ###############
+    ###############
+    def _scale_SR_frames(self, sFrame, rFrame, sr_fraction):
+        """
+        Move all but <sr_fraction> of the read noise in the R frame back into the S frame
+        """
+        if sr_fraction == 1:
+            return sFrame, rFrame
+        rFrameScaled = rFrame * sr_fraction
+        return sFrame + rFrame - rFrameScaled, rFrameScaled
+
     ###############
     ###############
     def _estimate_residual_covariance(
@@ -752,31 +739,47 @@ class ReadNoise:
     ):
         """
         Estimate a covariance matrix for an optimising simulation, assuming the sky/noise frames have already been created
+
+        The whole pipeline (add CTI, add read noise, S+R separation, CTI removal from the S frame,
+        re-adding the R frame, and the covariances) runs in C++ with one prepared CTI model, see
+        estimate_residual_covariances() in read_noise.cpp. The S+R separation is done once and
+        rescaled for each fraction.
+
+        skyFrame, noiseFrame: 2D or 3D numpy arrays
+            The simulated frame(s), optionally a stack of realisations whose covariances are averaged
+
+        sr_fraction: float or 1D array
+            The S+R fraction(s), returning a stack of matrices if an array
+
+        **kwargs: the CTI model parameters, as for CTIModel
         """
-        # add CTI effects to skyFrame
-        ctiTrailedFrame = w.add_cti(skyFrame, **kwargs)
-        # add read noise to CTI-trailed image
-        readNoiseAddedFrame = ctiTrailedFrame + noiseFrame
-        # do S+R routine
-        sFrame, rFrame = self.generate_SR_frames_from_image(
-            readNoiseAddedFrame, sr_fraction
-        )
-        ###rescale S+R correction to a fractional value (for optimization)
-        ##sFrame+=rFrame
-        ##rFrame*=sr_fraction
-        ##sFrame-=rFrame
-        # clean CTI from S frame
-        ctiCorrectedFrame = w.remove_cti(sFrame, 1, **kwargs)
-        # re-add R frame to correction
-        outputFrame = ctiCorrectedFrame + rFrame
-
-        # determine covariance FOMs
-        fomSR = self.covariance_matrix_from_image(outputFrame, matrix_size=matrix_size)
-        fomBenchmark = self.covariance_matrix_from_image(
-            skyFrame + noiseFrame, matrix_size=matrix_size
-        )
+        from arcticpy.cti import CTIModel
+
+        sr_fractions = np.atleast_1d(np.asarray(sr_fraction, dtype=np.float64))
+        skyFrames = np.asarray(skyFrame, dtype=np.float64)
+        noiseFrames = np.asarray(noiseFrame, dtype=np.float64)
+        if skyFrames.ndim == 2:
+            skyFrames = skyFrames[np.newaxis]
+            noiseFrames = noiseFrames[np.newaxis]
+
+        cti_model = CTIModel(**kwargs)
+        with cti_model._lock:
+            fomSR, fomBenchmark = cti_model._model.estimate_residual_covariances(
+                skyFrames,
+                noiseFrames,
+                self.sigmaRN,
+                self.ampScale,
+                self.smoothCol,
+                self.outScale,
+                self.n_iter,
+                sr_fractions,
+                matrix_size,
+                5,
+            )
         fomDiff = fomSR - fomBenchmark
 
+        if np.ndim(sr_fraction) == 0:
+            return fomSR[0], fomDiff[0]
         return fomSR, fomDiff
 
     ###############
@@ -872,26 +875,19 @@ class ReadNoise:
         # if 'serial_roe' in allKwargs:
         #    kwargs['serial_roe'].prescan_offset = n_pixels[1]+(subchip_size//2)
 
-        # re-run the S+R routine with the optimised level
-        raw_matrix_opt, correction_matrix_opt = self._estimate_residual_covariance(
-            self.skyFrameSim,
-            self.readnoiseFrameSim,
-            frac_opt,
-            matrix_size=matrix_size,
-            **self.arcKwargs,
-            **kwargs
-        )
+        # re-run the S+R routine with the optimised level, and without S+R, in one pass
+        fracs = np.array([frac_opt, 0.0])
         (
-            raw_matrix_opt_noSR,
-            correction_matrix_opt_noSR,
+            (raw_matrix_opt, raw_matrix_opt_noSR),
+            (correction_matrix_opt, correction_matrix_opt_noSR),
         ) = self._estimate_residual_covariance(
             self.skyFrameSim,
             self.readnoiseFrameSim,
-            0,
+            fracs,
             matrix_size=matrix_size,
             **self.arcKwargs,
             **kwargs
-        )  # this is dumb...do it better
+        )
 
         # run a second S+R routine in the region close to the readout registers, to identify/remove stochastic simulation noise
         kwargs_noCTI = kwargs | self.arcKwargs
@@ -899,22 +895,12 @@ class ReadNoise:
         kwargs_noCTI["serial_traps"] = None
         # effectively, we are removing the effects of CTI, but still calculating a covariance matrix
         (
-            raw_matrix_opt_noCTI,
-            correction_matrix_opt_noCTI,
+            (raw_matrix_opt_noCTI, raw_matrix_opt_noCTI_noSR),
+            (correction_matrix_opt_noCTI, correction_matrix_opt_noCTI_noSR),
         ) = self._estimate_residual_covariance(
             self.skyFrameSim,
             self.readnoiseFrameSim,
-            frac_opt,
-            matrix_size=matrix_size,
-            **kwargs_noCTI
-        )
-        (
-            raw_matrix_opt_noCTI_noSR,
-            correction_matrix_opt_noCTI_noSR,
-        ) = self._estimate_residual_covariance(
-            self.skyFrameSim,
-            self.readnoiseFrameSim,
-            0,
+            fracs,
             matrix_size=matrix_size,
             **kwargs_noCTI
         )
@@ -940,42 +926,22 @@ class ReadNoise:
                 kwargs_serialOnly["parallel_traps"] = None  # make a serial-only corner
 
                 (
-                    raw_matrix_opt_parallel,
-                    correction_matrix_opt_parallel,
+                    (raw_matrix_opt_parallel, raw_matrix_opt_parallel_noSR),
+                    (correction_matrix_opt_parallel, correction_matrix_opt_parallel_noSR),
                 ) = self._estimate_residual_covariance(
                     self.skyFrameSim,
                     self.readnoiseFrameSim,
-                    frac_opt,
+                    fracs,
                     matrix_size=matrix_size,
                     **kwargs_parallelOnly
                 )
                 (
-                    raw_matrix_opt_serial,
-                    correction_matrix_opt_serial,
+                    (raw_matrix_opt_serial, raw_matrix_opt_serial_noSR),
+                    (correction_matrix_opt_serial, correction_matrix_opt_serial_noSR),
                 ) = self._estimate_residual_covariance(
                     self.skyFrameSim,
                     self.readnoiseFrameSim,
-                    frac_opt,
-                    matrix_size=matrix_size,
-                    **kwargs_serialOnly
-                )
-                (
-                    raw_matrix_opt_parallel_noSR,
-                    correction_matrix_opt_parallel_noSR,
-                ) = self._estimate_residual_covariance(
-                    self.skyFrameSim,
-                    self.readnoiseFrameSim,
-                    0,
-                    matrix_size=matrix_size,
-                    **kwargs_parallelOnly
-                )
-                (
-                    raw_matrix_opt_serial_noSR,
-                    correction_matrix_opt_serial_noSR,
-                ) = self._estimate_residual_covariance(
-                    self.skyFrameSim,
-                    self.readnoiseFrameSim,
-                    0,
+                    fracs,
                     matrix_size=matrix_size,
                     **kwargs_serialOnly
                 )
@@ -1045,33 +1011,16 @@ class CovarianceMatrix(np.ndarray):
         """        
         # Initialise output variable
         self = CovarianceMatrix(matrix_size=matrix_size)
-        middle = self.middle
-        roll_border = tuple(max(a,1) for a in middle)
 
         # Optionally remove a border around the image, e.g. to avoid FPR decrement
-        # (this actually removes one extra row at the top and column on the right)
-        subimage = image[border[0]:-border[2]-1, 
-                         border[1]:-border[3]-1]
-
-        # Remove the outside edge of an image that could be rolled over in the next copy, 
-        # so the two copies stay the same size
-        x = subimage[roll_border[0]:-roll_border[1], roll_border[0]:-roll_border[1]].flatten()
-        xbar = np.mean(x)
-
-        # Loop over all pixel offsets
-        for i in range(-middle[0], middle[0] + 1, 1):
-            for j in range(-middle[1], middle[1] + 1, 1):
-
-                # Shift the pixels in a second copy of the image
-                y = np.roll(subimage, (-j, -i), axis=(0, 1))[roll_border[0]:-roll_border[1], roll_border[0]:-roll_border[1]].flatten()
-                ybar = np.mean(y)
-                
-                # Calcluate covariance between shifted pixels
-                self[middle[0] + i, middle[1] + j] = (
-                    np.sum((x - xbar) * (y - ybar)) / x.size
-                )  # /(np.std(x-xbar)*np.std(y-ybar))/(x.size) #removing noise-level normalization
-                # covar = np.sum((x-xbar)*(y-ybar))/(np.std(x-xbar)*np.std(y-ybar))/(x.size)
-                
+        # (this actually removes one extra row at the top and column on the right),
+        # then remove the outside edge that could be rolled over for each pixel offset.
+        # The covariances are calculated in parallel in C++, see
+        # covariance_matrix_from_image() in read_noise.cpp
+        self[...] = w.cy_covariance_matrix_from_image(
+            np.asarray(image, dtype=np.float64), self.shape[0], self.shape[1], border
+        )
+
         return self
 
     @property
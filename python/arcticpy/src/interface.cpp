@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 
+#include <condition_variable>
+#include <mutex>
 #include <valarray>
 
 /*
@@ -33,17 +35,80 @@ void print_array_2D(double* array, int n_rows, int n_columns) {
 }
 
 /*
-    Wrapper for arctic's add_cti() in src/cti.cpp.
+    Add (or remove if n_iterations > 0) CTI for a strided stack of images, in
+    their precision and in place. See clock_images() below.
+*/
+template <typename real>
+static void clock_image_stack(
+    real* image, int n_images, int n_rows, int n_columns, long image_stride,
+    long row_stride, long column_stride, CTIModel& model, int verbosity,
+    int iteration, int n_iterations) {
 
-    Add CTI trails to an image by trapping, releasing, and moving electrons
-    along their independent columns, for parallel and/or serial clocking.
+    // The first pixel of each image in the stack
+    std::valarray<real*> images(n_images);
+    for (int i_image = 0; i_image < n_images; i_image++) {
+        images[i_image] = image + i_image * image_stride;
+    }
+
+    if (n_iterations > 0)
+        remove_cti_batch(
+            &images[0], n_images, n_rows, n_columns, row_stride, column_stride,
+            n_iterations, model);
+    else
+        add_cti_batch(
+            &images[0], n_images, n_rows, n_columns, row_stride, column_stride,
+            model, verbosity, iteration);
+}
+
+/*
+    Guard for arctic's global verbosity while clock_images() runs with the GIL
+    released, e.g. for models in different python threads.
+
+    A call only starts once no others are running with a different verbosity,
+    then sets it, so concurrent calls with the same verbosity still run at the
+    same time, while one with another verbosity waits for them to finish.
+*/
+static std::mutex verbosity_mutex;
+static std::condition_variable verbosity_released;
+static int n_calls_using_verbosity = 0;
+
+static void acquire_verbosity(int v) {
+    std::unique_lock<std::mutex> lock(verbosity_mutex);
+    verbosity_released.wait(
+        lock, [v] { return (n_calls_using_verbosity == 0) || (verbosity == v); });
+    set_verbosity(v);
+    n_calls_using_verbosity++;
+}
+
+static void release_verbosity() {
+    std::lock_guard<std::mutex> lock(verbosity_mutex);
+    n_calls_using_verbosity--;
+    if (n_calls_using_verbosity == 0) verbosity_released.notify_all();
+}
+
+/*
+    Delete the model and the ROEs that its clocking points to, which are the
+    interface's own copies, like its CCDs and dwell times.
+*/
+InterfaceModel::~InterfaceModel() {
+    delete model;
+    delete parallel_roe;
+    delete serial_roe;
+}
+
+/*
+    Prepare arctic's CTIModel in model.hpp from the python wrapper's parameters,
+    to keep and reuse for many add_cti() or remove_cti() calls, see
+    clock_images() below and CTIModel in cti.py.
 
     This wrapper converts the individual numbers and arrays from the Cython
-    wrapper into C++ variables to pass to the main arcctic library. See
-    cy_add_cti() in wrapper.pyx and add_cti() in cti.py.
+    wrapper into C++ variables for the main arctic library, once per model
+    instead of once per image. See cy_CTIModel in wrapper.pyx.
+
+    The returned model owns its ROEs and CCDs (and the dwell times that the
+    ROEs refer to), and must be deleted by the caller.
 */
-void add_cti(
-    double* image, int n_rows, int n_columns,
+InterfaceModel* new_cti_model(
     // ========
     // Parallel
     // ========
@@ -104,27 +169,19 @@ void add_cti(
     // Combined
     // ========
     int allow_negative_pixels, 
-    // Output
-    int verbosity, int iteration) {
+    // Threads
+    int column_schedule) {
 
-    set_verbosity(verbosity);
+    InterfaceModel* interface_model = new InterfaceModel();
 
-    // Convert the inputs into the relevant C++ objects
-
-    // Image to 2D valarray
-    std::valarray<std::valarray<double> > image_in(
-        std::valarray<double>(0.0, n_columns), n_rows);
-    for (int i_row = 0; i_row < n_rows; i_row++) {
-        for (int i_col = 0; i_col < n_columns; i_col++) {
-            image_in[i_row][i_col] = image[i_row * n_columns + i_col];
-        }
-    }
+    // Convert the inputs into the relevant C++ objects, kept by the model
 
     // ========
     // Parallel
     // ========
     // ROE
-    std::valarray<double> parallel_dwell_times(0.0, parallel_n_steps);
+    std::valarray<double>& parallel_dwell_times = interface_model->parallel_dwell_times;
+    parallel_dwell_times.resize(parallel_n_steps);
     for (int i_step = 0; i_step < parallel_n_steps; i_step++) {
         parallel_dwell_times[i_step] = parallel_dwell_times_in[i_step];
     }
@@ -165,7 +222,8 @@ void add_cti(
         parallel_phases[i_phase].well_fill_power = parallel_well_fill_powers[i_phase];
         parallel_phases[i_phase].first_electron_fill = parallel_first_electron_fills[i_phase];
     }
-    CCD parallel_ccd(parallel_phases, parallel_fraction_of_traps_per_phase);
+    interface_model->parallel_roe = p_parallel_roe;
+    interface_model->parallel_ccd = CCD(parallel_phases, parallel_fraction_of_traps_per_phase);
 
     // Traps
     std::valarray<TrapInstantCapture> parallel_traps_ic(
@@ -211,7 +269,8 @@ void add_cti(
     // Serial
     // ========
     // ROE
-    std::valarray<double> serial_dwell_times(0.0, serial_n_steps);
+    std::valarray<double>& serial_dwell_times = interface_model->serial_dwell_times;
+    serial_dwell_times.resize(serial_n_steps);
     for (int i_step = 0; i_step < serial_n_steps; i_step++) {
         serial_dwell_times[i_step] = serial_dwell_times_in[i_step];
     }
@@ -252,7 +311,8 @@ void add_cti(
         serial_phases[i_phase].well_fill_power = serial_well_fill_powers[i_phase];
         serial_phases[i_phase].first_electron_fill = serial_first_electron_fills[i_phase];
     }
-    CCD serial_ccd(serial_phases, serial_fraction_of_traps_per_phase);
+    interface_model->serial_roe = p_serial_roe;
+    interface_model->serial_ccd = CCD(serial_phases, serial_fraction_of_traps_per_phase);
 
     // Traps
     std::valarray<TrapInstantCapture> serial_traps_ic(
@@ -303,82 +363,70 @@ void add_cti(
     //parallel_prune_n_electronss[0] = parallel_prune_n_electrons;
     //double serial_prune_n_electrons = serial_prune_n_electrons_in[0];
     //serial_prune_n_electronss[0] = serial_prune_n_electrons;
-    double prune_zero = 0;
     
     // ========
-    // Add CTI
+    // Model
     // ========
-    std::valarray<std::valarray<double> > image_out;
-    // No parallel, serial only
-    if (n_traps_parallel == 0) {
-        image_out = add_cti(
-            image_in,
-            // Parallel
-            nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, 
-            0, 0, parallel_window_start, parallel_window_stop, 0, 0, prune_zero, 0,
-            // Serial
-            p_serial_roe, &serial_ccd, &serial_traps_ic, &serial_traps_sc,
-            &serial_traps_continuum, &serial_traps_sc_co, 
-            serial_express, serial_offset,
-            serial_window_start, serial_window_stop, 
-            serial_time_start, serial_time_stop,
-            serial_prune_n_electrons[0], serial_prune_frequency,
-            // Combined
-            allow_negative_pixels, 
-            // Output
-            verbosity, iteration);
-    }
-    // No serial, parallel only
-    else if (n_traps_serial == 0) {
-        image_out = add_cti(
-            image_in,
-            // Parallel
-            p_parallel_roe, &parallel_ccd, &parallel_traps_ic, &parallel_traps_sc,
-            &parallel_traps_continuum, &parallel_traps_sc_co, 
+    // Prepared on the first images, and again only for a different size. It
+    // doesn't clock in a direction without any traps
+    interface_model->model = new CTIModel(
+        ClockingModel(
+            p_parallel_roe, &interface_model->parallel_ccd, 
+            &parallel_traps_ic, &parallel_traps_sc, &parallel_traps_continuum, &parallel_traps_sc_co,
             parallel_express, parallel_offset, 
             parallel_window_start, parallel_window_stop,
             parallel_time_start, parallel_time_stop,
-            parallel_prune_n_electrons[0], parallel_prune_frequency,
-            // Serial
-            nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, 
-            0, 0, serial_window_start, serial_window_stop, 0, 0, prune_zero, 0, 
-            // Combined
-            allow_negative_pixels, 
-            // Output
-            verbosity, iteration);
-    }
-    // Parallel and serial
-    else {
-        image_out = add_cti(
-            image_in,
-            // Parallel
-            p_parallel_roe, &parallel_ccd, 
-            &parallel_traps_ic, &parallel_traps_sc, &parallel_traps_continuum, &parallel_traps_sc_co, 
-            parallel_express, parallel_offset, 
-            parallel_window_start, parallel_window_stop,
-            parallel_time_start, parallel_time_stop,
-            parallel_prune_n_electrons[0], parallel_prune_frequency,
-            // Serial
-            p_serial_roe, &serial_ccd, 
-            &serial_traps_ic, &serial_traps_sc, &serial_traps_continuum, &serial_traps_sc_co, 
+            parallel_prune_n_electrons[0], parallel_prune_frequency),
+        ClockingModel(
+            p_serial_roe, &interface_model->serial_ccd, 
+            &serial_traps_ic, &serial_traps_sc, &serial_traps_continuum, &serial_traps_sc_co,
             serial_express, serial_offset,
             serial_window_start, serial_window_stop,
             serial_time_start, serial_time_stop,
-            serial_prune_n_electrons[0], serial_prune_frequency,
-            // Combined
-            allow_negative_pixels, 
-            // Output
-            verbosity, iteration);
-    }
+            serial_prune_n_electrons[0], serial_prune_frequency),
+        allow_negative_pixels, column_schedule);
 
-    // Delete serial/parallel ROE if previously allocated
-    delete p_parallel_roe;
-    delete p_serial_roe;
+    return interface_model;
+}
 
-    // Convert the output image back to modify the input image array
-    for (int i_row = 0; i_row < n_rows; i_row++) {
-        for (int i_col = 0; i_col < n_columns; i_col++) {
-            image[i_row * n_columns + i_col] = image_out[i_row][i_col];
-        }
-    }
+/*
+    Wrapper for arctic's add_cti() in src/cti.cpp, with a model from
+    new_cti_model().
+
+    Add CTI trails to an image by trapping, releasing, and moving electrons
+    along their independent columns, for parallel and/or serial clocking.
+
+    The image can be a stack of n_images images, which all share the same
+    prepared model. See add_cti_batch() in src/model.cpp. If n_iterations > 0
+    then instead remove CTI with that many iterations, e.g. for
+    remove_cti_batch() in cti.py.
+
+    The image buffer is either double, or float if image_is_float, which is
+    clocked in double via a temporary copy. See clock_charge_in_images().
+    It is modified in place, directly in the numpy array's memory, with the
+    strides (in pixels, not bytes) between images, rows, and columns. So any
+    numpy view can be used without a contiguous copy, e.g. a cutout or a
+    transposed image.
+
+    The global verbosity is set for the call, see acquire_verbosity().
+*/
+void clock_images(
+    InterfaceModel* interface_model, void* image, bool image_is_float, int n_images,
+    int n_rows, int n_columns, long image_stride, long row_stride,
+    long column_stride, int verbosity, int iteration, int n_iterations) {
+
+    acquire_verbosity(verbosity);
+
+    if (image_is_float)
+        clock_image_stack(
+            (float*)image, n_images, n_rows, n_columns, image_stride, row_stride,
+            column_stride, *interface_model->model, verbosity, iteration,
+            n_iterations);
+    else
+        clock_image_stack(
+            (double*)image, n_images, n_rows, n_columns, image_stride, row_stride,
+            column_stride, *interface_model->model, verbosity, iteration,
+            n_iterations);
+
+    release_verbosity();
 }
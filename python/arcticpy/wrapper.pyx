@@ -2,29 +2,225 @@ cimport cython
 
 cimport numpy as np
 import numpy as np
+import warnings
 from libcpp.string cimport string
+from libcpp.vector cimport vector
+
+# Initialise numpy's C API, for np.PyArray_DATA() etc.
+np.import_array()
+
+cdef extern from "pixel_bounce.hpp":
+    cdef cppclass PixelBounce:
+        PixelBounce(double kA, double kv, double gamma, double omega)
+    void add_pixel_bounce[real](
+        real** images, int n_images, long line_stride, long pixel_stride,
+        int line_start, int line_stop, int pixel_start, int pixel_stop,
+        const vector[PixelBounce]& pixel_bounces
+    ) nogil
+
+cdef extern from "model.hpp":
+    cdef cppclass CTIModel:
+        vector[PixelBounce] pixel_bounces
+    void add_cti_density_sweep(
+        double** images, int n_models, int n_rows, int n_columns, long row_stride,
+        long column_stride, CTIModel& model, const double* parallel_trap_densities,
+        const double* serial_trap_densities, int verbosity
+    ) nogil
 
 cdef extern from "read_noise.hpp":
-    void determine_read_noise_model(const double* imageIn, const double* imageOut, const int rows, const int cols, const double readNoiseAmp, const double readNoiseAmpFraction, const int smoothCol, double* output);
+    void determine_read_noise_model(
+        const double* image_in, const double* image_out, const int rows, const int cols,
+        const double read_noise_amp, const double read_noise_amp_fraction,
+        const int smooth_col, double* output
+    ) nogil
+    double generate_sr_frames(
+        const double* image_in, const int rows, const int cols,
+        const double read_noise_amp, const double read_noise_amp_fraction,
+        const int smooth_col, const double out_scale, const int n_iterations,
+        double* image_out, double* image_noise, double* scratch
+    ) nogil
+    void covariance_matrix_from_image(
+        const double* image, const int n_rows, const int n_columns,
+        const int matrix_n_rows, const int matrix_n_columns, const int border_bottom,
+        const int border_left, const int border_top, const int border_right,
+        double* covariance
+    ) nogil
+    void estimate_residual_covariances(
+        const double* sky_frames, const double* noise_frames, const int n_realisations,
+        const int n_rows, const int n_columns, CTIModel& model,
+        const double read_noise_amp, const double read_noise_amp_fraction,
+        const int smooth_col, const double out_scale, const int n_sr_iterations,
+        const double* sr_fractions, const int n_sr_fractions, const int matrix_size,
+        const int fpr_size, double* covariances, double* covariance_benchmark
+    ) nogil
 
-def cy_determine_read_noise_model(np.ndarray[np.float64_t, ndim=2] arr1, np.ndarray[np.float64_t, ndim=2] arr2, readNoiseAmp, readNoiseAmpFraction, smoothCol):
+def cy_determine_read_noise_model(np.ndarray[np.float64_t, ndim=2] arr1, np.ndarray[np.float64_t, ndim=2] arr2, readNoiseAmp, readNoiseAmpFraction, smoothCol, np.ndarray[np.float64_t, ndim=2] out=None):
+    """ Optionally reuse an existing (rows, cols) output array. """
+    arr1 = np.ascontiguousarray(arr1)
+    arr2 = np.ascontiguousarray(arr2)
     cdef int rows = arr1.shape[0]
     cdef int cols = arr1.shape[1]
-    cdef np.ndarray[np.float64_t, ndim=2] out = np.zeros((rows, cols), dtype=np.float64)
-    determine_read_noise_model(&arr1[0,0], &arr2[0,0], rows, cols, readNoiseAmp, readNoiseAmpFraction, smoothCol, &out[0,0])
+    if out is None:
+        out = np.empty((rows, cols), dtype=np.float64)
+    cdef double* c_arr1 = &arr1[0,0]
+    cdef double* c_arr2 = &arr2[0,0]
+    cdef double* c_out = &out[0,0]
+    cdef double c_amp = readNoiseAmp
+    cdef double c_fraction = readNoiseAmpFraction
+    cdef int c_smooth_col = smoothCol
+    with nogil:
+        determine_read_noise_model(c_arr1, c_arr2, rows, cols, c_amp, c_fraction, c_smooth_col, c_out)
     return out
-    
+
+def cy_generate_sr_frames(np.ndarray[np.float64_t, ndim=2] image, readNoiseAmp, readNoiseAmpFraction, smoothCol, outScale, n_iter, np.ndarray[np.float64_t, ndim=2] scratch=None):
+    """ Returns the smooth and read-noise frames and the final rms. """
+    image = np.ascontiguousarray(image)
+    cdef int rows = image.shape[0]
+    cdef int cols = image.shape[1]
+    cdef np.ndarray[np.float64_t, ndim=2] image_out = np.empty((rows, cols), dtype=np.float64)
+    cdef np.ndarray[np.float64_t, ndim=2] image_noise = np.empty((rows, cols), dtype=np.float64)
+    if scratch is None:
+        scratch = np.empty((rows, cols), dtype=np.float64)
+    cdef double* c_image = &image[0,0]
+    cdef double* c_image_out = &image_out[0,0]
+    cdef double* c_image_noise = &image_noise[0,0]
+    cdef double* c_scratch = &scratch[0,0]
+    cdef double c_amp = readNoiseAmp
+    cdef double c_fraction = readNoiseAmpFraction
+    cdef int c_smooth_col = smoothCol
+    cdef double c_out_scale = outScale
+    cdef int c_n_iter = n_iter
+    cdef double rms
+    with nogil:
+        rms = generate_sr_frames(
+            c_image, rows, cols, c_amp, c_fraction, c_smooth_col, c_out_scale,
+            c_n_iter, c_image_out, c_image_noise, c_scratch
+        )
+    return image_out, image_noise, rms
+
+def cy_covariance_matrix_from_image(np.ndarray[np.float64_t, ndim=2] image, matrix_n_rows, matrix_n_columns, border):
+    """ See covariance_matrix_from_image() in read_noise.cpp. """
+    image = np.ascontiguousarray(image)
+    cdef int n_rows = image.shape[0]
+    cdef int n_columns = image.shape[1]
+    cdef int c_matrix_n_rows = matrix_n_rows
+    cdef int c_matrix_n_columns = matrix_n_columns
+    cdef int border_bottom = border[0]
+    cdef int border_left = border[1]
+    cdef int border_top = border[2]
+    cdef int border_right = border[3]
+    cdef np.ndarray[np.float64_t, ndim=2] covariance = np.empty((matrix_n_rows, matrix_n_columns), dtype=np.float64)
+    cdef double* c_image = &image[0,0]
+    cdef double* c_covariance = &covariance[0,0]
+    with nogil:
+        covariance_matrix_from_image(
+            c_image, n_rows, n_columns, c_matrix_n_rows, c_matrix_n_columns,
+            border_bottom, border_left, border_top, border_right, c_covariance
+        )
+    return covariance
+
+cdef vector[PixelBounce] pixel_bounce_vector(kA, kv, gamma, omega):
+    """ The C++ PixelBounce models, from arrays of each parameter. """
+    cdef vector[PixelBounce] pixel_bounces
+    for i in range(len(kA)):
+        pixel_bounces.push_back(PixelBounce(kA[i], kv[i], gamma[i], omega[i]))
+    return pixel_bounces
+
+def cy_add_pixel_bounce(np.ndarray image, kA, kv, gamma, omega, int row_start, int row_stop, int column_start, int column_stop):
+    """
+    Add pixel bounce along the rows of an image, or a 3D stack of images,
+    modifying them in place directly in the array's memory, with the GIL
+    released. See add_pixel_bounce() in pixel_bounce.cpp and
+    check_clockable() for the requirements.
+    """
+    if not check_clockable(image):
+        raise ValueError(
+            "Expected a writeable, native float32 or float64 array with "
+            "whole-pixel strides, not %s with strides %s"
+            % (image.dtype, image.strides)
+        )
+
+    cdef vector[PixelBounce] pixel_bounces = pixel_bounce_vector(kA, kv, gamma, omega)
+
+    # The image(s) shape and strides in pixels
+    cdef char* image_data = <char*>np.PyArray_DATA(image)
+    cdef int n_images = 1 if image.ndim == 2 else image.shape[0]
+    cdef long image_stride = 0 if image.ndim == 2 else image.strides[0]
+    cdef long row_stride = image.strides[image.ndim - 2] // image.itemsize
+    cdef long column_stride = image.strides[image.ndim - 1] // image.itemsize
+    cdef vector[double*] images_double
+    cdef vector[float*] images_float
+    cdef int i_image
+
+    if image.dtype == np.float32:
+        for i_image in range(n_images):
+            images_float.push_back(<float*>(image_data + i_image * image_stride))
+        with nogil:
+            add_pixel_bounce[float](
+                images_float.data(), n_images, row_stride, column_stride,
+                row_start, row_stop, column_start, column_stop, pixel_bounces
+            )
+    else:
+        for i_image in range(n_images):
+            images_double.push_back(<double*>(image_data + i_image * image_stride))
+        with nogil:
+            add_pixel_bounce[double](
+                images_double.data(), n_images, row_stride, column_stride,
+                row_start, row_stop, column_start, column_stop, pixel_bounces
+            )
+
 cdef extern from "util.hpp":
     cdef string version_arctic()
     void print_version()
 
+cdef extern from "table_cache.hpp":
+    void set_table_cache_dir(const char* dir)
+    void clear_table_cache()
+
+cdef extern from "profile.hpp":
+    cdef cppclass ClockingProfile:
+        int transfer_axis
+        int n_images
+        int n_active_rows
+        int n_active_columns
+        int n_express_passes
+        long n_express_passes_clocked
+        double wall_time
+        vector[int] thread_n_columns
+        vector[double] thread_times
+        vector[int] n_watermarks_ic
+        vector[int] n_watermarks_sc
+        vector[int] n_watermarks_ic_co
+        vector[int] n_watermarks_sc_co
+        vector[int] max_n_active_watermarks_ic
+        vector[int] max_n_active_watermarks_sc
+        vector[int] max_n_active_watermarks_ic_co
+        vector[int] max_n_active_watermarks_sc_co
+        long n_prunes
+        long n_pruned_watermarks
+        long n_stores
+        long n_restores
+        double store_time
+        double restore_time
+        int n_workspace_copies
+
+    cdef cppclass CTIProfile:
+        vector[ClockingProfile] clockings
+
+    void set_profiling(int p)
+    void reset_profile()
+    CTIProfile get_profile()
+
+cdef extern from "trap_managers.hpp":
+    void set_watermark_memory_limit(double n_bytes)
+
 cdef extern from "interface.hpp":
     void print_array(double* array, int length)
     void print_array_2D(double* array, int n_rows, int n_columns)
-    void add_cti(
-        double* image,
-        int n_rows,
-        int n_columns,
+    cdef cppclass InterfaceModel:
+        CTIModel* model
+
+    InterfaceModel* new_cti_model(
         # ========
         # Parallel
         # ========
@@ -107,11 +303,25 @@ cdef extern from "interface.hpp":
         # Combined
         # ========
         int allow_negative_pixels,
-        # Output
-        int verbosity,
-        int iteration
+        # Threads
+        int column_schedule
     )
 
+    void clock_images(
+        InterfaceModel* interface_model,
+        void* image,
+        bint image_is_float,
+        int n_images,
+        int n_rows,
+        int n_columns,
+        long image_stride,
+        long row_stride,
+        long column_stride,
+        int verbosity,
+        int iteration,
+        int n_iterations
+    ) nogil
+
 
 def cy_print_version():
     print_version()
@@ -119,6 +329,98 @@ def cy_print_version():
 def cy_version_arctic():
     return version_arctic().decode("utf-8")
 
+def cy_set_table_cache_dir(directory):
+    """
+    Set the directory for the on-disk cache of continuum-trap interpolation
+    tables, shared between processes, or None to only cache them in memory.
+    Otherwise the ARCTIC_TABLE_CACHE_DIR environment variable is used, if set.
+    """
+    if directory is None:
+        directory = ""
+    set_table_cache_dir(str(directory).encode("utf-8"))
+
+def cy_clear_table_cache():
+    """ Empty the in-memory cache of continuum-trap interpolation tables. """
+    clear_table_cache()
+
+def cy_set_watermark_memory_limit(n_bytes):
+    """
+    Limit the memory for each thread's watermark arrays, in bytes, or None for
+    no limit (default). If the traps aren't emptied between columns then the
+    arrays grow on demand up to this limit, after which the smallest
+    watermarks are merged, slightly approximating the trap states.
+    """
+    if n_bytes is None:
+        n_bytes = 0
+    set_watermark_memory_limit(n_bytes)
+
+def cy_set_profiling(enabled):
+    """
+    Record a profile of every set of columns clocked in either direction, for
+    add_cti() and remove_cti(), returned by cy_get_profile(). Adds some small
+    overhead for the timers and watermark counts, so is off by default.
+    """
+    set_profiling(1 if enabled else 0)
+
+def cy_reset_profile():
+    """ Discard the profiles recorded so far. """
+    reset_profile()
+
+def cy_get_profile():
+    """
+    Return the profiles recorded since the last cy_reset_profile().
+
+    Returns
+    -------
+    profile : dict
+        "clockings" : [dict]
+            The profile of each call to clock charge in one direction, e.g. two
+            for add_cti() with parallel and serial CTI, with the attributes of
+            ClockingProfile in src/profile.cpp. Per-thread and per-phase values
+            are lists, with the watermark counts keyed by the family of traps.
+    """
+    cdef CTIProfile profile = get_profile()
+    cdef ClockingProfile c
+
+    clockings = []
+    for c in profile.clockings:
+        clockings.append(
+            {
+                "transfer_axis": "serial" if c.transfer_axis == 1 else "parallel",
+                "n_images": c.n_images,
+                "n_active_rows": c.n_active_rows,
+                "n_active_columns": c.n_active_columns,
+                "n_express_passes": c.n_express_passes,
+                "n_express_passes_clocked": c.n_express_passes_clocked,
+                "wall_time": c.wall_time,
+                "thread_n_columns": list(c.thread_n_columns),
+                "thread_times": list(c.thread_times),
+                "n_watermarks": {
+                    "instant_capture": list(c.n_watermarks_ic),
+                    "slow_capture": list(c.n_watermarks_sc),
+                    "instant_capture_continuum": list(c.n_watermarks_ic_co),
+                    "slow_capture_continuum": list(c.n_watermarks_sc_co),
+                },
+                "max_n_active_watermarks": {
+                    "instant_capture": list(c.max_n_active_watermarks_ic),
+                    "slow_capture": list(c.max_n_active_watermarks_sc),
+                    "instant_capture_continuum": list(
+                        c.max_n_active_watermarks_ic_co
+                    ),
+                    "slow_capture_continuum": list(c.max_n_active_watermarks_sc_co),
+                },
+                "n_prunes": c.n_prunes,
+                "n_pruned_watermarks": c.n_pruned_watermarks,
+                "n_stores": c.n_stores,
+                "n_restores": c.n_restores,
+                "store_time": c.store_time,
+                "restore_time": c.restore_time,
+                "n_workspace_copies": c.n_workspace_copies,
+            }
+        )
+
+    return {"clockings": clockings}
+
 def check_contiguous(array):
     """ Make sure an array is contiguous and C-style. """
     if not array.flags['C_CONTIGUOUS']:
@@ -126,6 +428,24 @@ def check_contiguous(array):
     else:
         return array
 
+def check_clockable(array):
+    """
+    Whether arctic can clock an image (or a 3D stack of images) directly in
+    its memory: a writeable float32 or float64 array in native byte order,
+    with strides in whole pixels. Any other layout is fine, e.g. cutouts or
+    transposed or reversed views, except overlapping (e.g. broadcast) pixels.
+    """
+    if not isinstance(array, np.ndarray) or array.ndim not in (2, 3):
+        return False
+    if array.dtype not in (np.float32, np.float64) or not array.dtype.isnative:
+        return False
+    if not array.flags["WRITEABLE"]:
+        return False
+    return all(
+        stride % array.itemsize == 0 and (stride != 0 or length == 1)
+        for stride, length in zip(array.strides, array.shape)
+    )
+
 
 def cy_print_array(np.ndarray[np.double_t, ndim=1] array):
     array = check_contiguous(array)
@@ -139,188 +459,394 @@ def cy_print_array_2D(np.ndarray[np.double_t, ndim=2] array):
     print_array_2D(&array[0, 0], array.shape[0], array.shape[1])
 
 
-def cy_add_cti(
-    np.ndarray[np.double_t, ndim=2] image,
-    # ========
-    # Parallel
-    # ========
-    # ROE
-    np.ndarray[np.double_t, ndim=1] parallel_dwell_times,
-    int parallel_prescan_offset,
-    int parallel_overscan_start,
-    int parallel_empty_traps_between_columns,
-    int parallel_empty_traps_for_first_transfers,
-    int parallel_force_release_away_from_readout,
-    int parallel_use_integer_express_matrix,
-    int parallel_n_pumps,
-    int parallel_roe_type,
-    # CCD
-    np.ndarray[np.double_t, ndim=1] parallel_fraction_of_traps_per_phase,
-    np.ndarray[np.double_t, ndim=1] parallel_full_well_depths,
-    np.ndarray[np.double_t, ndim=1] parallel_well_notch_depths,
-    np.ndarray[np.double_t, ndim=1] parallel_well_fill_powers,
-    np.ndarray[np.double_t, ndim=1] parallel_first_electron_fills,
-    # Traps
-    np.ndarray[np.double_t, ndim=1] parallel_trap_densities,
-    np.ndarray[np.double_t, ndim=1] parallel_trap_release_timescales,
-    np.ndarray[np.double_t, ndim=1] parallel_trap_third_params,
-    np.ndarray[np.double_t, ndim=1] parallel_trap_fourth_params,
-    int parallel_n_traps_ic,
-    int parallel_n_traps_sc,
-    int parallel_n_traps_ic_co,
-    int parallel_n_traps_sc_co,
-    # Misc
-    int parallel_express,
-    int parallel_window_offset,
-    int parallel_window_start,
-    int parallel_window_stop,
-    int parallel_time_start,
-    int parallel_time_stop,
-    np.ndarray[np.double_t, ndim=1] parallel_prune_n_electrons, 
-    int parallel_prune_frequency,
-    # ========
-    # Serial
-    # ========
-    # ROE
-    np.ndarray[np.double_t, ndim=1] serial_dwell_times,
-    int serial_prescan_offset,
-    int serial_overscan_start,
-    int serial_empty_traps_between_columns,
-    int serial_empty_traps_for_first_transfers,
-    int serial_force_release_away_from_readout,
-    int serial_use_integer_express_matrix,
-    int serial_n_pumps,
-    int serial_roe_type,
-    # CCD
-    np.ndarray[np.double_t, ndim=1] serial_fraction_of_traps_per_phase,
-    np.ndarray[np.double_t, ndim=1] serial_full_well_depths,
-    np.ndarray[np.double_t, ndim=1] serial_well_notch_depths,
-    np.ndarray[np.double_t, ndim=1] serial_well_fill_powers,
-    np.ndarray[np.double_t, ndim=1] serial_first_electron_fills,
-    # Traps
-    np.ndarray[np.double_t, ndim=1] serial_trap_densities,
-    np.ndarray[np.double_t, ndim=1] serial_trap_release_timescales,
-    np.ndarray[np.double_t, ndim=1] serial_trap_third_params,
-    np.ndarray[np.double_t, ndim=1] serial_trap_fourth_params,
-    int serial_n_traps_ic,
-    int serial_n_traps_sc,
-    int serial_n_traps_ic_co,
-    int serial_n_traps_sc_co,
-    # Misc
-    int serial_express,
-    int serial_window_offset,
-    int serial_window_start,
-    int serial_window_stop,
-    int serial_time_start,
-    int serial_time_stop,
-    np.ndarray[np.double_t, ndim=1] serial_prune_n_electrons, 
-    int serial_prune_frequency,
-    # ========
-    # Combined
-    # ========
-    int allow_negative_pixels,
-    # Output
-    int verbosity,
-    int iteration,
-):
+cdef class cy_CTIModel:
     """
-    Cython wrapper for arctic's add_cti() in src/cti.cpp.
+    Cython wrapper for a prepared arctic CTIModel, built by new_cti_model() in
+    interface.cpp from the individual numbers and arrays extracted by the
+    python wrapper, and kept to add or remove CTI for many images. See CTIModel
+    in cti.py.
 
-    This wrapper passes the individual numbers and arrays extracted by the
-    python wrapper to the C++ interface. See add_cti() in cti.py and add_cti()
-    in interface.cpp.
+    The C++ model keeps its trap managers etc. prepared for the last image
+    size, so a model must not clock images in more than one thread at a time.
     """
-    image = check_contiguous(image)
+    cdef InterfaceModel* c_model
 
-    add_cti(
-        &image[0, 0],
-        image.shape[0],
-        image.shape[1],
+    def __cinit__(
+        self,
         # ========
         # Parallel
         # ========
         # ROE
-        &parallel_dwell_times[0],
-        len(parallel_dwell_times),
-        parallel_prescan_offset,
-        parallel_overscan_start,
-        parallel_empty_traps_between_columns,
-        parallel_empty_traps_for_first_transfers,
-        parallel_force_release_away_from_readout,
-        parallel_use_integer_express_matrix,
-        parallel_n_pumps,
-        parallel_roe_type,
+        np.ndarray[np.double_t, ndim=1] parallel_dwell_times,
+        int parallel_prescan_offset,
+        int parallel_overscan_start,
+        int parallel_empty_traps_between_columns,
+        int parallel_empty_traps_for_first_transfers,
+        int parallel_force_release_away_from_readout,
+        int parallel_use_integer_express_matrix,
+        int parallel_n_pumps,
+        int parallel_roe_type,
         # CCD
-        &parallel_fraction_of_traps_per_phase[0],
-        len(parallel_fraction_of_traps_per_phase),
-        &parallel_full_well_depths[0],
-        &parallel_well_notch_depths[0],
-        &parallel_well_fill_powers[0],
-        &parallel_first_electron_fills[0],
+        np.ndarray[np.double_t, ndim=1] parallel_fraction_of_traps_per_phase,
+        np.ndarray[np.double_t, ndim=1] parallel_full_well_depths,
+        np.ndarray[np.double_t, ndim=1] parallel_well_notch_depths,
+        np.ndarray[np.double_t, ndim=1] parallel_well_fill_powers,
+        np.ndarray[np.double_t, ndim=1] parallel_first_electron_fills,
         # Traps
-        &parallel_trap_densities[0],
-        &parallel_trap_release_timescales[0],
-        &parallel_trap_third_params[0],
-        &parallel_trap_fourth_params[0],
-        parallel_n_traps_ic,
-        parallel_n_traps_sc,
-        parallel_n_traps_ic_co,
-        parallel_n_traps_sc_co,
+        np.ndarray[np.double_t, ndim=1] parallel_trap_densities,
+        np.ndarray[np.double_t, ndim=1] parallel_trap_release_timescales,
+        np.ndarray[np.double_t, ndim=1] parallel_trap_third_params,
+        np.ndarray[np.double_t, ndim=1] parallel_trap_fourth_params,
+        int parallel_n_traps_ic,
+        int parallel_n_traps_sc,
+        int parallel_n_traps_ic_co,
+        int parallel_n_traps_sc_co,
         # Misc
-        parallel_express,
-        parallel_window_offset,
-        parallel_window_start,
-        parallel_window_stop,
-        parallel_time_start,
-        parallel_time_stop,
-        &parallel_prune_n_electrons[0], 
-        parallel_prune_frequency,
+        int parallel_express,
+        int parallel_window_offset,
+        int parallel_window_start,
+        int parallel_window_stop,
+        int parallel_time_start,
+        int parallel_time_stop,
+        np.ndarray[np.double_t, ndim=1] parallel_prune_n_electrons, 
+        int parallel_prune_frequency,
         # ========
         # Serial
         # ========
         # ROE
-        &serial_dwell_times[0],
-        len(serial_dwell_times),
-        serial_prescan_offset,
-        serial_overscan_start,
-        serial_empty_traps_between_columns,
-        serial_empty_traps_for_first_transfers,
-        serial_force_release_away_from_readout,
-        serial_use_integer_express_matrix,
-        serial_n_pumps,
-        serial_roe_type,
+        np.ndarray[np.double_t, ndim=1] serial_dwell_times,
+        int serial_prescan_offset,
+        int serial_overscan_start,
+        int serial_empty_traps_between_columns,
+        int serial_empty_traps_for_first_transfers,
+        int serial_force_release_away_from_readout,
+        int serial_use_integer_express_matrix,
+        int serial_n_pumps,
+        int serial_roe_type,
         # CCD
-        &serial_fraction_of_traps_per_phase[0],
-        len(serial_fraction_of_traps_per_phase),
-        &serial_full_well_depths[0],
-        &serial_well_notch_depths[0],
-        &serial_well_fill_powers[0],
-        &serial_first_electron_fills[0],
+        np.ndarray[np.double_t, ndim=1] serial_fraction_of_traps_per_phase,
+        np.ndarray[np.double_t, ndim=1] serial_full_well_depths,
+        np.ndarray[np.double_t, ndim=1] serial_well_notch_depths,
+        np.ndarray[np.double_t, ndim=1] serial_well_fill_powers,
+        np.ndarray[np.double_t, ndim=1] serial_first_electron_fills,
         # Traps
-        &serial_trap_densities[0],
-        &serial_trap_release_timescales[0],
-        &serial_trap_third_params[0],
-        &serial_trap_fourth_params[0],
-        serial_n_traps_ic,
-        serial_n_traps_sc,
-        serial_n_traps_ic_co,
-        serial_n_traps_sc_co,
+        np.ndarray[np.double_t, ndim=1] serial_trap_densities,
+        np.ndarray[np.double_t, ndim=1] serial_trap_release_timescales,
+        np.ndarray[np.double_t, ndim=1] serial_trap_third_params,
+        np.ndarray[np.double_t, ndim=1] serial_trap_fourth_params,
+        int serial_n_traps_ic,
+        int serial_n_traps_sc,
+        int serial_n_traps_ic_co,
+        int serial_n_traps_sc_co,
         # Misc
-        serial_express,
-        serial_window_offset,
-        serial_window_start,
-        serial_window_stop,
-        serial_time_start,
-        serial_time_stop,
-        &serial_prune_n_electrons[0], 
-        serial_prune_frequency,
+        int serial_express,
+        int serial_window_offset,
+        int serial_window_start,
+        int serial_window_stop,
+        int serial_time_start,
+        int serial_time_stop,
+        np.ndarray[np.double_t, ndim=1] serial_prune_n_electrons, 
+        int serial_prune_frequency,
         # ========
         # Combined
         # ========
-        allow_negative_pixels,
-        # Output
-        verbosity,
-        iteration
+        int allow_negative_pixels,
+        # Threads
+        int column_schedule,
+    ):
+        cdef int parallel_n_steps = len(parallel_dwell_times)
+        cdef int parallel_n_phases = len(parallel_fraction_of_traps_per_phase)
+        cdef int serial_n_steps = len(serial_dwell_times)
+        cdef int serial_n_phases = len(serial_fraction_of_traps_per_phase)
+
+        self.c_model = new_cti_model(
+            # ========
+            # Parallel
+            # ========
+            # ROE
+            &parallel_dwell_times[0],
+            parallel_n_steps,
+            parallel_prescan_offset,
+            parallel_overscan_start,
+            parallel_empty_traps_between_columns,
+            parallel_empty_traps_for_first_transfers,
+            parallel_force_release_away_from_readout,
+            parallel_use_integer_express_matrix,
+            parallel_n_pumps,
+            parallel_roe_type,
+            # CCD
+            &parallel_fraction_of_traps_per_phase[0],
+            parallel_n_phases,
+            &parallel_full_well_depths[0],
+            &parallel_well_notch_depths[0],
+            &parallel_well_fill_powers[0],
+            &parallel_first_electron_fills[0],
+            # Traps
+            &parallel_trap_densities[0],
+            &parallel_trap_release_timescales[0],
+            &parallel_trap_third_params[0],
+            &parallel_trap_fourth_params[0],
+            parallel_n_traps_ic,
+            parallel_n_traps_sc,
+            parallel_n_traps_ic_co,
+            parallel_n_traps_sc_co,
+            # Misc
+            parallel_express,
+            parallel_window_offset,
+            parallel_window_start,
+            parallel_window_stop,
+            parallel_time_start,
+            parallel_time_stop,
+            &parallel_prune_n_electrons[0], 
+            parallel_prune_frequency,
+            # ========
+            # Serial
+            # ========
+            # ROE
+            &serial_dwell_times[0],
+            serial_n_steps,
+            serial_prescan_offset,
+            serial_overscan_start,
+            serial_empty_traps_between_columns,
+            serial_empty_traps_for_first_transfers,
+            serial_force_release_away_from_readout,
+            serial_use_integer_express_matrix,
+            serial_n_pumps,
+            serial_roe_type,
+            # CCD
+            &serial_fraction_of_traps_per_phase[0],
+            serial_n_phases,
+            &serial_full_well_depths[0],
+            &serial_well_notch_depths[0],
+            &serial_well_fill_powers[0],
+            &serial_first_electron_fills[0],
+            # Traps
+            &serial_trap_densities[0],
+            &serial_trap_release_timescales[0],
+            &serial_trap_third_params[0],
+            &serial_trap_fourth_params[0],
+            serial_n_traps_ic,
+            serial_n_traps_sc,
+            serial_n_traps_ic_co,
+            serial_n_traps_sc_co,
+            # Misc
+            serial_express,
+            serial_window_offset,
+            serial_window_start,
+            serial_window_stop,
+            serial_time_start,
+            serial_time_stop,
+            &serial_prune_n_electrons[0], 
+            serial_prune_frequency,
+            # ========
+            # Combined
+            # ========
+            allow_negative_pixels,
+            # Threads
+            column_schedule,
+        )
+
+    def __dealloc__(self):
+        del self.c_model
+
+    def set_pixel_bounces(self, kA, kv, gamma, omega):
+        """
+        Set the model's pixel bounce, from arrays of each parameter, to be
+        added to each row as it is clocked in the serial direction. See
+        CTIModel in src/model.cpp.
+        """
+        self.c_model.model.pixel_bounces = pixel_bounce_vector(kA, kv, gamma, omega)
+
+    def clock(self, np.ndarray image, int verbosity, int iteration, int n_iterations):
+        """
+        Add CTI to the image(s), or remove CTI if n_iterations > 0, with this
+        model. See clock_images() in interface.cpp.
+
+        The image can be either 2D or a 3D stack of images, which are all
+        modified in place, directly in the array's memory, including for
+        non-contiguous views. A float32 image is clocked in double via a
+        temporary copy, see clock_charge_in_images() in src/cti.cpp, otherwise
+        it must be float64. See check_clockable() for the
+        requirements.
+
+        The GIL is released while the C++ runs, so other python threads (e.g.
+        Dask workers) can run, or clock other images with other models, at
+        the same time.
+        """
+        if not check_clockable(image):
+            raise ValueError(
+                "Expected a writeable, native float32 or float64 array with "
+                "whole-pixel strides, not %s with strides %s"
+                % (image.dtype, image.strides)
+            )
+
+        # The image(s) shape and strides in pixels
+        cdef void* image_data = np.PyArray_DATA(image)
+        cdef bint image_is_float = image.dtype == np.float32
+        cdef int n_images = 1 if image.ndim == 2 else image.shape[0]
+        cdef int n_rows = image.shape[image.ndim - 2]
+        cdef int n_columns = image.shape[image.ndim - 1]
+        cdef long image_stride = 0 if image.ndim == 2 else image.strides[0] // image.itemsize
+        cdef long row_stride = image.strides[image.ndim - 2] // image.itemsize
+        cdef long column_stride = image.strides[image.ndim - 1] // image.itemsize
+
+        with nogil:
+            clock_images(
+                self.c_model,
+                image_data,
+                image_is_float,
+                n_images,
+                n_rows,
+                n_columns,
+                image_stride,
+                row_stride,
+                column_stride,
+                verbosity,
+                iteration,
+                n_iterations,
+            )
+
+        return image
+
+    def estimate_residual_covariances(
+        self,
+        np.ndarray[np.float64_t, ndim=3] sky_frames,
+        np.ndarray[np.float64_t, ndim=3] noise_frames,
+        double read_noise_amp,
+        double read_noise_amp_fraction,
+        int smooth_col,
+        double out_scale,
+        int n_sr_iterations,
+        np.ndarray[np.float64_t, ndim=1] sr_fractions,
+        int matrix_size,
+        int fpr_size,
+    ):
+        """
+        Measure the residual covariance after S+R separation and CTI correction
+        of simulated images, for each S+R fraction, with this model. See
+        estimate_residual_covariances() in read_noise.cpp.
+
+        Returns the (n_sr_fractions, matrix_size, matrix_size) covariance
+        matrices and the benchmark matrix without CTI.
+        """
+        sky_frames = np.ascontiguousarray(sky_frames)
+        noise_frames = np.ascontiguousarray(noise_frames)
+        sr_fractions = np.ascontiguousarray(sr_fractions)
+        cdef int n_realisations = sky_frames.shape[0]
+        cdef int n_rows = sky_frames.shape[1]
+        cdef int n_columns = sky_frames.shape[2]
+        cdef int n_sr_fractions = sr_fractions.shape[0]
+        cdef np.ndarray[np.float64_t, ndim=3] covariances = np.empty(
+            (n_sr_fractions, matrix_size, matrix_size), dtype=np.float64
+        )
+        cdef np.ndarray[np.float64_t, ndim=2] covariance_benchmark = np.empty(
+            (matrix_size, matrix_size), dtype=np.float64
+        )
+        cdef double* c_sky_frames = &sky_frames[0, 0, 0]
+        cdef double* c_noise_frames = &noise_frames[0, 0, 0]
+        cdef double* c_sr_fractions = &sr_fractions[0]
+        cdef double* c_covariances = &covariances[0, 0, 0]
+        cdef double* c_covariance_benchmark = &covariance_benchmark[0, 0]
+
+        with nogil:
+            estimate_residual_covariances(
+                c_sky_frames,
+                c_noise_frames,
+                n_realisations,
+                n_rows,
+                n_columns,
+                self.c_model.model[0],
+                read_noise_amp,
+                read_noise_amp_fraction,
+                smooth_col,
+                out_scale,
+                n_sr_iterations,
+                c_sr_fractions,
+                n_sr_fractions,
+                matrix_size,
+                fpr_size,
+                c_covariances,
+                c_covariance_benchmark,
+            )
+
+        return covariances, covariance_benchmark
+
+    def add_density_sweep(
+        self,
+        np.ndarray[np.float64_t, ndim=2] image,
+        int n_models,
+        parallel_trap_densities,
+        serial_trap_densities,
+        int verbosity,
+    ):
+        """
+        Add CTI trails to copies of the image for each of several models that
+        only differ in their instant-capture and slow-capture trap densities,
+        all clocked together. See add_cti_density_sweep() in src/model.cpp.
+
+        The densities are either None, to use this model's own, or a
+        (n_models, n_traps_ic + n_traps_sc) array for that direction.
+
+        Returns the (n_models, n_rows, n_columns) images.
+        """
+        cdef int n_rows = image.shape[0]
+        cdef int n_columns = image.shape[1]
+        cdef np.ndarray[np.float64_t, ndim=3] images = np.empty(
+            (n_models, n_rows, n_columns), dtype=np.float64
+        )
+        images[...] = image
+        cdef vector[double*] image_pointers
+        cdef int i_model
+        for i_model in range(n_models):
+            image_pointers.push_back(&images[i_model, 0, 0])
+
+        cdef np.ndarray[np.float64_t, ndim=2] parallel_densities
+        cdef np.ndarray[np.float64_t, ndim=2] serial_densities
+        cdef double* c_parallel_densities = NULL
+        cdef double* c_serial_densities = NULL
+        if parallel_trap_densities is not None:
+            parallel_densities = np.ascontiguousarray(
+                parallel_trap_densities, dtype=np.float64
+            )
+            c_parallel_densities = &parallel_densities[0, 0]
+        if serial_trap_densities is not None:
+            serial_densities = np.ascontiguousarray(
+                serial_trap_densities, dtype=np.float64
+            )
+            c_serial_densities = &serial_densities[0, 0]
+
+        with nogil:
+            add_cti_density_sweep(
+                image_pointers.data(),
+                n_models,
+                n_rows,
+                n_columns,
+                n_columns,
+                1,
+                self.c_model.model[0],
+                c_parallel_densities,
+                c_serial_densities,
+                verbosity,
+            )
+
+        return images
+
+
+def cy_add_cti(np.ndarray image, *args):
+    """
+    Deprecated, use cy_CTIModel (or CTIModel in cti.py) to prepare the model
+    once and then clock any number of images with it.
+
+    Takes the same parameters as before: those of cy_CTIModel, with verbosity
+    and iteration before column_schedule, then n_iterations to remove CTI if
+    > 0. Clocks the image in place with a temporary model and returns it.
+    """
+    warnings.warn(
+        "cy_add_cti() is deprecated, use cy_CTIModel or arcticpy.CTIModel instead",
+        DeprecationWarning,
+        stacklevel=2,
     )
+    verbosity, iteration, column_schedule, n_iterations = args[-4:]
+    model = cy_CTIModel(*args[:-4], column_schedule)
 
-    return image
+    return model.clock(image, verbosity, iteration, n_iterations)
@@ -1,99 +1,781 @@
 
 #include "cti.hpp"
 
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/time.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
 #include <valarray>
+#include <vector>
 #include <iostream>
 
 #include "ccd.hpp"
+#include "model.hpp"
+#include "profile.hpp"
 #include "roe.hpp"
 #include "trap_managers.hpp"
 #include "traps.hpp"
 #include "util.hpp"
 
 /*
-    Add CTI trails to an image by trapping, releasing, and moving electrons
-    along their independent columns.
+    The number of adjacent columns in each tile for clock_charge_in_one_direction(),
+    so that copying a tile reads whole 64-byte cache lines of a row-major image.
+*/
+static const unsigned int n_tile_columns = 8;
 
-    See add_cti() for more detail and e.g. parallel vs serial clocking.
+/*
+    Estimate the relative cost of clocking each tile of columns, to schedule the
+    most expensive first, e.g. for columns with bright sources that create many
+    more watermarks.
+
+    The estimate is the number of pixels plus the total charge above the
+    lowest well notch depth, in the active region of each tile. See
+    clock_charge_in_one_direction() for the parameters.
+
+    Returns
+    -------
+    tile_costs : std::valarray<double>
+        The estimated cost of each tile.
+*/
+std::valarray<double> estimate_tile_costs(
+    double* image, long row_stride, long column_stride, int row_start,
+    int n_active_rows, int column_start, int n_active_columns, CCD* ccd) {
+    int n_tiles = (n_active_columns + n_tile_columns - 1) / n_tile_columns;
+    std::valarray<double> tile_costs(0.0, n_tiles);
+
+    double notch_depth = ccd->phases[0].well_notch_depth;
+    for (int i_phase = 1; i_phase < ccd->n_phases; i_phase++)
+        notch_depth = std::min(notch_depth, ccd->phases[i_phase].well_notch_depth);
+
+    for (int i_row = 0; i_row < n_active_rows; i_row++) {
+        double* row = image + (row_start + i_row) * row_stride;
+
+        for (int i_column = 0; i_column < n_active_columns; i_column++) {
+            double n_electrons = row[(column_start + i_column) * column_stride];
+
+            tile_costs[i_column / n_tile_columns] +=
+                1.0 + std::max(n_electrons - notch_depth, 0.0);
+        }
+    }
+
+    return tile_costs;
+}
+
+// ========
+// ColumnCheckpoints::
+// ========
+/*
+    Class ColumnCheckpoints.
+
+    Saved trap states at regular intervals of rows in one column, to restart
+    clocking the column part way through if only its later pixels change,
+    e.g. between the iterations of removing CTI. See ClockingModel::clock().
+
+    Only valid for columns whose charge doesn't depend on the pixels either
+    side, i.e. with a single-step clock sequence and single-phase pixels, and
+    with the traps emptied between columns.
+
+    Attributes
+    ----------
+    interval : int
+        The number of modelled rows between checkpoints.
+
+    n_checkpoints : int
+        The number of checkpoints in each express pass, the first being the
+        start of the column.
+
+    i_restart : int
+        The checkpoint to start clocking the column from, for every express
+        pass, or -1 to skip the column. Set before each clocking.
+
+    i_stop : int
+        The checkpoint to stop clocking the column at, saving the trap states
+        there to restart from later, or -1 to clock to the end of the column.
+
+    i_first_kept : int
+        The first checkpoint whose states are kept, 0 unless only a window of
+        them is, see reset_window().
+
+    is_recorded : bool
+        Whether the column has been clocked with these checkpoints.
+
+    states : std::vector<std::vector<double> >
+        The saved trap states at each checkpoint of each express pass, see
+        TrapManagerManager::save_trap_states() and state(). The first of each
+        pass isn't used, since restarting from the start is just clocking the
+        column as normal.
+
+    use_restart_states : std::vector<bool>
+        Whether each express pass starts from its saved states at i_restart,
+        instead of the restored states from the previous pass, if already
+        known. Otherwise (if empty) worked out from the rows before i_restart.
+
+    pixels_in, pixels_out : std::valarray<double>
+        The modelled rows of the column before and after it was last clocked.
+        The kept input rows are those from which the kept output was modelled.
+*/
+ColumnCheckpoints::ColumnCheckpoints()
+    : interval(0),
+      n_checkpoints(0),
+      i_restart(0),
+      i_stop(-1),
+      i_first_kept(0),
+      is_recorded(false) {}
+
+/*
+    Discard any saved checkpoints and set up for a new size of column.
 
     Parameters
     ----------
-    image_in : std::valarray<std::valarray<double> >
-        The input array of pixel values, assumed to be in units of electrons.
+    interval : int
+        The number of modelled rows between checkpoints.
 
-        The first dimension is the "row" index, the second is the "column"
-        index. Charge is transferred "up" from row N to row 0 along each
-        independent column.
+    n_express_passes, n_active_rows : int
+        The numbers of express passes and modelled rows.
+*/
+void ColumnCheckpoints::reset(int interval, int n_express_passes, int n_active_rows) {
+    this->interval = interval;
+    n_checkpoints = (n_active_rows + interval - 1) / interval;
+    i_restart = 0;
+    i_stop = -1;
+    i_first_kept = 0;
+    is_recorded = false;
+    states.assign(n_express_passes * n_checkpoints, std::vector<double>());
+    use_restart_states.clear();
+    pixels_in.resize(n_active_rows);
+    pixels_out.resize(n_active_rows);
+}
+
+/*
+    Set up to clock the column one window of rows at a time, e.g. as they are
+    streamed in, see add_cti_streaming(). Only the states at the start and
+    stop of the current window are kept, starting with the first interval.
+
+    Parameters
+    ----------
+    interval : int
+        The number of modelled rows in each window.
+
+    n_express_passes : int
+        The number of express passes.
+*/
+void ColumnCheckpoints::reset_window(int interval, int n_express_passes) {
+    this->interval = interval;
+    n_checkpoints = 2;
+    i_restart = 0;
+    i_stop = 1;
+    i_first_kept = 0;
+    is_recorded = false;
+    states.assign(n_express_passes * n_checkpoints, std::vector<double>());
+    use_restart_states.clear();
+}
+
+/*
+    Move the window on to the next interval of rows, to restart from the
+    states saved at the stop of the current one.
+*/
+void ColumnCheckpoints::advance_window() {
+    for (unsigned int i_state = 0; i_state < states.size(); i_state += 2)
+        states[i_state].swap(states[i_state + 1]);
+    i_restart++;
+    i_stop++;
+    i_first_kept++;
+}
+
+/*
+    The saved trap states of one express pass at one checkpoint.
+*/
+std::vector<double>& ColumnCheckpoints::state(int express_index, int i_checkpoint) {
+    return states[express_index * n_checkpoints + i_checkpoint - i_first_kept];
+}
+
+// ========
+// TrapStateSnapshot::
+// ========
+/*
+    Class TrapStateSnapshot.
+
+    The trap states of every column of one or more images part way through the
+    readout, i.e. between two express passes, that can be written to and read
+    from a file. Clocking can then be split into ranges of express passes
+    (time_start, time_stop), e.g. in separate jobs, with each continuing from
+    the image and the trap states at the end of the previous range, with the
+    same result as clocking them all at once. See clock_charge_in_images().
+
+    Requires the traps to be emptied between columns.
+
+    Attributes
+    ----------
+    time : int
+        The express pass from which the trap states continue, i.e. the
+        time_stop of the range that saved them, and the time_start of the next.
+
+    n_images, n_columns : int
+        The number of images and columns in each image, with the charge
+        transferred along each column, e.g. rows for serial clocking.
+
+    states : std::vector<std::vector<double> >
+        The trap states of each column of each image, see
+        TrapManagerManager::save_trap_states(), indexed by i_image * n_columns
+        + column_index. Empty for columns that weren't modelled.
+*/
+TrapStateSnapshot::TrapStateSnapshot() : time(0), n_images(0), n_columns(0) {}
+
+/*
+    Discard any saved trap states and set up for a new time and number of
+    columns, with all the columns' states empty.
+*/
+void TrapStateSnapshot::reset(int time, int n_images, int n_columns) {
+    this->time = time;
+    this->n_images = n_images;
+    this->n_columns = n_columns;
+    states.assign((long)n_images * n_columns, std::vector<double>());
+}
+
+/*
+    The saved trap states of one column of one image.
+*/
+std::vector<double>& TrapStateSnapshot::state(int i_image, int column_index) {
+    return states[(long)i_image * n_columns + column_index];
+}
+const std::vector<double>& TrapStateSnapshot::state(
+    int i_image, int column_index) const {
+    return states[(long)i_image * n_columns + column_index];
+}
+
+// The identifier and version at the start of a trap state snapshot file
+static const char snapshot_magic[8] = {'A', 'R', 'C', 'T', 'I', 'C', 'T', 'S'};
+static const int32_t snapshot_version = 1;
+
+/*
+    Write the snapshot to a binary file, in native byte order: the identifier
+    "ARCTICTS", then the int32 version, time, n_images, and n_columns, then for
+    each column the int64 number of values and the double trap states.
+
+    Parameters
+    ----------
+    filename : const char*
+        The file to write, replacing any existing one.
+*/
+void TrapStateSnapshot::write(const char* filename) const {
+    FILE* f = fopen(filename, "wb");
+    if (!f) error("Failed to open trap state snapshot file %s", filename);
+
+    int32_t header[4] = {snapshot_version, time, n_images, n_columns};
+    bool is_written = (fwrite(snapshot_magic, 1, sizeof(snapshot_magic), f) ==
+                       sizeof(snapshot_magic)) &&
+                      (fwrite(header, sizeof(int32_t), 4, f) == 4);
+    for (unsigned long i_state = 0; is_written && (i_state < states.size());
+         i_state++) {
+        int64_t n_values = states[i_state].size();
+        is_written = (fwrite(&n_values, sizeof(int64_t), 1, f) == 1) &&
+                     (fwrite(states[i_state].data(), sizeof(double), n_values, f) ==
+                      (size_t)n_values);
+    }
+    is_written = (fclose(f) == 0) && is_written;
+
+    if (!is_written) error("Failed to write trap state snapshot file %s", filename);
+}
+
+/*
+    Read the snapshot from a binary file written by write(), replacing any
+    saved trap states.
+
+    Parameters
+    ----------
+    filename : const char*
+        The file to read.
+*/
+void TrapStateSnapshot::read(const char* filename) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) error("Failed to open trap state snapshot file %s", filename);
+
+    char magic[sizeof(snapshot_magic)];
+    int32_t header[4];
+    if ((fread(magic, 1, sizeof(magic), f) != sizeof(magic)) ||
+        (memcmp(magic, snapshot_magic, sizeof(magic)) != 0) ||
+        (fread(header, sizeof(int32_t), 4, f) != 4) ||
+        (header[0] != snapshot_version))
+        error("Not a trap state snapshot file (version %d): %s", snapshot_version, filename);
+    reset(header[1], header[2], header[3]);
+
+    for (unsigned long i_state = 0; i_state < states.size(); i_state++) {
+        int64_t n_values;
+        if (fread(&n_values, sizeof(int64_t), 1, f) != 1)
+            error("Truncated trap state snapshot file %s", filename);
+        states[i_state].resize(n_values);
+        if (fread(states[i_state].data(), sizeof(double), n_values, f) !=
+            (size_t)n_values)
+            error("Truncated trap state snapshot file %s", filename);
+    }
+
+    fclose(f);
+}
+
+/*
+    Bit flags for the families of traps present, to choose the specialised
+    instantiation of clock_charge_in_one_column_kernel().
+
+    trap_families_any checks the numbers of each family of traps at run time
+    instead, for the general (and traced) version.
+*/
+enum TrapFamilies {
+    trap_family_ic = 1,
+    trap_family_sc = 2,
+    trap_family_ic_co = 4,
+    trap_family_sc_co = 8,
+    trap_families_any = -1
+};
+
+/*
+    Clock the charge in one pixel of a column through its traps, for each step
+    of the clock sequence and phase of the pixel, modifying the column in
+    place. The per-pixel step of clock_charge_in_one_column_kernel(), with the
+    same template parameters, and of the ensemble kernel for each model.
+
+    Parameters
+    ----------
+    column, row_stride, column_index, n_rows, buffer_row_start : *
+        See clock_charge_in_one_column().
+
+    row_index : unsigned int
+        The row of the pixel.
+
+    express_multiplier : double
+        The number of transfers that this one represents.
 
     roe : ROE*
     ccd : CCD*
-    traps_ic : std::valarray<TrapInstantCapture>*
-    traps_sc : std::valarray<TrapSlowCapture>*
-    traps_ic_co : std::valarray<TrapInstantCaptureContinuum>*
-    traps_sc_co : std::valarray<TrapSlowCaptureContinuum>*
-    express : int (opt.)
-    row_offset : int (opt.)
-        See add_cti()'s docstring. Same as the corresponding parallel_*
-        parameters.
+    trap_manager_manager : TrapManagerManager&
+        The set-up readout electronics and CCD, and the trap managers of the
+        column, with the trap states as at the start of the pixel.
 
-    row_start, row_stop : int (opt.)
-        The subset of row pixels to model, to save time when only a specific
-        region of the image is of interest. Defaults to 0, n_rows for the full
-        image.
+    allow_negative_pixels : int
+        See clock_charge_in_one_direction().
 
-        For trap pumping, it is currently assumed that only a single pixel is
-        active and contains traps, so row_stop must be row_start + 1. See
-        ROETrapPumping for more detail.
+    are_traps_empty : bool&
+        Whether the traps are still empty, updated once they capture.
+*/
+template <bool trace, int trap_families, bool one_step_phase>
+static inline void clock_charge_in_one_pixel(
+    double* column, long row_stride, int column_index, int n_rows,
+    int buffer_row_start, unsigned int row_index, double express_multiplier, ROE* roe,
+    CCD* ccd, TrapManagerManager& trap_manager_manager, int allow_negative_pixels,
+    bool& are_traps_empty) {
 
-    column_start, column_stop : int (opt.)
-        The subset of column pixels to model, to save time when only a specific
-        region of the image is of interest. Defaults to 0, n_columns for the
-        full image.
+    unsigned int row_read;
+    unsigned int row_write;
+    double n_free_electrons;
+    double n_electrons_released_and_captured;
+    ROEStepPhase* roe_step_phase;
 
-    print_inputs : int (opt.)
-        Whether or not to print the model inputs. Defaults to True if
-        verbosity >= 1.
+    // Which families of traps to release and capture with
+    const bool use_ic = (trap_families == trap_families_any)
+                            ? (trap_manager_manager.n_traps_ic > 0)
+                            : ((trap_families & trap_family_ic) != 0);
+    const bool use_sc = (trap_families == trap_families_any)
+                            ? (trap_manager_manager.n_traps_sc > 0)
+                            : ((trap_families & trap_family_sc) != 0);
+    const bool use_ic_co = (trap_families == trap_families_any)
+                               ? (trap_manager_manager.n_traps_ic_co > 0)
+                               : ((trap_families & trap_family_ic_co) != 0);
+    const bool use_sc_co = (trap_families == trap_families_any)
+                               ? (trap_manager_manager.n_traps_sc_co > 0)
+                               : ((trap_families & trap_family_sc_co) != 0);
+    const unsigned int n_steps = one_step_phase ? 1 : roe->n_steps;
+    const unsigned int n_phases = one_step_phase ? 1 : ccd->n_phases;
+
+    // Make room for this pixel's new watermarks, if not preallocated
+    if (trap_manager_manager.watermarks_on_demand)
+        trap_manager_manager.ensure_watermark_capacity(n_steps);
+
+    // Each step in the clock sequence
+    for (unsigned int i_step = 0; i_step < n_steps; i_step++) {
+
+        // Each phase in the pixel
+        for (unsigned int i_phase = 0; i_phase < n_phases; i_phase++) {
+
+            if (trace && ((n_steps > 1) || (n_phases > 1)))
+                print_v(2, "#  i_step, i_phase  %d,  %d \n", i_step, i_phase);
+
+            // State of the ROE in this step and phase of the sequence
+            roe_step_phase = &roe->clock_sequence[i_step][i_phase];
+
+            // Get the initial charge from the relevant pixel(s)
+            n_free_electrons = 0;
+            for (int i = 0; i < roe_step_phase->n_capture_pixels; i++) {
+                row_read = row_index + roe_step_phase->capture_from_which_pixels[i];
+
+                // Multiple phases can reach past the end of the column, where
+                // there's no charge
+                if (!one_step_phase && (row_read >= (unsigned int)n_rows)) continue;
+
+                n_free_electrons += column[(row_read - buffer_row_start) * row_stride];
+            }
+
+            if (trace) {
+                print_v(2, "row_read  %d \n", row_read);
+                print_v(2, "n_free_electrons  %g \n", n_free_electrons);
+            }
+
+            // Release and capture electrons with the traps in this
+            // pixel/phase, for each type of traps
+            n_electrons_released_and_captured = 0;
+
+            // Nothing can be released or captured while the traps are empty
+            // and the cloud doesn't reach any volume, e.g. in the empty
+            // background of a sparse image, so skip these pixels until there's
+            // charge that could be captured. The trace version models every
+            // pixel, as a reference
+            if (trace || !are_traps_empty ||
+                (ccd->phases[i_phase].cloud_fractional_volume_from_electrons(
+                     n_free_electrons) != 0.0)) {
+                are_traps_empty = false;
+                if (use_ic)
+                    n_electrons_released_and_captured +=
+                        trap_manager_manager.trap_managers_ic[i_phase]
+                            .n_electrons_released_and_captured(
+                                n_free_electrons + n_electrons_released_and_captured);
+                if (use_sc)
+                    n_electrons_released_and_captured +=
+                        trap_manager_manager.trap_managers_sc[i_phase]
+                            .n_electrons_released_and_captured(
+                                n_free_electrons + n_electrons_released_and_captured);
+                if (use_ic_co)
+                    n_electrons_released_and_captured +=
+                        trap_manager_manager.trap_managers_ic_co[i_phase]
+                            .n_electrons_released_and_captured(
+                                n_free_electrons + n_electrons_released_and_captured);
+                if (use_sc_co)
+                    n_electrons_released_and_captured +=
+                        trap_manager_manager.trap_managers_sc_co[i_phase]
+                            .n_electrons_released_and_captured(
+                                n_free_electrons + n_electrons_released_and_captured);
+            }
+
+            if (trace) {
+                print_v(
+                    2, "n_electrons_released_and_captured  %g \n",
+                    n_electrons_released_and_captured);
+
+                if (use_ic)
+                    print_v(
+                        2, "n_trapped_electrons_from_watermarks  %g \n",
+                        trap_manager_manager.trap_managers_ic[i_phase]
+                            .n_trapped_electrons_from_watermarks(
+                                trap_manager_manager.trap_managers_ic[i_phase]
+                                    .watermark_volumes,
+                                trap_manager_manager.trap_managers_ic[i_phase]
+                                    .watermark_fills));
+
+                print_v(2, "n_free_electrons  %g \n", n_free_electrons);
+            }
+
+            // Return the charge to the relevant pixel(s)
+            for (int i = 0; i < roe_step_phase->n_release_pixels; i++) {
+                row_write = row_index + roe_step_phase->release_to_which_pixels[i];
+
+                // Charge released past the end of the column is lost
+                if (!one_step_phase && (row_write >= (unsigned int)n_rows)) continue;
+
+                double& pixel = column[(row_write - buffer_row_start) * row_stride];
+                pixel += n_electrons_released_and_captured * express_multiplier *
+                         roe_step_phase->release_fraction_to_pixels[i];
+
+                // Make sure image counts don't go negative, which could happen
+                // with a too-large express multiplier
+                if (!allow_negative_pixels) {
+                    if (pixel < 0.0) pixel = 0.0;
+                }
+
+                if (trace) {
+                    print_v(2, "row_write  %d \n", row_write);
+                    print_v(
+                        2, "image[%d][%d]  %g \n", row_write, column_index, pixel);
+                }
+            }
+        }
+    }
+}
+
+/*
+    Clock the charge in one column of pixels through the column of traps,
+    modifying the column in place. See clock_charge_in_one_column().
+
+    Template parameters
+    -------------------
+    trace : bool
+        Whether to print the verbosity >= 2 details. Compiled out if false.
+
+    trap_families : int
+        The TrapFamilies flags of the traps present, or trap_families_any, so
+        that the calls for each absent family are compiled out.
+
+    one_step_phase : bool
+        Whether the clock sequence has a single step and the pixels a single
+        phase (e.g. the standard parallel and serial cases), so that those
+        loops are compiled out.
+*/
+template <bool trace, int trap_families, bool one_step_phase>
+static void clock_charge_in_one_column_kernel(
+    double* column, long row_stride, int column_index, int n_rows, int row_start,
+    int n_active_rows, ROE* roe, CCD* ccd, TrapManagerManager& trap_manager_manager,
+    double prune_n_electrons, int prune_frequency, int allow_negative_pixels,
+    ColumnCheckpoints* checkpoints, int buffer_row_start) {
+
+    unsigned int row_index;
+    double express_multiplier;
+    bool are_traps_empty;
+
+    // Start every express pass from this row, if restarting from a checkpoint,
+    // and stop before this one, if stopping at a checkpoint
+    const unsigned int i_row_first =
+        checkpoints ? checkpoints->i_restart * checkpoints->interval : 0;
+    const unsigned int i_row_stop =
+        (checkpoints && (checkpoints->i_stop >= 0))
+            ? std::min(checkpoints->i_stop * checkpoints->interval, n_active_rows)
+            : n_active_rows;
+
+    // Monitor the traps for every transfer (express=n_rows), or just one
+    // (express=1) or a few (express=a few) then replicate their effect
+    for (int express_index = roe->express_pass_start;
+         express_index < roe->express_pass_stop; express_index++) {
+
+        if (trace) print_v(2, "# # #  express_index  %d \n", express_index);
+
+        // Restore the trap occupancy levels, either to empty or to a saved
+        // state from a previous express pass, or from the restart checkpoint
+        // if this pass models any rows before it or the previous pass stored
+        // its states before it. Otherwise, any state stored in the previous
+        // pass is from after the restart, so was just updated
+        bool use_checkpoint = false;
+        if (checkpoints && !checkpoints->use_restart_states.empty())
+            use_checkpoint = checkpoints->use_restart_states[express_index];
+        else if (i_row_first > 0)
+            use_checkpoint = roe->express_pass_depends_on_rows(
+                express_index, row_start, row_start + i_row_first);
+        if (use_checkpoint)
+            trap_manager_manager.load_trap_states(
+                checkpoints->state(express_index, checkpoints->i_restart));
+        else
+            trap_manager_manager.restore_trap_states();
+        are_traps_empty = !trap_manager_manager.any_active_watermarks();
+
+        // The next later checkpoint at which to save the trap states
+        unsigned int i_row_checkpoint =
+            checkpoints ? i_row_first + checkpoints->interval : i_row_stop;
+
+        // Each pixel that this pass models, from the ROE's express schedule
+        const int i_transfer_stop = roe->express_schedule_starts[express_index + 1];
+        for (int i_transfer =
+                 roe->express_schedule_first(express_index, row_start + i_row_first);
+             i_transfer < i_transfer_stop; i_transfer++) {
+            const ROEExpressTransfer& transfer = roe->express_schedule[i_transfer];
+            row_index = transfer.row_index;
+            unsigned int i_row = row_index - row_start;
+            if (i_row >= i_row_stop) break;
+
+            if (trace)
+                print_v(2, "# #  i_row, row_index  %d,  %d \n", i_row, row_index);
+
+            // Save the trap states at each later checkpoint, including any
+            // in the skipped rows since the previous transfer
+            for (; i_row_checkpoint <= i_row; i_row_checkpoint += checkpoints->interval)
+                trap_manager_manager.save_trap_states(checkpoints->state(
+                    express_index, i_row_checkpoint / checkpoints->interval));
+
+            express_multiplier = transfer.express_multiplier;
+            if (express_multiplier == 0) continue;
+
+            if (trace) print_v(2, "express_multiplier  %g \n", express_multiplier);
+
+            clock_charge_in_one_pixel<trace, trap_families, one_step_phase>(
+                column, row_stride, column_index, n_rows, buffer_row_start, row_index,
+                express_multiplier, roe, ccd, trap_manager_manager,
+                allow_negative_pixels, are_traps_empty);
+
+            if (profiling) trap_manager_manager.update_max_n_active_watermarks();
+
+            // Absorb really small watermarks  into others, for speed
+            if (prune_frequency > 0) {
+                if (((i_row + 1) % prune_frequency) == 0) {
+                    trap_manager_manager.prune_watermarks(prune_n_electrons);
+                }
+            }
+            
+            // Store the trap states if needed for the next express pass
+            if (transfer.store_trap_states) {
+                if (trace) print_v(2, "store_trap_states \n");
+                trap_manager_manager.store_trap_states();
+            }
+        }
+
+        // Save the trap states at any checkpoints in the skipped rows after
+        // the last transfer
+        for (; i_row_checkpoint < i_row_stop; i_row_checkpoint += checkpoints->interval)
+            trap_manager_manager.save_trap_states(checkpoints->state(
+                express_index, i_row_checkpoint / checkpoints->interval));
+
+        // Save the trap states to restart from, if stopping part way
+        if (i_row_stop < n_active_rows)
+            trap_manager_manager.save_trap_states(
+                checkpoints->state(express_index, checkpoints->i_stop));
+    }
+}
+
+/*
+    Select the instantiation of clock_charge_in_one_column_kernel() for the
+    given families of traps, for either one or multiple steps and phases.
+*/
+template <bool one_step_phase>
+static ColumnClocker select_column_clocker_for_families(int trap_families) {
+    switch (trap_families) {
+        case 1: return &clock_charge_in_one_column_kernel<false, 1, one_step_phase>;
+        case 2: return &clock_charge_in_one_column_kernel<false, 2, one_step_phase>;
+        case 3: return &clock_charge_in_one_column_kernel<false, 3, one_step_phase>;
+        case 4: return &clock_charge_in_one_column_kernel<false, 4, one_step_phase>;
+        case 5: return &clock_charge_in_one_column_kernel<false, 5, one_step_phase>;
+        case 6: return &clock_charge_in_one_column_kernel<false, 6, one_step_phase>;
+        case 7: return &clock_charge_in_one_column_kernel<false, 7, one_step_phase>;
+        case 8: return &clock_charge_in_one_column_kernel<false, 8, one_step_phase>;
+        case 9: return &clock_charge_in_one_column_kernel<false, 9, one_step_phase>;
+        case 10: return &clock_charge_in_one_column_kernel<false, 10, one_step_phase>;
+        case 11: return &clock_charge_in_one_column_kernel<false, 11, one_step_phase>;
+        case 12: return &clock_charge_in_one_column_kernel<false, 12, one_step_phase>;
+        case 13: return &clock_charge_in_one_column_kernel<false, 13, one_step_phase>;
+        case 14: return &clock_charge_in_one_column_kernel<false, 14, one_step_phase>;
+        case 15: return &clock_charge_in_one_column_kernel<false, 15, one_step_phase>;
+        default:
+            return &clock_charge_in_one_column_kernel<
+                false, trap_families_any, one_step_phase>;
+    }
+}
+
+/*
+    Select the version of the column-clocking function to use for a set of trap
+    managers, ROE, and CCD, once before clocking all the columns.
+
+    The returned function has the same parameters and behaviour as
+    clock_charge_in_one_column(), but without the run-time checks for each
+    family of traps and, if possible, the loops over clock-sequence steps and
+    pixel phases. The detailed printing is only included if verbosity >= 2.
+
+    Parameters
+    ----------
+    trap_manager_manager : TrapManagerManager&
+    roe : ROE*
+    ccd : CCD*
+        The set-up trap manager manager, readout electronics, and CCD objects.
 
     Returns
     -------
-    image : std::valarray<std::valarray<double> >
-        The output array of pixel values.
+    clock_column : ColumnClocker
+        The specialised column-clocking function.
 */
-std::valarray<std::valarray<double> > clock_charge_in_one_direction(
-    std::valarray<std::valarray<double> >& image_in, ROE* roe, CCD* ccd,
-    std::valarray<TrapInstantCapture>* traps_ic,
-    std::valarray<TrapSlowCapture>* traps_sc,
-    std::valarray<TrapInstantCaptureContinuum>* traps_ic_co,
-    std::valarray<TrapSlowCaptureContinuum>* traps_sc_co, 
-    int express, int row_offset,
-    int row_start, int row_stop, 
-    int column_start, int column_stop, 
-    int time_start, int time_stop, 
-    double prune_n_electrons, int prune_frequency,
-    int allow_negative_pixels, int print_inputs) {
-    
-    // Initialise the output image as a copy of the input image
-    std::valarray<std::valarray<double> > image = image_in;
+ColumnClocker select_column_clocker(
+    TrapManagerManager& trap_manager_manager, ROE* roe, CCD* ccd) {
+    // General version with printing
+    if (verbosity >= 2)
+        return &clock_charge_in_one_column_kernel<true, trap_families_any, false>;
+
+    int trap_families = 0;
+    if (trap_manager_manager.n_traps_ic > 0) trap_families |= trap_family_ic;
+    if (trap_manager_manager.n_traps_sc > 0) trap_families |= trap_family_sc;
+    if (trap_manager_manager.n_traps_ic_co > 0) trap_families |= trap_family_ic_co;
+    if (trap_manager_manager.n_traps_sc_co > 0) trap_families |= trap_family_sc_co;
+
+    if ((roe->n_steps == 1) && (ccd->n_phases == 1))
+        return select_column_clocker_for_families<true>(trap_families);
+    else
+        return select_column_clocker_for_families<false>(trap_families);
+}
 
-    // Image shape
-    unsigned int n_rows = image.size();
-    unsigned int n_columns = image[0].size();
+/*
+    Clock the charge in one column of pixels through the column of traps,
+    modifying the column in place. See clock_charge_in_one_direction().
 
-    // Defaults
-    if (row_stop == -1) row_stop = n_rows;
-    if (column_stop == -1) column_stop = n_columns;
+    Parameters
+    ----------
+    column : double*
+        The pixel values in the column, where the pixel in row i is
+        column[i * row_stride].
 
-    // Number of active rows and columns
-    unsigned int n_active_rows = row_stop - row_start;
-    unsigned int n_active_columns = column_stop - column_start;
-    unsigned int max_n_transfers = n_active_rows + row_offset;
-    print_v(
-        1, "%d column(s) [%d to %d], %d row(s) [%d to %d] \n", n_active_columns,
-        column_start, column_stop, n_active_rows, row_start, row_stop);
+    row_stride : long
+        The step in the buffer between adjacent rows of the column.
 
+    column_index : int
+        The index of the column in the full image, only used for printing.
+
+    n_rows, row_start, n_active_rows : int
+        The total number of rows, and the first and number of rows to model.
+
+    roe : ROE*
+    ccd : CCD*
+        The set-up readout electronics and CCD objects.
+
+    trap_manager_manager : TrapManagerManager&
+        The trap managers, with the trap states as at the start of the column.
+
+    prune_n_electrons : double
+    prune_frequency : int
+    allow_negative_pixels : int
+        See clock_charge_in_one_direction().
+
+    checkpoints : ColumnCheckpoints* (opt.)
+        If provided, save the trap states at each of its checkpoints after
+        checkpoints->i_restart, and start each express pass from that saved
+        checkpoint instead of the start of the column. The rows before it
+        must already have their clocked values, and are not modified. If
+        checkpoints->i_stop is set then stop there instead, saving the states.
+
+    buffer_row_start : int (opt.)
+        The row of the column held in column[0], if the buffer only holds the
+        rows from there, e.g. a chunk of rows whose earlier ones are skipped
+        by restarting from the checkpoints. Default 0 for the whole column.
+*/
+void clock_charge_in_one_column(
+    double* column, long row_stride, int column_index, int n_rows, int row_start,
+    int n_active_rows, ROE* roe, CCD* ccd, TrapManagerManager& trap_manager_manager,
+    double prune_n_electrons, int prune_frequency, int allow_negative_pixels,
+    ColumnCheckpoints* checkpoints, int buffer_row_start) {
+
+    ColumnClocker clock_column = select_column_clocker(trap_manager_manager, roe, ccd);
+
+    clock_column(
+        column, row_stride, column_index, n_rows, row_start, n_active_rows, roe, ccd,
+        trap_manager_manager, prune_n_electrons, prune_frequency,
+        allow_negative_pixels, checkpoints, buffer_row_start);
+}
+
+/*
+    Set up the readout electronics' clock sequence and express matrices for
+    clocking images with a given number of rows.
+
+    Parameters
+    ----------
+    roe : ROE*
+    ccd : CCD*
+        The readout electronics to set up, and the CCD to check it against.
+
+    n_rows : int
+        The number of rows in the images, with the charge transferred along
+        each column towards row 0.
+
+    n_active_rows : int
+        The number of rows to model, i.e. row_stop - row_start.
+
+    express, row_offset, time_start, time_stop : int
+        See clock_charge_in_one_direction().
+*/
+void prepare_roe(
+    ROE* roe, CCD* ccd, int n_rows, int n_active_rows, int express, int row_offset,
+    int time_start, int time_stop) {
     // Checks for non-standard modes
     if ((roe->type == roe_type_trap_pumping) && (n_active_rows != 1))
         error(
@@ -105,14 +787,59 @@ std::valarray<std::valarray<double> > clock_charge_in_one_direction(
     roe->set_clock_sequence();
     roe->set_express_matrix_from_rows_and_express(n_rows, express, row_offset);
     roe->set_store_trap_states_matrix();
+    roe->set_express_schedule();
+    roe->set_express_pass_range(time_start, time_stop);
     if (ccd->n_phases != roe->n_phases)
         error(
             "Number of CCD phases (%d) and ROE phases (%d) don't match.", ccd->n_phases,
             roe->n_phases);
-    if (!roe->empty_traps_between_columns) {
-        // Account for the complete set of capture/release events that might
-        // need to be tracked if the traps are never reset
-        max_n_transfers *= n_columns;
+}
+
+/*
+    Set up the readout electronics and the trap managers for clocking images of
+    a given size, once for any number of images with the same model.
+
+    Parameters
+    ----------
+    roe : ROE*
+    ccd : CCD*
+    traps_ic, traps_sc, traps_ic_co, traps_sc_co : std::valarray<Trap...>*
+        The readout electronics, CCD, and trap species. See
+        clock_charge_in_one_direction(). The ROE is set up by prepare_roe().
+
+    n_rows : int
+        The number of rows in the images, with the charge transferred along
+        each column towards row 0. Any number of columns can be clocked with
+        the same trap managers, since the watermark arrays only need room for
+        one column's transfers, or else grow on demand.
+
+    n_active_rows : int
+        The number of rows to model, i.e. row_stop - row_start.
+
+    express, row_offset, time_start, time_stop : int
+        See clock_charge_in_one_direction().
+
+    Returns
+    -------
+    trap_manager_manager : TrapManagerManager
+        The set-up trap managers, with empty trap states.
+*/
+TrapManagerManager prepare_clocking(
+    ROE* roe, CCD* ccd, std::valarray<TrapInstantCapture>* traps_ic,
+    std::valarray<TrapSlowCapture>* traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* traps_sc_co, int n_rows, int n_active_rows,
+    int express, int row_offset, int time_start, int time_stop) {
+
+    unsigned int max_n_transfers = n_active_rows + row_offset;
+
+    prepare_roe(
+        roe, ccd, n_rows, n_active_rows, express, row_offset, time_start, time_stop);
+    if (roe->type == roe_type_trap_pumping) {
+        // Each express pass continues from the stored trap states of the
+        // previous one, with each phase capturing more than once per pump
+        max_n_transfers = roe->n_express_passes *
+                          ((roe->n_steps + ccd->n_phases - 1) / ccd->n_phases);
     }
 
     // Set empty arrays for nullptr trap lists
@@ -138,136 +865,964 @@ std::valarray<std::valarray<double> > clock_charge_in_one_direction(
         *traps_ic, *traps_sc, *traps_ic_co, *traps_sc_co, max_n_transfers, *ccd,
         roe->dwell_times);
 
-    unsigned int column_index;
-    unsigned int row_index;
-    unsigned int row_read;
-    unsigned int row_write;
-    double n_free_electrons;
-    double n_electrons_released_and_captured;
-    double express_multiplier;
-    ROEStepPhase* roe_step_phase;
+    // If the traps are never reset then the watermarks might need to track the
+    // capture/release events of every transfer in the image, so start with
+    // enough for one column and grow the arrays only if needed
+    if (!roe->empty_traps_between_columns)
+        trap_manager_manager.watermarks_on_demand = true;
+
+    return trap_manager_manager;
+}
+
+/*
+    Print the model inputs for clock_charge_in_one_direction().
+
+    Parameters
+    ----------
+    roe : ROE*
+    ccd : CCD*
+    trap_manager_manager : TrapManagerManager&
+        The set-up readout electronics, CCD, and trap managers.
+
+    express, row_offset : int
+        See clock_charge_in_one_direction().
+*/
+void print_clocking_inputs(
+    ROE* roe, CCD* ccd, TrapManagerManager& trap_manager_manager, int express,
+    int row_offset) {
+    print_v(2, "\n");
+    printf("  express = %d \n", express);
+    if (row_offset != 0) printf("  row_offset = %d \n", row_offset);
+
+    printf("  ROE type = %d, n_steps = %d \n", roe->type, roe->n_steps);
+    printf("    dwell_times = ");
+    print_array(roe->dwell_times);
+    printf(
+        "    empty_traps_between_columns = %d \n",
+        roe->empty_traps_between_columns);
+    printf(
+        "    empty_traps_for_first_transfers = %d \n",
+        roe->empty_traps_for_first_transfers);
+    if (roe->n_steps != 1)
+        printf(
+            "    force_release_away_from_readout = %d \n",
+            roe->force_release_away_from_readout);
+    if (roe->use_integer_express_matrix)
+        printf(
+            "    use_integer_express_matrix = %d \n",
+            roe->use_integer_express_matrix);
+    if (roe->type == roe_type_trap_pumping)
+        printf("    n_pumps = %d \n", roe->n_pumps);
+
+    printf("  CCD n_phases = %d \n", ccd->n_phases);
+    if (ccd->n_phases != 1) {
+        printf("    fraction_of_traps_per_phase = ");
+        print_array(ccd->fraction_of_traps_per_phase);
+    }
+    for (int i_phase = 0; i_phase < ccd->n_phases; i_phase++) {
+        printf(
+            "    full_well_depth = %g, well_notch_depth = %g, well_fill_power = %g "
+            "\n",
+            ccd->phases[i_phase].full_well_depth,
+            ccd->phases[i_phase].well_notch_depth,
+            ccd->phases[i_phase].well_fill_power);
+    }
+
+    if (trap_manager_manager.n_traps_ic != 0) {
+        printf(
+            "  Instant-capture traps n = %d \n", trap_manager_manager.n_traps_ic);
+        for (int i_trap = 0; i_trap < trap_manager_manager.n_traps_ic; i_trap++) {
+            printf(
+                "    density = %g, release_timescale = %g \n",
+                trap_manager_manager.trap_managers_ic[0].traps[i_trap].density,
+                trap_manager_manager.trap_managers_ic[0]
+                    .traps[i_trap]
+                    .release_timescale);
+            if (trap_manager_manager.trap_managers_ic[0]
+                    .traps[i_trap]
+                    .fractional_volume_full_exposed != 0.0)
+                printf(
+                    "      fractional_volume_none_exposed = %g, "
+                    "fractional_volume_full_exposed = %g \n",
+                    trap_manager_manager.trap_managers_ic[0]
+                        .traps[i_trap]
+                        .fractional_volume_none_exposed,
+                    trap_manager_manager.trap_managers_ic[0]
+                        .traps[i_trap]
+                        .fractional_volume_full_exposed);
+        }
+    }
+    if (trap_manager_manager.n_traps_sc != 0) {
+        printf("  Slow-capture traps n = %d \n", trap_manager_manager.n_traps_sc);
+        for (int i_trap = 0; i_trap < trap_manager_manager.n_traps_sc; i_trap++) {
+            printf(
+                "    density = %g, release_timescale = %g, capture_timescale = %g "
+                "\n",
+                trap_manager_manager.trap_managers_sc[0].traps[i_trap].density,
+                trap_manager_manager.trap_managers_sc[0]
+                    .traps[i_trap]
+                    .release_timescale,
+                trap_manager_manager.trap_managers_sc[0]
+                    .traps[i_trap]
+                    .capture_timescale);
+        }
+    }
+    if (trap_manager_manager.n_traps_ic_co != 0) {
+        printf("  Continuum traps n = %d \n", trap_manager_manager.n_traps_ic_co);
+        for (int i_trap = 0; i_trap < trap_manager_manager.n_traps_ic_co;
+             i_trap++) {
+            printf(
+                "    density = %g, release_timescale = %g, release_timescale_sigma "
+                "= %g "
+                "\n",
+                trap_manager_manager.trap_managers_ic_co[0].traps[i_trap].density,
+                trap_manager_manager.trap_managers_ic_co[0]
+                    .traps[i_trap]
+                    .release_timescale,
+                trap_manager_manager.trap_managers_ic_co[0]
+                    .traps[i_trap]
+                    .release_timescale_sigma);
+        }
+    }
+    if (trap_manager_manager.n_traps_sc_co != 0) {
+        printf(
+            "  Slow-capture continuum traps n = %d \n",
+            trap_manager_manager.n_traps_sc_co);
+        for (int i_trap = 0; i_trap < trap_manager_manager.n_traps_sc_co;
+             i_trap++) {
+            printf(
+                "    density = %g, release_timescale = %g, release_timescale_sigma "
+                "= %g, "
+                "capture_timescale = %g \n",
+                trap_manager_manager.trap_managers_sc_co[0].traps[i_trap].density,
+                trap_manager_manager.trap_managers_sc_co[0]
+                    .traps[i_trap]
+                    .release_timescale,
+                trap_manager_manager.trap_managers_sc_co[0]
+                    .traps[i_trap]
+                    .release_timescale_sigma,
+                trap_manager_manager.trap_managers_sc_co[0]
+                    .traps[i_trap]
+                    .capture_timescale);
+        }
+    }
+    print_v(2, "\n");
+}
+
+/*
+    The trap manager of one phase for one family of traps (0-3 for instant
+    capture, slow capture, and their continuum versions).
+*/
+static TrapManagerBase& trap_manager_of_family(
+    TrapManagerManager& trap_manager_manager, int i_family, int phase_index) {
+    switch (i_family) {
+        case 0: return trap_manager_manager.trap_managers_ic[phase_index];
+        case 1: return trap_manager_manager.trap_managers_sc[phase_index];
+        case 2: return trap_manager_manager.trap_managers_ic_co[phase_index];
+        default: return trap_manager_manager.trap_managers_sc_co[phase_index];
+    }
+}
+
+/*
+    Collect the measurements from each thread's trap managers after clocking a
+    set of columns, for the profile. See clock_charge_in_images() and
+    ClockingProfile.
+*/
+static ClockingProfile profile_clocking(
+    TrapManagerManagerPool* pool, std::valarray<bool>& is_thread_used,
+    TrapManagerManager& trap_manager_manager, ROE* roe, int n_images,
+    int n_active_rows, int n_active_columns, int transfer_axis) {
+
+    ClockingProfile clocking_profile;
+    clocking_profile.transfer_axis = transfer_axis;
+    clocking_profile.n_images = n_images;
+    clocking_profile.n_active_rows = n_active_rows;
+    clocking_profile.n_active_columns = n_active_columns;
+    clocking_profile.n_express_passes = roe->n_express_passes;
+    clocking_profile.n_express_passes_clocked =
+        (long)n_images * n_active_columns * roe->n_express_passes;
+
+    // The trap managers of each family
+    int n_phases = trap_manager_manager.ccd.n_phases;
+    int n_traps[4] = {
+        trap_manager_manager.n_traps_ic, trap_manager_manager.n_traps_sc,
+        trap_manager_manager.n_traps_ic_co, trap_manager_manager.n_traps_sc_co};
+    std::vector<int>* n_watermarks[4] = {
+        &clocking_profile.n_watermarks_ic, &clocking_profile.n_watermarks_sc,
+        &clocking_profile.n_watermarks_ic_co, &clocking_profile.n_watermarks_sc_co};
+    std::vector<int>* max_n_active_watermarks[4] = {
+        &clocking_profile.max_n_active_watermarks_ic,
+        &clocking_profile.max_n_active_watermarks_sc,
+        &clocking_profile.max_n_active_watermarks_ic_co,
+        &clocking_profile.max_n_active_watermarks_sc_co};
+    for (int i_family = 0; i_family < 4; i_family++) {
+        if (n_traps[i_family] == 0) continue;
+
+        max_n_active_watermarks[i_family]->assign(n_phases, 0);
+        for (int phase_index = 0; phase_index < n_phases; phase_index++) {
+            n_watermarks[i_family]->push_back(
+                trap_manager_of_family(trap_manager_manager, i_family, phase_index)
+                    .n_watermarks);
+        }
+    }
+
+    // Combine the threads' counts
+    for (unsigned int i_thread = 0; i_thread < is_thread_used.size(); i_thread++) {
+        if (!is_thread_used[i_thread]) continue;
+        TrapManagerManager& workspace = pool->workspaces[i_thread];
+
+        clocking_profile.n_prunes += workspace.n_prunes;
+        clocking_profile.n_stores += workspace.n_stores;
+        clocking_profile.n_restores += workspace.n_restores;
+        clocking_profile.store_time += workspace.store_time;
+        clocking_profile.restore_time += workspace.restore_time;
+
+        for (int i_family = 0; i_family < 4; i_family++) {
+            if (n_traps[i_family] == 0) continue;
+
+            for (int phase_index = 0; phase_index < n_phases; phase_index++) {
+                TrapManagerBase& trap_manager =
+                    trap_manager_of_family(workspace, i_family, phase_index);
+                int& max_n_active = (*max_n_active_watermarks[i_family])[phase_index];
+                max_n_active =
+                    std::max(max_n_active, trap_manager.max_n_active_watermarks);
+                clocking_profile.n_pruned_watermarks +=
+                    trap_manager.n_pruned_watermarks;
+            }
+        }
+    }
+
+    return clocking_profile;
+}
+
+/*
+    Clock the charge in one or more images that share the same prepared model,
+    sharing the columns of all the images between the threads.
+
+    Parameters
+    ----------
+    images : double**
+        The pixel values of each image, modified in place, with the same
+        dimensions and strides. Charge is transferred along each column
+        towards row 0, e.g. swap the rows and columns for serial clocking.
+
+    n_images : int
+        The number of images.
+
+    n_rows, n_columns, row_stride, column_stride : int, int, long, long
+        The dimensions and strides of each image's buffer.
+
+    roe : ROE*
+    ccd : CCD*
+    trap_manager_manager : TrapManagerManager&
+        The set up model, see prepare_clocking().
+
+    row_start, row_stop, column_start, column_stop : int
+        The window of pixels to model in each image, with the defaults already
+        applied.
+
+    prune_n_electrons, prune_frequency, allow_negative_pixels, pool,
+    column_schedule : * (opt.)
+        See clock_charge_in_one_direction(). Each image starts with empty traps
+        even if they are not emptied between columns.
+
+    transfer_axis : int (opt.)
+        The direction the image was swapped for, only to record in the
+        ClockingProfile if profiling, see profile.hpp.
+
+    column_checkpoints : std::vector<ColumnCheckpoints>* (opt.)
+        If provided, the checkpoints for every column of every image, indexed
+        by i_image * n_columns + column_index, to restart each column from its
+        i_restart checkpoint, or skip it if -1. See clock_charge_in_one_column().
+        Requires the traps to be emptied between columns.
+
+    pixel_bounces : const std::vector<PixelBounce>* (opt.)
+        If provided, pixel bounce models to add along each column (i.e. each
+        row of the image for serial clocking) straight after it is clocked,
+        while it is still in cache, see add_pixel_bounce_to_lines().
+
+    snapshot_in : const TrapStateSnapshot* (opt.)
+        If provided, the trap states from which to continue each column, saved
+        at the end of the previous range of express passes, which must stop at
+        the ROE's express_pass_start. Requires the traps to be emptied between
+        columns.
+
+    snapshot_out : TrapStateSnapshot* (opt.)
+        If provided, set to the trap states of each column at the end of the
+        ROE's range of express passes, to continue from with the next range.
+        Requires the traps to be emptied between columns.
+
+    buffer_row_start : int (opt.)
+        The image row held in the first row of each image's buffer, if the
+        buffers only hold the rows from there, e.g. a streamed chunk of rows
+        whose earlier ones are skipped by restarting from column_checkpoints.
+        Requires contiguous columns (row_stride 1), and no pixel_bounces or
+        cost column schedule. Default 0 for whole images.
+*/
+void clock_charge_in_images(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, ROE* roe, CCD* ccd, TrapManagerManager& trap_manager_manager,
+    int row_start, int row_stop, int column_start, int column_stop,
+    double prune_n_electrons, int prune_frequency, int allow_negative_pixels,
+    TrapManagerManagerPool* pool, int column_schedule, int transfer_axis,
+    std::vector<ColumnCheckpoints>* column_checkpoints,
+    const std::vector<PixelBounce>* pixel_bounces,
+    const TrapStateSnapshot* snapshot_in, TrapStateSnapshot* snapshot_out,
+    int buffer_row_start) {
+
+    if ((buffer_row_start > 0) &&
+        ((row_stride != 1) || pixel_bounces ||
+         (column_schedule == column_schedule_cost)))
+        error(
+            "A buffer of the later rows requires contiguous columns, without pixel "
+            "bounce or the cost column schedule");
+
+    if (snapshot_in || snapshot_out) {
+        if (!roe->empty_traps_between_columns)
+            error("Trap state snapshots require the traps to be emptied between columns");
+        if (snapshot_in &&
+            ((snapshot_in->time != roe->express_pass_start) ||
+             (snapshot_in->n_images != n_images) ||
+             (snapshot_in->n_columns != n_columns)))
+            error(
+                "Trap state snapshot at time %d for %d images of %d columns doesn't "
+                "match time_start %d for %d images of %d columns",
+                snapshot_in->time, snapshot_in->n_images, snapshot_in->n_columns,
+                roe->express_pass_start, n_images, n_columns);
+        if (snapshot_out) snapshot_out->reset(roe->express_pass_stop, n_images, n_columns);
+    }
+
+    struct timeval wall_time_start, wall_time_end;
+    if (profiling) gettimeofday(&wall_time_start, nullptr);
+
+    unsigned int n_active_rows = row_stop - row_start;
+    unsigned int n_active_columns = column_stop - column_start;
+
+    // Clock tiles of adjacent columns in turn, for cache locality. If the
+    // pixels in each column aren't contiguous in memory (e.g. for parallel
+    // clocking of a row-major image) then first copy the tile into a buffer
+    // that stores each of its columns contiguously
+    bool use_tile_buffer = (row_stride != 1);
+    unsigned int n_tiles_per_image =
+        (n_active_columns + n_tile_columns - 1) / n_tile_columns;
+    unsigned int n_tiles = n_images * n_tiles_per_image;
+
+    // Per-thread trap manager workspaces, reused from previous calls if provided
+    TrapManagerManagerPool local_pool;
+    if (pool == nullptr) pool = &local_pool;
+    int n_threads_max = get_n_threads_max();
+    pool->reserve(n_threads_max);
+
+    // Per-thread measurements for the profile
+    std::valarray<int> thread_n_columns(0, n_threads_max);
+    std::valarray<double> thread_times(0.0, n_threads_max);
+    std::valarray<bool> is_thread_used(false, n_threads_max);
+    std::valarray<bool> is_thread_copied(false, n_threads_max);
+
+    // The column-clocking function specialised for these traps and clock sequence
+    ColumnClocker clock_column = select_column_clocker(trap_manager_manager, roe, ccd);
+
+    // The order in which to clock the tiles (of all images) and how to share
+    // them between threads. Only reorder the tiles if the columns are independent
+    std::valarray<unsigned int> tile_order(n_tiles);
+    for (unsigned int i_tile = 0; i_tile < n_tiles; i_tile++)
+        tile_order[i_tile] = i_tile;
+    if (!roe->empty_traps_between_columns) column_schedule = column_schedule_static;
+    if (column_schedule == column_schedule_cost) {
+        // Start the most expensive tiles first
+        std::valarray<double> tile_costs(n_tiles);
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            tile_costs[std::slice(i_image * n_tiles_per_image, n_tiles_per_image, 1)] =
+                estimate_tile_costs(
+                    images[i_image], row_stride, column_stride, row_start,
+                    n_active_rows, column_start, n_active_columns, ccd);
+        }
+        std::stable_sort(
+            std::begin(tile_order), std::end(tile_order),
+            [&tile_costs](unsigned int a, unsigned int b) {
+                return tile_costs[a] > tile_costs[b];
+            });
+    }
+#ifdef _OPENMP
+    omp_sched_t previous_schedule_kind;
+    int previous_schedule_chunk;
+    omp_get_schedule(&previous_schedule_kind, &previous_schedule_chunk);
+    if (column_schedule == column_schedule_static)
+        omp_set_schedule(omp_sched_static, 0);
+    else if (column_schedule == column_schedule_guided)
+        omp_set_schedule(omp_sched_guided, 1);
+    else
+        omp_set_schedule(omp_sched_dynamic, 1);
+#endif
+
+    // Loop over:
+    //   Images > Columns > Express passes > Rows > Clock-sequence steps > Pixel phases
+    #pragma omp parallel
+    {
+        // This thread's own trap managers, copied from the prepared ones
+        int i_thread = get_thread_index();
+        TrapManagerManager& thread_trap_manager_manager =
+            pool->thread_workspace(
+                i_thread, trap_manager_manager, &is_thread_copied[i_thread]);
+        is_thread_used[i_thread] = true;
+        struct timeval thread_time_start, thread_time_end;
+        if (profiling) gettimeofday(&thread_time_start, nullptr);
+
+        std::valarray<double> tile(0.0, use_tile_buffer ? n_rows * n_tile_columns : 0);
+        int i_image;
+        int i_previous_image = 0;
+        double* image;
+        unsigned int tile_column_start;
+        unsigned int n_tile_active_columns;
+        unsigned int column_index;
+        double* column;
+        long column_row_stride;
+
+        #pragma omp for schedule(runtime) nowait
+        for (unsigned int i_order = 0; i_order < n_tiles; i_order++) {
+            i_image = tile_order[i_order] / n_tiles_per_image;
+            image = images[i_image];
+            tile_column_start =
+                column_start +
+                (tile_order[i_order] % n_tiles_per_image) * n_tile_columns;
+            n_tile_active_columns =
+                std::min(n_tile_columns, column_stop - tile_column_start);
+
+            // Start each new image with empty traps
+            if ((i_image != i_previous_image) && !roe->empty_traps_between_columns) {
+                thread_trap_manager_manager.reset_trap_states();
+                thread_trap_manager_manager.store_trap_states();
+            }
+            i_previous_image = i_image;
+
+            if (use_tile_buffer) {
+                for (int row_index = 0; row_index < n_rows; row_index++) {
+                    for (unsigned int i_column = 0; i_column < n_tile_active_columns;
+                         i_column++) {
+                        tile[i_column * n_rows + row_index] =
+                            image[row_index * row_stride +
+                                  (tile_column_start + i_column) * column_stride];
+                    }
+                }
+            }
+
+            for (unsigned int i_column = 0; i_column < n_tile_active_columns;
+                 i_column++) {
+                column_index = tile_column_start + i_column;
+                if (use_tile_buffer) {
+                    column = &tile[i_column * n_rows];
+                    column_row_stride = 1;
+                } else {
+                    column = image + column_index * column_stride;
+                    column_row_stride = row_stride;
+                }
+
+                print_v(
+                    2, "# # # #  i_column, column_index  %d,  %d \n",
+                    column_index - column_start, column_index);
+
+                // Skip unchanged columns, with their trap states still empty
+                ColumnCheckpoints* checkpoints = nullptr;
+                if (column_checkpoints) {
+                    checkpoints =
+                        &(*column_checkpoints)[i_image * n_columns + column_index];
+                    if (checkpoints->i_restart < 0) continue;
+                }
+
+                // Continue from the trap states at the end of the previous
+                // range of express passes
+                if (snapshot_in && (snapshot_in->state(i_image, column_index).size() > 0)) {
+                    thread_trap_manager_manager.load_trap_states(
+                        snapshot_in->state(i_image, column_index));
+                    thread_trap_manager_manager.store_trap_states();
+                }
+
+                clock_column(
+                    column, column_row_stride, column_index, n_rows, row_start,
+                    n_active_rows, roe, ccd, thread_trap_manager_manager,
+                    prune_n_electrons, prune_frequency, allow_negative_pixels,
+                    checkpoints, buffer_row_start);
+                if (pixel_bounces)
+                    add_pixel_bounce_to_lines(
+                        column, 0, column_row_stride, 1, row_start, row_stop,
+                        *pixel_bounces);
+
+                // Save the trap states from which the next express pass would
+                // continue, i.e. as stored by the last one
+                if (snapshot_out) {
+                    thread_trap_manager_manager.restore_trap_states();
+                    thread_trap_manager_manager.save_trap_states(
+                        snapshot_out->state(i_image, column_index));
+                }
+
+                // Reset the trap states to empty and/or store them for the next
+                // column
+                if (roe->empty_traps_between_columns)
+                    thread_trap_manager_manager.reset_trap_states();
+                thread_trap_manager_manager.store_trap_states();
+            }
+
+            // Copy the modified tile back into the image
+            if (use_tile_buffer) {
+                for (int row_index = 0; row_index < n_rows; row_index++) {
+                    for (unsigned int i_column = 0; i_column < n_tile_active_columns;
+                         i_column++) {
+                        image[row_index * row_stride +
+                              (tile_column_start + i_column) * column_stride] =
+                            tile[i_column * n_rows + row_index];
+                    }
+                }
+            }
+            thread_n_columns[i_thread] += n_tile_active_columns;
+        }
+
+        if (profiling) {
+            gettimeofday(&thread_time_end, nullptr);
+            thread_times[i_thread] = gettimelapsed(thread_time_start, thread_time_end);
+        }
+    }
+
+#ifdef _OPENMP
+    omp_set_schedule(previous_schedule_kind, previous_schedule_chunk);
+#endif
+
+    if (profiling) {
+        gettimeofday(&wall_time_end, nullptr);
+        ClockingProfile clocking_profile = profile_clocking(
+            pool, is_thread_used, trap_manager_manager, roe, n_images, n_active_rows,
+            n_active_columns, transfer_axis);
+        clocking_profile.wall_time = gettimelapsed(wall_time_start, wall_time_end);
+        clocking_profile.thread_n_columns.assign(
+            std::begin(thread_n_columns), std::end(thread_n_columns));
+        clocking_profile.thread_times.assign(
+            std::begin(thread_times), std::end(thread_times));
+        clocking_profile.n_workspace_copies =
+            std::count(std::begin(is_thread_copied), std::end(is_thread_copied), true);
+        add_clocking_profile(clocking_profile);
+    }
+}
+
+/*
+    Clock the charge in the columns of float images, modifying them in place.
+    See the double version above for the parameters.
+
+    This only accepts float image buffers, it isn't a single-precision mode:
+    the images are copied into a contiguous double buffer, clocked in double
+    with the same (double) trap managers, and copied back. So the results are
+    the double ones rounded to float, using more memory than the double
+    version for the temporary copy.
+*/
+void clock_charge_in_images(
+    float** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, ROE* roe, CCD* ccd, TrapManagerManager& trap_manager_manager,
+    int row_start, int row_stop, int column_start, int column_stop,
+    double prune_n_electrons, int prune_frequency, int allow_negative_pixels,
+    TrapManagerManagerPool* pool, int column_schedule, int transfer_axis,
+    std::vector<ColumnCheckpoints>* column_checkpoints,
+    const std::vector<PixelBounce>* pixel_bounces,
+    const TrapStateSnapshot* snapshot_in, TrapStateSnapshot* snapshot_out) {
+
+    // Contiguous double copies of the images
+    long n_pixels = (long)n_rows * n_columns;
+    std::valarray<double> images_double(n_images * n_pixels);
+    std::vector<double*> images_double_pointers(n_images);
+    for (int i_image = 0; i_image < n_images; i_image++) {
+        images_double_pointers[i_image] = &images_double[i_image * n_pixels];
+
+        for (int row_index = 0; row_index < n_rows; row_index++) {
+            for (int column_index = 0; column_index < n_columns; column_index++) {
+                images_double[i_image * n_pixels + row_index * n_columns + column_index] =
+                    images[i_image]
+                          [row_index * row_stride + column_index * column_stride];
+            }
+        }
+    }
+
+    clock_charge_in_images(
+        &images_double_pointers[0], n_images, n_rows, n_columns, n_columns, 1, roe,
+        ccd, trap_manager_manager, row_start, row_stop, column_start, column_stop,
+        prune_n_electrons, prune_frequency, allow_negative_pixels, pool,
+        column_schedule, transfer_axis, column_checkpoints, pixel_bounces,
+        snapshot_in, snapshot_out);
+
+    for (int i_image = 0; i_image < n_images; i_image++) {
+        for (int row_index = 0; row_index < n_rows; row_index++) {
+            for (int column_index = 0; column_index < n_columns; column_index++) {
+                images[i_image][row_index * row_stride + column_index * column_stride] =
+                    images_double
+                        [i_image * n_pixels + row_index * n_columns + column_index];
+            }
+        }
+    }
+}
+
+/*
+    Clock the charge in the same column of each of several images through the
+    columns of traps of their own trap models, together in one traversal of
+    the ROE's express schedule, modifying the columns in place. See
+    clock_charge_in_images_ensemble().
+
+    Each model's pixels are clocked by the same clock_charge_in_one_pixel() as
+    in clock_charge_in_one_column_kernel(), with its own trap states and
+    charge, so the results are the same as clocking each image separately.
+    Without checkpoints or the detailed verbosity >= 2 printing.
+
+    Parameters
+    ----------
+    columns : double**
+        The pixel values in the column of each model's image, where the pixel
+        in row i is columns[i_model][i * row_stride].
+
+    n_models : int
+        The number of models (and columns).
+
+    trap_manager_managers : TrapManagerManager*
+        The trap managers of each model, with the trap states as at the start
+        of the column, sharing the same traps apart from their densities.
+
+    are_traps_empty : bool*
+        Work space for whether each model's traps are empty.
+
+    See clock_charge_in_one_column() for the other parameters.
+*/
+template <bool one_step_phase>
+static void clock_charge_in_one_column_ensemble_kernel(
+    double** columns, long row_stride, int column_index, int n_models, int n_rows,
+    int row_start, int n_active_rows, ROE* roe, CCD* ccd,
+    TrapManagerManager* trap_manager_managers, double prune_n_electrons,
+    int prune_frequency, int allow_negative_pixels, bool* are_traps_empty) {
+
+    for (int express_index = roe->express_pass_start;
+         express_index < roe->express_pass_stop; express_index++) {
+
+        // Restore each model's trap occupancy levels, either to empty or to a
+        // saved state from a previous express pass
+        for (int i_model = 0; i_model < n_models; i_model++) {
+            trap_manager_managers[i_model].restore_trap_states();
+            are_traps_empty[i_model] =
+                !trap_manager_managers[i_model].any_active_watermarks();
+        }
+
+        // Each pixel that this pass models, from the ROE's express schedule
+        const int i_transfer_stop = roe->express_schedule_starts[express_index + 1];
+        for (int i_transfer = roe->express_schedule_first(express_index, row_start);
+             i_transfer < i_transfer_stop; i_transfer++) {
+            const ROEExpressTransfer& transfer = roe->express_schedule[i_transfer];
+            const unsigned int row_index = transfer.row_index;
+            const unsigned int i_row = row_index - row_start;
+            if (i_row >= (unsigned int)n_active_rows) break;
+
+            const double express_multiplier = transfer.express_multiplier;
+            if (express_multiplier == 0) continue;
+
+            // Each model in turn for this pixel
+            for (int i_model = 0; i_model < n_models; i_model++) {
+                TrapManagerManager& trap_manager_manager =
+                    trap_manager_managers[i_model];
+
+                clock_charge_in_one_pixel<false, trap_families_any, one_step_phase>(
+                    columns[i_model], row_stride, column_index, n_rows, 0, row_index,
+                    express_multiplier, roe, ccd, trap_manager_manager,
+                    allow_negative_pixels, are_traps_empty[i_model]);
+
+                // Absorb really small watermarks into others, for speed
+                if ((prune_frequency > 0) && (((i_row + 1) % prune_frequency) == 0))
+                    trap_manager_manager.prune_watermarks(prune_n_electrons);
+
+                // Store the trap states if needed for the next express pass
+                if (transfer.store_trap_states)
+                    trap_manager_manager.store_trap_states();
+            }
+        }
+    }
+}
+
+/*
+    Clock the charge in the columns of several images, each with its own trap
+    model, modifying them in place, e.g. to evaluate many trap densities for
+    the same input image in one call. See add_cti_density_sweep().
+
+    The same column of every image is clocked together, with each image's
+    traps, in one traversal of the express schedule (see
+    clock_charge_in_one_column_ensemble_kernel()). This shares the loading of
+    the tiles of columns and the express bookkeeping between the models, while
+    each model's trap managers are kept together in each thread's workspace.
+
+    Parameters
+    ----------
+    images : double**
+        The pixel values of each model's image, with the same dimensions and
+        strides, e.g. copies of the same input image.
+
+    n_models : int
+        The number of models and images.
+
+    trap_manager_managers : std::vector<TrapManagerManager>&
+        The set-up trap managers of each model, e.g. copies that differ only
+        in their trap densities, see TrapManagerManager::set_trap_densities().
+
+    See clock_charge_in_images() for the other parameters. Each image starts
+    with empty traps even if they are not emptied between columns. Always
+    clocked on the CPU, with the columns shared between threads statically.
+*/
+void clock_charge_in_images_ensemble(
+    double** images, int n_models, int n_rows, long row_stride, long column_stride,
+    ROE* roe, CCD* ccd, std::vector<TrapManagerManager>& trap_manager_managers,
+    int row_start, int row_stop, int column_start, int column_stop,
+    double prune_n_electrons, int prune_frequency, int allow_negative_pixels) {
+
+    if ((int)trap_manager_managers.size() != n_models)
+        error(
+            "Expected trap managers for %d models, not %d", n_models,
+            (int)trap_manager_managers.size());
+
+    unsigned int n_active_rows = row_stop - row_start;
+    unsigned int n_active_columns = column_stop - column_start;
+    bool use_tile_buffer = (row_stride != 1);
+    unsigned int n_tiles = (n_active_columns + n_tile_columns - 1) / n_tile_columns;
+    bool one_step_phase = (roe->n_steps == 1) && (ccd->n_phases == 1);
+
+    #pragma omp parallel
+    {
+        // This thread's own copies of every model's trap managers, together
+        std::vector<TrapManagerManager> thread_trap_manager_managers(
+            trap_manager_managers);
+        for (TrapManagerManager& thread_trap_manager_manager :
+             thread_trap_manager_managers) {
+            thread_trap_manager_manager.reset_trap_states();
+            thread_trap_manager_manager.store_trap_states();
+        }
+
+        std::valarray<double> tile(
+            0.0, use_tile_buffer ? (long)n_models * n_tile_columns * n_rows : 0);
+        std::vector<double*> columns(n_models);
+        std::valarray<bool> are_traps_empty(n_models);
+        unsigned int tile_column_start;
+        unsigned int n_tile_active_columns;
+        unsigned int column_index;
+        long column_row_stride = use_tile_buffer ? 1 : row_stride;
+
+        #pragma omp for schedule(static) nowait
+        for (unsigned int i_tile = 0; i_tile < n_tiles; i_tile++) {
+            tile_column_start = column_start + i_tile * n_tile_columns;
+            n_tile_active_columns =
+                std::min(n_tile_columns, column_stop - tile_column_start);
+
+            // Copy the tile of every image into the buffer, each column of
+            // each model contiguous
+            if (use_tile_buffer) {
+                for (int i_model = 0; i_model < n_models; i_model++) {
+                    double* tile_model = &tile[(long)i_model * n_tile_columns * n_rows];
+                    for (int row_index = 0; row_index < n_rows; row_index++) {
+                        for (unsigned int i_column = 0;
+                             i_column < n_tile_active_columns; i_column++) {
+                            tile_model[i_column * n_rows + row_index] =
+                                images[i_model]
+                                      [row_index * row_stride +
+                                       (tile_column_start + i_column) * column_stride];
+                        }
+                    }
+                }
+            }
+
+            for (unsigned int i_column = 0; i_column < n_tile_active_columns;
+                 i_column++) {
+                column_index = tile_column_start + i_column;
+                for (int i_model = 0; i_model < n_models; i_model++) {
+                    if (use_tile_buffer)
+                        columns[i_model] =
+                            &tile[((long)i_model * n_tile_columns + i_column) * n_rows];
+                    else
+                        columns[i_model] =
+                            images[i_model] + column_index * column_stride;
+                }
+
+                if (one_step_phase)
+                    clock_charge_in_one_column_ensemble_kernel<true>(
+                        columns.data(), column_row_stride, column_index, n_models,
+                        n_rows, row_start, n_active_rows, roe, ccd,
+                        thread_trap_manager_managers.data(), prune_n_electrons,
+                        prune_frequency, allow_negative_pixels, &are_traps_empty[0]);
+                else
+                    clock_charge_in_one_column_ensemble_kernel<false>(
+                        columns.data(), column_row_stride, column_index, n_models,
+                        n_rows, row_start, n_active_rows, roe, ccd,
+                        thread_trap_manager_managers.data(), prune_n_electrons,
+                        prune_frequency, allow_negative_pixels, &are_traps_empty[0]);
+
+                // Reset the trap states to empty and/or store them for the next
+                // column
+                for (TrapManagerManager& thread_trap_manager_manager :
+                     thread_trap_manager_managers) {
+                    if (roe->empty_traps_between_columns)
+                        thread_trap_manager_manager.reset_trap_states();
+                    thread_trap_manager_manager.store_trap_states();
+                }
+            }
+
+            // Copy the modified tile back into each image
+            if (use_tile_buffer) {
+                for (int i_model = 0; i_model < n_models; i_model++) {
+                    double* tile_model = &tile[(long)i_model * n_tile_columns * n_rows];
+                    for (int row_index = 0; row_index < n_rows; row_index++) {
+                        for (unsigned int i_column = 0;
+                             i_column < n_tile_active_columns; i_column++) {
+                            images[i_model]
+                                  [row_index * row_stride +
+                                   (tile_column_start + i_column) * column_stride] =
+                                tile_model[i_column * n_rows + row_index];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+    Add CTI trails to an image by trapping, releasing, and moving electrons
+    along their independent columns.
+
+    See add_cti() for more detail and e.g. parallel vs serial clocking.
+
+    The image is modified in place, via a strided view of a contiguous buffer
+    so that no copies of the image are made. See the valarray version below
+    for the original interface.
+
+    Parameters
+    ----------
+    image : real*
+        The array of pixel values, assumed to be in units of electrons, which
+        is modified in place to have CTI added. Either double, or float, which
+        is clocked in double via a copy, see clock_charge_in_images().
+
+        The pixel in "row" i and "column" j is image[i * row_stride +
+        j * column_stride]. Charge is transferred "up" from row N to row 0
+        along each independent column.
+
+    n_rows, n_columns : int
+        The shape of the image.
+
+    row_stride, column_stride : long
+        The step in the buffer between adjacent rows and between adjacent
+        columns, e.g. n_columns and 1 for a C-contiguous (row-major) array.
+
+    roe : ROE*
+    ccd : CCD*
+    traps_ic : std::valarray<TrapInstantCapture>*
+    traps_sc : std::valarray<TrapSlowCapture>*
+    traps_ic_co : std::valarray<TrapInstantCaptureContinuum>*
+    traps_sc_co : std::valarray<TrapSlowCaptureContinuum>*
+    express : int (opt.)
+    row_offset : int (opt.)
+        See add_cti()'s docstring. Same as the corresponding parallel_*
+        parameters.
+
+    row_start, row_stop : int (opt.)
+        The subset of row pixels to model, to save time when only a specific
+        region of the image is of interest. Defaults to 0, n_rows for the full
+        image.
+
+        For trap pumping, it is currently assumed that only a single pixel is
+        active and contains traps, so row_stop must be row_start + 1. See
+        ROETrapPumping for more detail.
+
+    column_start, column_stop : int (opt.)
+        The subset of column pixels to model, to save time when only a specific
+        region of the image is of interest. Defaults to 0, n_columns for the
+        full image.
+
+    time_start, time_stop : int (opt.)
+        The subset of express passes to model, i.e. of transfers in the
+        readout sequence for the default express = n_rows, see
+        ROE::set_express_pass_range(). Defaults to 0, -1 for all of them.
+
+        To split the readout into ranges, e.g. in separate jobs, clock the
+        output image of each range with the snapshot_out of the previous one
+        as snapshot_in.
+
+    print_inputs : int (opt.)
+        Whether or not to print the model inputs. Defaults to True if
+        verbosity >= 1.
+
+    transfer_axis : int (opt.)
+        The direction in which to transfer the charge:
+            transfer_axis_parallel  (default) Along each column towards row 0.
+            transfer_axis_serial    Along each row towards column 0, e.g. for
+                                    serial clocking without transposing the
+                                    image. The row_* parameters above then
+                                    refer to the image's columns along which
+                                    the charge is transferred, and vice versa.
+
+    pool : TrapManagerManagerPool* (opt.)
+        Persistent per-thread trap manager workspaces to reuse, e.g. from a
+        previous call with the same model, to avoid reallocating the watermark
+        arrays. They are still copied from the trap managers that each call
+        sets up, unlike with a ClockingModel's pool. Default nullptr to use
+        temporary workspaces for this call.
+
+    column_schedule : int (opt.)
+        How to share the (tiles of adjacent) columns between threads:
+            column_schedule_static   (default) Equal blocks of columns.
+            column_schedule_dynamic  Each thread takes the next tile when free.
+            column_schedule_guided   As dynamic, but in decreasing-size chunks.
+            column_schedule_cost     As dynamic, but start with the tiles with
+                                     the highest estimated cost from the charge
+                                     above the notch depth, for images with
+                                     sparse bright sources.
+        Ignored (static) if the traps are not emptied between columns, since
+        the columns are not then independent.
+
+    snapshot_in, snapshot_out : TrapStateSnapshot* (opt.)
+        The trap states of each column to continue from at time_start, and to
+        save at time_stop, e.g. written to and read from files in between. See
+        clock_charge_in_images(). Default nullptr to start with empty traps and
+        not save them.
+*/
+template <typename real>
+void clock_charge_in_one_direction(
+    real* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    ROE* roe, CCD* ccd,
+    std::valarray<TrapInstantCapture>* traps_ic,
+    std::valarray<TrapSlowCapture>* traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* traps_sc_co, 
+    int express, int row_offset,
+    int row_start, int row_stop, 
+    int column_start, int column_stop, 
+    int time_start, int time_stop, 
+    double prune_n_electrons, int prune_frequency,
+    int allow_negative_pixels, int print_inputs, int transfer_axis,
+    TrapManagerManagerPool* pool, int column_schedule,
+    const TrapStateSnapshot* snapshot_in, TrapStateSnapshot* snapshot_out) {
+
+    // View the image with its rows and columns swapped to transfer the charge
+    // along each row instead
+    if (transfer_axis == transfer_axis_serial) {
+        std::swap(n_rows, n_columns);
+        std::swap(row_stride, column_stride);
+    }
+
+    // Defaults
+    if (row_stop == -1) row_stop = n_rows;
+    if (column_stop == -1) column_stop = n_columns;
+
+    // Number of active rows and columns
+    unsigned int n_active_rows = row_stop - row_start;
+    unsigned int n_active_columns = column_stop - column_start;
+    print_v(
+        1, "%d column(s) [%d to %d], %d row(s) [%d to %d] \n", n_active_columns,
+        column_start, column_stop, n_active_rows, row_start, row_stop);
+
+    // Set up the readout electronics and trap managers
+    TrapManagerManager trap_manager_manager = prepare_clocking(
+        roe, ccd, traps_ic, traps_sc, traps_ic_co, traps_sc_co, n_rows, n_active_rows,
+        express, row_offset, time_start, time_stop);
 
     // Print model inputs
     //if (print_inputs == -1) print_inputs = verbosity >= 1;
-    if (print_inputs > 0) {
-        print_v(2, "\n");
-        printf("  express = %d \n", express);
-        if (row_offset != 0) printf("  row_offset = %d \n", row_offset);
-
-        printf("  ROE type = %d, n_steps = %d \n", roe->type, roe->n_steps);
-        printf("    dwell_times = ");
-        print_array(roe->dwell_times);
-        printf(
-            "    empty_traps_between_columns = %d \n",
-            roe->empty_traps_between_columns);
-        printf(
-            "    empty_traps_for_first_transfers = %d \n",
-            roe->empty_traps_for_first_transfers);
-        if (roe->n_steps != 1)
-            printf(
-                "    force_release_away_from_readout = %d \n",
-                roe->force_release_away_from_readout);
-        if (roe->use_integer_express_matrix)
-            printf(
-                "    use_integer_express_matrix = %d \n",
-                roe->use_integer_express_matrix);
-        if (roe->type == roe_type_trap_pumping)
-            printf("    n_pumps = %d \n", roe->n_pumps);
-
-        printf("  CCD n_phases = %d \n", ccd->n_phases);
-        if (ccd->n_phases != 1) {
-            printf("    fraction_of_traps_per_phase = ");
-            print_array(ccd->fraction_of_traps_per_phase);
-        }
-        for (int i_phase = 0; i_phase < ccd->n_phases; i_phase++) {
-            printf(
-                "    full_well_depth = %g, well_notch_depth = %g, well_fill_power = %g "
-                "\n",
-                ccd->phases[i_phase].full_well_depth,
-                ccd->phases[i_phase].well_notch_depth,
-                ccd->phases[i_phase].well_fill_power);
-        }
-
-        if (trap_manager_manager.n_traps_ic != 0) {
-            printf(
-                "  Instant-capture traps n = %d \n", trap_manager_manager.n_traps_ic);
-            for (int i_trap = 0; i_trap < trap_manager_manager.n_traps_ic; i_trap++) {
-                printf(
-                    "    density = %g, release_timescale = %g \n",
-                    trap_manager_manager.trap_managers_ic[0].traps[i_trap].density,
-                    trap_manager_manager.trap_managers_ic[0]
-                        .traps[i_trap]
-                        .release_timescale);
-                if (trap_manager_manager.trap_managers_ic[0]
-                        .traps[i_trap]
-                        .fractional_volume_full_exposed != 0.0)
-                    printf(
-                        "      fractional_volume_none_exposed = %g, "
-                        "fractional_volume_full_exposed = %g \n",
-                        trap_manager_manager.trap_managers_ic[0]
-                            .traps[i_trap]
-                            .fractional_volume_none_exposed,
-                        trap_manager_manager.trap_managers_ic[0]
-                            .traps[i_trap]
-                            .fractional_volume_full_exposed);
-            }
-        }
-        if (trap_manager_manager.n_traps_sc != 0) {
-            printf("  Slow-capture traps n = %d \n", trap_manager_manager.n_traps_sc);
-            for (int i_trap = 0; i_trap < trap_manager_manager.n_traps_sc; i_trap++) {
-                printf(
-                    "    density = %g, release_timescale = %g, capture_timescale = %g "
-                    "\n",
-                    trap_manager_manager.trap_managers_sc[0].traps[i_trap].density,
-                    trap_manager_manager.trap_managers_sc[0]
-                        .traps[i_trap]
-                        .release_timescale,
-                    trap_manager_manager.trap_managers_sc[0]
-                        .traps[i_trap]
-                        .capture_timescale);
-            }
-        }
-        if (trap_manager_manager.n_traps_ic_co != 0) {
-            printf("  Continuum traps n = %d \n", trap_manager_manager.n_traps_ic_co);
-            for (int i_trap = 0; i_trap < trap_manager_manager.n_traps_ic_co;
-                 i_trap++) {
-                printf(
-                    "    density = %g, release_timescale = %g, release_timescale_sigma "
-                    "= %g "
-                    "\n",
-                    trap_manager_manager.trap_managers_ic_co[0].traps[i_trap].density,
-                    trap_manager_manager.trap_managers_ic_co[0]
-                        .traps[i_trap]
-                        .release_timescale,
-                    trap_manager_manager.trap_managers_ic_co[0]
-                        .traps[i_trap]
-                        .release_timescale_sigma);
-            }
-        }
-        if (trap_manager_manager.n_traps_sc_co != 0) {
-            printf(
-                "  Slow-capture continuum traps n = %d \n",
-                trap_manager_manager.n_traps_sc_co);
-            for (int i_trap = 0; i_trap < trap_manager_manager.n_traps_sc_co;
-                 i_trap++) {
-                printf(
-                    "    density = %g, release_timescale = %g, release_timescale_sigma "
-                    "= %g, "
-                    "capture_timescale = %g \n",
-                    trap_manager_manager.trap_managers_sc_co[0].traps[i_trap].density,
-                    trap_manager_manager.trap_managers_sc_co[0]
-                        .traps[i_trap]
-                        .release_timescale,
-                    trap_manager_manager.trap_managers_sc_co[0]
-                        .traps[i_trap]
-                        .release_timescale_sigma,
-                    trap_manager_manager.trap_managers_sc_co[0]
-                        .traps[i_trap]
-                        .capture_timescale);
-            }
-        }
-        print_v(2, "\n");
-    }
+    if (print_inputs > 0)
+        print_clocking_inputs(roe, ccd, trap_manager_manager, express, row_offset);
 
     // Measure wall-clock time taken for the primary loop
     struct timeval wall_time_start;
@@ -309,152 +1864,92 @@ std::valarray<std::valarray<double> > clock_charge_in_one_direction(
     // Print express matrix
     //print_array_2D(roe->express_matrix, n_active_rows);
     //print_array_2D((int)roe->store_trap_states_matrix, n_active_rows);
-    // Loop over:
-    //   Columns > Express passes > Rows > Clock-sequence steps > Pixel phases
-    #pragma omp parallel for private(column_index, row_index, row_read, row_write, n_free_electrons, \
-				     n_electrons_released_and_captured, express_multiplier, roe_step_phase) \
-                             firstprivate(trap_manager_manager)
-    for (unsigned int i_column = 0; i_column < n_active_columns; i_column++) {
-        column_index = column_start + i_column;
-
-        print_v(
-            2, "# # # #  i_column, column_index  %d,  %d \n", i_column, column_index);
-
-        // Monitor the traps for every transfer (express=n_rows), or just one
-        // (express=1) or a few (express=a few) then replicate their effect
-        for (unsigned int express_index = 0; express_index < roe->n_express_passes;
-             express_index++) {
-
-            print_v(2, "# # #  express_index  %d \n", express_index);
-
-            // Restore the trap occupancy levels, either to empty or to a saved
-            // state from a previous express pass
-            trap_manager_manager.restore_trap_states();
-
-            // Each pixel
-            for (unsigned int i_row = 0; i_row < n_active_rows; i_row++) {
-                row_index = row_start + i_row;
-
-                print_v(2, "# #  i_row, row_index  %d,  %d \n", i_row, row_index);
-
-                express_multiplier =
-                    roe->express_matrix[express_index * n_rows + row_index];
-                if (express_multiplier == 0) continue;
+    clock_charge_in_images(
+        &image, 1, n_rows, n_columns, row_stride, column_stride, roe, ccd,
+        trap_manager_manager, row_start, row_stop, column_start, column_stop,
+        prune_n_electrons, prune_frequency, allow_negative_pixels, pool,
+        column_schedule, transfer_axis, nullptr, nullptr, snapshot_in, snapshot_out);
 
-                print_v(2, "express_multiplier  %g \n", express_multiplier);
+    // Time taken
+    gettimeofday(&wall_time_end, nullptr);
+    wall_time_elapsed = gettimelapsed(wall_time_start, wall_time_end);
+    print_v(1, "Wall-clock time elapsed: %.4g s \n", wall_time_elapsed);
+}
 
-                // Each step in the clock sequence
-                for (unsigned int i_step = 0; i_step < roe->n_steps; i_step++) {
+template void clock_charge_in_one_direction<double>(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    ROE* roe, CCD* ccd, std::valarray<TrapInstantCapture>* traps_ic,
+    std::valarray<TrapSlowCapture>* traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* traps_sc_co, int express,
+    int row_offset, int row_start, int row_stop, int column_start, int column_stop,
+    int time_start, int time_stop, double prune_n_electrons, int prune_frequency,
+    int allow_negative_pixels, int print_inputs, int transfer_axis,
+    TrapManagerManagerPool* pool, int column_schedule,
+    const TrapStateSnapshot* snapshot_in, TrapStateSnapshot* snapshot_out);
+template void clock_charge_in_one_direction<float>(
+    float* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    ROE* roe, CCD* ccd, std::valarray<TrapInstantCapture>* traps_ic,
+    std::valarray<TrapSlowCapture>* traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* traps_sc_co, int express,
+    int row_offset, int row_start, int row_stop, int column_start, int column_stop,
+    int time_start, int time_stop, double prune_n_electrons, int prune_frequency,
+    int allow_negative_pixels, int print_inputs, int transfer_axis,
+    TrapManagerManagerPool* pool, int column_schedule,
+    const TrapStateSnapshot* snapshot_in, TrapStateSnapshot* snapshot_out);
 
-                    // Each phase in the pixel
-                    for (unsigned int i_phase = 0; i_phase < ccd->n_phases; i_phase++) {
+/*
+    Wrapper for clock_charge_in_one_direction() above for a valarray image.
 
-                        if ((roe->n_steps > 1) || (ccd->n_phases > 1))
-                            print_v(
-                                2, "#  i_step, i_phase  %d,  %d \n", i_step, i_phase);
+    Parameters
+    ----------
+    image_in : std::valarray<std::valarray<double> >
+        The input array of pixel values, assumed to be in units of electrons.
 
-                        // State of the ROE in this step and phase of the sequence
-                        roe_step_phase = &roe->clock_sequence[i_step][i_phase];
+        The first dimension is the "row" index, the second is the "column"
+        index. Charge is transferred "up" from row N to row 0 along each
+        independent column.
 
-                        // Get the initial charge from the relevant pixel(s)
-                        n_free_electrons = 0;
-                        for (int i = 0; i < roe_step_phase->n_capture_pixels; i++) {
-                            row_read = row_index +
-                                       roe_step_phase->capture_from_which_pixels[i];
+    ... : * (opt.)
+        As for the flat-buffer version.
 
-                            n_free_electrons += image[row_read][column_index];
-                        }
+    Returns
+    -------
+    image : std::valarray<std::valarray<double> >
+        The output array of pixel values.
+*/
+std::valarray<std::valarray<double> > clock_charge_in_one_direction(
+    std::valarray<std::valarray<double> >& image_in, ROE* roe, CCD* ccd,
+    std::valarray<TrapInstantCapture>* traps_ic,
+    std::valarray<TrapSlowCapture>* traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* traps_sc_co, 
+    int express, int row_offset,
+    int row_start, int row_stop, 
+    int column_start, int column_stop, 
+    int time_start, int time_stop, 
+    double prune_n_electrons, int prune_frequency,
+    int allow_negative_pixels, int print_inputs, int transfer_axis,
+    int column_schedule) {
 
-                        print_v(2, "row_read  %d \n", row_read);
-                        print_v(2, "n_free_electrons  %g \n", n_free_electrons);
- 
-                        // Release and capture electrons with the traps in this
-                        // pixel/phase, for each type of traps
-                        n_electrons_released_and_captured = 0;
-                        if (trap_manager_manager.n_traps_ic > 0)
-                            n_electrons_released_and_captured +=
-                                trap_manager_manager.trap_managers_ic[i_phase]
-                                    .n_electrons_released_and_captured(
-                                        n_free_electrons +
-                                        n_electrons_released_and_captured);
-                        if (trap_manager_manager.n_traps_sc > 0)
-                            n_electrons_released_and_captured +=
-                                trap_manager_manager.trap_managers_sc[i_phase]
-                                    .n_electrons_released_and_captured(
-                                        n_free_electrons +
-                                        n_electrons_released_and_captured);
-                        if (trap_manager_manager.n_traps_ic_co > 0)
-                            n_electrons_released_and_captured +=
-                                trap_manager_manager.trap_managers_ic_co[i_phase]
-                                    .n_electrons_released_and_captured(
-                                        n_free_electrons +
-                                        n_electrons_released_and_captured);
-                        if (trap_manager_manager.n_traps_sc_co > 0)
-                            n_electrons_released_and_captured +=
-                                trap_manager_manager.trap_managers_sc_co[i_phase]
-                                    .n_electrons_released_and_captured(
-                                        n_free_electrons +
-                                        n_electrons_released_and_captured);
-                      
-                        print_v(
-                            2, "n_electrons_released_and_captured  %g \n",
-                            n_electrons_released_and_captured);
-
-                        print_v(
-                           2, "n_trapped_electrons_from_watermarks  %g \n",
-                            trap_manager_manager.trap_managers_ic[i_phase].n_trapped_electrons_from_watermarks(trap_manager_manager.trap_managers_ic[i_phase].watermark_volumes,trap_manager_manager.trap_managers_ic[i_phase].watermark_fills));
-
-                        print_v(2, "n_free_electrons  %g \n", n_free_electrons);
-
-
-                        // Return the charge to the relevant pixel(s)
-                        for (int i = 0; i < roe_step_phase->n_release_pixels; i++) {
-                            row_write =
-                                row_index + roe_step_phase->release_to_which_pixels[i];
-
-                            image[row_write][column_index] +=
-                                n_electrons_released_and_captured * express_multiplier *
-                                roe_step_phase->release_fraction_to_pixels[i];
-
-                            // Make sure image counts don't go negative, which
-                            // could happen with a too-large express multiplier
-                            if (!allow_negative_pixels) {
-                                if (image[row_write][column_index] < 0.0)
-                                    image[row_write][column_index] = 0.0;
-                            }
-                            
-                            print_v(2, "row_write  %d \n", row_write);
-                            print_v(
-                                2, "image[%d][%d]  %g \n", row_write, column_index,
-                                image[row_write][column_index]);
-                        }
-                    }
-                }
+    int n_rows = image_in.size();
+    int n_columns = image_in[0].size();
 
-                // Absorb really small watermarks  into others, for speed
-                if (prune_frequency > 0) {
-                    if (((i_row + 1) % prune_frequency) == 0) {
-                        trap_manager_manager.prune_watermarks(prune_n_electrons);
-                    }
-                }
-                
-                // Store the trap states if needed for the next express pass
-                if (roe->store_trap_states_matrix[express_index * n_rows + row_index]) {
-                    print_v(2, "store_trap_states \n");
-                    trap_manager_manager.store_trap_states();
-                }
-            }
-        }
+    // Clock a contiguous copy of the image
+    std::valarray<double> buffer(n_rows * n_columns);
+    copy_image_to_buffer(image_in, &buffer[0]);
 
-        // Reset the trap states to empty and/or store them for the next column
-        if (roe->empty_traps_between_columns) trap_manager_manager.reset_trap_states();
-        trap_manager_manager.store_trap_states();
-    }
+    clock_charge_in_one_direction(
+        &buffer[0], n_rows, n_columns, n_columns, 1, roe, ccd, traps_ic, traps_sc,
+        traps_ic_co, traps_sc_co, express, row_offset, row_start, row_stop,
+        column_start, column_stop, time_start, time_stop, prune_n_electrons,
+        prune_frequency, allow_negative_pixels, print_inputs, transfer_axis, nullptr,
+        column_schedule);
 
-    // Time taken
-    gettimeofday(&wall_time_end, nullptr);
-    wall_time_elapsed = gettimelapsed(wall_time_start, wall_time_end);
-    print_v(1, "Wall-clock time elapsed: %.4g s \n", wall_time_elapsed);
+    std::valarray<std::valarray<double> > image(
+        std::valarray<double>(n_columns), n_rows);
+    copy_buffer_to_image(&buffer[0], image);
 
     return image;
 }
@@ -465,14 +1960,17 @@ std::valarray<std::valarray<double> > clock_charge_in_one_direction(
 
     Parameters
     ----------
-    image_in : std::valarray<std::valarray<double> >
-        The input array of pixel values, assumed to be in units of electrons.
-
-        The first dimension is the "row" index, the second is the "column"
-        index. By default (for parallel clocking), charge is transfered "up"
-        from row N to row 0 along each independent column. i.e. the readout
-        register is above row 0. For serial clocking, the image is rotated
-        before modelling, such that charge moves from column M to column 0.
+    image : real*
+        The array of pixel values, assumed to be in units of electrons, which
+        is modified in place to have CTI added. Either double, or float, which
+        is clocked in double via a copy, see clock_charge_in_images().
+
+        The pixel in "row" i and "column" j is image[i * row_stride +
+        j * column_stride]. By default (for parallel clocking), charge is
+        transfered "up" from row N to row 0 along each independent column.
+        i.e. the readout register is above row 0. For serial clocking, charge
+        is transferred along each row from column M to column 0, directly in
+        the same buffer without transposing the image.
 
         e.g.
         Initial image with one bright pixel in the first three columns:
@@ -497,6 +1995,13 @@ std::valarray<std::valarray<double> > clock_charge_in_one_direction(
              {  1.2,     2.4,     4.7,     0.1  },
              {  0.7,     1.4,     2.8,     0.06 }}
 
+    n_rows, n_columns : int
+        The shape of the image.
+
+    row_stride, column_stride : long
+        The step in the buffer between adjacent rows and between adjacent
+        columns, e.g. n_columns and 1 for a C-contiguous (row-major) array.
+
     parallel_roe : ROE* (opt.)
         The object describing the clocking read-out electronics, for parallel
         clocking. Default nullptr to not do parallel clocking.
@@ -552,13 +2057,19 @@ std::valarray<std::valarray<double> > clock_charge_in_one_direction(
         The interation when being called by remove_cti(), default 0 otherwise.
         Only used to control printing.
 
-    Returns
-    -------
-    image : std::valarray<std::valarray<double> >
-        The output array of pixel values with CTI added.
+    column_schedule : int (opt.)
+        How to share the columns (or rows for serial clocking) between threads.
+        See clock_charge_in_one_direction(). Default column_schedule_static.
+
+    parallel_pool, serial_pool : TrapManagerManagerPool* (opt.)
+        Persistent trap manager workspaces to reuse for each direction, e.g.
+        across repeated calls. Default nullptr to use temporary workspaces. See
+        clock_charge_in_one_direction(), and use a prepared CTIModel instead to
+        also set up the trap managers only once.
 */
-std::valarray<std::valarray<double> > add_cti(
-    std::valarray<std::valarray<double> >& image_in,
+template <typename real>
+void add_cti(
+    real* image, int n_rows, int n_columns, long row_stride, long column_stride,
     // Parallel
     ROE* parallel_roe, CCD* parallel_ccd,
     std::valarray<TrapInstantCapture>* parallel_traps_ic,
@@ -582,7 +2093,11 @@ std::valarray<std::valarray<double> > add_cti(
     // Combined
     int allow_negative_pixels, 
     // Output
-    int verbosity, int iteration) {
+    int verbosity, int iteration,
+    // Threads
+    int column_schedule,
+    // Workspaces
+    TrapManagerManagerPool* parallel_pool, TrapManagerManagerPool* serial_pool) {
     
  
     // Print unless being called by remove_cti()
@@ -591,22 +2106,21 @@ std::valarray<std::valarray<double> > add_cti(
     // Don't print model inputs every iteration
     int print_inputs = (iteration > 1) ? 0 : verbosity >= 1;
 
-    // Initialise the output image as a copy of the input image
-    std::valarray<std::valarray<double> > image = image_in;
-
     // Parallel clocking along columns, transfer charge towards row 0
     if (parallel_traps_ic || parallel_traps_sc || parallel_traps_ic_co ||
         parallel_traps_sc_co) {
         print_v(1, "Parallel: ");
-        image = clock_charge_in_one_direction(
-            image, parallel_roe, parallel_ccd, parallel_traps_ic, parallel_traps_sc,
+        clock_charge_in_one_direction(
+            image, n_rows, n_columns, row_stride, column_stride, parallel_roe,
+            parallel_ccd, parallel_traps_ic, parallel_traps_sc,
             parallel_traps_ic_co, parallel_traps_sc_co, 
             parallel_express, parallel_offset, 
             parallel_window_start, parallel_window_stop,
             serial_window_start, serial_window_stop, 
             parallel_time_start, parallel_time_stop,
             parallel_prune_n_electrons, parallel_prune_frequency,
-            allow_negative_pixels, print_inputs);
+            allow_negative_pixels, print_inputs, transfer_axis_parallel,
+            parallel_pool, column_schedule);
     }
 
     // Serial clocking along rows, transfer charge towards column 0
@@ -614,19 +2128,137 @@ std::valarray<std::valarray<double> > add_cti(
         serial_traps_sc_co) {
 
         print_v(1, "Serial: ");
-        image = transpose(image);
-        image = clock_charge_in_one_direction(
-            image, serial_roe, serial_ccd, serial_traps_ic, serial_traps_sc,
+        clock_charge_in_one_direction(
+            image, n_rows, n_columns, row_stride, column_stride, serial_roe,
+            serial_ccd, serial_traps_ic, serial_traps_sc,
             serial_traps_ic_co, serial_traps_sc_co, 
             serial_express, serial_offset,
             serial_window_start, serial_window_stop, 
             parallel_window_start, parallel_window_stop, 
             serial_time_start, serial_time_stop,
             serial_prune_n_electrons, serial_prune_frequency,
-            allow_negative_pixels, print_inputs);
-
-        image = transpose(image);
+            allow_negative_pixels, print_inputs, transfer_axis_serial, serial_pool,
+            column_schedule);
     }
+}
+
+template void add_cti<double>(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    ROE* parallel_roe, CCD* parallel_ccd,
+    std::valarray<TrapInstantCapture>* parallel_traps_ic,
+    std::valarray<TrapSlowCapture>* parallel_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* parallel_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* parallel_traps_sc_co,
+    int parallel_express, int parallel_offset, int parallel_window_start,
+    int parallel_window_stop, int parallel_time_start, int parallel_time_stop,
+    double parallel_prune_n_electrons, int parallel_prune_frequency,
+    ROE* serial_roe, CCD* serial_ccd, std::valarray<TrapInstantCapture>* serial_traps_ic,
+    std::valarray<TrapSlowCapture>* serial_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* serial_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* serial_traps_sc_co, int serial_express,
+    int serial_offset, int serial_window_start, int serial_window_stop,
+    int serial_time_start, int serial_time_stop, double serial_prune_n_electrons,
+    int serial_prune_frequency, int allow_negative_pixels, int verbosity,
+    int iteration, int column_schedule, TrapManagerManagerPool* parallel_pool,
+    TrapManagerManagerPool* serial_pool);
+template void add_cti<float>(
+    float* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    ROE* parallel_roe, CCD* parallel_ccd,
+    std::valarray<TrapInstantCapture>* parallel_traps_ic,
+    std::valarray<TrapSlowCapture>* parallel_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* parallel_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* parallel_traps_sc_co,
+    int parallel_express, int parallel_offset, int parallel_window_start,
+    int parallel_window_stop, int parallel_time_start, int parallel_time_stop,
+    double parallel_prune_n_electrons, int parallel_prune_frequency,
+    ROE* serial_roe, CCD* serial_ccd, std::valarray<TrapInstantCapture>* serial_traps_ic,
+    std::valarray<TrapSlowCapture>* serial_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* serial_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* serial_traps_sc_co, int serial_express,
+    int serial_offset, int serial_window_start, int serial_window_stop,
+    int serial_time_start, int serial_time_stop, double serial_prune_n_electrons,
+    int serial_prune_frequency, int allow_negative_pixels, int verbosity,
+    int iteration, int column_schedule, TrapManagerManagerPool* parallel_pool,
+    TrapManagerManagerPool* serial_pool);
+
+/*
+    Wrapper for add_cti() above for a valarray image.
+
+    Parameters
+    ----------
+    image_in : std::valarray<std::valarray<double> >
+        The input array of pixel values, assumed to be in units of electrons.
+
+        The first dimension is the "row" index, the second is the "column"
+        index. See the flat-buffer version for more detail.
+
+    ... : * (opt.)
+        As for the flat-buffer version.
+
+    Returns
+    -------
+    image : std::valarray<std::valarray<double> >
+        The output array of pixel values with CTI added.
+*/
+std::valarray<std::valarray<double> > add_cti(
+    std::valarray<std::valarray<double> >& image_in,
+    // Parallel
+    ROE* parallel_roe, CCD* parallel_ccd,
+    std::valarray<TrapInstantCapture>* parallel_traps_ic,
+    std::valarray<TrapSlowCapture>* parallel_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* parallel_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* parallel_traps_sc_co, 
+    int parallel_express, int parallel_offset, 
+    int parallel_window_start, int parallel_window_stop,
+    int parallel_time_start, int parallel_time_stop,
+    double parallel_prune_n_electrons, int parallel_prune_frequency,
+    // Serial
+    ROE* serial_roe, CCD* serial_ccd,
+    std::valarray<TrapInstantCapture>* serial_traps_ic,
+    std::valarray<TrapSlowCapture>* serial_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* serial_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* serial_traps_sc_co, 
+    int serial_express, int serial_offset, 
+    int serial_window_start, int serial_window_stop, 
+    int serial_time_start, int serial_time_stop,
+    double serial_prune_n_electrons, int serial_prune_frequency,
+    // Combined
+    int allow_negative_pixels, 
+    // Output
+    int verbosity, int iteration,
+    // Threads
+    int column_schedule) {
+
+    int n_rows = image_in.size();
+    int n_columns = image_in[0].size();
+
+    // Add CTI to a contiguous copy of the image
+    std::valarray<double> buffer(n_rows * n_columns);
+    copy_image_to_buffer(image_in, &buffer[0]);
+
+    add_cti(
+        &buffer[0], n_rows, n_columns, n_columns, 1,
+        // Parallel
+        parallel_roe, parallel_ccd, parallel_traps_ic, parallel_traps_sc,
+        parallel_traps_ic_co, parallel_traps_sc_co, parallel_express,
+        parallel_offset, parallel_window_start, parallel_window_stop,
+        parallel_time_start, parallel_time_stop, parallel_prune_n_electrons,
+        parallel_prune_frequency,
+        // Serial
+        serial_roe, serial_ccd, serial_traps_ic, serial_traps_sc,
+        serial_traps_ic_co, serial_traps_sc_co, serial_express, serial_offset,
+        serial_window_start, serial_window_stop, serial_time_start,
+        serial_time_stop, serial_prune_n_electrons, serial_prune_frequency,
+        // Combined
+        allow_negative_pixels,
+        // Output
+        verbosity, iteration,
+        // Threads
+        column_schedule);
+
+    std::valarray<std::valarray<double> > image(
+        std::valarray<double>(n_columns), n_rows);
+    copy_buffer_to_image(&buffer[0], image);
 
     return image;
 }
@@ -643,12 +2275,115 @@ std::valarray<std::valarray<double> > add_cti(
     All parameters are identical to those of add_cti() as described in its
     documentation, with the exception of:
 
+    image : real*
+        The array of pixel values (double or float), which is modified in
+        place to have CTI removed. See add_cti().
+
     n_iterations : int
         The number of times CTI-adding clocking is run to perform the correction
         via forward modelling. More iterations provide better results at the
         cost of longer runtime. In practice, two or three iterations are often
         sufficient.
 
+    The trap managers are set up once in a CTIModel for all the iterations,
+    so each thread's workspace is only copied from them in the first one. See
+    remove_cti_batch().
+*/
+template <typename real>
+void remove_cti(
+    real* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations,
+    // Parallel
+    ROE* parallel_roe, CCD* parallel_ccd,
+    std::valarray<TrapInstantCapture>* parallel_traps_ic,
+    std::valarray<TrapSlowCapture>* parallel_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* parallel_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* parallel_traps_sc_co, 
+    int parallel_express, int parallel_offset, 
+    int parallel_window_start, int parallel_window_stop,
+    int parallel_time_start, int parallel_time_stop,
+    double parallel_prune_n_electrons, int parallel_prune_frequency,
+    // Serial
+    ROE* serial_roe, CCD* serial_ccd,
+    std::valarray<TrapInstantCapture>* serial_traps_ic,
+    std::valarray<TrapSlowCapture>* serial_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* serial_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* serial_traps_sc_co, 
+    int serial_express, int serial_offset, 
+    int serial_window_start, int serial_window_stop,
+    int serial_time_start, int serial_time_stop,
+    double serial_prune_n_electrons, int serial_prune_frequency,
+    // Combined
+    int allow_negative_pixels,
+    // Threads
+    int column_schedule) {
+
+    // Set up the trap managers once for every iteration, instead of in each
+    // call of add_cti(), so the same workspaces are reused without copying
+    CTIModel model(
+        ClockingModel(
+            parallel_roe, parallel_ccd, parallel_traps_ic, parallel_traps_sc,
+            parallel_traps_ic_co, parallel_traps_sc_co, parallel_express,
+            parallel_offset, parallel_window_start, parallel_window_stop,
+            parallel_time_start, parallel_time_stop, parallel_prune_n_electrons,
+            parallel_prune_frequency),
+        ClockingModel(
+            serial_roe, serial_ccd, serial_traps_ic, serial_traps_sc,
+            serial_traps_ic_co, serial_traps_sc_co, serial_express, serial_offset,
+            serial_window_start, serial_window_stop, serial_time_start,
+            serial_time_stop, serial_prune_n_electrons, serial_prune_frequency),
+        allow_negative_pixels, column_schedule);
+
+    remove_cti(
+        image, n_rows, n_columns, row_stride, column_stride, n_iterations, model);
+}
+
+template void remove_cti<double>(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations, ROE* parallel_roe, CCD* parallel_ccd,
+    std::valarray<TrapInstantCapture>* parallel_traps_ic,
+    std::valarray<TrapSlowCapture>* parallel_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* parallel_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* parallel_traps_sc_co,
+    int parallel_express, int parallel_offset, int parallel_window_start,
+    int parallel_window_stop, int parallel_time_start, int parallel_time_stop,
+    double parallel_prune_n_electrons, int parallel_prune_frequency,
+    ROE* serial_roe, CCD* serial_ccd, std::valarray<TrapInstantCapture>* serial_traps_ic,
+    std::valarray<TrapSlowCapture>* serial_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* serial_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* serial_traps_sc_co, int serial_express,
+    int serial_offset, int serial_window_start, int serial_window_stop,
+    int serial_time_start, int serial_time_stop, double serial_prune_n_electrons,
+    int serial_prune_frequency, int allow_negative_pixels, int column_schedule);
+template void remove_cti<float>(
+    float* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations, ROE* parallel_roe, CCD* parallel_ccd,
+    std::valarray<TrapInstantCapture>* parallel_traps_ic,
+    std::valarray<TrapSlowCapture>* parallel_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* parallel_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* parallel_traps_sc_co,
+    int parallel_express, int parallel_offset, int parallel_window_start,
+    int parallel_window_stop, int parallel_time_start, int parallel_time_stop,
+    double parallel_prune_n_electrons, int parallel_prune_frequency,
+    ROE* serial_roe, CCD* serial_ccd, std::valarray<TrapInstantCapture>* serial_traps_ic,
+    std::valarray<TrapSlowCapture>* serial_traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* serial_traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* serial_traps_sc_co, int serial_express,
+    int serial_offset, int serial_window_start, int serial_window_stop,
+    int serial_time_start, int serial_time_stop, double serial_prune_n_electrons,
+    int serial_prune_frequency, int allow_negative_pixels, int column_schedule);
+
+/*
+    Wrapper for remove_cti() above for a valarray image.
+
+    Parameters
+    ----------
+    image_in : std::valarray<std::valarray<double> >
+        The input array of pixel values, assumed to be in units of electrons.
+
+    ... : * (opt.)
+        As for the flat-buffer version.
+
     Returns
     -------
     image : std::valarray<std::valarray<double> >
@@ -678,45 +2413,38 @@ std::valarray<std::valarray<double> > remove_cti(
     int serial_time_start, int serial_time_stop,
     double serial_prune_n_electrons, int serial_prune_frequency,
     // Combined
-    int allow_negative_pixels) {
-
-    print_version();
-
-    // Initialise the output image as a copy of the input image
-    std::valarray<std::valarray<double> > image_remove_cti = image_in;
-    std::valarray<std::valarray<double> > image_add_cti;
+    int allow_negative_pixels,
+    // Threads
+    int column_schedule) {
 
     int n_rows = image_in.size();
-
-    // Estimate the image with removed CTI more accurately each iteration
-    for (int iteration = 1; iteration <= n_iterations; iteration++) {
-        print_v(1, "Iter %d: ", iteration);
-
-        // Model the effect of adding CTI trails
-        image_add_cti = add_cti(
-            image_remove_cti, parallel_roe, parallel_ccd, parallel_traps_ic,
-            parallel_traps_sc, parallel_traps_ic_co, parallel_traps_sc_co,
-            parallel_express, parallel_offset, 
-            parallel_window_start, parallel_window_stop, 
-            parallel_time_start, parallel_time_stop,
-            parallel_prune_n_electrons, parallel_prune_frequency,
-            serial_roe, serial_ccd, serial_traps_ic,
-            serial_traps_sc, serial_traps_ic_co, serial_traps_sc_co, serial_express,
-            serial_offset, serial_window_start, serial_window_stop, 
-            serial_time_start, serial_time_stop, 
-            serial_prune_n_electrons, serial_prune_frequency,
-            allow_negative_pixels, 0, iteration);
-
-        // Improve the estimate of the image with CTI trails removed
-        image_remove_cti += image_in - image_add_cti;
-
-        // Prevent negative image values
-        if (!allow_negative_pixels) {
-            for (int row_index = 0; row_index < n_rows; row_index++) {
-                image_remove_cti[row_index][image_remove_cti[row_index] < 0.0] = 0.0;
-            }
-        }
-    }
+    int n_columns = image_in[0].size();
+
+    // Remove CTI from a contiguous copy of the image
+    std::valarray<double> buffer(n_rows * n_columns);
+    copy_image_to_buffer(image_in, &buffer[0]);
+
+    remove_cti(
+        &buffer[0], n_rows, n_columns, n_columns, 1, n_iterations,
+        // Parallel
+        parallel_roe, parallel_ccd, parallel_traps_ic, parallel_traps_sc,
+        parallel_traps_ic_co, parallel_traps_sc_co, parallel_express,
+        parallel_offset, parallel_window_start, parallel_window_stop,
+        parallel_time_start, parallel_time_stop, parallel_prune_n_electrons,
+        parallel_prune_frequency,
+        // Serial
+        serial_roe, serial_ccd, serial_traps_ic, serial_traps_sc,
+        serial_traps_ic_co, serial_traps_sc_co, serial_express, serial_offset,
+        serial_window_start, serial_window_stop, serial_time_start,
+        serial_time_stop, serial_prune_n_electrons, serial_prune_frequency,
+        // Combined
+        allow_negative_pixels,
+        // Threads
+        column_schedule);
+
+    std::valarray<std::valarray<double> > image_remove_cti(
+        std::valarray<double>(n_columns), n_rows);
+    copy_buffer_to_image(&buffer[0], image_remove_cti);
 
     return image_remove_cti;
 }
@@ -1,10 +1,17 @@
 
 #include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
 
+#include <string>
+#include <utility>
 #include <valarray>
+#include <vector>
 
+#include "ccd.hpp"
 #include "cti.hpp"
+#include "model.hpp"
 #include "roe.hpp"
 #include "trap_managers.hpp"
 #include "traps.hpp"
@@ -13,6 +20,18 @@
 static bool demo_mode = false;
 static bool benchmark_mode = false;
 
+// Batch mode settings, see print_help()
+static std::vector<std::pair<std::string, std::string> > batch_files;
+static int n_iterations = 0;
+static std::valarray<double> parallel_trap_parameters = {};
+static std::valarray<double> serial_trap_parameters = {};
+static std::valarray<double> parallel_slow_trap_parameters = {};
+static std::valarray<double> serial_slow_trap_parameters = {};
+static std::valarray<double> parallel_ccd_parameters = {1e4, 0.0, 1.0};
+static std::valarray<double> serial_ccd_parameters = {1e4, 0.0, 1.0};
+static int parallel_express = 0;
+static int serial_express = 0;
+
 /*
     Run arctic with --demo or -d to execute this editable demo code.
 
@@ -146,6 +165,119 @@ int run_benchmark() {
     return 0;
 }
 
+/*
+    Instant-capture traps from pairs of densities and release timescales.
+*/
+static std::valarray<TrapInstantCapture> traps_from_parameters(
+    std::valarray<double>& parameters) {
+    std::vector<TrapInstantCapture> traps;
+    for (unsigned int i_trap = 0; i_trap < parameters.size() / 2; i_trap++)
+        traps.push_back(
+            TrapInstantCapture(parameters[2 * i_trap], parameters[2 * i_trap + 1]));
+
+    return std::valarray<TrapInstantCapture>(traps.data(), traps.size());
+}
+
+/*
+    Slow-capture traps from triplets of densities, release timescales, and
+    capture timescales.
+*/
+static std::valarray<TrapSlowCapture> slow_traps_from_parameters(
+    std::valarray<double>& parameters) {
+    std::vector<TrapSlowCapture> traps;
+    for (unsigned int i_trap = 0; i_trap < parameters.size() / 3; i_trap++)
+        traps.push_back(TrapSlowCapture(
+            parameters[3 * i_trap], parameters[3 * i_trap + 1],
+            parameters[3 * i_trap + 2]));
+
+    return std::valarray<TrapSlowCapture>(traps.data(), traps.size());
+}
+
+/*
+    Run arctic with pairs of input and output image files (and/or --list) to add
+    or remove CTI for each one in turn, with the same prepared model.
+
+    The images are loaded and saved as text, raw binary, or FITS depending on
+    their file extensions, see load_image() and save_image().
+
+    Only instant-capture and slow-capture traps can be set, with a standard
+    single-step clock sequence in each direction, see print_help().
+*/
+int run_batch() {
+    std::valarray<TrapInstantCapture> parallel_traps =
+        traps_from_parameters(parallel_trap_parameters);
+    std::valarray<TrapInstantCapture> serial_traps =
+        traps_from_parameters(serial_trap_parameters);
+    std::valarray<TrapSlowCapture> parallel_slow_traps =
+        slow_traps_from_parameters(parallel_slow_trap_parameters);
+    std::valarray<TrapSlowCapture> serial_slow_traps =
+        slow_traps_from_parameters(serial_slow_trap_parameters);
+
+    // The prepared model, reused for every image of the same size
+    std::valarray<double> dwell_times = {1.0};
+    ROE parallel_roe(dwell_times);
+    ROE serial_roe(dwell_times);
+    CCD parallel_ccd(CCDPhase(
+        parallel_ccd_parameters[0], parallel_ccd_parameters[1],
+        parallel_ccd_parameters[2]));
+    CCD serial_ccd(CCDPhase(
+        serial_ccd_parameters[0], serial_ccd_parameters[1], serial_ccd_parameters[2]));
+    CTIModel model(
+        ClockingModel(
+            &parallel_roe, &parallel_ccd, &parallel_traps, &parallel_slow_traps,
+            nullptr, nullptr, parallel_express),
+        ClockingModel(
+            &serial_roe, &serial_ccd, &serial_traps, &serial_slow_traps, nullptr,
+            nullptr, serial_express));
+    if (!model.parallel.is_active() && !model.serial.is_active())
+        error("No traps given, see --parallel-traps and --serial-traps etc");
+
+    struct timeval time_start, time_end;
+    for (std::pair<std::string, std::string>& files : batch_files) {
+        gettimeofday(&time_start, nullptr);
+
+        int n_rows;
+        int n_columns;
+        std::vector<double> image = load_image(files.first.c_str(), n_rows, n_columns);
+
+        if (n_iterations > 0)
+            remove_cti(
+                image.data(), n_rows, n_columns, n_columns, 1, n_iterations, model);
+        else
+            add_cti(image.data(), n_rows, n_columns, n_columns, 1, model, verbosity);
+
+        save_image(files.second.c_str(), image.data(), n_rows, n_columns);
+
+        gettimeofday(&time_end, nullptr);
+        print_v(
+            1, "# %s -> %s [%d, %d] in %.4g s \n", files.first.c_str(),
+            files.second.c_str(), n_rows, n_columns,
+            gettimelapsed(time_start, time_end));
+    }
+
+    return 0;
+}
+
+/*
+    Parse a comma-separated list of numbers, e.g. for --parallel-traps.
+*/
+static std::valarray<double> parse_list(const char* option, const char* text) {
+    std::vector<double> values;
+    const char* start = text;
+    char* end;
+    while (*start != '\0') {
+        values.push_back(strtod(start, &end));
+        if ((end == start) || ((*end != ',') && (*end != '\0'))) {
+            printf(
+                "Error: Invalid list '%s' for %s. Run with -h for help. \n", text,
+                option);
+            exit(1);
+        }
+        start = (*end == ',') ? end + 1 : end;
+    }
+    return std::valarray<double>(values.data(), values.size());
+}
+
 /*
     Print help information.
 */
@@ -173,6 +305,36 @@ void print_help() {
         "-b, --benchmark \n"
         "    Execute the run_benchmark() function in main.cpp, e.g. for profiling. \n"
         "\n"
+        "Batch mode \n"
+        "---------- \n"
+        "arctic [options] <input> <output> [<input> <output> ...] \n"
+        "    Add (or remove) CTI to each input image and save it to the output, \n"
+        "    reusing the same prepared model. Files ending in .bin are raw binary \n"
+        "    (int32 n_rows, n_columns then float64 pixels), .fits (or .fit, .fts) \n"
+        "    are FITS, and others are text, see load_image() in util.cpp. \n"
+        "-l <file>, --list=<file> \n"
+        "    A text file of further input and output file pairs, one per line. \n"
+        "-r <int>, --remove=<int> \n"
+        "    Remove CTI with this many iterations, instead of adding it. \n"
+        "--parallel-traps=<density,timescale,...> \n"
+        "--serial-traps=<density,timescale,...> \n"
+        "    The density and release timescale of each instant-capture trap \n"
+        "    species, for clocking in that direction. \n"
+        "--parallel-slow-traps=<density,release_timescale,capture_timescale,...> \n"
+        "--serial-slow-traps=<density,release_timescale,capture_timescale,...> \n"
+        "    The density, release timescale, and capture timescale of each \n"
+        "    slow-capture trap species, for clocking in that direction. \n"
+        "--parallel-ccd=<full_well_depth,well_notch_depth,well_fill_power> \n"
+        "--serial-ccd=<full_well_depth,well_notch_depth,well_fill_power> \n"
+        "    The CCD well parameters. Default 1e4,0,1. \n"
+        "--parallel-express=<int>, --serial-express=<int> \n"
+        "    The number of express passes. Default 0 for every transfer. \n"
+        "\n"
+        "Batch mode is limited to these options: continuum traps, other clock \n"
+        "sequences (each direction uses a standard single-step ROE with a dwell \n"
+        "time of 1 and empty traps between columns), windows, offsets, and pixel \n"
+        "bounce all need the C++ library or arcticpy instead. \n"
+        "\n"
         "See README.md for more information.  https://github.com/jkeger/arctic \n\n");
 }
 
@@ -181,14 +343,37 @@ void print_help() {
 */
 void parse_parameters(int argc, char** argv) {
     // Short options
-    const char* const short_opts = ":hv:db";
-    // Full options
+    const char* const short_opts = ":hv:dbl:r:";
+    // Full options, with the long-only ones after the characters
+    enum {
+        opt_parallel_traps = 256,
+        opt_serial_traps,
+        opt_parallel_slow_traps,
+        opt_serial_slow_traps,
+        opt_parallel_ccd,
+        opt_serial_ccd,
+        opt_parallel_express,
+        opt_serial_express
+    };
     const option long_opts[] = {
         {"help", no_argument, nullptr, 'h'},
         {"verbosity", required_argument, nullptr, 'v'},
         {"demo", no_argument, nullptr, 'd'},
         {"benchmark", no_argument, nullptr, 'b'},
+        {"list", required_argument, nullptr, 'l'},
+        {"remove", required_argument, nullptr, 'r'},
+        {"parallel-traps", required_argument, nullptr, opt_parallel_traps},
+        {"serial-traps", required_argument, nullptr, opt_serial_traps},
+        {"parallel-slow-traps", required_argument, nullptr, opt_parallel_slow_traps},
+        {"serial-slow-traps", required_argument, nullptr, opt_serial_slow_traps},
+        {"parallel-ccd", required_argument, nullptr, opt_parallel_ccd},
+        {"serial-ccd", required_argument, nullptr, opt_serial_ccd},
+        {"parallel-express", required_argument, nullptr, opt_parallel_express},
+        {"serial-express", required_argument, nullptr, opt_serial_express},
         {0, 0, 0, 0}};
+    FILE* f;
+    char input[4096];
+    char output[4096];
 
     // Parse options
     while (true) {
@@ -209,6 +394,41 @@ void parse_parameters(int argc, char** argv) {
             case 'b':
                 benchmark_mode = true;
                 break;
+            case 'l':
+                f = fopen(optarg, "r");
+                if (!f) error("Failed to open file list '%s'", optarg);
+                while (fscanf(f, "%4095s %4095s", input, output) == 2)
+                    batch_files.push_back(std::make_pair(input, output));
+                fclose(f);
+                break;
+            case 'r':
+                n_iterations = atoi(optarg);
+                break;
+            case opt_parallel_traps:
+                parallel_trap_parameters = parse_list("--parallel-traps", optarg);
+                break;
+            case opt_serial_traps:
+                serial_trap_parameters = parse_list("--serial-traps", optarg);
+                break;
+            case opt_parallel_slow_traps:
+                parallel_slow_trap_parameters =
+                    parse_list("--parallel-slow-traps", optarg);
+                break;
+            case opt_serial_slow_traps:
+                serial_slow_trap_parameters = parse_list("--serial-slow-traps", optarg);
+                break;
+            case opt_parallel_ccd:
+                parallel_ccd_parameters = parse_list("--parallel-ccd", optarg);
+                break;
+            case opt_serial_ccd:
+                serial_ccd_parameters = parse_list("--serial-ccd", optarg);
+                break;
+            case opt_parallel_express:
+                parallel_express = atoi(optarg);
+                break;
+            case opt_serial_express:
+                serial_express = atoi(optarg);
+                break;
             case ':':
                 printf(
                     "Error: Option %s requires a value. Run with -h for help. \n",
@@ -222,9 +442,32 @@ void parse_parameters(int argc, char** argv) {
         }
     }
 
-    // Other parameters (currently unused)
-    for (; optind < argc; optind++) {
-        printf("Unparsed parameter: %s \n", argv[optind]);
+    // Input and output file pairs for batch mode
+    if ((argc - optind) % 2 != 0) {
+        printf(
+            "Error: Input file '%s' has no output. Run with -h for help. \n",
+            argv[argc - 1]);
+        exit(1);
+    }
+    for (; optind < argc; optind += 2)
+        batch_files.push_back(std::make_pair(argv[optind], argv[optind + 1]));
+
+    // Check the list lengths
+    if ((parallel_trap_parameters.size() % 2 != 0) ||
+        (serial_trap_parameters.size() % 2 != 0)) {
+        printf("Error: Traps need pairs of densities and timescales. \n");
+        exit(1);
+    }
+    if ((parallel_slow_trap_parameters.size() % 3 != 0) ||
+        (serial_slow_trap_parameters.size() % 3 != 0)) {
+        printf(
+            "Error: Slow-capture traps need triplets of densities and release and "
+            "capture timescales. \n");
+        exit(1);
+    }
+    if ((parallel_ccd_parameters.size() != 3) || (serial_ccd_parameters.size() != 3)) {
+        printf("Error: CCDs need three well parameters. \n");
+        exit(1);
     }
 }
 
@@ -249,6 +492,14 @@ void parse_parameters(int argc, char** argv) {
 
     -b, --benchmark
         Execute the run_benchmark() function above, e.g. for profiling.
+
+    <input> <output> [<input> <output> ...]
+    -l <file>, --list=<file>
+    -r <int>, --remove=<int>
+    --parallel-traps, --serial-traps, --parallel-ccd, --serial-ccd,
+    --parallel-express, --serial-express
+        Batch mode to add or remove CTI for each pair of image files, see
+        run_batch() and print_help().
 */
 int main(int argc, char** argv) {
 
@@ -262,6 +513,7 @@ int main(int argc, char** argv) {
         print_v(1, "# Running benchmark code \n");
         return run_benchmark();
     }
+    if (!batch_files.empty()) return run_batch();
 
     return 0;
 }
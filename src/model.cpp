@@ -0,0 +1,1583 @@
+
+#include "model.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <valarray>
+#include <vector>
+
+#include "ccd.hpp"
+#include "cti.hpp"
+#include "roe.hpp"
+#include "trap_managers.hpp"
+#include "traps.hpp"
+#include "util.hpp"
+
+// ========
+// ClockingModel::
+// ========
+/*
+    Class ClockingModel.
+
+    A prepared model for clocking in one direction (parallel or serial), to
+    set up the readout electronics and trap managers only once for any number
+    of images, instead of for every call of add_cti().
+
+    Parameters
+    ----------
+    roe : ROE*
+    ccd : CCD*
+    traps_ic, traps_sc, traps_ic_co, traps_sc_co : std::valarray<Trap...>*
+    express, window_offset, window_start, window_stop, time_start, time_stop,
+    prune_n_electrons, prune_frequency : * (opt.)
+        As for the equivalent parallel_* or serial_* parameters of add_cti().
+        The traps are copied, while the ROE and CCD must not be deleted while
+        the model is in use. Default nullptr traps to not clock this direction.
+
+    checkpoint_interval : int (opt.)
+        If > 0, then save the trap states every this many rows while clocking
+        each column, and in the next call restart each column from its last
+        checkpoint before the first pixel whose input has changed (or skip it
+        entirely if none have) instead of from the start. This avoids
+        reclocking long unchanged stretches of columns, e.g. in the iterations
+        of remove_cti_batch() for images with sparse bright sources, at the
+        cost of the memory for the saved states and two copies of the images.
+        Only used with the traps emptied between columns, a single-step clock
+        sequence, and single-phase pixels, otherwise ignored. Default 0 to
+        clock every column in full.
+
+    checkpoint_tolerance : double (opt.)
+        The change in a pixel's input, since it was last clocked, above which
+        the column is reclocked from before that pixel. Default 0 for the same
+        results as without checkpoints, or larger to also reuse pixels that
+        have changed by only a little.
+
+    Attributes
+    ----------
+    roe_is_shared : bool
+        Whether the ROE is also used by another model (e.g. the same object for
+        parallel and serial clocking), in which case it is set up again for
+        every call. Set by CTIModel(). Otherwise, the ROE should not be used for
+        anything else meanwhile.
+
+    is_prepared : bool
+    prepared_n_rows, prepared_n_columns, prepared_n_active_rows,
+    prepared_window_offset : int
+        Whether and for what size of images (with the charge transferred along
+        each column) and window_offset the trap managers have been set up.
+
+    trap_manager_manager : TrapManagerManager
+        The set-up trap managers, with empty trap states.
+
+    pool : TrapManagerManagerPool
+        The per-thread trap manager workspaces, reused for every call.
+
+    column_checkpoints : std::vector<ColumnCheckpoints>
+    checkpoints_n_images, checkpoints_n_rows, checkpoints_n_columns,
+    checkpoints_n_express_passes : int
+        The checkpoints and the clocked pixels of every column of every image
+        (with the charge transferred along each column) from the last call, if
+        using checkpoint_interval, and for what size of images and express.
+
+    n_rows_reused : long
+        The total number of modelled rows in all columns that weren't reclocked
+        thanks to the checkpoints, in the last call.
+*/
+ClockingModel::ClockingModel(
+    ROE* roe, CCD* ccd, std::valarray<TrapInstantCapture>* traps_ic,
+    std::valarray<TrapSlowCapture>* traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* traps_ic_co,
+    std::valarray<TrapSlowCaptureContinuum>* traps_sc_co, int express,
+    int window_offset, int window_start, int window_stop, int time_start,
+    int time_stop, double prune_n_electrons, int prune_frequency,
+    int checkpoint_interval, double checkpoint_tolerance)
+    : roe(roe),
+      ccd(ccd),
+      express(express),
+      window_offset(window_offset),
+      window_start(window_start),
+      window_stop(window_stop),
+      time_start(time_start),
+      time_stop(time_stop),
+      prune_n_electrons(prune_n_electrons),
+      prune_frequency(prune_frequency),
+      roe_is_shared(false),
+      checkpoint_interval(checkpoint_interval),
+      checkpoint_tolerance(checkpoint_tolerance),
+      is_prepared(false),
+      prepared_n_rows(0),
+      prepared_n_columns(0),
+      prepared_n_active_rows(0),
+      prepared_window_offset(0),
+      checkpoints_n_images(0),
+      checkpoints_n_rows(0),
+      checkpoints_n_columns(0),
+      checkpoints_n_express_passes(0),
+      n_rows_reused(0) {
+
+    if (traps_ic) this->traps_ic = *traps_ic;
+    if (traps_sc) this->traps_sc = *traps_sc;
+    if (traps_ic_co) this->traps_ic_co = *traps_ic_co;
+    if (traps_sc_co) this->traps_sc_co = *traps_sc_co;
+
+    if (is_active() && ((roe == nullptr) || (ccd == nullptr)))
+        error("An ROE and CCD are required with the traps");
+}
+
+/*
+    Whether there are any traps to clock in this direction.
+*/
+bool ClockingModel::is_active() {
+    return (traps_ic.size() > 0) || (traps_sc.size() > 0) ||
+           (traps_ic_co.size() > 0) || (traps_sc_co.size() > 0);
+}
+
+/*
+    The fraction of a trap species' captured electrons still held after a
+    time, for trail_length_of_traps().
+*/
+static double fill_fraction_after(
+    TrapInstantCapture& trap, double time_elapsed, gsl_integration_workspace*) {
+    return trap.fill_fraction_from_time_elapsed(time_elapsed);
+}
+
+static double fill_fraction_after(
+    TrapInstantCaptureContinuum& trap, double time_elapsed,
+    gsl_integration_workspace* workspace) {
+    return trap.fill_fraction_from_time_elapsed(time_elapsed, workspace);
+}
+
+static double fill_fraction_after(
+    TrapSlowCaptureContinuum& trap, double time_elapsed,
+    gsl_integration_workspace* workspace) {
+    return trap.fill_fraction_from_time_elapsed(time_elapsed, workspace);
+}
+
+/*
+    The longest trail of any of the traps, see ClockingModel::trail_length().
+*/
+template <class Trap>
+static int trail_length_of_traps(
+    std::valarray<Trap>& traps, double transfer_time, double trail_fraction,
+    int max_trail_length, gsl_integration_workspace* workspace) {
+    int trail_length = 0;
+
+    for (unsigned int i_trap = 0; i_trap < traps.size(); i_trap++) {
+        // Double the number of transfers until the traps are drained enough,
+        // then bisect between the last two
+        int n_lo = 0;
+        int n_hi = 1;
+        while ((n_hi < max_trail_length) &&
+               (fill_fraction_after(traps[i_trap], n_hi * transfer_time, workspace) >
+                trail_fraction)) {
+            n_lo = n_hi;
+            n_hi *= 2;
+        }
+        n_hi = std::min(n_hi, max_trail_length);
+        while (n_hi - n_lo > 1) {
+            int n_mid = (n_lo + n_hi) / 2;
+            if (fill_fraction_after(traps[i_trap], n_mid * transfer_time, workspace) >
+                trail_fraction)
+                n_lo = n_mid;
+            else
+                n_hi = n_mid;
+        }
+
+        trail_length = std::max(trail_length, n_hi);
+    }
+
+    return trail_length;
+}
+
+/*
+    The number of transfers after which every trap species holds no more than
+    a fraction of the electrons it captured, i.e. roughly how far behind a
+    pixel its CTI trail reaches.
+
+    Parameters
+    ----------
+    trail_fraction : double
+        The fraction of the captured electrons left to be released.
+
+    max_trail_length : int
+        The maximum number of transfers to return, e.g. the number of rows.
+
+    Returns
+    -------
+    trail_length : int
+        The number of transfers, each of the ROE's total dwell time.
+*/
+int ClockingModel::trail_length(double trail_fraction, int max_trail_length) {
+    if (!is_active() || (max_trail_length <= 0)) return 0;
+
+    double transfer_time = roe->dwell_times.sum();
+    gsl_integration_workspace* workspace = gsl_integration_workspace_alloc(100);
+
+    int trail_length = std::max(
+        std::max(
+            trail_length_of_traps(
+                traps_ic, transfer_time, trail_fraction, max_trail_length, workspace),
+            trail_length_of_traps(
+                traps_sc, transfer_time, trail_fraction, max_trail_length, workspace)),
+        std::max(
+            trail_length_of_traps(
+                traps_ic_co, transfer_time, trail_fraction, max_trail_length,
+                workspace),
+            trail_length_of_traps(
+                traps_sc_co, transfer_time, trail_fraction, max_trail_length,
+                workspace)));
+
+    gsl_integration_workspace_free(workspace);
+
+    return trail_length;
+}
+
+/*
+    Set up the readout electronics and trap managers for a size of image, if
+    not already done for the same size and window_offset.
+
+    Parameters
+    ----------
+    n_rows, n_columns : int
+        The numbers of rows and columns in the images, with the charge
+        transferred along each column towards row 0.
+
+    n_active_rows : int
+        The number of rows to model.
+*/
+void ClockingModel::prepare(int n_rows, int n_columns, int n_active_rows) {
+    // Reuse the existing trap managers, unless the number of columns matters
+    if (is_prepared && (n_rows == prepared_n_rows) &&
+        (n_active_rows == prepared_n_active_rows) &&
+        (window_offset == prepared_window_offset) &&
+        (roe->empty_traps_between_columns || (n_columns == prepared_n_columns))) {
+        if (roe_is_shared)
+            prepare_roe(
+                roe, ccd, n_rows, n_active_rows, express, window_offset, time_start,
+                time_stop);
+        return;
+    }
+
+    trap_manager_manager = prepare_clocking(
+        roe, ccd, &traps_ic, &traps_sc, &traps_ic_co, &traps_sc_co, n_rows,
+        n_active_rows, express, window_offset, time_start, time_stop);
+
+    is_prepared = true;
+    prepared_n_rows = n_rows;
+    prepared_n_columns = n_columns;
+    prepared_n_active_rows = n_active_rows;
+    prepared_window_offset = window_offset;
+
+    // The saved trap states are only valid for the same express passes
+    column_checkpoints.clear();
+}
+
+/*
+    Choose where to restart clocking each column from its checkpoints, see
+    checkpoint_interval, and set the rows before then to their already
+    clocked values. Set up new checkpoints if the size of the images changed.
+
+    Parameters
+    ----------
+    images : real**
+    n_images, n_rows, n_columns, row_stride, column_stride : int/long
+        The images to be clocked, with the charge transferred along each
+        column, e.g. with the rows and columns swapped for serial clocking.
+
+    row_start, n_active_rows, column_start, column_stop : int
+        The window of pixels to model, with the defaults already applied.
+*/
+template <typename real>
+void ClockingModel::prepare_checkpoints(
+    real** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int row_start, int n_active_rows, int column_start,
+    int column_stop) {
+
+    // Discard the saved checkpoints of a different size of images
+    if ((n_images != checkpoints_n_images) || (n_rows != checkpoints_n_rows) ||
+        (n_columns != checkpoints_n_columns) ||
+        ((int)roe->n_express_passes != checkpoints_n_express_passes) ||
+        (column_checkpoints.size() == 0) ||
+        (column_checkpoints[0].interval != checkpoint_interval) ||
+        ((int)column_checkpoints[0].pixels_in.size() != n_active_rows)) {
+        column_checkpoints.assign(n_images * n_columns, ColumnCheckpoints());
+        for (ColumnCheckpoints& checkpoints : column_checkpoints)
+            checkpoints.reset(checkpoint_interval, roe->n_express_passes, n_active_rows);
+        checkpoints_n_images = n_images;
+        checkpoints_n_rows = n_rows;
+        checkpoints_n_columns = n_columns;
+        checkpoints_n_express_passes = roe->n_express_passes;
+    }
+
+    n_rows_reused = 0;
+    for (int i_image = 0; i_image < n_images; i_image++) {
+        for (int column_index = column_start; column_index < column_stop;
+             column_index++) {
+            ColumnCheckpoints& checkpoints =
+                column_checkpoints[i_image * n_columns + column_index];
+            real* column =
+                images[i_image] + column_index * column_stride + row_start * row_stride;
+
+            // The first modelled row whose input changed since it was clocked
+            int i_row_changed = 0;
+            if (checkpoints.is_recorded) {
+                while ((i_row_changed < n_active_rows) &&
+                       (fabs(column[i_row_changed * row_stride] -
+                             checkpoints.pixels_in[i_row_changed]) <=
+                        checkpoint_tolerance))
+                    i_row_changed++;
+            }
+
+            // Restart from the last checkpoint before then, or skip the column
+            int i_row_restart;
+            if (i_row_changed == n_active_rows) {
+                checkpoints.i_restart = -1;
+                i_row_restart = n_active_rows;
+            } else {
+                checkpoints.i_restart = i_row_changed / checkpoint_interval;
+                i_row_restart = checkpoints.i_restart * checkpoint_interval;
+            }
+            n_rows_reused += i_row_restart;
+
+            // Reuse the clocked rows before the restart, and keep the input of
+            // the rows to be clocked
+            for (int i_row = 0; i_row < i_row_restart; i_row++)
+                column[i_row * row_stride] = checkpoints.pixels_out[i_row];
+            for (int i_row = i_row_restart; i_row < n_active_rows; i_row++)
+                checkpoints.pixels_in[i_row] = column[i_row * row_stride];
+        }
+    }
+}
+
+/*
+    Keep the clocked pixels of each column after clocking with checkpoints,
+    see prepare_checkpoints() for the parameters.
+*/
+template <typename real>
+void ClockingModel::record_checkpoints(
+    real** images, int n_images, int n_columns, long row_stride,
+    long column_stride, int row_start, int n_active_rows, int column_start,
+    int column_stop) {
+
+    for (int i_image = 0; i_image < n_images; i_image++) {
+        for (int column_index = column_start; column_index < column_stop;
+             column_index++) {
+            ColumnCheckpoints& checkpoints =
+                column_checkpoints[i_image * n_columns + column_index];
+            if (checkpoints.i_restart < 0) continue;
+            real* column =
+                images[i_image] + column_index * column_stride + row_start * row_stride;
+
+            for (int i_row = checkpoints.i_restart * checkpoint_interval;
+                 i_row < n_active_rows; i_row++)
+                checkpoints.pixels_out[i_row] = column[i_row * row_stride];
+            checkpoints.is_recorded = true;
+        }
+    }
+}
+
+/*
+    Clock the charge in one or more images in this direction, modifying them
+    in place. See clock_charge_in_one_direction() and clock_charge_in_images().
+
+    Parameters
+    ----------
+    images : real**
+        The pixel values of each image, with the same dimensions and strides,
+        either double or float (see clock_charge_in_images()).
+
+    n_images, n_rows, n_columns, row_stride, column_stride : int/long
+        The number of images, and the dimensions and strides of each one.
+
+    column_start, column_stop : int
+        The window of columns (or rows for serial clocking) to model, from the
+        model for the other direction.
+
+    transfer_axis : int
+        transfer_axis_parallel or transfer_axis_serial.
+
+    allow_negative_pixels, print_inputs, column_schedule : int
+        See clock_charge_in_one_direction().
+
+    pixel_bounces : const std::vector<PixelBounce>* (opt.)
+        Pixel bounce models to add along each clocked line, normally only for
+        serial clocking. See clock_charge_in_images().
+*/
+template <typename real>
+void ClockingModel::clock(
+    real** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int column_start, int column_stop, int transfer_axis,
+    int allow_negative_pixels, int print_inputs, int column_schedule,
+    const std::vector<PixelBounce>* pixel_bounces) {
+
+    // View the images with their rows and columns swapped to transfer the
+    // charge along each row instead
+    if (transfer_axis == transfer_axis_serial) {
+        std::swap(n_rows, n_columns);
+        std::swap(row_stride, column_stride);
+    }
+
+    // Defaults
+    int row_start = window_start;
+    int row_stop = (window_stop == -1) ? n_rows : window_stop;
+    if (column_stop == -1) column_stop = n_columns;
+
+    // Number of active rows and columns
+    unsigned int n_active_rows = row_stop - row_start;
+    unsigned int n_active_columns = column_stop - column_start;
+    print_v(
+        1, "%d image(s), %d column(s) [%d to %d], %d row(s) [%d to %d] \n", n_images,
+        n_active_columns, column_start, column_stop, n_active_rows, row_start,
+        row_stop);
+
+    prepare(n_rows, n_columns, n_active_rows);
+
+    if (print_inputs > 0)
+        print_clocking_inputs(roe, ccd, trap_manager_manager, express, window_offset);
+
+    // Measure wall-clock time taken for the primary loop
+    struct timeval wall_time_start;
+    struct timeval wall_time_end;
+    double wall_time_elapsed;
+    gettimeofday(&wall_time_start, nullptr);
+
+    // Restart each column from its last checkpoint before any changed input
+    bool use_checkpoints = (checkpoint_interval > 0) &&
+                           roe->empty_traps_between_columns && (roe->n_steps == 1) &&
+                           (ccd->n_phases == 1) && (roe->express_pass_start == 0) &&
+                           (roe->express_pass_stop == roe->n_express_passes);
+    if (use_checkpoints)
+        prepare_checkpoints(
+            images, n_images, n_rows, n_columns, row_stride, column_stride, row_start,
+            n_active_rows, column_start, column_stop);
+
+    clock_charge_in_images(
+        images, n_images, n_rows, n_columns, row_stride, column_stride, roe, ccd,
+        trap_manager_manager, row_start, row_stop, column_start, column_stop,
+        prune_n_electrons, prune_frequency, allow_negative_pixels, &pool,
+        column_schedule, transfer_axis, use_checkpoints ? &column_checkpoints : nullptr,
+        use_checkpoints ? nullptr : pixel_bounces);
+
+    if (use_checkpoints)
+        record_checkpoints(
+            images, n_images, n_columns, row_stride, column_stride, row_start,
+            n_active_rows, column_start, column_stop);
+
+    // Add pixel bounce only after recording the clocked pixels to be reused
+    if (use_checkpoints && pixel_bounces)
+        add_pixel_bounce(
+            images, n_images, column_stride, row_stride, column_start, column_stop,
+            row_start, row_stop, *pixel_bounces);
+
+    // Time taken
+    gettimeofday(&wall_time_end, nullptr);
+    wall_time_elapsed = gettimelapsed(wall_time_start, wall_time_end);
+    print_v(1, "Wall-clock time elapsed: %.4g s \n", wall_time_elapsed);
+}
+
+/*
+    Clock the charge in the images of several trap models in this direction,
+    each model with different densities of its instant-capture and slow-capture
+    traps, modifying them in place. See add_cti_density_sweep() and
+    clock_charge_in_images_ensemble().
+
+    Parameters
+    ----------
+    images : double**
+        The pixel values of each model's image, with the same dimensions and
+        strides.
+
+    n_models : int
+        The number of models and images.
+
+    trap_densities : const double*
+        The densities of the model's instant-capture then slow-capture trap
+        species for each model, so trap species i of model k has the density
+        trap_densities[k * (n_traps_ic + n_traps_sc) + i]. Or nullptr for all
+        the models to use the original densities.
+
+    See clock() for the other parameters.
+*/
+void ClockingModel::clock_density_sweep(
+    double** images, int n_models, int n_rows, int n_columns, long row_stride,
+    long column_stride, int column_start, int column_stop, int transfer_axis,
+    int allow_negative_pixels, int print_inputs, const double* trap_densities) {
+
+    if (transfer_axis == transfer_axis_serial) {
+        std::swap(n_rows, n_columns);
+        std::swap(row_stride, column_stride);
+    }
+
+    // Defaults
+    int row_start = window_start;
+    int row_stop = (window_stop == -1) ? n_rows : window_stop;
+    if (column_stop == -1) column_stop = n_columns;
+    unsigned int n_active_rows = row_stop - row_start;
+    print_v(
+        1, "%d model(s), %d column(s) [%d to %d], %d row(s) [%d to %d] \n", n_models,
+        column_stop - column_start, column_start, column_stop, n_active_rows,
+        row_start, row_stop);
+
+    prepare(n_rows, n_columns, n_active_rows);
+
+    if (print_inputs > 0)
+        print_clocking_inputs(roe, ccd, trap_manager_manager, express, window_offset);
+
+    // Each model's trap managers, copied from the prepared ones
+    std::vector<TrapManagerManager> trap_manager_managers(
+        n_models, trap_manager_manager);
+    if (trap_densities) {
+        int n_traps_ic = traps_ic.size();
+        int n_traps = n_traps_ic + traps_sc.size();
+        for (int i_model = 0; i_model < n_models; i_model++)
+            trap_manager_managers[i_model].set_trap_densities(
+                trap_densities + i_model * n_traps,
+                trap_densities + i_model * n_traps + n_traps_ic);
+    }
+
+    struct timeval wall_time_start;
+    struct timeval wall_time_end;
+    gettimeofday(&wall_time_start, nullptr);
+
+    clock_charge_in_images_ensemble(
+        images, n_models, n_rows, row_stride, column_stride, roe, ccd,
+        trap_manager_managers, row_start, row_stop, column_start, column_stop,
+        prune_n_electrons, prune_frequency, allow_negative_pixels);
+
+    gettimeofday(&wall_time_end, nullptr);
+    print_v(
+        1, "Wall-clock time elapsed: %.4g s \n",
+        gettimelapsed(wall_time_start, wall_time_end));
+}
+
+template void ClockingModel::prepare_checkpoints<double>(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int row_start, int n_active_rows, int column_start,
+    int column_stop);
+template void ClockingModel::prepare_checkpoints<float>(
+    float** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int row_start, int n_active_rows, int column_start,
+    int column_stop);
+template void ClockingModel::record_checkpoints<double>(
+    double** images, int n_images, int n_columns, long row_stride,
+    long column_stride, int row_start, int n_active_rows, int column_start,
+    int column_stop);
+template void ClockingModel::record_checkpoints<float>(
+    float** images, int n_images, int n_columns, long row_stride,
+    long column_stride, int row_start, int n_active_rows, int column_start,
+    int column_stop);
+template void ClockingModel::clock<double>(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int column_start, int column_stop, int transfer_axis,
+    int allow_negative_pixels, int print_inputs, int column_schedule,
+    const std::vector<PixelBounce>* pixel_bounces);
+template void ClockingModel::clock<float>(
+    float** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int column_start, int column_stop, int transfer_axis,
+    int allow_negative_pixels, int print_inputs, int column_schedule,
+    const std::vector<PixelBounce>* pixel_bounces);
+
+// ========
+// CTIModel::
+// ========
+/*
+    Class CTIModel.
+
+    A prepared model for both parallel and serial clocking, to add or remove
+    CTI from many images without repeating the set up for each one.
+
+    Parameters
+    ----------
+    parallel, serial : ClockingModel (opt.)
+        The models for parallel and serial clocking. Default no traps to not
+        clock that direction, but still use its window for the other.
+
+    allow_negative_pixels : int (opt.)
+        See add_cti().
+
+    column_schedule : int (opt.)
+        How to share the columns of all images between threads. See
+        clock_charge_in_one_direction().
+
+    pixel_bounces : std::vector<PixelBounce> (opt.)
+        Pixel bounce models to add after CTI, in the serial windows. Added to
+        each row straight after it is clocked by the serial model, or in a
+        separate pass if there is no serial clocking. Default none.
+*/
+CTIModel::CTIModel(
+    ClockingModel parallel, ClockingModel serial, int allow_negative_pixels,
+    int column_schedule, std::vector<PixelBounce> pixel_bounces)
+    : parallel(parallel),
+      serial(serial),
+      allow_negative_pixels(allow_negative_pixels),
+      column_schedule(column_schedule),
+      pixel_bounces(pixel_bounces) {
+
+    // The same ROE for both directions must be set up for each in turn
+    if ((parallel.roe != nullptr) && (parallel.roe == serial.roe)) {
+        this->parallel.roe_is_shared = true;
+        this->serial.roe_is_shared = true;
+    }
+}
+
+/*
+    Add CTI trails to a batch of images that all use the same prepared model,
+    sharing the columns of all the images between threads.
+
+    See add_cti() for more detail.
+
+    Parameters
+    ----------
+    images : real**
+        The pixel values of each image, with the same dimensions and strides,
+        modified in place to have CTI added.
+
+    n_images : int
+        The number of images.
+
+    n_rows, n_columns, row_stride, column_stride : int, int, long, long
+        The dimensions and strides of each image. See add_cti().
+
+    model : CTIModel&
+        The model, which is prepared for the images' size.
+
+    verbosity, iteration : int (opt.)
+        See add_cti().
+*/
+template <typename real>
+void add_cti_batch(
+    real** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, CTIModel& model, int verbosity, int iteration) {
+
+    // Print unless being called by remove_cti()
+    if (!iteration) print_version();
+
+    // Don't print model inputs every iteration
+    int print_inputs = (iteration > 1) ? 0 : verbosity >= 1;
+
+    // Parallel clocking along columns, transfer charge towards row 0
+    if (model.parallel.is_active()) {
+        print_v(1, "Parallel: ");
+        model.parallel.clock(
+            images, n_images, n_rows, n_columns, row_stride, column_stride,
+            model.serial.window_start, model.serial.window_stop,
+            transfer_axis_parallel, model.allow_negative_pixels, print_inputs,
+            model.column_schedule);
+    }
+
+    // Serial clocking along rows, transfer charge towards column 0, with any
+    // pixel bounce added to each row as it is read out
+    const std::vector<PixelBounce>* pixel_bounces =
+        model.pixel_bounces.empty() ? nullptr : &model.pixel_bounces;
+    if (model.serial.is_active()) {
+        print_v(1, "Serial: ");
+        model.serial.clock(
+            images, n_images, n_rows, n_columns, row_stride, column_stride,
+            model.parallel.window_start, model.parallel.window_stop,
+            transfer_axis_serial, model.allow_negative_pixels, print_inputs,
+            model.column_schedule, pixel_bounces);
+    }
+
+    // Pixel bounce without serial clocking
+    else if (pixel_bounces) {
+        add_pixel_bounce(
+            images, n_images, row_stride, column_stride, model.parallel.window_start,
+            (model.parallel.window_stop == -1) ? n_rows : model.parallel.window_stop,
+            model.serial.window_start,
+            (model.serial.window_stop == -1) ? n_columns : model.serial.window_stop,
+            *pixel_bounces);
+    }
+}
+
+/*
+    Add CTI trails to one image using a prepared model. See add_cti_batch().
+*/
+template <typename real>
+void add_cti(
+    real* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    CTIModel& model, int verbosity, int iteration) {
+
+    add_cti_batch(
+        &image, 1, n_rows, n_columns, row_stride, column_stride, model, verbosity,
+        iteration);
+}
+
+template void add_cti_batch<double>(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, CTIModel& model, int verbosity, int iteration);
+template void add_cti<double>(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    CTIModel& model, int verbosity, int iteration);
+template void add_cti_batch<float>(
+    float** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, CTIModel& model, int verbosity, int iteration);
+template void add_cti<float>(
+    float* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    CTIModel& model, int verbosity, int iteration);
+
+/*
+    Add CTI trails to copies of an image for each of several models that only
+    differ in the densities of their instant-capture and slow-capture traps,
+    e.g. to fit the densities to warm-pixel trails.
+
+    All the models are clocked together, in one traversal of the images and
+    the ROE's express schedule for each direction, which is faster than
+    separate add_cti() calls for each model. The results are the same. See
+    ClockingModel::clock_density_sweep().
+
+    Parameters
+    ----------
+    images : double**
+        The pixel values of each model's image, with the same dimensions and
+        strides, e.g. copies of the same input image, modified in place to
+        have CTI added by that model.
+
+    n_models : int
+        The number of models and images.
+
+    n_rows, n_columns, row_stride, column_stride : int, int, long, long
+        The dimensions and strides of each image. See add_cti().
+
+    model : CTIModel&
+        The model for all the traps' other parameters, the ROE, CCD, windows
+        etc, and any pixel bounce.
+
+    parallel_trap_densities, serial_trap_densities : const double* (opt.)
+        The densities of the parallel and serial instant-capture then
+        slow-capture trap species for each model, with n_models *
+        (n_traps_ic + n_traps_sc) values, see clock_density_sweep(). Default
+        nullptr to use the model's own densities in that direction.
+
+    verbosity : int (opt.)
+        See add_cti().
+*/
+void add_cti_density_sweep(
+    double** images, int n_models, int n_rows, int n_columns, long row_stride,
+    long column_stride, CTIModel& model, const double* parallel_trap_densities,
+    const double* serial_trap_densities, int verbosity) {
+
+    print_version();
+
+    // Parallel clocking along columns, transfer charge towards row 0
+    if (model.parallel.is_active()) {
+        print_v(1, "Parallel: ");
+        model.parallel.clock_density_sweep(
+            images, n_models, n_rows, n_columns, row_stride, column_stride,
+            model.serial.window_start, model.serial.window_stop,
+            transfer_axis_parallel, model.allow_negative_pixels, verbosity >= 1,
+            parallel_trap_densities);
+    }
+
+    // Serial clocking along rows, transfer charge towards column 0
+    if (model.serial.is_active()) {
+        print_v(1, "Serial: ");
+        model.serial.clock_density_sweep(
+            images, n_models, n_rows, n_columns, row_stride, column_stride,
+            model.parallel.window_start, model.parallel.window_stop,
+            transfer_axis_serial, model.allow_negative_pixels, verbosity >= 1,
+            serial_trap_densities);
+    }
+
+    // Pixel bounce, after all the clocking
+    if (!model.pixel_bounces.empty())
+        add_pixel_bounce(
+            images, n_models, row_stride, column_stride, model.parallel.window_start,
+            (model.parallel.window_stop == -1) ? n_rows : model.parallel.window_stop,
+            model.serial.window_start,
+            (model.serial.window_stop == -1) ? n_columns : model.serial.window_stop,
+            model.pixel_bounces);
+}
+
+/*
+    Remove CTI trails from a batch of images that all use the same prepared
+    model, by first modelling the addition of CTI to all of them together.
+
+    See remove_cti() and add_cti_batch() for the parameters.
+*/
+template <typename real>
+void remove_cti_batch(
+    real** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int n_iterations, CTIModel& model) {
+
+    print_version();
+
+    // Keep contiguous copies of the input images, and work space for the
+    // forward-modelled images, while the corrected images are updated in place
+    int n_pixels = n_rows * n_columns;
+    std::valarray<real> images_in(n_images * n_pixels);
+    std::valarray<real> images_add_cti(n_images * n_pixels);
+    std::vector<real*> images_add_cti_pointers(n_images);
+    for (int i_image = 0; i_image < n_images; i_image++) {
+        images_add_cti_pointers[i_image] = &images_add_cti[i_image * n_pixels];
+
+        for (int row_index = 0; row_index < n_rows; row_index++) {
+            for (int column_index = 0; column_index < n_columns; column_index++) {
+                images_in[i_image * n_pixels + row_index * n_columns + column_index] =
+                    images[i_image]
+                          [row_index * row_stride + column_index * column_stride];
+            }
+        }
+    }
+
+    // Estimate the images with removed CTI more accurately each iteration
+    for (int iteration = 1; iteration <= n_iterations; iteration++) {
+        print_v(1, "Iter %d: ", iteration);
+
+        // Model the effect of adding CTI trails
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            for (int row_index = 0; row_index < n_rows; row_index++) {
+                for (int column_index = 0; column_index < n_columns; column_index++) {
+                    images_add_cti
+                        [i_image * n_pixels + row_index * n_columns + column_index] =
+                            images[i_image]
+                                  [row_index * row_stride + column_index * column_stride];
+                }
+            }
+        }
+        add_cti_batch(
+            &images_add_cti_pointers[0], n_images, n_rows, n_columns, n_columns, 1,
+            model, 0, iteration);
+
+        // Improve the estimate of the images with CTI trails removed, and
+        // prevent negative image values
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            for (int row_index = 0; row_index < n_rows; row_index++) {
+                for (int column_index = 0; column_index < n_columns; column_index++) {
+                    int i_pixel = i_image * n_pixels + row_index * n_columns + column_index;
+                    real& pixel =
+                        images[i_image]
+                              [row_index * row_stride + column_index * column_stride];
+                    pixel += images_in[i_pixel] - images_add_cti[i_pixel];
+
+                    if (!model.allow_negative_pixels && (pixel < 0.0)) pixel = 0.0;
+                }
+            }
+        }
+    }
+}
+
+/*
+    Remove CTI trails from one image using a prepared model. See
+    remove_cti_batch().
+*/
+template <typename real>
+void remove_cti(
+    real* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations, CTIModel& model) {
+
+    remove_cti_batch(
+        &image, 1, n_rows, n_columns, row_stride, column_stride, n_iterations, model);
+}
+
+template void remove_cti_batch<double>(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int n_iterations, CTIModel& model);
+template void remove_cti<double>(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations, CTIModel& model);
+template void remove_cti_batch<float>(
+    float** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int n_iterations, CTIModel& model);
+template void remove_cti<float>(
+    float* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations, CTIModel& model);
+
+/*
+    Remove CTI trails from a batch of images that all use the same prepared
+    model, iterating each independent line of pixels only until it converges.
+
+    Where the trap states don't carry over between the lines of pixels being
+    clocked, i.e. with only parallel (or only serial) CTI and the ROE's
+    empty_traps_between_columns, each column (or row) is corrected separately
+    and stops being forward modelled once converged. Otherwise, every pixel
+    can affect the others, so each whole image is a single line.
+
+    Parameters
+    ----------
+    images : double**
+        The pixel values of each image, with the same dimensions and strides,
+        modified in place to have CTI removed.
+
+    n_images, n_rows, n_columns, row_stride, column_stride : int/long
+        The number of images, and the dimensions and strides of each one. See
+        add_cti().
+
+    max_n_iterations : int
+        The maximum number of iterations, i.e. forward models of each line.
+
+    tolerance : double
+        A line is converged once no pixel's residual, i.e. the input image minus
+        the forward-modelled current estimate, is larger than this, after
+        which its estimate is updated a final time. A tolerance of 0 with the
+        fixed-point update gives the same result as remove_cti_batch().
+
+    model : CTIModel&
+        The model, which is prepared for the lines' size.
+
+    update : int (opt.)
+        How to improve the estimate of each line from its residuals.
+
+        remove_cti_update_fixed_point (default)
+            Add the residuals, as for remove_cti_batch().
+        remove_cti_update_anderson
+            Anderson acceleration with one previous iterate, i.e. a secant
+            step along the change in the residuals since the last iteration
+            (equivalent to a vector Aitken extrapolation). Falls back to the
+            fixed-point step if the residuals grew. Often no faster, since
+            the fixed-point update already converges quickly for typical trap
+            densities and the watermarks' discrete steps limit how well the
+            forward model can be extrapolated, but may help where the
+            fixed-point iterations converge slowly.
+
+    Returns
+    -------
+    n_iterations : std::valarray<int>
+        The number of iterations used for each line, ordered by image then:
+        column for only parallel CTI, row for only serial CTI, or just one
+        per image otherwise (see above). Zero for lines outside the window
+        of the other direction, which are unchanged by CTI.
+*/
+std::valarray<int> remove_cti_batch_until_converged(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int max_n_iterations, double tolerance, CTIModel& model,
+    int update) {
+
+    print_version();
+
+    if ((update != remove_cti_update_fixed_point) &&
+        (update != remove_cti_update_anderson))
+        error("Invalid update %d", update);
+
+    // Split the images into independent lines of pixels where possible, each
+    // with a stride between lines and between pixels along a line
+    // (pixel bounce couples the columns along each row)
+    bool parallel_lines = model.parallel.is_active() && !model.serial.is_active() &&
+                          model.parallel.roe->empty_traps_between_columns &&
+                          model.pixel_bounces.empty();
+    bool serial_lines = model.serial.is_active() && !model.parallel.is_active() &&
+                        model.serial.roe->empty_traps_between_columns;
+    int n_lines = 1;
+    int line_length = n_rows * n_columns;
+    long line_stride = 0;
+    long pixel_stride = 0;
+    int line_start = 0;
+    int line_stop = 1;
+    if (parallel_lines) {
+        n_lines = n_columns;
+        line_length = n_rows;
+        line_stride = column_stride;
+        pixel_stride = row_stride;
+        line_start = model.serial.window_start;
+        line_stop = (model.serial.window_stop == -1) ? n_columns
+                                                     : model.serial.window_stop;
+    } else if (serial_lines) {
+        n_lines = n_rows;
+        line_length = n_columns;
+        line_stride = row_stride;
+        pixel_stride = column_stride;
+        line_start = model.parallel.window_start;
+        line_stop = (model.parallel.window_stop == -1) ? n_rows
+                                                       : model.parallel.window_stop;
+    }
+    int n_units = n_images * n_lines;
+
+    // The pixel in an image of each line's i-th pixel
+    auto pixel = [&](int i_unit, int i_pixel) -> double& {
+        double* image = images[i_unit / n_lines];
+        if (n_lines == 1)
+            return image
+                [(i_pixel / n_columns) * row_stride +
+                 (i_pixel % n_columns) * column_stride];
+        return image[(i_unit % n_lines) * line_stride + i_pixel * pixel_stride];
+    };
+
+    // Contiguous copies of the input and estimated lines, and work space for
+    // the forward-modelled lines that haven't converged and their residuals
+    long n_pixels = (long)n_units * line_length;
+    std::valarray<double> lines_in(n_pixels);
+    for (int i_unit = 0; i_unit < n_units; i_unit++) {
+        for (int i_pixel = 0; i_pixel < line_length; i_pixel++)
+            lines_in[(long)i_unit * line_length + i_pixel] = pixel(i_unit, i_pixel);
+    }
+    std::valarray<double> lines_estimate = lines_in;
+    std::valarray<double> lines_add_cti(n_pixels);
+    bool anderson = (update == remove_cti_update_anderson);
+    std::valarray<double> lines_estimate_previous(anderson ? n_pixels : 0);
+    std::valarray<double> lines_residual_previous(anderson ? n_pixels : 0);
+    std::valarray<double> max_residual_previous(anderson ? n_units : 0);
+
+    std::valarray<int> n_iterations(0, n_units);
+    std::vector<int> active_units;
+    for (int i_unit = 0; i_unit < n_units; i_unit++) {
+        int line_index = i_unit % n_lines;
+        if ((line_index >= line_start) && (line_index < line_stop))
+            active_units.push_back(i_unit);
+    }
+
+    for (int iteration = 1; iteration <= max_n_iterations; iteration++) {
+        int n_active = active_units.size();
+        if (n_active == 0) break;
+        print_v(1, "Iter %d, %d line(s): ", iteration, n_active);
+
+        // Model the effect of adding CTI trails to the unconverged lines
+        for (int i_active = 0; i_active < n_active; i_active++) {
+            std::copy(
+                &lines_estimate[(long)active_units[i_active] * line_length],
+                &lines_estimate[(long)active_units[i_active] * line_length] +
+                    line_length,
+                &lines_add_cti[(long)i_active * line_length]);
+        }
+        double* lines_add_cti_pointer = &lines_add_cti[0];
+        if (parallel_lines) {
+            model.parallel.clock(
+                &lines_add_cti_pointer, 1, line_length, n_active, 1, line_length, 0,
+                n_active, transfer_axis_parallel, model.allow_negative_pixels, 0,
+                model.column_schedule);
+        } else if (serial_lines) {
+            model.serial.clock(
+                &lines_add_cti_pointer, 1, n_active, line_length, line_length, 1, 0,
+                n_active, transfer_axis_serial, model.allow_negative_pixels, 0,
+                model.column_schedule,
+                model.pixel_bounces.empty() ? nullptr : &model.pixel_bounces);
+        } else {
+            std::vector<double*> images_add_cti_pointers(n_active);
+            for (int i_active = 0; i_active < n_active; i_active++)
+                images_add_cti_pointers[i_active] =
+                    &lines_add_cti[(long)i_active * line_length];
+            add_cti_batch(
+                &images_add_cti_pointers[0], n_active, n_rows, n_columns, n_columns,
+                1, model, 0, iteration);
+        }
+
+        // Improve the estimate of each line, and drop the converged ones
+        std::vector<int> unconverged_units;
+        for (int i_active = 0; i_active < n_active; i_active++) {
+            int i_unit = active_units[i_active];
+            long i_first = (long)i_unit * line_length;
+            double* residual = &lines_add_cti[(long)i_active * line_length];
+
+            double max_residual = 0.0;
+            for (int i_pixel = 0; i_pixel < line_length; i_pixel++) {
+                residual[i_pixel] = lines_in[i_first + i_pixel] - residual[i_pixel];
+                max_residual = std::max(max_residual, fabs(residual[i_pixel]));
+            }
+
+            // Secant step size from the change in residuals, unless they grew
+            double gamma = 0.0;
+            if (anderson && (n_iterations[i_unit] > 0) &&
+                (max_residual < max_residual_previous[i_unit])) {
+                double d_residual_dot_residual = 0.0;
+                double d_residual_dot_d_residual = 0.0;
+                for (int i_pixel = 0; i_pixel < line_length; i_pixel++) {
+                    double d_residual =
+                        residual[i_pixel] - lines_residual_previous[i_first + i_pixel];
+                    d_residual_dot_residual += d_residual * residual[i_pixel];
+                    d_residual_dot_d_residual += d_residual * d_residual;
+                }
+                if (d_residual_dot_d_residual > 0.0)
+                    gamma = d_residual_dot_residual / d_residual_dot_d_residual;
+            }
+
+            // Update the estimate, and prevent negative image values
+            for (int i_pixel = 0; i_pixel < line_length; i_pixel++) {
+                double& estimate = lines_estimate[i_first + i_pixel];
+                double step = residual[i_pixel];
+                if (anderson) {
+                    if (gamma != 0.0)
+                        step -= gamma *
+                                (estimate - lines_estimate_previous[i_first + i_pixel] +
+                                 residual[i_pixel] -
+                                 lines_residual_previous[i_first + i_pixel]);
+                    lines_estimate_previous[i_first + i_pixel] = estimate;
+                    lines_residual_previous[i_first + i_pixel] = residual[i_pixel];
+                }
+                estimate += step;
+
+                if (!model.allow_negative_pixels && (estimate < 0.0)) estimate = 0.0;
+            }
+            if (anderson) max_residual_previous[i_unit] = max_residual;
+
+            n_iterations[i_unit]++;
+            if (max_residual > tolerance) unconverged_units.push_back(i_unit);
+        }
+        active_units.swap(unconverged_units);
+    }
+
+    // Copy the estimates back into the images
+    for (int i_unit = 0; i_unit < n_units; i_unit++) {
+        if (n_iterations[i_unit] == 0) continue;
+        for (int i_pixel = 0; i_pixel < line_length; i_pixel++)
+            pixel(i_unit, i_pixel) = lines_estimate[(long)i_unit * line_length + i_pixel];
+    }
+
+    return n_iterations;
+}
+
+/*
+    Remove CTI trails from one image using a prepared model, iterating until
+    converged. See remove_cti_batch_until_converged().
+*/
+std::valarray<int> remove_cti_until_converged(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int max_n_iterations, double tolerance, CTIModel& model, int update) {
+
+    return remove_cti_batch_until_converged(
+        &image, 1, n_rows, n_columns, row_stride, column_stride, max_n_iterations,
+        tolerance, model, update);
+}
+
+/*
+    Add CTI trails to an image too large to hold in memory, e.g. a very tall
+    stitched scan, by reading, clocking, and writing it a chunk of rows at a
+    time.
+
+    The parallel clocking of each column stops at the end of each chunk and
+    saves the trap states of every express pass, which the next chunk then
+    restarts from (see ColumnCheckpoints::reset_window()). So each chunk's rows
+    are finished once it has been clocked, with the same results as add_cti()
+    for the whole image. Each finished chunk is then clocked in the serial
+    direction and written out. Only one chunk of pixels (twice, to clock the
+    columns contiguously) and the trap states for each column are held.
+
+    Requires a single-step clock sequence, single-phase pixels, and the traps
+    emptied between columns for parallel clocking, and the traps emptied
+    between rows for serial clocking. The model's checkpoints aren't used.
+
+    Parameters
+    ----------
+    read_rows : RowReader
+        Called for each chunk in turn to fill the buffer with the pixel values
+        of the rows, as read_rows(rows, row_start, n_rows), e.g. from a file or
+        memory map, with pixel [row_index][column_index] in
+        rows[(row_index - row_start) * n_columns + column_index].
+
+    write_rows : RowWriter
+        Called for each chunk in turn with the rows after CTI has been added,
+        as write_rows(rows, row_start, n_rows), in the same layout.
+
+    n_rows, n_columns : int
+        The dimensions of the image, with the charge transferred along each
+        column towards row 0 then along each row towards column 0.
+
+    n_rows_per_chunk : int
+        The number of modelled rows in each chunk. Any rows before and after
+        the parallel window are included in the first and last chunks.
+
+    model : CTIModel&
+        The model, which is prepared for the image's size.
+
+    verbosity : int (opt.)
+        See add_cti().
+*/
+void add_cti_streaming(
+    RowReader read_rows, RowWriter write_rows, int n_rows, int n_columns,
+    int n_rows_per_chunk, CTIModel& model, int verbosity) {
+
+    print_version();
+
+    ClockingModel& parallel = model.parallel;
+    ClockingModel& serial = model.serial;
+    bool is_parallel_active = parallel.is_active();
+    bool is_serial_active = serial.is_active();
+
+    // The chunks must be independent of the later rows
+    if (n_rows_per_chunk < 1)
+        error("The number of rows per chunk (%d) must be positive", n_rows_per_chunk);
+    if (is_parallel_active &&
+        ((parallel.roe->n_steps != 1) || (parallel.ccd->n_phases != 1) ||
+         !parallel.roe->empty_traps_between_columns))
+        error(
+            "Streaming requires a single-step clock sequence, single-phase pixels, "
+            "and the traps emptied between columns for parallel clocking");
+    if (is_serial_active && !serial.roe->empty_traps_between_columns)
+        error("Streaming requires the traps emptied between rows for serial clocking");
+
+    // The windows, with the parallel one split into chunks (or the whole image
+    // if not clocking in parallel)
+    int parallel_window_stop =
+        (parallel.window_stop == -1) ? n_rows : parallel.window_stop;
+    int row_start = is_parallel_active ? parallel.window_start : 0;
+    int row_stop = is_parallel_active ? parallel_window_stop : n_rows;
+    int column_start = serial.window_start;
+    int column_stop = (serial.window_stop == -1) ? n_columns : serial.window_stop;
+    int n_active_rows = row_stop - row_start;
+    int n_chunks =
+        std::max((n_active_rows + n_rows_per_chunk - 1) / n_rows_per_chunk, 1);
+    print_v(
+        1, "Streaming %d row(s) in %d chunk(s) of %d row(s) \n", n_rows, n_chunks,
+        n_rows_per_chunk);
+
+    // The first and last image rows of each chunk
+    std::valarray<int> chunk_row_starts(n_chunks);
+    std::valarray<int> chunk_row_stops(n_chunks);
+    int max_n_chunk_rows = 0;
+    for (int i_chunk = 0; i_chunk < n_chunks; i_chunk++) {
+        chunk_row_starts[i_chunk] =
+            (i_chunk == 0) ? 0 : row_start + i_chunk * n_rows_per_chunk;
+        chunk_row_stops[i_chunk] =
+            (i_chunk == n_chunks - 1) ? n_rows
+                                      : row_start + (i_chunk + 1) * n_rows_per_chunk;
+        max_n_chunk_rows = std::max(
+            max_n_chunk_rows, chunk_row_stops[i_chunk] - chunk_row_starts[i_chunk]);
+    }
+    std::vector<double> rows((long)max_n_chunk_rows * n_columns);
+
+    // Each column's trap states at the end of the previous chunk, and the
+    // chunk's modelled rows with each column contiguous
+    std::vector<ColumnCheckpoints> column_checkpoints;
+    std::vector<bool> use_restart_states;
+    std::vector<double> columns;
+    int column_schedule = (model.column_schedule == column_schedule_cost)
+                              ? column_schedule_dynamic
+                              : model.column_schedule;
+    if (is_parallel_active) {
+        parallel.prepare(n_rows, n_columns, n_active_rows);
+        if (verbosity >= 1)
+            print_clocking_inputs(
+                parallel.roe, parallel.ccd, parallel.trap_manager_manager,
+                parallel.express, parallel.window_offset);
+
+        column_checkpoints.assign(n_columns, ColumnCheckpoints());
+        for (ColumnCheckpoints& checkpoints : column_checkpoints)
+            checkpoints.reset_window(n_rows_per_chunk, parallel.roe->n_express_passes);
+        use_restart_states.assign(parallel.roe->n_express_passes, false);
+        columns.resize((long)n_rows_per_chunk * n_columns);
+    }
+
+    // Don't restart the serial clocking from checkpoints of other rows
+    int serial_checkpoint_interval = serial.checkpoint_interval;
+    serial.checkpoint_interval = 0;
+
+    for (int i_chunk = 0; i_chunk < n_chunks; i_chunk++) {
+        int chunk_row_start = chunk_row_starts[i_chunk];
+        int chunk_row_stop = chunk_row_stops[i_chunk];
+        int n_chunk_rows = chunk_row_stop - chunk_row_start;
+        read_rows(rows.data(), chunk_row_start, n_chunk_rows);
+
+        // Parallel clocking of the chunk's modelled rows in each column
+        int i_row_first = i_chunk * n_rows_per_chunk;
+        int i_row_stop = std::min(i_row_first + n_rows_per_chunk, n_active_rows);
+        if (is_parallel_active && (i_row_first < i_row_stop)) {
+            // Set up the ROE again if the serial clocking shares it
+            parallel.prepare(n_rows, n_columns, n_active_rows);
+            ROE* roe = parallel.roe;
+
+            // Whether each express pass continues from its own states at the
+            // end of the previous chunk, see clock_charge_in_one_column(),
+            // updated for the previous chunk's rows instead of every column
+            // checking all the earlier rows
+            int i_row_previous = std::max(i_row_first - n_rows_per_chunk, 0);
+            for (unsigned int express_index = 0;
+                 express_index < roe->n_express_passes; express_index++) {
+                if (!use_restart_states[express_index] &&
+                    roe->express_pass_depends_on_rows(
+                        express_index, row_start + i_row_previous,
+                        row_start + i_row_first))
+                    use_restart_states[express_index] = true;
+            }
+
+            for (int i_row = i_row_first; i_row < i_row_stop; i_row++) {
+                for (int column_index = 0; column_index < n_columns; column_index++)
+                    columns
+                        [(long)column_index * n_rows_per_chunk + i_row - i_row_first] =
+                            rows[(long)(row_start + i_row - chunk_row_start) *
+                                     n_columns +
+                                 column_index];
+            }
+            for (ColumnCheckpoints& checkpoints : column_checkpoints)
+                checkpoints.use_restart_states = use_restart_states;
+
+            // Each column's buffer holds the rows from the chunk's first one
+            double* image = columns.data();
+            clock_charge_in_images(
+                &image, 1, n_rows, n_columns, 1, n_rows_per_chunk, roe, parallel.ccd,
+                parallel.trap_manager_manager, row_start, row_stop, column_start,
+                column_stop, parallel.prune_n_electrons, parallel.prune_frequency,
+                model.allow_negative_pixels, &parallel.pool, column_schedule,
+                transfer_axis_parallel, &column_checkpoints, nullptr, nullptr, nullptr,
+                row_start + i_row_first);
+
+            for (ColumnCheckpoints& checkpoints : column_checkpoints)
+                checkpoints.advance_window();
+            for (int i_row = i_row_first; i_row < i_row_stop; i_row++) {
+                for (int column_index = 0; column_index < n_columns; column_index++)
+                    rows[(long)(row_start + i_row - chunk_row_start) * n_columns +
+                         column_index] =
+                        columns[(long)column_index * n_rows_per_chunk + i_row -
+                                i_row_first];
+            }
+        }
+
+        // Serial clocking of the chunk's rows in the parallel window
+        int serial_row_start =
+            std::max(parallel.window_start, chunk_row_start) - chunk_row_start;
+        int serial_row_stop =
+            std::min(parallel_window_stop, chunk_row_stop) - chunk_row_start;
+        double* image = rows.data();
+        if (is_serial_active && (serial_row_start < serial_row_stop)) {
+            serial.clock(
+                &image, 1, n_chunk_rows, n_columns, n_columns, 1, serial_row_start,
+                serial_row_stop, transfer_axis_serial, model.allow_negative_pixels,
+                (verbosity >= 1) && (i_chunk == 0), column_schedule,
+                model.pixel_bounces.empty() ? nullptr : &model.pixel_bounces);
+        } else if (!model.pixel_bounces.empty()) {
+            add_pixel_bounce(
+                &image, 1, n_columns, 1, std::max(serial_row_start, 0),
+                std::max(serial_row_stop, 0), serial.window_start,
+                (serial.window_stop == -1) ? n_columns : serial.window_stop,
+                model.pixel_bounces);
+        }
+
+        write_rows(rows.data(), chunk_row_start, n_chunk_rows);
+    }
+
+    serial.checkpoint_interval = serial_checkpoint_interval;
+}
+
+// ========
+// RegionOfInterest::
+// ========
+/*
+    Class RegionOfInterest.
+
+    A window of pixels in an image whose output is wanted, e.g. a postage
+    stamp around a galaxy, for add_cti_regions() and remove_cti_regions().
+
+    Parameters
+    ----------
+    row_start, row_stop, column_start, column_stop : int
+        The rows and columns of the window, from the start up to (not
+        including) the stop.
+*/
+RegionOfInterest::RegionOfInterest(
+    int row_start, int row_stop, int column_start, int column_stop)
+    : row_start(row_start),
+      row_stop(row_stop),
+      column_start(column_start),
+      column_stop(column_stop) {}
+
+/*
+    Add (n_iterations = 0) or remove CTI in only the regions of interest of an
+    image, see add_cti_regions().
+*/
+static void clock_cti_regions(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations, std::vector<RegionOfInterest>& regions, CTIModel& model,
+    double trail_fraction, int parallel_trail_length, int serial_trail_length) {
+
+    print_version();
+
+    // The regions must be independent of the pixels beside them
+    for (ClockingModel* clocking_model : {&model.parallel, &model.serial}) {
+        if (!clocking_model->is_active()) continue;
+        if (clocking_model->roe->type != roe_type_standard)
+            error("Regions of interest require a standard ROE");
+        if (!clocking_model->roe->empty_traps_between_columns)
+            error("Regions of interest require the traps to be emptied between columns");
+    }
+    if (!model.pixel_bounces.empty())
+        error("Regions of interest don't support pixel bounce");
+
+    // How far upstream of each region to model, to include its trails
+    if (parallel_trail_length < 0)
+        parallel_trail_length = model.parallel.trail_length(trail_fraction, n_rows);
+    if (serial_trail_length < 0)
+        serial_trail_length = model.serial.trail_length(trail_fraction, n_columns);
+    if (!model.parallel.is_active()) parallel_trail_length = 0;
+    if (!model.serial.is_active()) serial_trail_length = 0;
+    print_v(
+        1, "%d region(s), trail lengths %d (parallel), %d (serial) \n",
+        (int)regions.size(), parallel_trail_length, serial_trail_length);
+
+    // The windows of the whole image to model
+    int parallel_window_stop =
+        (model.parallel.window_stop == -1) ? n_rows : model.parallel.window_stop;
+    int serial_window_stop =
+        (model.serial.window_stop == -1) ? n_columns : model.serial.window_stop;
+
+    // Copy each region and the pixels upstream of it before modifying any, in
+    // case they overlap
+    int n_regions = regions.size();
+    std::vector<std::vector<double> > stamps(n_regions);
+    std::valarray<int> stamp_row_starts(n_regions);
+    std::valarray<int> stamp_column_starts(n_regions);
+    for (int i_region = 0; i_region < n_regions; i_region++) {
+        RegionOfInterest& region = regions[i_region];
+        if ((region.row_start < 0) || (region.row_stop > n_rows) ||
+            (region.row_start > region.row_stop) || (region.column_start < 0) ||
+            (region.column_stop > n_columns) ||
+            (region.column_start > region.column_stop))
+            error(
+                "Region %d [%d:%d, %d:%d] is outside the image [%d, %d]", i_region,
+                region.row_start, region.row_stop, region.column_start,
+                region.column_stop, n_rows, n_columns);
+
+        stamp_row_starts[i_region] =
+            std::max(0, region.row_start - parallel_trail_length);
+        stamp_column_starts[i_region] =
+            std::max(0, region.column_start - serial_trail_length);
+        int n_stamp_rows = region.row_stop - stamp_row_starts[i_region];
+        int n_stamp_columns = region.column_stop - stamp_column_starts[i_region];
+
+        stamps[i_region].resize(n_stamp_rows * n_stamp_columns);
+        for (int i_row = 0; i_row < n_stamp_rows; i_row++) {
+            for (int i_column = 0; i_column < n_stamp_columns; i_column++) {
+                stamps[i_region][i_row * n_stamp_columns + i_column] =
+                    image
+                        [(stamp_row_starts[i_region] + i_row) * row_stride +
+                         (stamp_column_starts[i_region] + i_column) * column_stride];
+            }
+        }
+    }
+
+    // Clock each region independently, with the number of transfers of each
+    // pixel from its position in the whole image
+    #pragma omp parallel
+    {
+        // This thread's own copies of the ROEs and models, to prepare for
+        // each region's size and offset
+        ROE parallel_roe = model.parallel.roe ? *model.parallel.roe : ROE();
+        ROE serial_roe = model.serial.roe ? *model.serial.roe : ROE();
+        CTIModel region_model(
+            ClockingModel(
+                model.parallel.roe ? &parallel_roe : nullptr, model.parallel.ccd,
+                &model.parallel.traps_ic, &model.parallel.traps_sc,
+                &model.parallel.traps_ic_co, &model.parallel.traps_sc_co,
+                model.parallel.express, 0, 0, -1, 0, -1,
+                model.parallel.prune_n_electrons, model.parallel.prune_frequency),
+            ClockingModel(
+                model.serial.roe ? &serial_roe : nullptr, model.serial.ccd,
+                &model.serial.traps_ic, &model.serial.traps_sc,
+                &model.serial.traps_ic_co, &model.serial.traps_sc_co,
+                model.serial.express, 0, 0, -1, 0, -1,
+                model.serial.prune_n_electrons, model.serial.prune_frequency),
+            model.allow_negative_pixels, column_schedule_static);
+
+        #pragma omp for schedule(dynamic, 1)
+        for (int i_region = 0; i_region < n_regions; i_region++) {
+            int stamp_row_start = stamp_row_starts[i_region];
+            int stamp_column_start = stamp_column_starts[i_region];
+            int n_stamp_rows = regions[i_region].row_stop - stamp_row_start;
+            int n_stamp_columns = regions[i_region].column_stop - stamp_column_start;
+
+            // The whole image's windows and offsets, relative to the stamp
+            ClockingModel& parallel = region_model.parallel;
+            ClockingModel& serial = region_model.serial;
+            parallel.window_offset = model.parallel.window_offset + stamp_row_start;
+            parallel.window_start = std::min(
+                std::max(model.parallel.window_start - stamp_row_start, 0),
+                n_stamp_rows);
+            parallel.window_stop = std::min(
+                std::max(parallel_window_stop - stamp_row_start, 0), n_stamp_rows);
+            serial.window_offset = model.serial.window_offset + stamp_column_start;
+            serial.window_start = std::min(
+                std::max(model.serial.window_start - stamp_column_start, 0),
+                n_stamp_columns);
+            serial.window_stop = std::min(
+                std::max(serial_window_stop - stamp_column_start, 0),
+                n_stamp_columns);
+
+            // Nothing to model outside the windows
+            if ((parallel.window_start == parallel.window_stop) ||
+                (serial.window_start == serial.window_stop))
+                continue;
+
+            if (n_iterations == 0)
+                add_cti(
+                    stamps[i_region].data(), n_stamp_rows, n_stamp_columns,
+                    n_stamp_columns, 1, region_model, 0, 1);
+            else
+                remove_cti(
+                    stamps[i_region].data(), n_stamp_rows, n_stamp_columns,
+                    n_stamp_columns, 1, n_iterations, region_model);
+        }
+    }
+
+    // Copy the regions, without the upstream pixels, back into the image
+    for (int i_region = 0; i_region < n_regions; i_region++) {
+        RegionOfInterest& region = regions[i_region];
+        int n_stamp_columns = region.column_stop - stamp_column_starts[i_region];
+        for (int row_index = region.row_start; row_index < region.row_stop;
+             row_index++) {
+            for (int column_index = region.column_start;
+                 column_index < region.column_stop; column_index++) {
+                image[row_index * row_stride + column_index * column_stride] =
+                    stamps[i_region]
+                          [(row_index - stamp_row_starts[i_region]) * n_stamp_columns +
+                           column_index - stamp_column_starts[i_region]];
+            }
+        }
+    }
+}
+
+/*
+    Add CTI trails to only some regions of an image, e.g. postage stamps
+    around sources, by clocking only the pixels that feed each one.
+
+    Each region is copied along with the pixels upstream of it, i.e. the rows
+    before it up to the parallel trail length and the columns before it up to
+    the serial trail length, which are then clocked as a separate image. The
+    express passes and numbers of transfers use the stamp's position in the
+    whole image (via the window_offset), while the traps start empty at the
+    start of the stamp. This is an approximation, with any trails from
+    further away neglected. The express passes are also spread over only the
+    stamp's rows, so use express = 0 (or long enough trails) for results
+    closer to clocking the whole image. The regions are clocked in parallel.
+
+    Requires a standard ROE and the traps emptied between columns, so that
+    the columns (and rows) are independent.
+
+    Parameters
+    ----------
+    image : double*
+        The pixel values of the image, modified in place within the regions to
+        have CTI added. The pixels outside the regions are not modified.
+
+    n_rows, n_columns, row_stride, column_stride : int, int, long, long
+        The dimensions and strides of the image. See add_cti().
+
+    regions : std::vector<RegionOfInterest>&
+        The windows of pixels to output, which may overlap.
+
+    model : CTIModel&
+        The model, whose windows and offsets apply to the whole image. The
+        model itself is not prepared, since each thread uses its own copy.
+
+    trail_fraction : double (opt.)
+        The fraction of captured electrons left in the traps at the end of
+        the trails to include, see ClockingModel::trail_length().
+
+    parallel_trail_length, serial_trail_length : int (opt.)
+        The number of rows or columns upstream of each region to include,
+        instead of from the trail_fraction. Default -1 to use the trail
+        fraction.
+*/
+void add_cti_regions(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    std::vector<RegionOfInterest>& regions, CTIModel& model, double trail_fraction,
+    int parallel_trail_length, int serial_trail_length) {
+
+    clock_cti_regions(
+        image, n_rows, n_columns, row_stride, column_stride, 0, regions, model,
+        trail_fraction, parallel_trail_length, serial_trail_length);
+}
+
+/*
+    Remove CTI trails from only some regions of an image, by removing CTI from
+    each region and the pixels upstream of it separately. See
+    add_cti_regions() and remove_cti() for the parameters.
+*/
+void remove_cti_regions(
+    double* image, int n_rows, int n_columns, long row_stride, long column_stride,
+    int n_iterations, std::vector<RegionOfInterest>& regions, CTIModel& model,
+    double trail_fraction, int parallel_trail_length, int serial_trail_length) {
+
+    if (n_iterations < 1) error("n_iterations (%d) must be at least 1", n_iterations);
+
+    clock_cti_regions(
+        image, n_rows, n_columns, row_stride, column_stride, n_iterations, regions,
+        model, trail_fraction, parallel_trail_length, serial_trail_length);
+}
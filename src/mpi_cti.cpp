@@ -0,0 +1,487 @@
+
+#ifdef ARCTIC_MPI
+
+#include "mpi_cti.hpp"
+
+#include <limits.h>
+#include <mpi.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "cti.hpp"
+#include "model.hpp"
+#include "util.hpp"
+
+/*
+    Split a number of items (e.g. columns or rows) into a contiguous block for
+    each rank, as evenly as possible.
+
+    Parameters
+    ----------
+    n : int
+        The number of items.
+
+    n_ranks : int
+        The number of ranks.
+
+    Returns
+    -------
+    block_starts : std::vector<int>
+        The first item of each rank's block, and the total number of items at
+        the end, so rank i has the items block_starts[i] to block_starts[i + 1].
+*/
+std::vector<int> mpi_block_starts(int n, int n_ranks) {
+    std::vector<int> block_starts(n_ranks + 1);
+    for (int i_rank = 0; i_rank <= n_ranks; i_rank++)
+        block_starts[i_rank] = (long)n * i_rank / n_ranks;
+
+    return block_starts;
+}
+
+/*
+    Check that a number of values fits in an MPI count.
+*/
+static int mpi_count(long n) {
+    if (n > INT_MAX) error("Too many values (%ld) to send in one MPI message", n);
+    return (int)n;
+}
+
+/*
+    The images split between ranks in blocks of columns, for parallel clocking,
+    or blocks of rows, for serial clocking, with the redistribution between
+    them. Each rank's block of each image is stored contiguously, row-major.
+*/
+class MPIBlocks {
+   public:
+    MPIBlocks(int n_images, int n_rows, int n_columns, MPI_Comm comm, int root);
+    ~MPIBlocks(){};
+
+    int n_images;
+    int n_rows;
+    int n_columns;
+    MPI_Comm comm;
+    int root;
+    int rank;
+    int n_ranks;
+    std::vector<int> column_starts;
+    std::vector<int> row_starts;
+    int n_local_columns;
+    int n_local_rows;
+
+    void scatter_columns(
+        double** images, long row_stride, long column_stride,
+        std::vector<double>& columns);
+    void gather_columns(
+        std::vector<double>& columns, double** images, long row_stride,
+        long column_stride);
+    void columns_to_rows(std::vector<double>& columns, std::vector<double>& rows);
+    void rows_to_columns(std::vector<double>& rows, std::vector<double>& columns);
+};
+
+MPIBlocks::MPIBlocks(int n_images, int n_rows, int n_columns, MPI_Comm comm, int root)
+    : n_images(n_images), n_rows(n_rows), n_columns(n_columns), comm(comm), root(root) {
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &n_ranks);
+
+    column_starts = mpi_block_starts(n_columns, n_ranks);
+    row_starts = mpi_block_starts(n_rows, n_ranks);
+    n_local_columns = column_starts[rank + 1] - column_starts[rank];
+    n_local_rows = row_starts[rank + 1] - row_starts[rank];
+}
+
+/*
+    Send each rank its block of columns of the images from the root.
+*/
+void MPIBlocks::scatter_columns(
+    double** images, long row_stride, long column_stride,
+    std::vector<double>& columns) {
+    std::vector<int> counts(n_ranks);
+    std::vector<int> displacements(n_ranks);
+    std::vector<double> buffer;
+
+    for (int i_rank = 0; i_rank < n_ranks; i_rank++) {
+        counts[i_rank] = mpi_count(
+            (long)n_images * n_rows * (column_starts[i_rank + 1] - column_starts[i_rank]));
+        displacements[i_rank] =
+            mpi_count((long)n_images * n_rows * column_starts[i_rank]);
+    }
+
+    // Pack each rank's block on the root
+    if (rank == root) {
+        buffer.resize((long)n_images * n_rows * n_columns);
+        long i_value = 0;
+        for (int i_rank = 0; i_rank < n_ranks; i_rank++) {
+            for (int i_image = 0; i_image < n_images; i_image++) {
+                for (int row_index = 0; row_index < n_rows; row_index++) {
+                    for (int column_index = column_starts[i_rank];
+                         column_index < column_starts[i_rank + 1]; column_index++) {
+                        buffer[i_value++] = images[i_image]
+                                                  [row_index * row_stride +
+                                                   column_index * column_stride];
+                    }
+                }
+            }
+        }
+    }
+
+    columns.resize((long)n_images * n_rows * n_local_columns);
+    MPI_Scatterv(
+        buffer.data(), counts.data(), displacements.data(), MPI_DOUBLE,
+        columns.data(), counts[rank], MPI_DOUBLE, root, comm);
+}
+
+/*
+    Collect each rank's block of columns back into the images on the root.
+*/
+void MPIBlocks::gather_columns(
+    std::vector<double>& columns, double** images, long row_stride,
+    long column_stride) {
+    std::vector<int> counts(n_ranks);
+    std::vector<int> displacements(n_ranks);
+    std::vector<double> buffer;
+
+    for (int i_rank = 0; i_rank < n_ranks; i_rank++) {
+        counts[i_rank] = mpi_count(
+            (long)n_images * n_rows * (column_starts[i_rank + 1] - column_starts[i_rank]));
+        displacements[i_rank] =
+            mpi_count((long)n_images * n_rows * column_starts[i_rank]);
+    }
+    if (rank == root) buffer.resize((long)n_images * n_rows * n_columns);
+
+    MPI_Gatherv(
+        columns.data(), counts[rank], MPI_DOUBLE, buffer.data(), counts.data(),
+        displacements.data(), MPI_DOUBLE, root, comm);
+
+    // Unpack each rank's block on the root
+    if (rank == root) {
+        long i_value = 0;
+        for (int i_rank = 0; i_rank < n_ranks; i_rank++) {
+            for (int i_image = 0; i_image < n_images; i_image++) {
+                for (int row_index = 0; row_index < n_rows; row_index++) {
+                    for (int column_index = column_starts[i_rank];
+                         column_index < column_starts[i_rank + 1]; column_index++) {
+                        images[i_image]
+                              [row_index * row_stride + column_index * column_stride] =
+                                  buffer[i_value++];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+    Redistribute the blocks of columns into blocks of rows, with one all-to-all
+    exchange of the overlapping pieces, instead of transposing whole images.
+*/
+void MPIBlocks::columns_to_rows(
+    std::vector<double>& columns, std::vector<double>& rows) {
+    std::vector<int> send_counts(n_ranks);
+    std::vector<int> send_displacements(n_ranks);
+    std::vector<int> receive_counts(n_ranks);
+    std::vector<int> receive_displacements(n_ranks);
+    std::vector<double> send_buffer(columns.size());
+    std::vector<double> receive_buffer((long)n_images * n_local_rows * n_columns);
+
+    // Pack this rank's columns of each rank's rows
+    long i_value = 0;
+    for (int i_rank = 0; i_rank < n_ranks; i_rank++) {
+        send_displacements[i_rank] = mpi_count(i_value);
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            for (int row_index = row_starts[i_rank]; row_index < row_starts[i_rank + 1];
+                 row_index++) {
+                std::copy_n(
+                    &columns[((long)i_image * n_rows + row_index) * n_local_columns],
+                    n_local_columns, &send_buffer[i_value]);
+                i_value += n_local_columns;
+            }
+        }
+        send_counts[i_rank] = mpi_count(i_value) - send_displacements[i_rank];
+
+        receive_displacements[i_rank] =
+            mpi_count((long)n_images * n_local_rows * column_starts[i_rank]);
+        receive_counts[i_rank] = mpi_count(
+            (long)n_images * n_local_rows *
+            (column_starts[i_rank + 1] - column_starts[i_rank]));
+    }
+
+    MPI_Alltoallv(
+        send_buffer.data(), send_counts.data(), send_displacements.data(),
+        MPI_DOUBLE, receive_buffer.data(), receive_counts.data(),
+        receive_displacements.data(), MPI_DOUBLE, comm);
+
+    // Unpack each rank's columns of this rank's rows
+    rows.resize(receive_buffer.size());
+    i_value = 0;
+    for (int i_rank = 0; i_rank < n_ranks; i_rank++) {
+        int n_rank_columns = column_starts[i_rank + 1] - column_starts[i_rank];
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            for (int i_row = 0; i_row < n_local_rows; i_row++) {
+                std::copy_n(
+                    &receive_buffer[i_value], n_rank_columns,
+                    &rows
+                        [((long)i_image * n_local_rows + i_row) * n_columns +
+                         column_starts[i_rank]]);
+                i_value += n_rank_columns;
+            }
+        }
+    }
+}
+
+/*
+    Redistribute the blocks of rows back into blocks of columns, the inverse of
+    columns_to_rows().
+*/
+void MPIBlocks::rows_to_columns(
+    std::vector<double>& rows, std::vector<double>& columns) {
+    std::vector<int> send_counts(n_ranks);
+    std::vector<int> send_displacements(n_ranks);
+    std::vector<int> receive_counts(n_ranks);
+    std::vector<int> receive_displacements(n_ranks);
+    std::vector<double> send_buffer(rows.size());
+    std::vector<double> receive_buffer((long)n_images * n_rows * n_local_columns);
+
+    // Pack each rank's columns of this rank's rows
+    long i_value = 0;
+    for (int i_rank = 0; i_rank < n_ranks; i_rank++) {
+        int n_rank_columns = column_starts[i_rank + 1] - column_starts[i_rank];
+        send_displacements[i_rank] = mpi_count(i_value);
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            for (int i_row = 0; i_row < n_local_rows; i_row++) {
+                std::copy_n(
+                    &rows
+                        [((long)i_image * n_local_rows + i_row) * n_columns +
+                         column_starts[i_rank]],
+                    n_rank_columns, &send_buffer[i_value]);
+                i_value += n_rank_columns;
+            }
+        }
+        send_counts[i_rank] = mpi_count(i_value) - send_displacements[i_rank];
+
+        receive_displacements[i_rank] =
+            mpi_count((long)n_images * n_local_columns * row_starts[i_rank]);
+        receive_counts[i_rank] = mpi_count(
+            (long)n_images * n_local_columns *
+            (row_starts[i_rank + 1] - row_starts[i_rank]));
+    }
+
+    MPI_Alltoallv(
+        send_buffer.data(), send_counts.data(), send_displacements.data(),
+        MPI_DOUBLE, receive_buffer.data(), receive_counts.data(),
+        receive_displacements.data(), MPI_DOUBLE, comm);
+
+    // Unpack this rank's columns of each rank's rows
+    columns.resize(receive_buffer.size());
+    i_value = 0;
+    for (int i_rank = 0; i_rank < n_ranks; i_rank++) {
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            for (int row_index = row_starts[i_rank]; row_index < row_starts[i_rank + 1];
+                 row_index++) {
+                std::copy_n(
+                    &receive_buffer[i_value], n_local_columns,
+                    &columns[((long)i_image * n_rows + row_index) * n_local_columns]);
+                i_value += n_local_columns;
+            }
+        }
+    }
+}
+
+/*
+    Clock this rank's block of columns of each image in parallel, within the
+    serial window of columns.
+*/
+static void clock_parallel_columns(
+    MPIBlocks& blocks, std::vector<double>& columns, CTIModel& model) {
+    int column_start = blocks.column_starts[blocks.rank];
+    int serial_window_stop = (model.serial.window_stop == -1)
+                                 ? blocks.n_columns
+                                 : model.serial.window_stop;
+    int local_column_start =
+        std::max(model.serial.window_start - column_start, 0);
+    int local_column_stop =
+        std::min(serial_window_stop - column_start, blocks.n_local_columns);
+    if (local_column_start >= local_column_stop) return;
+
+    std::vector<double*> image_pointers(blocks.n_images);
+    for (int i_image = 0; i_image < blocks.n_images; i_image++)
+        image_pointers[i_image] =
+            &columns[(long)i_image * blocks.n_rows * blocks.n_local_columns];
+
+    print_v(1, "Parallel (rank %d): ", blocks.rank);
+    model.parallel.clock(
+        image_pointers.data(), blocks.n_images, blocks.n_rows, blocks.n_local_columns,
+        blocks.n_local_columns, 1, local_column_start, local_column_stop,
+        transfer_axis_parallel, model.allow_negative_pixels, 0, model.column_schedule);
+}
+
+/*
+    Clock this rank's block of rows of each image in serial, within the
+    parallel window of rows.
+*/
+static void clock_serial_rows(
+    MPIBlocks& blocks, std::vector<double>& rows, CTIModel& model) {
+    int row_start = blocks.row_starts[blocks.rank];
+    int parallel_window_stop = (model.parallel.window_stop == -1)
+                                   ? blocks.n_rows
+                                   : model.parallel.window_stop;
+    int local_row_start = std::max(model.parallel.window_start - row_start, 0);
+    int local_row_stop =
+        std::min(parallel_window_stop - row_start, blocks.n_local_rows);
+    if (local_row_start >= local_row_stop) return;
+
+    std::vector<double*> image_pointers(blocks.n_images);
+    for (int i_image = 0; i_image < blocks.n_images; i_image++)
+        image_pointers[i_image] =
+            &rows[(long)i_image * blocks.n_local_rows * blocks.n_columns];
+
+    print_v(1, "Serial (rank %d): ", blocks.rank);
+    model.serial.clock(
+        image_pointers.data(), blocks.n_images, blocks.n_local_rows, blocks.n_columns,
+        blocks.n_columns, 1, local_row_start, local_row_stop, transfer_axis_serial,
+        model.allow_negative_pixels, 0, model.column_schedule);
+}
+
+/*
+    Check that the model can be split between ranks, i.e. that the columns (or
+    rows) clocked by different ranks are independent.
+*/
+static void check_mpi_model(CTIModel& model) {
+    if (model.parallel.is_active() && !model.parallel.roe->empty_traps_between_columns)
+        error("Splitting parallel clocking between ranks requires the traps to be "
+              "emptied between columns");
+    if (model.serial.is_active() && !model.serial.roe->empty_traps_between_columns)
+        error("Splitting serial clocking between ranks requires the traps to be "
+              "emptied between rows");
+}
+
+/*
+    Add CTI trails to a batch of images, sharing the work between MPI ranks.
+
+    The images are split into a contiguous block of columns for each rank, for
+    parallel clocking with no communication. For serial clocking, the blocks
+    are redistributed with one all-to-all exchange into a block of rows for
+    each rank, instead of transposing the images. Each rank still uses its
+    OpenMP threads for its own block.
+
+    Requires the traps to be emptied between columns (and rows), so that the
+    blocks are independent. Call from every rank in the communicator.
+
+    Parameters
+    ----------
+    images : double**
+        The pixel values of each image on the root rank, with the same
+        dimensions and strides, modified in place to have CTI added. Ignored
+        on the other ranks, e.g. nullptr.
+
+    n_images, n_rows, n_columns, row_stride, column_stride : int/long
+        The number of images, and the dimensions and strides of each one. The
+        same on every rank, except for the strides which are only used on the
+        root rank. See add_cti().
+
+    model : CTIModel&
+        The model, the same on every rank, which each rank prepares for the
+        size of its own blocks.
+
+    comm : MPI_Comm (opt.)
+        The communicator of the ranks to share the work. Default
+        MPI_COMM_WORLD.
+
+    root : int (opt.)
+        The rank that holds the images. Default 0.
+*/
+void add_cti_batch_mpi(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, CTIModel& model, MPI_Comm comm, int root) {
+
+    check_mpi_model(model);
+
+    MPIBlocks blocks(n_images, n_rows, n_columns, comm, root);
+    if (blocks.rank == root) print_version();
+
+    std::vector<double> columns;
+    std::vector<double> rows;
+    blocks.scatter_columns(images, row_stride, column_stride, columns);
+
+    // Parallel clocking along each rank's columns
+    if (model.parallel.is_active()) clock_parallel_columns(blocks, columns, model);
+
+    // Serial clocking along each rank's rows
+    if (model.serial.is_active()) {
+        blocks.columns_to_rows(columns, rows);
+        clock_serial_rows(blocks, rows, model);
+        blocks.rows_to_columns(rows, columns);
+    }
+
+    blocks.gather_columns(columns, images, row_stride, column_stride);
+}
+
+/*
+    Remove CTI trails from a batch of images, sharing the work between MPI
+    ranks, by iteratively modelling the addition of CTI as for
+    remove_cti_batch().
+
+    The estimated images stay split into each rank's block of columns between
+    iterations, with two all-to-all exchanges per iteration if clocking in
+    serial: of the forward-modelled images into blocks of rows, and of their
+    residuals back into blocks of columns.
+
+    See add_cti_batch_mpi() for the parameters, and remove_cti() for
+    n_iterations.
+*/
+void remove_cti_batch_mpi(
+    double** images, int n_images, int n_rows, int n_columns, long row_stride,
+    long column_stride, int n_iterations, CTIModel& model, MPI_Comm comm, int root) {
+
+    check_mpi_model(model);
+
+    MPIBlocks blocks(n_images, n_rows, n_columns, comm, root);
+    if (blocks.rank == root) print_version();
+
+    // This rank's blocks of the input images, also as rows if needed, and
+    // of the estimated images with removed CTI
+    std::vector<double> columns_in;
+    std::vector<double> rows_in;
+    blocks.scatter_columns(images, row_stride, column_stride, columns_in);
+    if (model.serial.is_active()) blocks.columns_to_rows(columns_in, rows_in);
+    std::vector<double> columns_estimate = columns_in;
+    std::vector<double> columns_add_cti;
+    std::vector<double> rows_add_cti;
+
+    // Estimate the images with removed CTI more accurately each iteration
+    for (int iteration = 1; iteration <= n_iterations; iteration++) {
+        if (blocks.rank == root) print_v(1, "Iter %d: ", iteration);
+
+        // Model the effect of adding CTI trails, and find the residuals of the
+        // input images minus the modelled images
+        columns_add_cti = columns_estimate;
+        if (model.parallel.is_active())
+            clock_parallel_columns(blocks, columns_add_cti, model);
+        if (model.serial.is_active()) {
+            blocks.columns_to_rows(columns_add_cti, rows_add_cti);
+            clock_serial_rows(blocks, rows_add_cti, model);
+            for (unsigned long i_value = 0; i_value < rows_add_cti.size(); i_value++)
+                rows_add_cti[i_value] = rows_in[i_value] - rows_add_cti[i_value];
+            blocks.rows_to_columns(rows_add_cti, columns_add_cti);
+        } else {
+            for (unsigned long i_value = 0; i_value < columns_add_cti.size();
+                 i_value++)
+                columns_add_cti[i_value] =
+                    columns_in[i_value] - columns_add_cti[i_value];
+        }
+
+        // Improve the estimate of the images with CTI trails removed, and
+        // prevent negative image values
+        for (unsigned long i_value = 0; i_value < columns_estimate.size(); i_value++) {
+            double& pixel = columns_estimate[i_value];
+            pixel += columns_add_cti[i_value];
+
+            if (!model.allow_negative_pixels && (pixel < 0.0)) pixel = 0.0;
+        }
+    }
+
+    blocks.gather_columns(columns_estimate, images, row_stride, column_stride);
+}
+
+#endif  // ARCTIC_MPI
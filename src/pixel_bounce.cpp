@@ -0,0 +1,206 @@
+
+#include "pixel_bounce.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "util.hpp"
+
+// The number of lines whose pixel bounce is modelled together, vectorised
+static const int n_block_lines = 8;
+
+// ========
+// PixelBounce::
+// ========
+/*
+    Class PixelBounce.
+
+    Pixel bounce in a CCD's reference voltage, modelled as a damped harmonic
+    oscillator that is kicked by each sudden change in the signal, see
+    PixelBounce in pixel_bounce.py. Correlated double sampling then subtracts a
+    spurious, oscillating bias from the next few pixels read out in the same
+    row, e.g. in the serial overscan.
+
+    Parameters
+    ----------
+    kA : double
+        The initial reference voltage offset after a change in signal, per
+        unit change.
+
+    kv : double
+        The initial rate of change of the reference voltage after a change in
+        signal, per unit change.
+
+    gamma : double
+        The damping coefficient, per pixel readout.
+
+    omega : double
+        The oscillation frequency, per pixel readout.
+
+    Attributes
+    ----------
+    coeff_A, coeff_B : double
+        The coefficients of the oscillator's difference equation, eqn (43) of
+        Cieslinski & Ratkiewicz (2005) https://arxiv.org/abs/physics/0507182.
+*/
+PixelBounce::PixelBounce(double kA, double kv, double gamma, double omega)
+    : kA(kA), kv(kv), gamma(gamma), omega(omega) {
+
+    if (gamma < 0.0) error("Damping factor gamma cannot be negative (%g)", gamma);
+    if (omega < 0.0)
+        error("Oscillation frequency omega should not be negative (%g)", omega);
+
+    coeff_A = 2.0 * exp(-gamma) * cos(omega);
+    coeff_B = exp(-2.0 * gamma);
+}
+
+/*
+    Add pixel bounce to one or a few lines of pixels that are read out along
+    the line (e.g. the rows of an image, for serial readout), modifying them in
+    place.
+
+    All the pixel bounce models are advanced together in one pass through the
+    pixels, with the lines vectorised. Each model's bias is driven by the
+    changes in the input pixels, and their sum is subtracted, so their order
+    has no effect, as for add_pixel_bounce() in pixel_bounce.py. The first
+    pixel is unaffected, as the electronics are assumed to have settled.
+
+    Parameters
+    ----------
+    image : real*
+        The first pixel of the first line.
+
+    line_stride, pixel_stride : long
+        The strides between adjacent lines and adjacent pixels along a line.
+
+    n_lines : int
+        The number of lines, at most n_block_lines.
+
+    pixel_start, pixel_stop : int
+        The range of pixels to model along each line.
+
+    pixel_bounces : const std::vector<PixelBounce>&
+        The pixel bounce models.
+*/
+template <typename real>
+void add_pixel_bounce_to_lines(
+    real* image, long line_stride, long pixel_stride, int n_lines, int pixel_start,
+    int pixel_stop, const std::vector<PixelBounce>& pixel_bounces) {
+
+    int n_bounces = pixel_bounces.size();
+    if ((n_bounces == 0) || (pixel_stop - pixel_start < 2)) return;
+
+    // The previous input pixel, and each model's previous bias and previous
+    // kicked bias (biasm1 in pixel_bounce.py), for each line
+    double pixel_previous[n_block_lines];
+    std::vector<double> bias_previous(n_bounces * n_block_lines, 0.0);
+    std::vector<double> bias_kicked_previous(n_bounces * n_block_lines, 0.0);
+    for (int i_line = 0; i_line < n_lines; i_line++)
+        pixel_previous[i_line] = image[i_line * line_stride + pixel_start * pixel_stride];
+
+    for (int pixel_index = pixel_start + 1; pixel_index < pixel_stop; pixel_index++) {
+        real* pixels = image + pixel_index * pixel_stride;
+        double bias_total[n_block_lines] = {0.0};
+        double delta[n_block_lines];
+
+        // The electronic impulse from the change in signal
+        for (int i_line = 0; i_line < n_lines; i_line++) {
+            double pixel = pixels[i_line * line_stride];
+            delta[i_line] = pixel - pixel_previous[i_line];
+            pixel_previous[i_line] = pixel;
+        }
+
+        for (int i_bounce = 0; i_bounce < n_bounces; i_bounce++) {
+            const PixelBounce& pixel_bounce = pixel_bounces[i_bounce];
+            double k_m1 = pixel_bounce.kA - pixel_bounce.kv;
+            double k_m2 = pixel_bounce.kA - 2.0 * pixel_bounce.kv;
+            double* bias_m1 = &bias_previous[i_bounce * n_block_lines];
+            double* bias_kicked_m1 = &bias_kicked_previous[i_bounce * n_block_lines];
+
+            // The damped harmonic oscillator's difference equation, with the
+            // impulse imposed on the bias offset and its rate of change
+            #pragma omp simd
+            for (int i_line = 0; i_line < n_lines; i_line++) {
+                double bias_kicked = bias_m1[i_line] + k_m1 * delta[i_line];
+                double bias_kicked_m2 = bias_kicked_m1[i_line] + k_m2 * delta[i_line];
+                double bias =
+                    pixel_bounce.coeff_A * bias_kicked - pixel_bounce.coeff_B * bias_kicked_m2;
+                bias_kicked_m1[i_line] = bias_kicked;
+                bias_m1[i_line] = bias;
+                bias_total[i_line] += bias;
+            }
+        }
+
+        // Correlated double sampling
+        for (int i_line = 0; i_line < n_lines; i_line++)
+            pixels[i_line * line_stride] -= bias_total[i_line];
+    }
+}
+
+template void add_pixel_bounce_to_lines<double>(
+    double* image, long line_stride, long pixel_stride, int n_lines, int pixel_start,
+    int pixel_stop, const std::vector<PixelBounce>& pixel_bounces);
+template void add_pixel_bounce_to_lines<float>(
+    float* image, long line_stride, long pixel_stride, int n_lines, int pixel_start,
+    int pixel_stop, const std::vector<PixelBounce>& pixel_bounces);
+
+/*
+    Add pixel bounce to a batch of images, modifying them in place, in one
+    pass with blocks of lines shared between threads. See
+    add_pixel_bounce_to_lines().
+
+    This is used when the pixel bounce can't be added to each line while it is
+    clocked, see clock_charge_in_images(), and for pixel bounce alone.
+
+    Parameters
+    ----------
+    images : real**
+        The pixel values of each image, with the same dimensions and strides.
+
+    n_images : int
+        The number of images.
+
+    line_stride, pixel_stride : long
+        The strides between the lines that are read out and between the pixels
+        along them, i.e. the row and column strides for serial readout.
+
+    line_start, line_stop, pixel_start, pixel_stop : int
+        The window of lines (e.g. the parallel window) and pixels along them
+        (e.g. the serial window) to model.
+
+    pixel_bounces : const std::vector<PixelBounce>&
+        The pixel bounce models.
+*/
+template <typename real>
+void add_pixel_bounce(
+    real** images, int n_images, long line_stride, long pixel_stride, int line_start,
+    int line_stop, int pixel_start, int pixel_stop,
+    const std::vector<PixelBounce>& pixel_bounces) {
+
+    if (pixel_bounces.size() == 0) return;
+
+    int n_blocks_per_image = (line_stop - line_start + n_block_lines - 1) / n_block_lines;
+    int n_blocks = n_images * n_blocks_per_image;
+
+    #pragma omp parallel for schedule(static)
+    for (int i_block = 0; i_block < n_blocks; i_block++) {
+        int i_image = i_block / n_blocks_per_image;
+        int line_index = line_start + (i_block % n_blocks_per_image) * n_block_lines;
+        int n_lines = std::min(n_block_lines, line_stop - line_index);
+
+        add_pixel_bounce_to_lines(
+            images[i_image] + line_index * line_stride, line_stride, pixel_stride,
+            n_lines, pixel_start, pixel_stop, pixel_bounces);
+    }
+}
+
+template void add_pixel_bounce<double>(
+    double** images, int n_images, long line_stride, long pixel_stride, int line_start,
+    int line_stop, int pixel_start, int pixel_stop,
+    const std::vector<PixelBounce>& pixel_bounces);
+template void add_pixel_bounce<float>(
+    float** images, int n_images, long line_stride, long pixel_stride, int line_start,
+    int line_stop, int pixel_start, int pixel_stop,
+    const std::vector<PixelBounce>& pixel_bounces);
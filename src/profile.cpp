@@ -0,0 +1,128 @@
+
+#include "profile.hpp"
+
+#include <mutex>
+#include <vector>
+
+#include "cti.hpp"
+
+// ========
+// ClockingProfile::
+// ========
+/*
+    Class ClockingProfile.
+
+    Measurements from one call to clock charge in one direction, e.g. to tune
+    the express and watermark pruning parameters. Only recorded if profiling,
+    see set_profiling().
+
+    Attributes
+    ----------
+    transfer_axis : int
+        The direction of clocking, see clock_charge_in_one_direction(). Note
+        that the rows and columns below are then swapped for serial clocking,
+        i.e. the columns are the independent lines of pixels being clocked.
+
+    n_images, n_active_rows, n_active_columns : int
+        The number of images and the size of the window modelled in each.
+
+    n_express_passes : int
+        The number of express passes for each column.
+
+    n_express_passes_clocked : long
+        The total number of express passes over all columns and images.
+
+    wall_time : double
+        The wall-clock time for clocking all the columns, in seconds.
+
+    thread_n_columns : std::vector<int>
+    thread_times : std::vector<double>
+        The number of columns clocked by each thread, and the wall-clock time
+        each thread spent clocking them, to check the load balance.
+
+    n_watermarks_ic, n_watermarks_sc, n_watermarks_ic_co, n_watermarks_sc_co :
+        std::vector<int>
+        The number of available watermarks in the trap manager of each phase,
+        for each family of traps (empty if none).
+
+    max_n_active_watermarks_ic, max_n_active_watermarks_sc,
+    max_n_active_watermarks_ic_co, max_n_active_watermarks_sc_co :
+        std::vector<int>
+        The high-water mark of the number of active watermarks in the trap
+        manager of each phase, for each family of traps, after any pixel.
+
+    n_prunes, n_pruned_watermarks : long
+        The number of times the watermarks were pruned, and the total number of
+        watermarks removed, summed over all trap managers.
+
+    n_stores, n_restores : long
+    store_time, restore_time : double
+        The number of times the trap states were stored and restored (e.g. for
+        each express pass), and the total time spent doing so over all threads,
+        in seconds.
+
+    n_workspace_copies : int
+        The number of threads whose trap manager workspace was copied from the
+        prepared trap managers, rather than just reset because the pool already
+        held a copy of them. See TrapManagerManagerPool.
+*/
+ClockingProfile::ClockingProfile()
+    : transfer_axis(transfer_axis_parallel),
+      n_images(0),
+      n_active_rows(0),
+      n_active_columns(0),
+      n_express_passes(0),
+      n_express_passes_clocked(0),
+      wall_time(0.0),
+      n_prunes(0),
+      n_pruned_watermarks(0),
+      n_stores(0),
+      n_restores(0),
+      store_time(0.0),
+      restore_time(0.0),
+      n_workspace_copies(0) {}
+
+// ========
+// Profiling
+// ========
+/*
+    Global profiling parameter, to record a ClockingProfile for every set of
+    columns clocked in either direction, e.g. two for add_cti() with both
+    parallel and serial CTI, or more for the iterations of remove_cti().
+
+    0       No profiling (default). Only negligible-cost counters are updated.
+    1       Record the profiles, with some small extra cost for the timers and
+            watermark counts.
+
+    The profiles are accumulated until reset_profile() and returned by
+    get_profile(), without printing anything.
+*/
+int profiling = 0;
+void set_profiling(int p) { profiling = p; }
+
+static std::mutex profile_mutex;
+static CTIProfile profile;
+
+/*
+    Discard the recorded profiles.
+*/
+void reset_profile() {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    profile.clockings.clear();
+}
+
+/*
+    Return a copy of the profiles recorded since the last reset_profile().
+*/
+CTIProfile get_profile() {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    return profile;
+}
+
+/*
+    Record the profile of one set of clocked columns.
+*/
+void add_clocking_profile(const ClockingProfile& clocking_profile) {
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    profile.clockings.push_back(clocking_profile);
+}
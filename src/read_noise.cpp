@@ -1,154 +1,502 @@
-#include <stdlib.h>
-#include <stdio.h>
+
+#include "read_noise.hpp"
+
 #include <math.h>
+
+#include <vector>
+
+#include "model.hpp"
 #include "util.hpp"
-#include <iostream>
-using namespace std;
 
 #define SQUARE(x) ((x) * (x))
 
-void determine_read_noise_model(const double* imageIn, const double* imageOut, const int rows, const int cols, const double readNoiseAmp, const double readNoiseAmpFraction, const int smoothCol, double* output) {
-
-  double* dval0 = output;  // using already allocated output buffer to temporarily store the results to avoid allocating more memory (safe as long as we do not modify output before storing dval0 there and not use dval0 after modifying output for the first time)
-  double* dval9 = (double*)malloc(rows * cols * sizeof(double));
-    
-  double mod_clip = readNoiseAmp * readNoiseAmpFraction;
-  double readNoiseAmp2 = SQUARE(readNoiseAmp);
-
-    int idx;
-    print_v(1, "hello");
-    cout << "Hello World!";
-    
-    for (int i = 0; i < rows * cols; i++) {
-        dval0[i] = imageIn[i] - imageOut[i];
-        dval9[i] = dval0[i];
-    }    
-    
-    // get the dval9 average
-    // inner part
-    for (int i = 1; i < rows - 1; i++) {
-#pragma omp parallel for private(idx)
-      for (int j = 1; j < cols - 1; j++) {
-            idx = i * cols + j;
-	    dval9[idx] += dval0[idx + cols + 1];  // comparison with bottom-left neighbour
-	    dval9[idx] += dval0[idx + cols];  // comparison with bottom-central neighbour
-	    dval9[idx] += dval0[idx + cols - 1];  // comparison with bottom-right neighbour
-	    dval9[idx] += dval0[idx + 1];  // comparison with middle-left neighbour
-	    dval9[idx] += dval0[idx - 1];  // comparison with middle-right neighbour
-	    dval9[idx] += dval0[idx - cols + 1];  // comparison with top-left neighbour
-	    dval9[idx] += dval0[idx - cols];  // comparison with top-central neighbour
-	    dval9[idx] += dval0[idx - cols - 1];  // comparison with top-right neighbour
-            dval9[idx] /= 9;
+/*
+    Clip a value to between -limit and limit.
+*/
+static inline double clip(double value, double limit) {
+    return fmax(fmin(value, limit), -limit);
+}
+
+/*
+    The read noise model of one pixel from the differences between the input
+    and smoothed images, see determine_read_noise_model().
+
+    Parameters
+    ----------
+    dval0 : double
+        The difference between the input and smoothed pixel.
+
+    dval9 : double
+        The mean difference over the pixel and its (up to 8) neighbours.
+
+    dmod1, dmod2, cmod1, cmod2 : double
+        The differences of the smoothed pixel from its neighbours in the
+        previous and next rows, and the previous and next columns, or 0 at the
+        edges of the image.
+
+    mod_clip, read_noise_amp_2 : double
+        The clipping limit and the squared read noise amplitude.
+
+    smooth_col : int
+        Whether to also include the neighbouring columns.
+*/
+static inline double read_noise_model_of_pixel(
+    double dval0, double dval9, double dmod1, double dmod2, double cmod1,
+    double cmod2, double mod_clip, double read_noise_amp_2, int smooth_col) {
+    double model = fmin(1.0, fmax(-1.0, dval0)) * SQUARE(dval0) /
+                   (SQUARE(dval0) + 4.0 * read_noise_amp_2);
+    model += clip(dval9, mod_clip) * SQUARE(dval9) /
+             (SQUARE(dval9) + 18.0 * read_noise_amp_2);
+    model += clip(dmod1, mod_clip) * 4 * read_noise_amp_2 /
+             (SQUARE(dmod1) + 4.0 * read_noise_amp_2);
+    model += clip(dmod2, mod_clip) * 4 * read_noise_amp_2 /
+             (SQUARE(dmod2) + 4.0 * read_noise_amp_2);
+
+    if (smooth_col) {
+        model += clip(cmod1, mod_clip) * 4 * read_noise_amp_2 /
+                 (SQUARE(cmod1) + 4.0 * read_noise_amp_2);
+        model += clip(cmod2, mod_clip) * 4 * read_noise_amp_2 /
+                 (SQUARE(cmod2) + 4.0 * read_noise_amp_2);
+        return model / 6.0;
+    } else
+        return model / 4.0;
+}
+
+/*
+    The read noise model of one pixel at any position, checking which
+    neighbours are inside the image, for the edges.
+*/
+static double read_noise_model_of_edge_pixel(
+    const double* image_in, const double* image_out, int rows, int cols, int i,
+    int j, double mod_clip, double read_noise_amp_2, int smooth_col) {
+    long idx = (long)i * cols + j;
+    double dval0 = image_in[idx] - image_out[idx];
+
+    // The mean difference of the pixel and its neighbours, in the same order
+    // as the interior pixels
+    double dval9 = dval0;
+    int n_pixels = 1;
+    for (int di = 1; di >= -1; di--) {
+        if ((i + di < 0) || (i + di >= rows)) continue;
+        for (int dj = 1; dj >= -1; dj--) {
+            if ((j + dj < 0) || (j + dj >= cols) || ((di == 0) && (dj == 0)))
+                continue;
+            long idx_neighbour = idx + (long)di * cols + dj;
+            dval9 += image_in[idx_neighbour] - image_out[idx_neighbour];
+            n_pixels++;
+        }
+    }
+    dval9 /= n_pixels;
+
+    double dmod1 = (i > 0) ? image_out[idx - cols] - image_out[idx] : 0.0;
+    double dmod2 = (i < rows - 1) ? image_out[idx + cols] - image_out[idx] : 0.0;
+    double cmod1 = (j > 0) ? image_out[idx - 1] - image_out[idx] : 0.0;
+    double cmod2 = (j < cols - 1) ? image_out[idx + 1] - image_out[idx] : 0.0;
+
+    return read_noise_model_of_pixel(
+        dval0, dval9, dmod1, dmod2, cmod1, cmod2, mod_clip, read_noise_amp_2,
+        smooth_col);
+}
+
+/*
+    Estimate the read noise adjustment to the smoothed image for each pixel, in
+    the S+R (smooth plus read noise) method, see ReadNoise in read_noise.py.
+
+    The differences between the input and smoothed images, their 3x3 means,
+    and the differences between neighbouring smoothed pixels are all computed
+    in a single pass, with the rows shared between threads and the interior of
+    each row vectorised, so no extra image-sized buffers are needed.
+
+    Parameters
+    ----------
+    image_in, image_out : const double*
+        The row-major input and current smoothed images.
+
+    rows, cols : int
+        The dimensions of the images.
+
+    read_noise_amp : double
+        The read noise amplitude (sigma).
+
+    read_noise_amp_fraction : double
+        The fraction of the amplitude at which to clip the differences.
+
+    smooth_col : int
+        Whether to also smooth along the rows, i.e. between columns.
+
+    output : double*
+        The row-major read noise model, which must not overlap the inputs.
+*/
+void determine_read_noise_model(
+    const double* image_in, const double* image_out, const int rows, const int cols,
+    const double read_noise_amp, const double read_noise_amp_fraction,
+    const int smooth_col, double* output) {
+
+    double mod_clip = read_noise_amp * read_noise_amp_fraction;
+    double read_noise_amp_2 = SQUARE(read_noise_amp);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++) {
+        double* output_row = output + (long)i * cols;
+
+        // The edge rows
+        if ((i == 0) || (i == rows - 1) || (cols < 3)) {
+            for (int j = 0; j < cols; j++) {
+                output_row[j] = read_noise_model_of_edge_pixel(
+                    image_in, image_out, rows, cols, i, j, mod_clip,
+                    read_noise_amp_2, smooth_col);
+            }
+            continue;
+        }
+
+        // The edge columns
+        output_row[0] = read_noise_model_of_edge_pixel(
+            image_in, image_out, rows, cols, i, 0, mod_clip, read_noise_amp_2,
+            smooth_col);
+        output_row[cols - 1] = read_noise_model_of_edge_pixel(
+            image_in, image_out, rows, cols, i, cols - 1, mod_clip, read_noise_amp_2,
+            smooth_col);
+
+        // The interior, with every neighbour present
+        const double* in_above = image_in + (long)(i - 1) * cols;
+        const double* in = image_in + (long)i * cols;
+        const double* in_below = image_in + (long)(i + 1) * cols;
+        const double* out_above = image_out + (long)(i - 1) * cols;
+        const double* out = image_out + (long)i * cols;
+        const double* out_below = image_out + (long)(i + 1) * cols;
+        #pragma omp simd
+        for (int j = 1; j < cols - 1; j++) {
+            double dval0 = in[j] - out[j];
+            double dval9 = dval0;
+            dval9 += in_below[j + 1] - out_below[j + 1];
+            dval9 += in_below[j] - out_below[j];
+            dval9 += in_below[j - 1] - out_below[j - 1];
+            dval9 += in[j + 1] - out[j + 1];
+            dval9 += in[j - 1] - out[j - 1];
+            dval9 += in_above[j + 1] - out_above[j + 1];
+            dval9 += in_above[j] - out_above[j];
+            dval9 += in_above[j - 1] - out_above[j - 1];
+            dval9 /= 9;
+
+            output_row[j] = read_noise_model_of_pixel(
+                dval0, dval9, out_above[j] - out[j], out_below[j] - out[j],
+                out[j - 1] - out[j], out[j + 1] - out[j], mod_clip, read_noise_amp_2,
+                smooth_col);
+        }
+    }
+}
+
+/*
+    Separate an image into a smooth (S) and a read-noise (R) frame, by
+    iteratively adjusting the smoothed image with determine_read_noise_model()
+    until the rms of the noise frame matches the read noise amplitude. The
+    native version of ReadNoise.generate_SR_frames_from_image() in
+    read_noise.py, for its repeated use by ReadNoise.optimise_SR_fraction().
+
+    Parameters
+    ----------
+    image_in : const double*
+        The row-major input image.
+
+    rows, cols : int
+        The dimensions of the image.
+
+    read_noise_amp, read_noise_amp_fraction, smooth_col : *
+        See determine_read_noise_model().
+
+    out_scale : double
+        The factor by which to scale each adjustment.
+
+    n_iterations : int
+        The maximum number of iterations.
+
+    image_out, image_noise : double*
+        The row-major smooth and read-noise frames, which sum to the input.
+
+    scratch : double* (opt.)
+        A buffer of rows * cols values for the adjustments, e.g. to reuse over
+        many calls. Default nullptr to allocate one.
+
+    Returns
+    -------
+    rms : double
+        The final rms of the noise frame, over the pixels above 0.1 in either
+        the input or smooth image.
+*/
+double generate_sr_frames(
+    const double* image_in, const int rows, const int cols,
+    const double read_noise_amp, const double read_noise_amp_fraction,
+    const int smooth_col, const double out_scale, const int n_iterations,
+    double* image_out, double* image_noise, double* scratch) {
+
+    long n_pixels = (long)rows * cols;
+    std::vector<double> local_scratch;
+    if (scratch == nullptr) {
+        local_scratch.resize(n_pixels);
+        scratch = local_scratch.data();
+    }
+    for (long i = 0; i < n_pixels; i++) image_out[i] = image_in[i];
+
+    double rms = 0.0;
+    int smoother = 1;
+    for (int iteration = 0; iteration < n_iterations; iteration++) {
+        double old_check = read_noise_amp - rms;
+        determine_read_noise_model(
+            image_in, image_out, rows, cols, read_noise_amp, read_noise_amp_fraction,
+            smooth_col, scratch);
+
+        // Adjust the smoothed image towards or away from the input
+        double sign = ((read_noise_amp - rms) > 0) ? 1.0 : -1.0;
+        double sum_squares = 0.0;
+        long n_rms = 0;
+        #pragma omp parallel for schedule(static) reduction(+ : sum_squares, n_rms)
+        for (long i = 0; i < n_pixels; i++) {
+            image_out[i] += sign * (scratch[i] * out_scale / smoother);
+            image_noise[i] = image_in[i] - image_out[i];
+            if ((image_in[i] > 0.1) || (image_out[i] > 0.1)) {
+                sum_squares += SQUARE(image_noise[i]);
+                n_rms++;
+            }
         }
+        rms = sqrt(sum_squares / n_rms);
+        print_v(
+            2, "%4d  %f    %5.2f    %f \n", iteration, rms, read_noise_amp,
+            read_noise_amp - rms);
+
+        // Smaller steps once it overshoots
+        double check = read_noise_amp - rms;
+        if (check * old_check < 0) smoother++;
+        if (fabs(check) < 0.0001) break;
     }
-    // edges (excl. corners)
-#pragma omp parallel for private(idx)
-    for (int i = 1; i < rows - 1; i++) {
-      // left edge (j=0)
-      idx = i * cols;
-      dval9[idx] += dval0[idx + cols + 1];  // comparison with bottom-left neighbour
-      dval9[idx] += dval0[idx + cols];  // comparison with bottom-central neighbour
-      dval9[idx] += dval0[idx + 1];  // comparison with middle-left neighbour
-      dval9[idx] += dval0[idx - cols + 1];  // comparison with top-left neighbour
-      dval9[idx] += dval0[idx - cols];  // comparison with top-central neighbour
-      dval9[idx] /= 6.0;
-      // right edge (j=cols-1)
-      idx = (i + 1) * cols - 1;
-      dval9[idx] += dval0[idx + cols];  // comparison with bottom-central neighbour
-      dval9[idx] += dval0[idx + cols - 1];  // comparison with bottom-right neighbour
-      dval9[idx] += dval0[idx - 1];  // comparison with middle-right neighbour
-      dval9[idx] += dval0[idx - cols];  // comparison with top-central neighbour
-      dval9[idx] += dval0[idx - cols - 1];  // comparison with top-right neighbour
-      dval9[idx] /= 6.0;
+
+    return rms;
+}
+
+/*
+    Calculate the pixel-to-pixel covariance matrix of an image, as for
+    CovarianceMatrix.from_image() in read_noise.py.
+
+    The image is first cropped by the border (plus one extra row and column at
+    the top and right), then each matrix element is the covariance between the
+    pixels and those at that offset, with the offset pixels wrapped around the
+    cropped image as by numpy.roll(), and excluding the outermost pixels that
+    could be wrapped. Each element is summed by rows shared between threads.
+
+    Parameters
+    ----------
+    image : const double*
+        The row-major image.
+
+    n_rows, n_columns : int
+        The dimensions of the image.
+
+    matrix_n_rows, matrix_n_columns : int
+        The dimensions of the covariance matrix, normally odd, with the
+        variance in the middle element.
+
+    border_bottom, border_left, border_top, border_right : int
+        The number of pixels to ignore around each edge of the image, e.g. to
+        avoid the first-pixel-response decrement.
+
+    covariance : double*
+        The row-major covariance matrix.
+*/
+void covariance_matrix_from_image(
+    const double* image, const int n_rows, const int n_columns,
+    const int matrix_n_rows, const int matrix_n_columns, const int border_bottom,
+    const int border_left, const int border_top, const int border_right,
+    double* covariance) {
+
+    // The cropped image
+    const double* sub_image = image + (long)border_bottom * n_columns + border_left;
+    int sub_n_rows = n_rows - border_bottom - border_top - 1;
+    int sub_n_columns = n_columns - border_left - border_right - 1;
+
+    // The pixels not rolled over, as indexed by read_noise.py
+    int middle_row = matrix_n_rows / 2;
+    int middle_column = matrix_n_columns / 2;
+    int roll_start = (middle_row > 1) ? middle_row : 1;
+    int roll_stop = (middle_column > 1) ? middle_column : 1;
+    int row_stop = sub_n_rows - roll_stop;
+    int column_stop = sub_n_columns - roll_stop;
+    if ((row_stop <= roll_start) || (column_stop <= roll_start))
+        error(
+            "Image (%d x %d) too small for a %d x %d covariance matrix with border "
+            "(%d, %d, %d, %d)",
+            n_rows, n_columns, matrix_n_rows, matrix_n_columns, border_bottom,
+            border_left, border_top, border_right);
+    double n_pixels = (double)(row_stop - roll_start) * (column_stop - roll_start);
+
+    // The mean of the unshifted pixels
+    double sum_x = 0.0;
+    #pragma omp parallel for schedule(static) reduction(+ : sum_x)
+    for (int row_index = roll_start; row_index < row_stop; row_index++) {
+        const double* row = sub_image + (long)row_index * n_columns;
+        for (int column_index = roll_start; column_index < column_stop; column_index++)
+            sum_x += row[column_index];
     }
+    double mean_x = sum_x / n_pixels;
+
+    // As in read_noise.py, the column offset sets the matrix row and vice versa
+    for (int i = -middle_row; i <= middle_row; i++) {
+        for (int j = -middle_column; j <= middle_column; j++) {
+            // The mean of the shifted pixels
+            double sum_y = 0.0;
+            #pragma omp parallel for schedule(static) reduction(+ : sum_y)
+            for (int row_index = roll_start; row_index < row_stop; row_index++) {
+                int row_index_y = (row_index + j + sub_n_rows) % sub_n_rows;
+                const double* row_y = sub_image + (long)row_index_y * n_columns;
+                for (int column_index = roll_start; column_index < column_stop;
+                     column_index++)
+                    sum_y += row_y[(column_index + i + sub_n_columns) % sub_n_columns];
+            }
+            double mean_y = sum_y / n_pixels;
+
+            double sum_xy = 0.0;
+            #pragma omp parallel for schedule(static) reduction(+ : sum_xy)
+            for (int row_index = roll_start; row_index < row_stop; row_index++) {
+                int row_index_y = (row_index + j + sub_n_rows) % sub_n_rows;
+                const double* row = sub_image + (long)row_index * n_columns;
+                const double* row_y = sub_image + (long)row_index_y * n_columns;
+                for (int column_index = roll_start; column_index < column_stop;
+                     column_index++)
+                    sum_xy += (row[column_index] - mean_x) *
+                              (row_y[(column_index + i + sub_n_columns) % sub_n_columns] -
+                               mean_y);
+            }
 
-#pragma omp parallel for private(idx), shared(dval0, dval9)
-    for (int j = 1; j < cols - 1; j++) {
-      // top edge (i=0)
-      idx = j;
-      dval9[idx] += dval0[idx + cols + 1];  // comparison with bottom-left neighbour
-      dval9[idx] += dval0[idx + cols];  // comparison with bottom-central neighbour
-      dval9[idx] += dval0[idx + cols - 1];  // comparison with bottom-right neighbour
-      dval9[idx] += dval0[idx + 1];  // comparison with middle-left neighbour
-      dval9[idx] += dval0[idx - 1];  // comparison with middle-right neighbour
-      dval9[idx] /= 6.0;
-      // bottom edge (i=rows-1)
-      idx = (rows - 1) * cols + j;
-      dval9[idx] += dval0[idx + 1];  // comparison with middle-left neighbour
-      dval9[idx] += dval0[idx - 1];  // comparison with middle-right neighbour
-      dval9[idx] += dval0[idx - cols + 1];  // comparison with top-left neighbour
-      dval9[idx] += dval0[idx - cols];  // comparison with top-central neighbour
-      dval9[idx] += dval0[idx - cols - 1];  // comparison with top-right neighbour
-      dval9[(rows - 1) * cols + j] /= 6.0;
+            covariance[(middle_row + i) * matrix_n_columns + middle_column + j] =
+                sum_xy / n_pixels;
+        }
     }
-    // corners
-    dval9[0] += dval0[cols + 1];  // comparison with bottom-left neighbour
-    dval9[0] += dval0[cols];  // comparison with bottom-central neighbour
-    dval9[0] += dval0[1];  // comparison with middle-left neighbour
-    dval9[0] /= 4.0;
-
-    idx = cols - 1;
-    dval9[idx] += dval0[idx + cols];  // comparison with bottom-central neighbour
-    dval9[idx] += dval0[idx +  cols - 1];  // comparison with bottom-right neighbour
-    dval9[idx] += dval0[idx - 1];  // comparison with middle-right neighbour
-    dval9[idx] /= 4.0;
-
-    idx = (rows - 1) * cols;
-    dval9[idx] += dval0[idx + 1];  // comparison with middle-left neighbour
-    dval9[idx] += dval0[idx - cols + 1];  // comparison with top-left neighbour
-    dval9[idx] += dval0[idx - cols];  // comparison with top-central neighbour
-    dval9[idx] /= 4.0;
-
-    idx = rows * cols - 1;
-    dval9[idx] += dval0[idx - 1];  // comparison with middle-right neighbour
-    dval9[idx] += dval0[idx - cols];  // comparison with top-central neighbour
-    dval9[idx] += dval0[idx - cols - 1];  // comparison with top-right neighbour
-    dval9[idx] /= 4.0;
-
-#pragma omp parallel for shared(output, dval0, dval9)
-    for (int i = 0; i < cols * rows; i++) {
-
-      // setting dval0u to output
-      output[i] = fmin(1.0, fmax(-1.0, dval0[i])) * SQUARE(dval0[i]) / (SQUARE(dval0[i]) + 4.0 * readNoiseAmp2);
-      // adding dval9u to output
-      output[i] += fmax(fmin(dval9[i], mod_clip), -mod_clip) * SQUARE(dval9[i]) / (SQUARE(dval9[i]) + 18.0 * readNoiseAmp2);
-
-      int rcol = i % cols;
-      double dmod1, dmod2;
-      if (i < cols) {  // first row
-	dmod1 = 0.0;
-      } else {
-	dmod1 = imageOut[i - cols] - imageOut[i];
-      }	  
-      output[i] += fmax(fmin(dmod1, mod_clip), -mod_clip) * 4 * readNoiseAmp2 / (SQUARE(dmod1) + 4.0 * readNoiseAmp2);
-      
-      if (i >= (rows - 1) * cols) {  // last row
-	dmod2 = 0.0;
-      } else {
-	dmod2 = imageOut[i + cols] - imageOut[i];
-      }
-      output[i] += fmax(fmin(dmod2, mod_clip), -mod_clip) * 4 * readNoiseAmp2 / (SQUARE(dmod2) + 4.0 * readNoiseAmp2);
-      
-      if (smoothCol) {
-	double cmod1, cmod2;
-	if (rcol == 0) {  // first column
-	  cmod1 = 0.0;
-	} else {
-	  cmod1 = imageOut[i - 1] - imageOut[i];
-	}
-	output[i] += fmax(fmin(cmod1, mod_clip), -mod_clip) * 4 * readNoiseAmp2 / (SQUARE(cmod1) + 4.0 * readNoiseAmp2);
-	if (rcol == cols - 1) {  // last column
-	  cmod2 = 0.0;
-	} else {
-	  cmod2 = imageOut[i + 1] - imageOut[i];
-	}
-	output[i] += fmax(fmin(cmod2, mod_clip), -mod_clip) * 4 * readNoiseAmp2 / (SQUARE(cmod2) + 4.0 * readNoiseAmp2);
-	
-	output[i] /= 6.0;
-      } else {
-	output[i] /= 4.0;
-      }
+}
+
+/*
+    Measure the residual covariance left by correcting CTI from simulated
+    images with read noise, with the read noise first separated by the S+R
+    method with each of a set of fractions, for ReadNoise.optimise_SR_fraction()
+    etc. in read_noise.py.
+
+    For each realisation: CTI is added to the sky frame, then the noise frame
+    is added and the result separated into S and R frames (generate_sr_frames()).
+    Then for each S+R fraction, that fraction of the R frame is kept separate,
+    CTI is removed (with one iteration) from the rest, and the R frame is added
+    back. The covariance matrices are averaged over the realisations.
+
+    The S+R separation is done once per realisation and only rescaled for each
+    fraction, and all the images are clocked together by the same prepared
+    model, in one add_cti_batch() and one remove_cti_batch() call.
+
+    Parameters
+    ----------
+    sky_frames, noise_frames : const double*
+        The n_realisations row-major simulated sky (without read noise) and
+        read noise images, one after another.
+
+    n_realisations, n_rows, n_columns : int
+        The number and dimensions of the images.
+
+    model : CTIModel&
+        The CTI model to add and remove CTI.
+
+    read_noise_amp, read_noise_amp_fraction, smooth_col, out_scale,
+    n_sr_iterations : *
+        The S+R parameters, see generate_sr_frames().
+
+    sr_fractions : const double*
+        The fractions of the read noise to separate.
+
+    n_sr_fractions : int
+        The number of fractions.
+
+    matrix_size, fpr_size : int
+        The dimension of the square covariance matrices, and the border to
+        ignore at the bottom and left of each image, see
+        covariance_matrix_from_image().
+
+    covariances : double*
+        The n_sr_fractions row-major covariance matrices of the corrected
+        images, one after another.
+
+    covariance_benchmark : double*
+        The covariance matrix of the sky plus read noise images without CTI.
+*/
+void estimate_residual_covariances(
+    const double* sky_frames, const double* noise_frames, const int n_realisations,
+    const int n_rows, const int n_columns, CTIModel& model,
+    const double read_noise_amp, const double read_noise_amp_fraction,
+    const int smooth_col, const double out_scale, const int n_sr_iterations,
+    const double* sr_fractions, const int n_sr_fractions, const int matrix_size,
+    const int fpr_size, double* covariances, double* covariance_benchmark) {
+
+    long n_pixels = (long)n_rows * n_columns;
+    int n_matrix = matrix_size * matrix_size;
+    std::vector<double> covariance(n_matrix);
+    for (int i = 0; i < n_matrix; i++) covariance_benchmark[i] = 0.0;
+    for (int i = 0; i < n_sr_fractions * n_matrix; i++) covariances[i] = 0.0;
+
+    // Add CTI to the sky frames
+    std::vector<double> images(n_realisations * n_pixels);
+    std::vector<double*> image_pointers(n_realisations);
+    for (int i_real = 0; i_real < n_realisations; i_real++) {
+        image_pointers[i_real] = &images[i_real * n_pixels];
+        for (long i = 0; i < n_pixels; i++)
+            images[i_real * n_pixels + i] = sky_frames[i_real * n_pixels + i];
+    }
+    add_cti_batch(
+        image_pointers.data(), n_realisations, n_rows, n_columns, n_columns, 1,
+        model);
+
+    // Add the read noise, then separate the smooth and read-noise frames
+    std::vector<double> s_frames(n_realisations * n_pixels);
+    std::vector<double> r_frames(n_realisations * n_pixels);
+    std::vector<double> scratch(n_pixels);
+    for (int i_real = 0; i_real < n_realisations; i_real++) {
+        double* image = image_pointers[i_real];
+        for (long i = 0; i < n_pixels; i++) image[i] += noise_frames[i_real * n_pixels + i];
+        generate_sr_frames(
+            image, n_rows, n_columns, read_noise_amp, read_noise_amp_fraction,
+            smooth_col, out_scale, n_sr_iterations, &s_frames[i_real * n_pixels],
+            &r_frames[i_real * n_pixels], scratch.data());
+
+        // The benchmark, reusing this realisation's buffer
+        for (long i = 0; i < n_pixels; i++)
+            image[i] = sky_frames[i_real * n_pixels + i] + noise_frames[i_real * n_pixels + i];
+        covariance_matrix_from_image(
+            image, n_rows, n_columns, matrix_size, matrix_size, fpr_size, fpr_size, 0,
+            0, covariance.data());
+        for (int i = 0; i < n_matrix; i++)
+            covariance_benchmark[i] += covariance[i] / n_realisations;
     }
 
-    free(dval9);
+    // Remove CTI from the smooth frames with each fraction of read noise
+    int n_images = n_realisations * n_sr_fractions;
+    images.resize(n_images * n_pixels);
+    image_pointers.resize(n_images);
+    for (int i_frac = 0; i_frac < n_sr_fractions; i_frac++) {
+        for (int i_real = 0; i_real < n_realisations; i_real++) {
+            int i_image = i_frac * n_realisations + i_real;
+            image_pointers[i_image] = &images[i_image * n_pixels];
+            for (long i = 0; i < n_pixels; i++)
+                images[i_image * n_pixels + i] =
+                    s_frames[i_real * n_pixels + i] +
+                    (1.0 - sr_fractions[i_frac]) * r_frames[i_real * n_pixels + i];
+        }
+    }
+    remove_cti_batch(
+        image_pointers.data(), n_images, n_rows, n_columns, n_columns, 1, 1, model);
+
+    // Add back the read noise and measure the covariance
+    for (int i_frac = 0; i_frac < n_sr_fractions; i_frac++) {
+        for (int i_real = 0; i_real < n_realisations; i_real++) {
+            double* image = image_pointers[i_frac * n_realisations + i_real];
+            for (long i = 0; i < n_pixels; i++)
+                image[i] += sr_fractions[i_frac] * r_frames[i_real * n_pixels + i];
+            covariance_matrix_from_image(
+                image, n_rows, n_columns, matrix_size, matrix_size, fpr_size,
+                fpr_size, 0, 0, covariance.data());
+            for (int i = 0; i < n_matrix; i++)
+                covariances[i_frac * n_matrix + i] += covariance[i] / n_realisations;
+        }
+    }
 }
@@ -4,7 +4,9 @@
 #include <math.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <valarray>
+#include <vector>
 
 #include <iostream>
 #include "util.hpp"
@@ -53,6 +55,33 @@ ROEStepPhase::ROEStepPhase(
     n_release_pixels = release_to_which_pixels.size();
 }
 
+// ========
+// ROEExpressTransfer::
+// ========
+/*
+    Class ROEExpressTransfer.
+
+    One pixel-to-pixel transfer that is modelled in an express pass, as an
+    entry in the ROE's compact express schedule.
+
+    Parameters
+    ----------
+    row_index : int
+        The row of the pixel, i.e. the column of the express matrix.
+
+    express_multiplier : double
+        The number of transfers that this one represents.
+
+    store_trap_states : bool
+        Whether to store the trap states after this transfer, for the next
+        express pass to continue from.
+*/
+ROEExpressTransfer::ROEExpressTransfer(
+    int row_index, double express_multiplier, bool store_trap_states)
+    : row_index(row_index),
+      express_multiplier(express_multiplier),
+      store_trap_states(store_trap_states) {}
+
 // ========
 // ROE::
 // ========
@@ -404,6 +433,133 @@ void ROE::set_store_trap_states_matrix() {
     }
 }
 
+/*
+    Set the compact schedule of the transfers to model in each express pass,
+    from the express and store-trap-states matrices, then release the
+    matrices.
+
+    Most of the express matrix is zeros, e.g. for express = n_rows only about
+    half of its n_rows^2 elements are non-zero, so the clocking loops over
+    just the listed transfers of each pass instead of scanning every row.
+
+    Sets
+    ----
+    express_schedule : std::vector<ROEExpressTransfer>
+        Each transfer with a non-zero express multiplier and/or that stores
+        the trap states, in order of express pass then row.
+
+    express_schedule_starts : std::vector<int>
+        The index in express_schedule of each express pass's first transfer,
+        plus the total number of transfers at the end.
+
+    express_pass_start, express_pass_stop : int
+        All the express passes, see set_express_pass_range().
+*/
+void ROE::set_express_schedule() {
+    int n_rows = express_matrix.size() / n_express_passes;
+
+    express_schedule.clear();
+    express_schedule_starts.assign(n_express_passes + 1, 0);
+    for (int express_index = 0; express_index < n_express_passes; express_index++) {
+        express_schedule_starts[express_index] = express_schedule.size();
+        for (int row_index = 0; row_index < n_rows; row_index++) {
+            int i_matrix = express_index * n_rows + row_index;
+            if ((express_matrix[i_matrix] != 0.0) || store_trap_states_matrix[i_matrix])
+                express_schedule.push_back(ROEExpressTransfer(
+                    row_index, express_matrix[i_matrix],
+                    store_trap_states_matrix[i_matrix]));
+        }
+    }
+    express_schedule_starts[n_express_passes] = express_schedule.size();
+    express_pass_start = 0;
+    express_pass_stop = n_express_passes;
+
+    express_matrix = std::valarray<double>();
+    store_trap_states_matrix = std::valarray<bool>();
+}
+
+/*
+    Set the range of express passes to model, e.g. to split a long readout
+    into several runs, each continuing from the trap states at the end of the
+    previous one, see TrapStateSnapshot in cti.cpp.
+
+    With the default express = n_rows, each express pass is one transfer in
+    the readout sequence (for all the pixels that haven't been read out yet),
+    so these are the times of the transfers. Modelling passes [0, t) then
+    [t, n_express_passes) gives the same result as all of them together.
+
+    Parameters
+    ----------
+    time_start, time_stop : int (opt.)
+        The first express pass to model and the one to stop before. Default
+        0 and -1 for all of them.
+
+    Sets
+    ----
+    express_pass_start, express_pass_stop : int
+        The range of express passes.
+*/
+void ROE::set_express_pass_range(int time_start, int time_stop) {
+    if (time_stop == -1) time_stop = n_express_passes;
+    if ((time_start < 0) || (time_stop > n_express_passes) || (time_start > time_stop))
+        error(
+            "Invalid time range %d to %d for %d express passes", time_start,
+            time_stop, n_express_passes);
+
+    express_pass_start = time_start;
+    express_pass_stop = time_stop;
+}
+
+/*
+    The index in express_schedule of an express pass's first transfer at or
+    after a row, or of the next pass's first transfer if there are none.
+*/
+int ROE::express_schedule_first(int express_index, int row_index) const {
+    return std::lower_bound(
+               express_schedule.begin() + express_schedule_starts[express_index],
+               express_schedule.begin() + express_schedule_starts[express_index + 1],
+               row_index,
+               [](const ROEExpressTransfer& transfer, int row_index) {
+                   return transfer.row_index < row_index;
+               }) -
+           express_schedule.begin();
+}
+
+/*
+    Whether an express pass models any transfers in a range of rows, or the
+    previous pass stores its trap states in them. If so then a pass that
+    starts after these rows must continue from the trap states it had at the
+    end of them, instead of the restored ones.
+
+    Parameters
+    ----------
+    express_index : int
+        The express pass.
+
+    row_index_start, row_index_stop : int
+        The range of rows.
+*/
+bool ROE::express_pass_depends_on_rows(
+    int express_index, int row_index_start, int row_index_stop) const {
+
+    for (int i_transfer = express_schedule_first(express_index, row_index_start);
+         (i_transfer < express_schedule_starts[express_index + 1]) &&
+         (express_schedule[i_transfer].row_index < row_index_stop);
+         i_transfer++) {
+        if (express_schedule[i_transfer].express_multiplier != 0.0) return true;
+    }
+
+    if (express_index == 0) return false;
+    for (int i_transfer = express_schedule_first(express_index - 1, row_index_start);
+         (i_transfer < express_schedule_starts[express_index]) &&
+         (express_schedule[i_transfer].row_index < row_index_stop);
+         i_transfer++) {
+        if (express_schedule[i_transfer].store_trap_states) return true;
+    }
+
+    return false;
+}
+
 /*
     Set the clock sequence 2D array of ROEStepPhase objects for each clocking
     step and phase.
@@ -0,0 +1,302 @@
+
+#include "table_cache.hpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <valarray>
+
+#include "util.hpp"
+
+// ========
+// TableKey::
+// ========
+/*
+    Class TableKey.
+
+    The parameters that fully determine an interpolation table of a continuum
+    trap, to look up previously computed tables.
+
+    Parameters
+    ----------
+    kind : int
+        The kind of table, see TableKind.
+
+    release_timescale : double
+    release_timescale_sigma : double
+        The median release timescale and its lognormal width.
+
+    capture_timescale : double
+        The capture timescale, or 0 for tables that don't depend on it.
+
+    dwell_time : double
+        The dwell time for slow-capture tables, or 0 for tables that don't
+        depend on it.
+
+    time_min : double
+    time_max : double
+    tolerance : double
+    n_intp : int
+        The table limits, target error, and (maximum) number of values, see
+        TrapInstantCaptureContinuum::prep_fill_fraction_and_time_elapsed_tables().
+*/
+TableKey::TableKey(
+    int kind, double release_timescale, double release_timescale_sigma,
+    double capture_timescale, double dwell_time, double time_min, double time_max,
+    double tolerance, int n_intp)
+    : kind(kind),
+      release_timescale(release_timescale),
+      release_timescale_sigma(release_timescale_sigma),
+      capture_timescale(capture_timescale),
+      dwell_time(dwell_time),
+      time_min(time_min),
+      time_max(time_max),
+      tolerance(tolerance),
+      n_intp(n_intp) {}
+
+/*
+    Order keys by their exact values, for the in-memory map.
+*/
+bool TableKey::operator<(const TableKey& other) const {
+    if (kind != other.kind) return kind < other.kind;
+    if (release_timescale != other.release_timescale)
+        return release_timescale < other.release_timescale;
+    if (release_timescale_sigma != other.release_timescale_sigma)
+        return release_timescale_sigma < other.release_timescale_sigma;
+    if (capture_timescale != other.capture_timescale)
+        return capture_timescale < other.capture_timescale;
+    if (dwell_time != other.dwell_time) return dwell_time < other.dwell_time;
+    if (time_min != other.time_min) return time_min < other.time_min;
+    if (time_max != other.time_max) return time_max < other.time_max;
+    if (tolerance != other.tolerance) return tolerance < other.tolerance;
+    return n_intp < other.n_intp;
+}
+
+/*
+    The key's parameters as the header of a cache file (after the format
+    version and the number of values).
+*/
+static const int n_header_values = 11;
+static const double table_file_version = 2.0;
+
+static void key_to_header(const TableKey& key, int n_values, double* header) {
+    header[0] = table_file_version;
+    header[1] = n_values;
+    header[2] = key.kind;
+    header[3] = key.release_timescale;
+    header[4] = key.release_timescale_sigma;
+    header[5] = key.capture_timescale;
+    header[6] = key.dwell_time;
+    header[7] = key.time_min;
+    header[8] = key.time_max;
+    header[9] = key.tolerance;
+    header[10] = key.n_intp;
+}
+
+/*
+    FNV-1a hash of the key's parameters, to name its cache file.
+*/
+unsigned long long TableKey::hash() const {
+    double header[n_header_values];
+    key_to_header(*this, 0, header);
+
+    unsigned long long hash = 14695981039346656037ULL;
+    const unsigned char* bytes = (const unsigned char*)&header[2];
+    for (size_t i = 0; i < (n_header_values - 2) * sizeof(double); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// ========
+// Cache
+// ========
+/*
+    Interpolation tables are cached in memory for the lifetime of the process,
+    and optionally in files in a directory that can be shared between
+    processes, so that repeated runs with the same traps and dwell times don't
+    need to recompute them.
+
+    The directory is set by set_table_cache_dir(), or by the environment
+    variable ARCTIC_TABLE_CACHE_DIR if that hasn't been called. Files are
+    written to a temporary name then renamed, so concurrent readers only ever
+    see complete tables, and they are read back with mmap().
+*/
+static std::mutex table_cache_mutex;
+static std::map<TableKey, std::valarray<double> > table_cache;
+static const size_t max_n_cached_tables = 4096;
+static std::string table_cache_dir;
+static bool table_cache_dir_is_set = false;
+
+/*
+    Set the directory for the on-disk cache of interpolation tables, or "" or
+    nullptr to only cache in memory. The directory must already exist.
+*/
+void set_table_cache_dir(const char* dir) {
+    std::lock_guard<std::mutex> lock(table_cache_mutex);
+    table_cache_dir = dir ? dir : "";
+    table_cache_dir_is_set = true;
+}
+
+/*
+    Empty the in-memory cache of interpolation tables. Any files in the
+    on-disk cache are left in place.
+*/
+void clear_table_cache() {
+    std::lock_guard<std::mutex> lock(table_cache_mutex);
+    table_cache.clear();
+}
+
+/*
+    The cache file name for a key, or "" if there is no on-disk cache. Must be
+    called with the mutex held.
+*/
+static std::string table_cache_path(const TableKey& key) {
+    if (!table_cache_dir_is_set) {
+        const char* dir = getenv("ARCTIC_TABLE_CACHE_DIR");
+        table_cache_dir = dir ? dir : "";
+        table_cache_dir_is_set = true;
+    }
+    if (table_cache_dir.empty()) return "";
+
+    char name[64];
+    snprintf(name, sizeof(name), "/arctic_table_%016llx.bin", key.hash());
+
+    return table_cache_dir + name;
+}
+
+/*
+    Add a table to the in-memory cache, first emptying it if full. Must be
+    called with the mutex held.
+*/
+static void insert_table(const TableKey& key, const std::valarray<double>& values) {
+    if (table_cache.size() >= max_n_cached_tables) table_cache.clear();
+    std::valarray<double>& stored = table_cache[key];
+    stored.resize(values.size());
+    stored = values;
+}
+
+/*
+    Read a table from its cache file, checking that the stored parameters
+    match the key exactly.
+*/
+static bool read_table_file(
+    const std::string& path, const TableKey& key, std::valarray<double>& values) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)(n_header_values * sizeof(double))) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const double* data = (const double*)map;
+    int n_values = (int)data[1];
+    double header[n_header_values];
+    key_to_header(key, n_values, header);
+    bool is_match =
+        (n_values > 0) &&
+        (size == (n_header_values + n_values) * sizeof(double)) &&
+        (memcmp(data, header, sizeof(header)) == 0);
+    if (is_match) {
+        values.resize(n_values);
+        memcpy(&values[0], data + n_header_values, n_values * sizeof(double));
+    }
+
+    munmap(map, size);
+
+    return is_match;
+}
+
+/*
+    Write a table to its cache file. Failures are ignored, since the table can
+    always be recomputed.
+*/
+static void write_table_file(
+    const std::string& path, const TableKey& key, const std::valarray<double>& values) {
+    static std::atomic<int> n_files_written(0);
+    char suffix[48];
+    snprintf(
+        suffix, sizeof(suffix), ".tmp%ld_%d", (long)getpid(), n_files_written++);
+    std::string path_tmp = path + suffix;
+
+    FILE* f = fopen(path_tmp.c_str(), "wb");
+    if (!f) {
+        print_v(2, "Failed to write table cache file %s \n", path_tmp.c_str());
+        return;
+    }
+    double header[n_header_values];
+    key_to_header(key, values.size(), header);
+    bool is_written =
+        (fwrite(header, sizeof(double), n_header_values, f) == n_header_values) &&
+        (fwrite(&values[0], sizeof(double), values.size(), f) == values.size());
+    is_written = (fclose(f) == 0) && is_written;
+
+    if (!is_written || rename(path_tmp.c_str(), path.c_str()) != 0)
+        remove(path_tmp.c_str());
+}
+
+/*
+    Look up a previously computed interpolation table.
+
+    Parameters
+    ----------
+    key : TableKey
+        The parameters of the table.
+
+    values : std::valarray<double>&
+        Set to the stored values if found.
+
+    Returns
+    -------
+    is_found : bool
+        Whether the table was found in memory or on disk.
+*/
+bool load_cached_table(const TableKey& key, std::valarray<double>& values) {
+    std::lock_guard<std::mutex> lock(table_cache_mutex);
+
+    std::map<TableKey, std::valarray<double> >::iterator it = table_cache.find(key);
+    if (it != table_cache.end()) {
+        values.resize(it->second.size());
+        values = it->second;
+        return true;
+    }
+
+    std::string path = table_cache_path(key);
+    if (path.empty() || !read_table_file(path, key, values)) return false;
+
+    insert_table(key, values);
+
+    return true;
+}
+
+/*
+    Store a newly computed interpolation table, in memory and in the on-disk
+    cache if set.
+*/
+void store_cached_table(const TableKey& key, const std::valarray<double>& values) {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(table_cache_mutex);
+        insert_table(key, values);
+        path = table_cache_path(key);
+    }
+
+    if (!path.empty()) write_table_file(path, key, values);
+}
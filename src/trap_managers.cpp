@@ -3,14 +3,33 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <sys/time.h>
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <valarray>
 
 #include "ccd.hpp"
+#include "profile.hpp"
 #include "traps.hpp"
 #include "util.hpp"
 #include <iostream>
 
+/*
+    Global limit on the memory used for the watermark arrays of each set of
+    trap managers, i.e. of each thread, in bytes. Only applies to models
+    prepared after it's set.
+
+    0       No limit (default). The arrays are allocated for the maximum number
+            of transfers, or grown on demand if the traps aren't emptied
+            between columns.
+    > 0     The arrays are grown on demand up to this limit, then the smallest
+            watermarks are merged to stay within it, at some cost to accuracy.
+*/
+double watermark_memory_limit = 0.0;
+void set_watermark_memory_limit(double n_bytes) { watermark_memory_limit = n_bytes; }
+
 // ========
 // TrapManagerBase::
 // ========
@@ -97,6 +116,20 @@
     n_watermarks : int
         The total number of available watermark levels, determined by the number
         of potential watermark-creating transfers and the watermarking scheme.
+
+    n_used_watermarks : int
+        The number of watermark levels that may have been modified since the
+        trap states were last reset, see update_n_used_watermarks().
+
+    max_n_watermarks : int
+        The cap on n_watermarks if the arrays are grown on demand, or 0 for no
+        cap, see ensure_watermark_capacity().
+
+    max_n_active_watermarks : int
+    n_pruned_watermarks : long
+        The most active watermarks so far, if profiling (see profile.hpp), and
+        the total number removed by prune_watermarks() or merged to respect
+        max_n_watermarks.
 */
 TrapManagerBase::TrapManagerBase(
     int max_n_transfers, CCDPhase ccd_phase, double dwell_time)
@@ -107,6 +140,10 @@ TrapManagerBase::TrapManagerBase(
     n_active_watermarks = 0;
     i_first_active_wmk = 0;
     n_watermarks_per_transfer = 1;
+    n_used_watermarks = 0;
+    max_n_watermarks = 0;
+    max_n_active_watermarks = 0;
+    n_pruned_watermarks = 0;
 }
 
 /*
@@ -125,40 +162,306 @@ void TrapManagerBase::initialise_trap_states() {
 
     watermark_volumes = std::valarray<double>(zeroth_watermark, n_watermarks);
     watermark_fills = std::valarray<double>(empty_watermark, n_traps * n_watermarks);
+    n_used_watermarks = 0;
     //empty_probabilities_from_release = std::valarray<double>(0.0, n_traps);
     
     // Initialise the stored trap states too
     store_trap_states();
 }
 
+/*
+    Update the number of watermark levels, from the start of the arrays, that
+    may have been modified since the trap states were last reset.
+
+    The levels beyond these still have their empty values, so only these need
+    to be reset, stored, and restored, instead of the full arrays that allow
+    for the maximum possible number of watermarks.
+
+    The end of the active watermarks only moves down when they are pruned, so
+    checking here before pruning and in the functions below is enough to track
+    all the modified levels. This includes the one level just above the active
+    watermarks, which can also be modified (e.g. when slow-capture traps add a
+    new watermark above the cloud).
+*/
+void TrapManagerBase::update_n_used_watermarks() {
+    n_used_watermarks = std::max(
+        n_used_watermarks,
+        std::min(i_first_active_wmk + n_active_watermarks + 1, n_watermarks));
+}
+
 /*
     Reset the watermark arrays to empty.
 */
 void TrapManagerBase::reset_trap_states() {
+    update_n_used_watermarks();
+
     n_active_watermarks = 0;
     i_first_active_wmk = 0;
-    watermark_volumes = zeroth_watermark;
-    watermark_fills = empty_watermark;
+    std::fill_n(&watermark_volumes[0], n_used_watermarks, zeroth_watermark);
+    std::fill_n(&watermark_fills[0], n_used_watermarks * n_traps, empty_watermark);
+    n_used_watermarks = 0;
 }
 
 /*
     Store the watermark arrays to be loaded again later.
 */
 void TrapManagerBase::store_trap_states() {
+    update_n_used_watermarks();
+
     stored_n_active_watermarks = n_active_watermarks;
     stored_i_first_active_wmk = i_first_active_wmk;
-    stored_watermark_volumes = watermark_volumes;
-    stored_watermark_fills = watermark_fills;
+    stored_n_used_watermarks = n_used_watermarks;
+
+    // Only copy the used levels, once the stored arrays have been allocated
+    if (stored_watermark_volumes.size() != watermark_volumes.size()) {
+        stored_watermark_volumes.resize(watermark_volumes.size());
+        stored_watermark_fills.resize(watermark_fills.size());
+    }
+    std::copy_n(
+        &watermark_volumes[0], n_used_watermarks, &stored_watermark_volumes[0]);
+    std::copy_n(
+        &watermark_fills[0], n_used_watermarks * n_traps, &stored_watermark_fills[0]);
 }
 
 /*
     Restore the watermark arrays to their saved values.
 */
 void TrapManagerBase::restore_trap_states() {
+    update_n_used_watermarks();
+
     n_active_watermarks = stored_n_active_watermarks;
     i_first_active_wmk = stored_i_first_active_wmk;
-    watermark_volumes = stored_watermark_volumes;
-    watermark_fills = stored_watermark_fills;
+
+    // Copy back the stored levels, and reset any others used since then
+    std::copy_n(
+        &stored_watermark_volumes[0], stored_n_used_watermarks, &watermark_volumes[0]);
+    std::copy_n(
+        &stored_watermark_fills[0], stored_n_used_watermarks * n_traps,
+        &watermark_fills[0]);
+    if (n_used_watermarks > stored_n_used_watermarks) {
+        std::fill_n(
+            &watermark_volumes[stored_n_used_watermarks],
+            n_used_watermarks - stored_n_used_watermarks, zeroth_watermark);
+        std::fill_n(
+            &watermark_fills[stored_n_used_watermarks * n_traps],
+            (n_used_watermarks - stored_n_used_watermarks) * n_traps,
+            empty_watermark);
+    }
+    n_used_watermarks = stored_n_used_watermarks;
+}
+
+/*
+    Append a copy of the current watermark arrays to a buffer, e.g. to load
+    them again later at the same point in the same column. Unlike
+    store_trap_states(), any number of states can be saved.
+
+    Only the used levels are saved, after the numbers of active and used
+    watermarks and the index of the first active one.
+
+    Parameters
+    ----------
+    states : std::vector<double>&
+        The buffer to append the trap states to.
+*/
+void TrapManagerBase::save_trap_states(std::vector<double>& states) {
+    update_n_used_watermarks();
+
+    states.push_back(n_active_watermarks);
+    states.push_back(i_first_active_wmk);
+    states.push_back(n_used_watermarks);
+    states.insert(
+        states.end(), &watermark_volumes[0], &watermark_volumes[0] + n_used_watermarks);
+    states.insert(
+        states.end(), &watermark_fills[0],
+        &watermark_fills[0] + n_used_watermarks * n_traps);
+}
+
+/*
+    Load the watermark arrays from states saved by save_trap_states(), and
+    reset any other levels used since then.
+
+    Parameters
+    ----------
+    states : const double*
+        The start of this trap manager's saved states.
+
+    Returns
+    -------
+    states_end : const double*
+        The end of this trap manager's saved states, e.g. the start of the
+        next one's.
+*/
+const double* TrapManagerBase::load_trap_states(const double* states) {
+    update_n_used_watermarks();
+
+    n_active_watermarks = (int)states[0];
+    i_first_active_wmk = (int)states[1];
+    int n_used_watermarks_saved = (int)states[2];
+    states += 3;
+    if (n_used_watermarks_saved > n_watermarks)
+        error(
+            "Saved trap states with %d watermarks, but only %d available",
+            n_used_watermarks_saved, n_watermarks);
+
+    std::copy_n(states, n_used_watermarks_saved, &watermark_volumes[0]);
+    states += n_used_watermarks_saved;
+    std::copy_n(states, n_used_watermarks_saved * n_traps, &watermark_fills[0]);
+    states += n_used_watermarks_saved * n_traps;
+    if (n_used_watermarks > n_used_watermarks_saved) {
+        std::fill_n(
+            &watermark_volumes[n_used_watermarks_saved],
+            n_used_watermarks - n_used_watermarks_saved, zeroth_watermark);
+        std::fill_n(
+            &watermark_fills[n_used_watermarks_saved * n_traps],
+            (n_used_watermarks - n_used_watermarks_saved) * n_traps,
+            empty_watermark);
+    }
+    n_used_watermarks = n_used_watermarks_saved;
+
+    return states;
+}
+
+/*
+    Change the number of available watermark levels, keeping the used ones.
+
+    Parameters
+    ----------
+    n_watermarks_new : int
+        The new total number of watermark levels, at least n_used_watermarks.
+*/
+void TrapManagerBase::resize_watermarks(int n_watermarks_new) {
+    update_n_used_watermarks();
+    if (n_watermarks_new < n_used_watermarks)
+        error(
+            "Cannot resize the watermarks (%d) to fewer than are used (%d)",
+            n_watermarks_new, n_used_watermarks);
+
+    std::valarray<double> volumes(zeroth_watermark, n_watermarks_new);
+    std::valarray<double> fills(empty_watermark, n_traps * n_watermarks_new);
+    std::copy_n(&watermark_volumes[0], n_used_watermarks, &volumes[0]);
+    std::copy_n(&watermark_fills[0], n_used_watermarks * n_traps, &fills[0]);
+    watermark_volumes.swap(volumes);
+    watermark_fills.swap(fills);
+    n_watermarks = n_watermarks_new;
+}
+
+/*
+    Move the active watermarks (and any used levels above them) down to the
+    start of the arrays, to reuse the levels left below them as the first
+    active watermark moves up. The levels vacated at the top are emptied, so
+    the trap states are exactly the same relative to the first active one.
+*/
+void TrapManagerBase::move_watermarks_to_start() {
+    update_n_used_watermarks();
+    if (i_first_active_wmk == 0) return;
+
+    int n_moved = n_used_watermarks - i_first_active_wmk;
+    std::copy(
+        &watermark_volumes[i_first_active_wmk],
+        &watermark_volumes[0] + n_used_watermarks, &watermark_volumes[0]);
+    std::copy(
+        &watermark_fills[i_first_active_wmk * n_traps],
+        &watermark_fills[0] + n_used_watermarks * n_traps, &watermark_fills[0]);
+    std::fill_n(&watermark_volumes[n_moved], i_first_active_wmk, zeroth_watermark);
+    std::fill_n(
+        &watermark_fills[n_moved * n_traps], i_first_active_wmk * n_traps,
+        empty_watermark);
+
+    // The stale levels below the first active one are now above the used ones
+    n_used_watermarks = n_moved;
+    i_first_active_wmk = 0;
+}
+
+/*
+    Merge the active watermark that holds the fewest trapped electrons into
+    the one below, to free a level when the arrays can't grow any further.
+
+    The merged watermark has the combined volume and the volume-weighted mean
+    fill of each trap species, so the number of trapped electrons of each
+    species is conserved and no fill exceeds the larger of the two.
+*/
+void TrapManagerBase::merge_smallest_watermark() {
+    update_n_used_watermarks();
+    if (n_active_watermarks <= 1) return;
+
+    // The watermark with the fewest electrons, above the first one
+    int i_wmk_merge = i_first_active_wmk + 1;
+    double n_electrons_min = n_trapped_electrons_in_watermark(i_wmk_merge);
+    for (int i_wmk = i_wmk_merge + 1;
+         i_wmk < i_first_active_wmk + n_active_watermarks; i_wmk++) {
+        double n_electrons = n_trapped_electrons_in_watermark(i_wmk);
+        if (n_electrons < n_electrons_min) {
+            n_electrons_min = n_electrons;
+            i_wmk_merge = i_wmk;
+        }
+    }
+
+    // Combine it with the watermark below
+    int i_wmk_below = i_wmk_merge - 1;
+    double volume = watermark_volumes[i_wmk_below] + watermark_volumes[i_wmk_merge];
+    if (volume > 0.0) {
+        for (int i_trap = 0; i_trap < n_traps; i_trap++) {
+            watermark_fills[i_wmk_below * n_traps + i_trap] =
+                (watermark_fills[i_wmk_below * n_traps + i_trap] *
+                     watermark_volumes[i_wmk_below] +
+                 watermark_fills[i_wmk_merge * n_traps + i_trap] *
+                     watermark_volumes[i_wmk_merge]) /
+                volume;
+        }
+    }
+    watermark_volumes[i_wmk_below] = volume;
+
+    // Shuffle the higher watermarks down
+    int i_wmk_end = i_first_active_wmk + n_active_watermarks;
+    std::copy(
+        &watermark_volumes[i_wmk_merge + 1], &watermark_volumes[0] + i_wmk_end,
+        &watermark_volumes[i_wmk_merge]);
+    std::copy(
+        &watermark_fills[(i_wmk_merge + 1) * n_traps],
+        &watermark_fills[0] + i_wmk_end * n_traps,
+        &watermark_fills[i_wmk_merge * n_traps]);
+
+    n_active_watermarks--;
+    n_pruned_watermarks++;
+}
+
+/*
+    Make sure there are enough available watermark levels for the next few
+    transfers, for arrays that are grown on demand instead of being allocated
+    for every transfer up front (e.g. if the traps aren't emptied between
+    columns, when that could be every transfer in the whole image).
+
+    First move the watermarks down to reuse any free levels below them, then
+    grow the arrays if needed, doubling their size up to max_n_watermarks.
+    If that cap is reached, merge the smallest watermarks instead until the
+    rest fit, see merge_smallest_watermark().
+
+    Parameters
+    ----------
+    n_transfers : int
+        The number of transfers (i.e. capture events) to make room for.
+*/
+void TrapManagerBase::ensure_watermark_capacity(int n_transfers) {
+    // Room for the new watermarks, and the level above them
+    int n_needed = n_active_watermarks + n_transfers * n_watermarks_per_transfer + 1;
+    if (i_first_active_wmk + n_needed <= n_watermarks) return;
+
+    move_watermarks_to_start();
+    if (n_needed <= n_watermarks) return;
+
+    int n_watermarks_new = std::max(n_needed, 2 * n_watermarks);
+    if (max_n_watermarks > 0)
+        n_watermarks_new = std::max(
+            n_watermarks, std::min(n_watermarks_new, max_n_watermarks));
+    if (n_watermarks_new > n_watermarks) resize_watermarks(n_watermarks_new);
+
+    while ((n_needed > n_watermarks) && (n_active_watermarks > 1)) {
+        merge_smallest_watermark();
+        n_needed--;
+    }
+
+    // Exceed the cap if it's too small for even a single watermark
+    if (n_needed > n_watermarks) resize_watermarks(n_needed);
 }
 
 /*
@@ -324,6 +627,9 @@ void TrapManagerBase::prune_watermarks(double min_n_electrons) {
 
     
 
+    // Keep track of the modified levels before the active ones are reduced
+    update_n_used_watermarks();
+
     // With only one watermark, not much can be done
     if (n_active_watermarks <= 1) return; // Cannot prune if there is only a trunk
     if (n_trapped_electrons_in_watermark(i_first_active_wmk) <= 0) return; // Something has gone wrong to get here
@@ -447,6 +753,7 @@ void TrapManagerBase::prune_watermarks(double min_n_electrons) {
         }
     }
     n_active_watermarks -= n_watermarks_pruned;
+    n_pruned_watermarks += n_watermarks_pruned;
 
     // Count the total number of electrons in each watermark
     print_v(3,"\n\n Fill fractions after prune (first %d n %d)\n",i_first_active_wmk, n_active_watermarks);
@@ -595,23 +902,45 @@ double TrapManagerInstantCapture::n_electrons_released() {
     double frac_exposed_per_volume;
     double cumulative_volume = 0.0;
     double next_cumulative_volume = 0.0;
+    double* fills;
+    const double* empty_probabilities = &empty_probabilities_from_release[0];
+
+    // Uniform traps, so the same simple (vectorisable) sum over the trap
+    // species for each active watermark
+    if (!any_non_uniform_traps) {
+        for (int i_wmk = i_first_active_wmk;
+             i_wmk < i_first_active_wmk + n_active_watermarks; i_wmk++) {
+            fills = &watermark_fills[i_wmk * n_traps];
+            n_released_this_wmk = 0.0;
+
+            #pragma omp simd reduction(+ : n_released_this_wmk)
+            for (int i_trap = 0; i_trap < n_traps; i_trap++) {
+                double frac_released_this_trap =
+                    fills[i_trap] * empty_probabilities[i_trap];
+                n_released_this_wmk += frac_released_this_trap;
+                fills[i_trap] -= frac_released_this_trap;
+            }
+
+            n_released += n_released_this_wmk * watermark_volumes[i_wmk];
+        }
+
+        return n_released;
+    }
 
     // Each active watermark
     for (int i_wmk = i_first_active_wmk;
          i_wmk < i_first_active_wmk + n_active_watermarks; i_wmk++) {
+        fills = &watermark_fills[i_wmk * n_traps];
         n_released_this_wmk = 0.0;
 
-        if (any_non_uniform_traps) {
-            // Total volume at the bottom and top of this watermark
-            cumulative_volume = next_cumulative_volume;
-            next_cumulative_volume += watermark_volumes[i_wmk];
-        }
+        // Total volume at the bottom and top of this watermark
+        cumulative_volume = next_cumulative_volume;
+        next_cumulative_volume += watermark_volumes[i_wmk];
 
         // Each trap species
         for (int i_trap = 0; i_trap < n_traps; i_trap++) {
             // Fraction of released electrons
-            frac_released = watermark_fills[i_wmk * n_traps + i_trap] *
-                            empty_probabilities_from_release[i_trap];
+            frac_released = fills[i_trap] * empty_probabilities[i_trap];
 
             // Account for non-uniform distribution with volume
             if (traps[i_trap].fractional_volume_full_exposed == 0.0)
@@ -625,7 +954,7 @@ double TrapManagerInstantCapture::n_electrons_released() {
             n_released_this_wmk += frac_released * frac_exposed_per_volume;
 
             // Update the watermark fill fraction
-            watermark_fills[i_wmk * n_traps + i_trap] -= frac_released;
+            fills[i_trap] -= frac_released;
         }
 
         // Multiply by the watermark volume
@@ -655,11 +984,12 @@ double TrapManagerInstantCapture::n_electrons_released_from_wmk_above_cloud(int
 
     // Fraction of electrons released from each trap species
     double frac_released_this_wmk = 0.0;
+    const double* fills = &watermark_fills[i_wmk * n_traps];
+    const double* empty_probabilities = &empty_probabilities_from_release[0];
+    #pragma omp simd reduction(+ : frac_released_this_wmk)
     for (int i_trap = 0; i_trap < n_traps; i_trap++) {
         // Fraction of released electrons
-        frac_released_this_wmk +=
-            watermark_fills[i_wmk * n_traps + i_trap] *
-            empty_probabilities_from_release[i_trap];
+        frac_released_this_wmk += fills[i_trap] * empty_probabilities[i_trap];
     }
 
     // Multiply by the watermark volume
@@ -1439,8 +1769,9 @@ double TrapManagerSlowCapture::n_electrons_released_and_captured(
         limits. See prep_fill_fraction_and_time_elapsed_tables().
 
     n_intp : int
-        The number of interpolation values in the arrays. Currently set here
-        manually. See prep_fill_fraction_and_time_elapsed_tables().
+        The maximum number of interpolation values in the arrays, for the
+        traps' table_tolerance. Currently set here manually. See
+        prep_fill_fraction_and_time_elapsed_tables().
 */
 TrapManagerInstantCaptureContinuum::TrapManagerInstantCaptureContinuum(
     std::valarray<TrapInstantCaptureContinuum> traps, int max_n_transfers,
@@ -1455,7 +1786,7 @@ TrapManagerInstantCaptureContinuum::TrapManagerInstantCaptureContinuum(
 
     time_min = dwell_time;
     time_max = max_n_transfers * dwell_time;
-    n_intp = 1000;
+    n_intp = 1025;
 }
 
 /*
@@ -1468,7 +1799,7 @@ void TrapManagerInstantCaptureContinuum::prepare_interpolation_tables() {
     // Prepare interpolation tables for each trap species
     for (int i_trap = 0; i_trap < n_traps; i_trap++) {
         traps[i_trap].prep_fill_fraction_and_time_elapsed_tables(
-            time_min, time_max, n_intp);
+            time_min, time_max, n_intp, traps[i_trap].table_tolerance);
     }
 }
 
@@ -1882,7 +2213,7 @@ TrapManagerSlowCaptureContinuum::TrapManagerSlowCaptureContinuum(
 
     time_min = dwell_time / 30;
     time_max = max_n_transfers * dwell_time;
-    n_intp = 1000;
+    n_intp = 1025;
 
     // Overwrite default parameter values
     n_watermarks_per_transfer = 2;
@@ -1899,9 +2230,9 @@ void TrapManagerSlowCaptureContinuum::prepare_interpolation_tables() {
     // Prepare interpolation tables for each trap species
     for (int i_trap = 0; i_trap < n_traps; i_trap++) {
         traps[i_trap].prep_fill_fraction_and_time_elapsed_tables(
-            time_min, time_max, n_intp);
+            time_min, time_max, n_intp, traps[i_trap].table_tolerance);
         traps[i_trap].prep_fill_fraction_after_slow_capture_tables(
-            dwell_time, time_min, time_max, n_intp);
+            dwell_time, time_min, time_max, n_intp, traps[i_trap].table_tolerance);
     }
 }
 
@@ -2240,7 +2571,26 @@ double TrapManagerSlowCaptureContinuum::n_electrons_released_and_captured(
     trap_managers_sc_co :
    std::valarray<TrapManagerSlowCaptureContinuum> For each watermark type, the list of
    trap manager objects for each phase. Ignored if the corresponding n_*_traps is 0.
+
+    n_prunes, n_stores, n_restores : long
+    store_time, restore_time : double
+        The number of calls to prune, store, and restore the watermarks of all
+        trap managers, and if profiling (see profile.hpp) the wall-clock time
+        spent storing and restoring them.
+
+    watermarks_on_demand : bool
+        Whether the watermark arrays might need to grow (or be merged) during
+        clocking, see ensure_watermark_capacity(). Set if the watermark memory
+        is limited, see set_watermark_memory_limit(), or by prepare_clocking()
+        if the traps aren't emptied between columns.
+
+    setup_id : long
+        A unique number for each set up of the trap managers, shared by their
+        copies, so that a TrapManagerManagerPool can tell whether its
+        workspaces are already copies of them.
 */
+static std::atomic<long> n_trap_manager_manager_setups(0);
+
 TrapManagerManager::TrapManagerManager(
     std::valarray<TrapInstantCapture>& traps_ic,
     std::valarray<TrapSlowCapture>& traps_sc,
@@ -2252,7 +2602,14 @@ TrapManagerManager::TrapManagerManager(
       traps_ic_co(traps_ic_co),
       traps_sc_co(traps_sc_co),
       max_n_transfers(max_n_transfers),
-      ccd(ccd) {
+      ccd(ccd),
+      n_prunes(0),
+      n_stores(0),
+      n_restores(0),
+      store_time(0.0),
+      restore_time(0.0),
+      watermarks_on_demand(false),
+      setup_id(++n_trap_manager_manager_setups) {
 
     // The number of trap species (if any) of each watermark type
     n_traps_ic = traps_ic.size();
@@ -2334,6 +2691,162 @@ TrapManagerManager::TrapManagerManager(
             trap_managers_sc_co[phase_index].setup();
         }
     }
+
+    if (watermark_memory_limit > 0) limit_watermark_memory(dwell_times.size());
+}
+
+/*
+    Cap the number of watermark levels of every trap manager to keep their
+    arrays (including the stored copies) within the watermark memory limit,
+    see set_watermark_memory_limit(). Shrinks any already-larger arrays.
+
+    Parameters
+    ----------
+    n_steps : int
+        The number of steps in the clock sequence, i.e. the transfers that each
+        trap manager needs room for in one pixel, for the minimum cap.
+*/
+void TrapManagerManager::limit_watermark_memory(int n_steps) {
+    // The memory per watermark level for all trap managers
+    double n_bytes_per_level = 0.0;
+    int n_watermarks_per_transfer = 1;
+    if (n_traps_ic > 0)
+        n_bytes_per_level += ccd.n_phases * 2 * (1 + n_traps_ic) * sizeof(double);
+    if (n_traps_sc > 0) {
+        n_bytes_per_level += ccd.n_phases * 2 * (1 + n_traps_sc) * sizeof(double);
+        n_watermarks_per_transfer = trap_managers_sc[0].n_watermarks_per_transfer;
+    }
+    if (n_traps_ic_co > 0)
+        n_bytes_per_level += ccd.n_phases * 2 * (1 + n_traps_ic_co) * sizeof(double);
+    if (n_traps_sc_co > 0)
+        n_bytes_per_level += ccd.n_phases * 2 * (1 + n_traps_sc_co) * sizeof(double);
+    if (n_bytes_per_level == 0.0) return;
+
+    // At least enough for one watermark and the next pixel's transfers
+    int max_n_watermarks = std::max(
+        (double)(n_steps * n_watermarks_per_transfer + 2),
+        std::min(watermark_memory_limit / n_bytes_per_level, (double)INT_MAX));
+    watermarks_on_demand = true;
+
+    if (n_traps_ic > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            TrapManagerBase& trap_manager = trap_managers_ic[phase_index];
+            trap_manager.max_n_watermarks = max_n_watermarks;
+            if (trap_manager.n_watermarks > max_n_watermarks) {
+                trap_manager.resize_watermarks(max_n_watermarks);
+                trap_manager.store_trap_states();
+            }
+        }
+    if (n_traps_sc > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            TrapManagerBase& trap_manager = trap_managers_sc[phase_index];
+            trap_manager.max_n_watermarks = max_n_watermarks;
+            if (trap_manager.n_watermarks > max_n_watermarks) {
+                trap_manager.resize_watermarks(max_n_watermarks);
+                trap_manager.store_trap_states();
+            }
+        }
+    if (n_traps_ic_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            TrapManagerBase& trap_manager = trap_managers_ic_co[phase_index];
+            trap_manager.max_n_watermarks = max_n_watermarks;
+            if (trap_manager.n_watermarks > max_n_watermarks) {
+                trap_manager.resize_watermarks(max_n_watermarks);
+                trap_manager.store_trap_states();
+            }
+        }
+    if (n_traps_sc_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            TrapManagerBase& trap_manager = trap_managers_sc_co[phase_index];
+            trap_manager.max_n_watermarks = max_n_watermarks;
+            if (trap_manager.n_watermarks > max_n_watermarks) {
+                trap_manager.resize_watermarks(max_n_watermarks);
+                trap_manager.store_trap_states();
+            }
+        }
+}
+
+/*
+    Make sure there are enough watermark levels for the next few transfers,
+    for all trap managers, see TrapManagerBase::ensure_watermark_capacity().
+*/
+void TrapManagerManager::ensure_watermark_capacity(int n_transfers) {
+    if (n_traps_ic > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            trap_managers_ic[phase_index].ensure_watermark_capacity(n_transfers);
+        }
+    if (n_traps_sc > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            trap_managers_sc[phase_index].ensure_watermark_capacity(n_transfers);
+        }
+    if (n_traps_ic_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            trap_managers_ic_co[phase_index].ensure_watermark_capacity(n_transfers);
+        }
+    if (n_traps_sc_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            trap_managers_sc_co[phase_index].ensure_watermark_capacity(n_transfers);
+        }
+}
+
+/*
+    Change the densities of the instant-capture and slow-capture trap species,
+    keeping all their other parameters, and reset the watermarks to empty.
+
+    This is much quicker than setting up new trap managers, e.g. for each of
+    many trap models that only differ in their densities, and keeps the same
+    watermark arrays.
+
+    Parameters
+    ----------
+    densities_ic, densities_sc : const double*
+        The new density of each instant-capture and slow-capture trap species,
+        as would be passed to their constructors. Ignored if nullptr.
+*/
+void TrapManagerManager::set_trap_densities(
+    const double* densities_ic, const double* densities_sc) {
+    if (densities_ic) {
+        for (int i_trap = 0; i_trap < n_traps_ic; i_trap++) {
+            const TrapInstantCapture& trap = traps_ic[i_trap];
+            traps_ic[i_trap] = TrapInstantCapture(
+                densities_ic[i_trap], trap.release_timescale,
+                trap.fractional_volume_none_exposed,
+                trap.fractional_volume_full_exposed);
+        }
+        for (int phase_index = 0; phase_index < (int)trap_managers_ic.size();
+             phase_index++) {
+            TrapManagerInstantCapture& trap_manager = trap_managers_ic[phase_index];
+            trap_manager.traps = traps_ic;
+            for (int i_trap = 0; i_trap < n_traps_ic; i_trap++)
+                trap_manager.trap_densities[i_trap] =
+                    traps_ic[i_trap].density *
+                    ccd.fraction_of_traps_per_phase[phase_index];
+        }
+    }
+
+    if (densities_sc) {
+        for (int i_trap = 0; i_trap < n_traps_sc; i_trap++) {
+            const TrapSlowCapture& trap = traps_sc[i_trap];
+            traps_sc[i_trap] = TrapSlowCapture(
+                densities_sc[i_trap], trap.release_timescale, trap.capture_timescale);
+        }
+        for (int phase_index = 0; phase_index < (int)trap_managers_sc.size();
+             phase_index++) {
+            TrapManagerSlowCapture& trap_manager = trap_managers_sc[phase_index];
+            trap_manager.traps = traps_sc;
+            for (int i_trap = 0; i_trap < n_traps_sc; i_trap++)
+                trap_manager.trap_densities[i_trap] =
+                    traps_sc[i_trap].density *
+                    ccd.fraction_of_traps_per_phase[phase_index];
+        }
+    }
+
+    // The watermark fills are in units of the densities
+    reset_trap_states();
+    store_trap_states();
+
+    // Any existing copies no longer match
+    setup_id = ++n_trap_manager_manager_setups;
 }
 
 /*
@@ -2358,10 +2871,41 @@ void TrapManagerManager::reset_trap_states() {
         }
 }
 
+/*
+    Reset the counts of prunes, stores, and restores, and the most active
+    watermarks, for all trap managers, e.g. to reuse a workspace for a new
+    clocking call's profile.
+*/
+void TrapManagerManager::reset_counters() {
+    n_prunes = 0;
+    n_stores = 0;
+    n_restores = 0;
+    store_time = 0.0;
+    restore_time = 0.0;
+
+    std::vector<TrapManagerBase*> trap_managers;
+    for (TrapManagerBase& trap_manager : trap_managers_ic)
+        trap_managers.push_back(&trap_manager);
+    for (TrapManagerBase& trap_manager : trap_managers_sc)
+        trap_managers.push_back(&trap_manager);
+    for (TrapManagerBase& trap_manager : trap_managers_ic_co)
+        trap_managers.push_back(&trap_manager);
+    for (TrapManagerBase& trap_manager : trap_managers_sc_co)
+        trap_managers.push_back(&trap_manager);
+    for (TrapManagerBase* trap_manager : trap_managers) {
+        trap_manager->max_n_active_watermarks = 0;
+        trap_manager->n_pruned_watermarks = 0;
+    }
+}
+
 /*
     Store the watermark arrays to be loaded again later, for all trap managers.
 */
 void TrapManagerManager::store_trap_states() {
+    struct timeval time_start, time_stop;
+    if (profiling) gettimeofday(&time_start, nullptr);
+    n_stores++;
+
     if (n_traps_ic > 0)
         for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
             trap_managers_ic[phase_index].store_trap_states();
@@ -2378,12 +2922,76 @@ void TrapManagerManager::store_trap_states() {
         for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
             trap_managers_sc_co[phase_index].store_trap_states();
         }
+
+    if (profiling) {
+        gettimeofday(&time_stop, nullptr);
+        store_time += gettimelapsed(time_start, time_stop);
+    }
+}
+
+/*
+    Save a copy of the watermark arrays of all trap managers, replacing the
+    buffer's contents. See TrapManagerBase::save_trap_states().
+*/
+void TrapManagerManager::save_trap_states(std::vector<double>& states) {
+    states.clear();
+
+    if (n_traps_ic > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            trap_managers_ic[phase_index].save_trap_states(states);
+        }
+    if (n_traps_sc > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            trap_managers_sc[phase_index].save_trap_states(states);
+        }
+    if (n_traps_ic_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            trap_managers_ic_co[phase_index].save_trap_states(states);
+        }
+    if (n_traps_sc_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            trap_managers_sc_co[phase_index].save_trap_states(states);
+        }
+}
+
+/*
+    Load the watermark arrays of all trap managers from states saved by
+    save_trap_states() with the same traps. See
+    TrapManagerBase::load_trap_states().
+*/
+void TrapManagerManager::load_trap_states(const std::vector<double>& states) {
+    if (states.size() == 0) error("No saved trap states to load");
+    const double* state = &states[0];
+
+    if (n_traps_ic > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            state = trap_managers_ic[phase_index].load_trap_states(state);
+        }
+    if (n_traps_sc > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            state = trap_managers_sc[phase_index].load_trap_states(state);
+        }
+    if (n_traps_ic_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            state = trap_managers_ic_co[phase_index].load_trap_states(state);
+        }
+    if (n_traps_sc_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            state = trap_managers_sc_co[phase_index].load_trap_states(state);
+        }
+
+    if (state != &states[0] + states.size())
+        error("Saved trap states don't match the trap managers");
 }
 
 /*
     Restore the watermark arrays to their saved values, for all trap managers.
 */
 void TrapManagerManager::restore_trap_states() {
+    struct timeval time_start, time_stop;
+    if (profiling) gettimeofday(&time_start, nullptr);
+    n_restores++;
+
     if (n_traps_ic > 0)
         for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
             trap_managers_ic[phase_index].restore_trap_states();
@@ -2400,12 +3008,19 @@ void TrapManagerManager::restore_trap_states() {
         for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
             trap_managers_sc_co[phase_index].restore_trap_states();
         }
+
+    if (profiling) {
+        gettimeofday(&time_stop, nullptr);
+        restore_time += gettimelapsed(time_start, time_stop);
+    }
 }
 
 /*
     Prune redundant watermarks from watermark arrays, for all trap managers.
 */
 void TrapManagerManager::prune_watermarks(double min_n_electrons) {
+    n_prunes++;
+
     //print_v(0,"IC traps\n");
     if (n_traps_ic > 0)
         for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
@@ -2427,3 +3042,131 @@ void TrapManagerManager::prune_watermarks(double min_n_electrons) {
             trap_managers_sc_co[phase_index].prune_watermarks(min_n_electrons);
         }
 }
+
+/*
+    Whether any trap manager has any active watermarks, i.e. any traps that
+    might not be empty.
+*/
+bool TrapManagerManager::any_active_watermarks() {
+    if (n_traps_ic > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            if (trap_managers_ic[phase_index].n_active_watermarks > 0) return true;
+        }
+    if (n_traps_sc > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            if (trap_managers_sc[phase_index].n_active_watermarks > 0) return true;
+        }
+    if (n_traps_ic_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            if (trap_managers_ic_co[phase_index].n_active_watermarks > 0) return true;
+        }
+    if (n_traps_sc_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            if (trap_managers_sc_co[phase_index].n_active_watermarks > 0) return true;
+        }
+
+    return false;
+}
+
+/*
+    Update the most active watermarks so far, for all trap managers.
+*/
+void TrapManagerManager::update_max_n_active_watermarks() {
+    if (n_traps_ic > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            TrapManagerBase& trap_manager = trap_managers_ic[phase_index];
+            trap_manager.max_n_active_watermarks = std::max(
+                trap_manager.max_n_active_watermarks, trap_manager.n_active_watermarks);
+        }
+    if (n_traps_sc > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            TrapManagerBase& trap_manager = trap_managers_sc[phase_index];
+            trap_manager.max_n_active_watermarks = std::max(
+                trap_manager.max_n_active_watermarks, trap_manager.n_active_watermarks);
+        }
+    if (n_traps_ic_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            TrapManagerBase& trap_manager = trap_managers_ic_co[phase_index];
+            trap_manager.max_n_active_watermarks = std::max(
+                trap_manager.max_n_active_watermarks, trap_manager.n_active_watermarks);
+        }
+    if (n_traps_sc_co > 0)
+        for (int phase_index = 0; phase_index < ccd.n_phases; phase_index++) {
+            TrapManagerBase& trap_manager = trap_managers_sc_co[phase_index];
+            trap_manager.max_n_active_watermarks = std::max(
+                trap_manager.max_n_active_watermarks, trap_manager.n_active_watermarks);
+        }
+}
+
+// ========
+// TrapManagerManagerPool::
+// ========
+/*
+    Class TrapManagerManagerPool.
+
+    Persistent per-thread workspaces of trap managers, to avoid allocating and
+    deep-copying a new set of watermark arrays for every thread on every call
+    to clock_charge_in_one_direction(), e.g. for the repeated iterations of
+    remove_cti() or many calls on small images with the same model.
+
+    Each workspace is copied from the prepared trap manager manager only on
+    its first use or if the trap managers have been set up again (see
+    TrapManagerManager::setup_id), e.g. for a new size of image. Otherwise it
+    is just reset to empty traps, so repeated calls with the same prepared
+    model (e.g. a ClockingModel) don't copy any watermark arrays.
+
+    Attributes
+    ----------
+    workspaces : std::vector<TrapManagerManager>
+        The trap manager manager workspace for each thread.
+*/
+
+/*
+    Make sure a workspace exists for each of n_threads threads. Must be called
+    outside of any parallel region, since it may reallocate the workspaces.
+*/
+void TrapManagerManagerPool::reserve(int n_threads) {
+    if ((int)workspaces.size() < n_threads) workspaces.resize(n_threads);
+}
+
+/*
+    Initialise and return the workspace for one thread, with empty traps.
+
+    Parameters
+    ----------
+    i_thread : int
+        The index of the thread, less than the number reserved.
+
+    trap_manager_manager : TrapManagerManager&
+        The prepared trap managers, copied into the workspace if it isn't
+        already a copy of them.
+
+    is_copied : bool* (opt.)
+        If provided, set to whether the workspace was copied, e.g. for the
+        profile.
+
+    Returns
+    -------
+    workspace : TrapManagerManager&
+        The thread's workspace, ready to clock charge with.
+*/
+TrapManagerManager& TrapManagerManagerPool::thread_workspace(
+    int i_thread, TrapManagerManager& trap_manager_manager, bool* is_copied) {
+    if (i_thread >= (int)workspaces.size())
+        error(
+            "Thread index (%d) exceeds the number of reserved workspaces (%d)",
+            i_thread, (int)workspaces.size());
+
+    TrapManagerManager& workspace = workspaces[i_thread];
+    bool copy = (workspace.setup_id != trap_manager_manager.setup_id);
+    if (is_copied) *is_copied = copy;
+    if (copy) {
+        workspace = trap_manager_manager;
+    } else {
+        workspace.reset_trap_states();
+        workspace.store_trap_states();
+        workspace.reset_counters();
+    }
+
+    return workspace;
+}
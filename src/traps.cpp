@@ -7,9 +7,11 @@
 #include <gsl/gsl_roots.h>
 #include <math.h>
 
+#include <functional>
 #include <valarray>
 #include <limits>
 
+#include "table_cache.hpp"
 #include "util.hpp"
 
 // ========
@@ -177,6 +179,239 @@ TrapSlowCapture::TrapSlowCapture(
         capture_rate = 0.0;
 }
 
+// ========
+// Interpolation tables
+// ========
+/*
+    Set the monotone cubic (Fritsch-Butland) slopes for a table of values at
+    equally spaced positions, in units of the change in value per interval.
+
+    The interior slopes are the harmonic mean of the adjacent differences, or
+    zero at a local extremum, and the end slopes are from the end three values,
+    limited to keep the interpolation monotonic between the table values.
+*/
+static double monotone_cubic_end_slope(double delta_end, double delta_next) {
+    double slope = 1.5 * delta_end - 0.5 * delta_next;
+    if (slope * delta_end <= 0.0)
+        return 0.0;
+    else if (delta_end * delta_next <= 0.0 && fabs(slope) > fabs(3.0 * delta_end))
+        return 3.0 * delta_end;
+    return slope;
+}
+
+static void set_monotone_cubic_slopes(
+    const std::valarray<double>& values, std::valarray<double>& slopes) {
+    int n_values = values.size();
+    slopes.resize(n_values, 0.0);
+    if (n_values < 2) return;
+
+    double delta_below;
+    double delta_above;
+    if (n_values == 2) {
+        slopes = values[1] - values[0];
+        return;
+    }
+    for (int i = 1; i < n_values - 1; i++) {
+        delta_below = values[i] - values[i - 1];
+        delta_above = values[i + 1] - values[i];
+        if (delta_below * delta_above > 0.0)
+            slopes[i] = 2.0 * delta_below * delta_above / (delta_below + delta_above);
+    }
+    slopes[0] = monotone_cubic_end_slope(values[1] - values[0], values[2] - values[1]);
+    slopes[n_values - 1] = monotone_cubic_end_slope(
+        values[n_values - 1] - values[n_values - 2],
+        values[n_values - 2] - values[n_values - 3]);
+}
+
+/*
+    Interpolate a table at a (non-integer) position, using the monotone cubic
+    between table values and linearly extrapolating the end intervals outside
+    the table.
+*/
+static double interpolate_table(
+    const std::valarray<double>& values, const std::valarray<double>& slopes,
+    double position) {
+    int n_values = values.size();
+    int idx = (int)std::floor(position);
+
+    // Extrapolate if outside the table
+    if (idx < 0)
+        return values[0] + position * (values[1] - values[0]);
+    else if (idx >= n_values - 1)
+        return values[n_values - 2] +
+               (position - (n_values - 2)) * (values[n_values - 1] - values[n_values - 2]);
+
+    // Cubic Hermite interpolation
+    double intp = position - idx;
+    double intp_2 = intp * intp;
+    double intp_3 = intp_2 * intp;
+    return (2.0 * intp_3 - 3.0 * intp_2 + 1.0) * values[idx] +
+           (intp_3 - 2.0 * intp_2 + intp) * slopes[idx] +
+           (3.0 * intp_2 - 2.0 * intp_3) * values[idx + 1] +
+           (intp_3 - intp_2) * slopes[idx + 1];
+}
+
+/*
+    Find the (non-integer) position of a value in a monotonically increasing
+    table, the exact inverse of interpolate_table().
+
+    Inside the table, invert the cubic with Newton's method (bracketed by the
+    interval), starting from the cubic with the inverse slopes, which is
+    usually close enough to converge in a single step.
+*/
+static double position_in_table(
+    const std::valarray<double>& values, const std::valarray<double>& slopes,
+    double value) {
+    int n_values = values.size();
+
+    // Find the index by searching the table
+    int idx = std::upper_bound(std::begin(values), std::end(values), value) -
+              std::begin(values) - 1;
+
+    // Extrapolate if outside the table
+    if (idx < 0)
+        idx = 0;
+    else if (idx == n_values - 1)
+        idx = n_values - 2;
+
+    // Linear interpolation factor
+    double delta = values[idx + 1] - values[idx];
+    double intp = (value - values[idx]) / delta;
+    if (!(intp > 0.0 && intp < 1.0)) return idx + intp;
+
+    // Initial estimate from the inverse cubic
+    if (slopes[idx] > 0.0 && slopes[idx + 1] > 0.0) {
+        double inv_slope_0 = std::min(delta / slopes[idx], 3.0);
+        double inv_slope_1 = std::min(delta / slopes[idx + 1], 3.0);
+        double lin_2 = intp * intp;
+        double lin_3 = lin_2 * intp;
+        intp = (lin_3 - 2.0 * lin_2 + intp) * inv_slope_0 +
+               (3.0 * lin_2 - 2.0 * lin_3) + (lin_3 - lin_2) * inv_slope_1;
+    }
+
+    // Refine for the cubic
+    double intp_lo = 0.0;
+    double intp_hi = 1.0;
+    double intp_2;
+    double intp_3;
+    double residual;
+    double derivative;
+    double intp_new;
+    for (int i_iter = 0; i_iter < 30; i_iter++) {
+        intp_2 = intp * intp;
+        intp_3 = intp_2 * intp;
+        residual = (2.0 * intp_3 - 3.0 * intp_2 + 1.0) * values[idx] +
+                   (intp_3 - 2.0 * intp_2 + intp) * slopes[idx] +
+                   (3.0 * intp_2 - 2.0 * intp_3) * values[idx + 1] +
+                   (intp_3 - intp_2) * slopes[idx + 1] - value;
+        if (residual == 0.0) break;
+        derivative = (6.0 * intp_2 - 6.0 * intp) * (values[idx] - values[idx + 1]) +
+                     (3.0 * intp_2 - 4.0 * intp + 1.0) * slopes[idx] +
+                     (3.0 * intp_2 - 2.0 * intp) * slopes[idx + 1];
+
+        // Shrink the bracket, and bisect if the Newton step would leave it
+        if (residual > 0.0)
+            intp_hi = intp;
+        else
+            intp_lo = intp;
+        intp_new = intp - residual / derivative;
+        if (!(intp_new > intp_lo && intp_new < intp_hi))
+            intp_new = 0.5 * (intp_lo + intp_hi);
+
+        // Converged (quadratically) once the step is small
+        if (fabs(intp_new - intp) < 1e-6) {
+            intp = intp_new;
+            break;
+        }
+        intp = intp_new;
+    }
+
+    return idx + intp;
+}
+
+/*
+    Tabulate a function of elapsed time at equally log-spaced (decreasing)
+    times from time_max to time_min, for interpolate_table().
+
+    With a tolerance, start with a small table and repeatedly halve the
+    intervals (reusing the values already computed) until the interpolation
+    error at the midpoints of all intervals is within the tolerance, or until
+    the next table would have more than n_intp values.
+
+    Parameters
+    ----------
+    function : std::function<double(double)>
+        The function of elapsed time to tabulate.
+
+    time_min : double
+    time_max : double
+        The minimum and maximum elapsed times.
+
+    n_intp : int
+        The number of values in the table, or the maximum number if refining.
+
+    tolerance : double
+        The target maximum absolute error of the interpolation, or 0 to use
+        exactly n_intp values.
+
+    values : std::valarray<double>&
+    slopes : std::valarray<double>&
+        Set to the tabulated values and their monotone cubic slopes.
+
+    Returns
+    -------
+    max_error : double
+        The maximum absolute error of the interpolation at the midpoints of
+        the intervals, or -1 if not checked (zero tolerance).
+*/
+static const int n_intp_adaptive_min = 9;
+
+static double tabulate_log_time_function(
+    std::function<double(double)> function, double time_min, double time_max,
+    int n_intp, double tolerance, std::valarray<double>& values,
+    std::valarray<double>& slopes) {
+    double log_time_max = log(time_max);
+    double log_time_range = log(time_max) - log(time_min);
+
+    // Start small if refining
+    int n_values = n_intp;
+    if (tolerance > 0.0 && n_intp > n_intp_adaptive_min) n_values = n_intp_adaptive_min;
+    double d_log_time = log_time_range / (n_values - 1);
+
+    // Tabulate the values corresponding to the equally log-spaced inputs
+    values.resize(n_values);
+    for (int i = 0; i < n_values; i++)
+        values[i] = function(exp(log_time_max - i * d_log_time));
+    set_monotone_cubic_slopes(values, slopes);
+
+    if (tolerance <= 0.0) return -1.0;
+
+    std::valarray<double> midpoints;
+    std::valarray<double> values_coarse;
+    double max_error;
+    while (true) {
+        // Check the errors halfway between the table values
+        midpoints.resize(n_values - 1);
+        max_error = 0.0;
+        for (int i = 0; i < n_values - 1; i++) {
+            midpoints[i] = function(exp(log_time_max - (i + 0.5) * d_log_time));
+            max_error = std::max(
+                max_error, fabs(interpolate_table(values, slopes, i + 0.5) - midpoints[i]));
+        }
+        if (max_error <= tolerance || 2 * n_values - 1 > n_intp) return max_error;
+
+        // Halve the intervals
+        values_coarse.resize(n_values);
+        values_coarse = values;
+        n_values = 2 * n_values - 1;
+        d_log_time = log_time_range / (n_values - 1);
+        values.resize(n_values);
+        for (int i = 0; i < n_values; i++)
+            values[i] = (i % 2 == 0) ? values_coarse[i / 2] : midpoints[i / 2];
+        set_monotone_cubic_slopes(values, slopes);
+    }
+}
+
 // ========
 // TrapInstantCaptureContinuum::
 // ========
@@ -200,11 +435,19 @@ TrapSlowCapture::TrapSlowCapture(
 
     release_timescale_sigma : double
         The sigma of release lifetimes of the traps.
+
+    table_tolerance : double (opt.)
+        The target maximum error of the fill fractions interpolated from the
+        tables, which sets the table sizes used by the trap managers. See
+        prep_fill_fraction_and_time_elapsed_tables(). Or 0 for tables of the
+        trap managers' maximum size.
 */
 TrapInstantCaptureContinuum::TrapInstantCaptureContinuum(
-    double density, double release_timescale, double release_timescale_sigma)
+    double density, double release_timescale, double release_timescale_sigma,
+    double table_tolerance)
     : TrapInstantCapture(density, release_timescale),
-      release_timescale_sigma(release_timescale_sigma) {}
+      release_timescale_sigma(release_timescale_sigma),
+      table_tolerance(table_tolerance) {}
 
 /*
     Calculate the fraction of filled traps after an amount of elapsed time.
@@ -384,7 +627,8 @@ double TrapInstantCaptureContinuum::time_elapsed_from_fill_fraction(
 
     Use logarithmically spaced (decreasing) times to calculate the corresponding
     (monotonically increasing) table of fill fractions. So no need to actually
-    store the elapsed times.
+    store the elapsed times. Values are interpolated with monotone cubics, so
+    the conversions both ways are exact inverses.
 
     Parameters
     ----------
@@ -394,42 +638,94 @@ double TrapInstantCaptureContinuum::time_elapsed_from_fill_fraction(
         single dwell time and the cumulative dwell time over all transfers.
 
     n_intp : int
-        The number of interpolation values in the arrays.
+        The number of interpolation values in the arrays, or the maximum number
+        if a tolerance is given.
+
+    tolerance : double (opt.)
+        If non-zero, then start with a small table and refine it until the
+        maximum error of the interpolated fill fractions (checked halfway
+        between the table values) is within this tolerance. Default 0.
 
     Sets
     ----
     fill_fraction_table : std::valarray<double>
-        The array of fill fractions.
+    fill_fraction_slopes : std::valarray<double>
+        The array of fill fractions and their interpolation slopes.
+
+    n_intp : int
+        The number of values in the table.
 
     fill_min : double
     fill_max : double
         The fill fractions corresponding to the maximum and minimum times.
 
     d_log_time : double
-        The logarithmic interval between successive (decreasing) times.
-*/
-void TrapInstantCaptureContinuum::prep_fill_fraction_and_time_elapsed_tables(
-    double time_min, double time_max, int n_intp) {
+    inv_d_log_time : double
+    log_time_max : double
+        The logarithmic interval between successive (decreasing) times, its
+        reciprocal, and the log of the maximum time.
 
-    // Prep for the GSL integration
-    const int limit = 100;
-    gsl_integration_workspace* workspace = gsl_integration_workspace_alloc(limit);
+    table_max_error : double
+        The returned maximum error.
+
+    Returns
+    -------
+    max_error : double
+        The maximum absolute error of the interpolated fill fractions, or -1 if
+        not checked (zero tolerance).
+*/
+double TrapInstantCaptureContinuum::prep_fill_fraction_and_time_elapsed_tables(
+    double time_min, double time_max, int n_intp, double tolerance) {
 
-    // Set up the arrays and limits
-    fill_fraction_table = std::valarray<double>(0.0, n_intp);
-    this->n_intp = n_intp;
+    // Set up the limits
     this->time_min = time_min;
     this->time_max = time_max;
-    fill_min = fill_fraction_from_time_elapsed(time_max, workspace);
-    fill_max = fill_fraction_from_time_elapsed(time_min, workspace);
-    d_log_time = (log(time_max) - log(time_min)) / (n_intp - 1);
-    double time_i;
-
-    // Tabulate the values corresponding to the equally log-spaced inputs
-    for (int i = 0; i < n_intp; i++) {
-        time_i = exp(log(time_max) - i * d_log_time);
-        fill_fraction_table[i] = fill_fraction_from_time_elapsed(time_i, workspace);
+    log_time_max = log(time_max);
+
+    // Reuse the table if already computed, stored with the two limits and the
+    // error after it
+    TableKey key(
+        table_kind_fill_fraction_from_time_elapsed, release_timescale,
+        release_timescale_sigma, 0.0, 0.0, time_min, time_max, tolerance, n_intp);
+    std::valarray<double> values;
+    if (load_cached_table(key, values)) {
+        this->n_intp = values.size() - 3;
+        fill_fraction_table =
+            std::valarray<double>(values[std::slice(0, this->n_intp, 1)]);
+        fill_min = values[this->n_intp];
+        fill_max = values[this->n_intp + 1];
+        table_max_error = values[this->n_intp + 2];
+        set_monotone_cubic_slopes(fill_fraction_table, fill_fraction_slopes);
+    } else {
+        // Prep for the GSL integration
+        const int limit = 100;
+        gsl_integration_workspace* workspace = gsl_integration_workspace_alloc(limit);
+
+        // Tabulate the fill fractions and their limits
+        fill_min = fill_fraction_from_time_elapsed(time_max, workspace);
+        fill_max = fill_fraction_from_time_elapsed(time_min, workspace);
+        table_max_error = tabulate_log_time_function(
+            [this, workspace](double time_elapsed) {
+                return fill_fraction_from_time_elapsed(time_elapsed, workspace);
+            },
+            time_min, time_max, n_intp, tolerance, fill_fraction_table,
+            fill_fraction_slopes);
+        this->n_intp = fill_fraction_table.size();
+
+        gsl_integration_workspace_free(workspace);
+
+        values.resize(this->n_intp + 3);
+        values[std::slice(0, this->n_intp, 1)] = fill_fraction_table;
+        values[this->n_intp] = fill_min;
+        values[this->n_intp + 1] = fill_max;
+        values[this->n_intp + 2] = table_max_error;
+        store_cached_table(key, values);
     }
+
+    d_log_time = (log(time_max) - log(time_min)) / (this->n_intp - 1);
+    inv_d_log_time = 1.0 / d_log_time;
+
+    return table_max_error;
 }
 
 /*
@@ -457,23 +753,10 @@ double TrapInstantCaptureContinuum::fill_fraction_from_time_elapsed_table(
     else if (time_elapsed == -1.0)
         return 0.0;
 
-    // Get the index and interpolation factor
-    double intp = (log(time_max) - log(time_elapsed)) / d_log_time;
-    int idx = (int)std::floor(intp);
-    intp = intp - idx;
-
-    // Extrapolate if outside the table
-    if (idx < 0) {
-        intp += idx;
-        idx = 0;
-    } else if (idx >= n_intp - 1) {
-        intp += idx - (n_intp - 2);
-        idx = n_intp - 2;
-    }
-
-    // Interpolate
-    double fill =
-        (1.0 - intp) * fill_fraction_table[idx] + intp * fill_fraction_table[idx + 1];
+    // Interpolate at the position in the table
+    double fill = interpolate_table(
+        fill_fraction_table, fill_fraction_slopes,
+        (log_time_max - log(time_elapsed)) * inv_d_log_time);
 
     return clamp(fill, 0.0, 1.0);
 }
@@ -503,24 +786,11 @@ double TrapInstantCaptureContinuum::time_elapsed_from_fill_fraction_table(
     else if (fill_fraction == -1.0)
         return 0.0;
 
-    // Find the index by searching the table
-    int idx = std::upper_bound(
-                  std::begin(fill_fraction_table), std::end(fill_fraction_table),
-                  fill_fraction) -
-              std::begin(fill_fraction_table) - 1;
-
-    // Extrapolate if outside the table
-    if (idx < 0)
-        idx = 0;
-    else if (idx == n_intp - 1)
-        idx = n_intp - 2;
-
-    // Interpolation factor
-    double intp = (fill_fraction - fill_fraction_table[idx]) /
-                  (fill_fraction_table[idx + 1] - fill_fraction_table[idx]);
+    // Find the position in the table
+    double position =
+        position_in_table(fill_fraction_table, fill_fraction_slopes, fill_fraction);
 
-    // Interpolate
-    return exp(log(time_max) - (idx + intp) * d_log_time);
+    return exp(log_time_max - position * d_log_time);
 }
 
 // ========
@@ -548,13 +818,17 @@ double TrapInstantCaptureContinuum::time_elapsed_from_fill_fraction_table(
 
     capture_timescale : double
         The capture timescale of the trap.
+
+    table_tolerance : double (opt.)
+        See TrapInstantCaptureContinuum.
 */
 TrapSlowCaptureContinuum::TrapSlowCaptureContinuum(
     double density, double release_timescale, double release_timescale_sigma,
-    double capture_timescale)
+    double capture_timescale, double table_tolerance)
     : TrapInstantCapture(density, release_timescale),
       release_timescale_sigma(release_timescale_sigma),
-      capture_timescale(capture_timescale) {
+      capture_timescale(capture_timescale),
+      table_tolerance(table_tolerance) {
 
     if (capture_timescale != 0.0)
         capture_rate = 1.0 / capture_timescale;
@@ -688,28 +962,58 @@ double TrapSlowCaptureContinuum::time_elapsed_from_fill_fraction(
 /*
     Same as TrapInstantCaptureContinuum
 */
-void TrapSlowCaptureContinuum::prep_fill_fraction_and_time_elapsed_tables(
-    double time_min, double time_max, int n_intp) {
-
-    // Prep for the GSL integration
-    const int limit = 100;
-    gsl_integration_workspace* workspace = gsl_integration_workspace_alloc(limit);
+double TrapSlowCaptureContinuum::prep_fill_fraction_and_time_elapsed_tables(
+    double time_min, double time_max, int n_intp, double tolerance) {
 
-    // Set up the arrays and limits
-    fill_fraction_table = std::valarray<double>(0.0, n_intp);
-    this->n_intp = n_intp;
+    // Set up the limits
     this->time_min = time_min;
     this->time_max = time_max;
-    fill_min = fill_fraction_from_time_elapsed(time_max, workspace);
-    fill_max = fill_fraction_from_time_elapsed(time_min, workspace);
-    d_log_time = (log(time_max) - log(time_min)) / (n_intp - 1);
-    double time_i;
-
-    // Tabulate the values corresponding to the equally log-spaced inputs
-    for (int i = 0; i < n_intp; i++) {
-        time_i = exp(log(time_max) - i * d_log_time);
-        fill_fraction_table[i] = fill_fraction_from_time_elapsed(time_i, workspace);
+    log_time_max = log(time_max);
+
+    // Reuse the table if already computed, stored with the two limits and the
+    // error after it
+    TableKey key(
+        table_kind_fill_fraction_from_time_elapsed, release_timescale,
+        release_timescale_sigma, 0.0, 0.0, time_min, time_max, tolerance, n_intp);
+    std::valarray<double> values;
+    if (load_cached_table(key, values)) {
+        this->n_intp = values.size() - 3;
+        fill_fraction_table =
+            std::valarray<double>(values[std::slice(0, this->n_intp, 1)]);
+        fill_min = values[this->n_intp];
+        fill_max = values[this->n_intp + 1];
+        table_max_error = values[this->n_intp + 2];
+        set_monotone_cubic_slopes(fill_fraction_table, fill_fraction_slopes);
+    } else {
+        // Prep for the GSL integration
+        const int limit = 100;
+        gsl_integration_workspace* workspace = gsl_integration_workspace_alloc(limit);
+
+        // Tabulate the fill fractions and their limits
+        fill_min = fill_fraction_from_time_elapsed(time_max, workspace);
+        fill_max = fill_fraction_from_time_elapsed(time_min, workspace);
+        table_max_error = tabulate_log_time_function(
+            [this, workspace](double time_elapsed) {
+                return fill_fraction_from_time_elapsed(time_elapsed, workspace);
+            },
+            time_min, time_max, n_intp, tolerance, fill_fraction_table,
+            fill_fraction_slopes);
+        this->n_intp = fill_fraction_table.size();
+
+        gsl_integration_workspace_free(workspace);
+
+        values.resize(this->n_intp + 3);
+        values[std::slice(0, this->n_intp, 1)] = fill_fraction_table;
+        values[this->n_intp] = fill_min;
+        values[this->n_intp + 1] = fill_max;
+        values[this->n_intp + 2] = table_max_error;
+        store_cached_table(key, values);
     }
+
+    d_log_time = (log(time_max) - log(time_min)) / (this->n_intp - 1);
+    inv_d_log_time = 1.0 / d_log_time;
+
+    return table_max_error;
 }
 
 /*
@@ -725,23 +1029,10 @@ double TrapSlowCaptureContinuum::fill_fraction_from_time_elapsed_table(
     else if (time_elapsed == -1.0)
         return 0.0;
 
-    // Get the index and interpolation factor
-    double intp = (log(time_max) - log(time_elapsed)) / d_log_time;
-    int idx = (int)std::floor(intp);
-    intp = intp - idx;
-
-    // Extrapolate if outside the table
-    if (idx < 0) {
-        intp += idx;
-        idx = 0;
-    } else if (idx >= n_intp - 1) {
-        intp += idx - (n_intp - 2);
-        idx = n_intp - 2;
-    }
-
-    // Interpolate
-    double fill =
-        (1.0 - intp) * fill_fraction_table[idx] + intp * fill_fraction_table[idx + 1];
+    // Interpolate at the position in the table
+    double fill = interpolate_table(
+        fill_fraction_table, fill_fraction_slopes,
+        (log_time_max - log(time_elapsed)) * inv_d_log_time);
 
     return clamp(fill, 0.0, 1.0);
 }
@@ -759,24 +1050,11 @@ double TrapSlowCaptureContinuum::time_elapsed_from_fill_fraction_table(
     else if (fill_fraction == -1.0)
         return 0.0;
 
-    // Find the index by searching the table
-    int idx = std::upper_bound(
-                  std::begin(fill_fraction_table), std::end(fill_fraction_table),
-                  fill_fraction) -
-              std::begin(fill_fraction_table) - 1;
-
-    // Extrapolate if outside the table
-    if (idx < 0)
-        idx = 0;
-    else if (idx == n_intp - 1)
-        idx = n_intp - 2;
-
-    // Interpolation factor
-    double intp = (fill_fraction - fill_fraction_table[idx]) /
-                  (fill_fraction_table[idx + 1] - fill_fraction_table[idx]);
+    // Find the position in the table
+    double position =
+        position_in_table(fill_fraction_table, fill_fraction_slopes, fill_fraction);
 
-    // Interpolate
-    return exp(log(time_max) - (idx + intp) * d_log_time);
+    return exp(log_time_max - position * d_log_time);
 }
 
 /*
@@ -899,42 +1177,96 @@ double TrapSlowCaptureContinuum::fill_fraction_after_slow_capture(
         single dwell time and the cumulative dwell time over all transfers.
 
     n_intp : int
-        The number of interpolation values in the arrays.
+    tolerance : double (opt.)
+        The number of interpolation values in the arrays, or the maximum number
+        for the target maximum error if a tolerance is given. See
+        prep_fill_fraction_and_time_elapsed_tables().
 
     Sets
     ----
     fill_fraction_capture_table : std::valarray<double>
-        The array of fill fractions.
+    fill_fraction_capture_slopes : std::valarray<double>
+        The array of fill fractions and their interpolation slopes.
+
+    n_intp_capture : int
+    d_log_time_capture : double
+    inv_d_log_time_capture : double
+    log_time_max_capture : double
+    capture_table_max_error : double
+        As for prep_fill_fraction_and_time_elapsed_tables(), but separate since
+        this table can need a different number of values.
+
+    fill_capture_min : double
+    fill_capture_max : double
+        The fill fractions corresponding to the maximum and minimum times.
 
     fill_capture_long_time : double
         The should-be-converged fill fraction from a very long elapsed time.
+
+    Returns
+    -------
+    max_error : double
+        The maximum absolute error of the interpolated fill fractions, or -1 if
+        not checked (zero tolerance).
 */
-void TrapSlowCaptureContinuum::prep_fill_fraction_after_slow_capture_tables(
-    double dwell_time, double time_min, double time_max, int n_intp) {
-    // Prep for the GSL integration
-    const int limit = 100;
-    gsl_integration_workspace* workspace = gsl_integration_workspace_alloc(limit);
+double TrapSlowCaptureContinuum::prep_fill_fraction_after_slow_capture_tables(
+    double dwell_time, double time_min, double time_max, int n_intp, double tolerance) {
+    // Set up the limits
+    log_time_max_capture = log(time_max);
+
+    // Reuse the table if already computed, stored with the three limits and the
+    // error after it
+    TableKey key(
+        table_kind_fill_fraction_after_slow_capture, release_timescale,
+        release_timescale_sigma, capture_timescale, dwell_time, time_min, time_max,
+        tolerance, n_intp);
+    std::valarray<double> values;
+    if (load_cached_table(key, values)) {
+        n_intp_capture = values.size() - 4;
+        fill_fraction_capture_table =
+            std::valarray<double>(values[std::slice(0, n_intp_capture, 1)]);
+        fill_capture_min = values[n_intp_capture];
+        fill_capture_max = values[n_intp_capture + 1];
+        fill_capture_long_time = values[n_intp_capture + 2];
+        capture_table_max_error = values[n_intp_capture + 3];
+        set_monotone_cubic_slopes(
+            fill_fraction_capture_table, fill_fraction_capture_slopes);
+    } else {
+        // Prep for the GSL integration
+        const int limit = 100;
+        gsl_integration_workspace* workspace = gsl_integration_workspace_alloc(limit);
+
+        // Tabulate the fill fractions and their limits
+        fill_capture_min =
+            fill_fraction_after_slow_capture(time_max, dwell_time, workspace);
+        fill_capture_max =
+            fill_fraction_after_slow_capture(time_min, dwell_time, workspace);
+        fill_capture_long_time =
+            fill_fraction_after_slow_capture(time_max * 100, dwell_time, workspace);
+        capture_table_max_error = tabulate_log_time_function(
+            [this, dwell_time, workspace](double time_elapsed) {
+                return fill_fraction_after_slow_capture(
+                    time_elapsed, dwell_time, workspace);
+            },
+            time_min, time_max, n_intp, tolerance, fill_fraction_capture_table,
+            fill_fraction_capture_slopes);
+        n_intp_capture = fill_fraction_capture_table.size();
+
+        gsl_integration_workspace_free(workspace);
+
+        values.resize(n_intp_capture + 4);
+        values[std::slice(0, n_intp_capture, 1)] = fill_fraction_capture_table;
+        values[n_intp_capture] = fill_capture_min;
+        values[n_intp_capture + 1] = fill_capture_max;
+        values[n_intp_capture + 2] = fill_capture_long_time;
+        values[n_intp_capture + 3] = capture_table_max_error;
+        store_cached_table(key, values);
+    }
 
-    // Set up the arrays and limits
-    fill_fraction_capture_table = std::valarray<double>(0.0, n_intp);
-    this->n_intp = n_intp;
-    this->time_min = time_min;
-    this->time_max = time_max;
-    fill_capture_min =
-        fill_fraction_after_slow_capture(time_max, dwell_time, workspace);
-    fill_capture_max =
-        fill_fraction_after_slow_capture(time_min, dwell_time, workspace);
-    fill_capture_long_time =
-        fill_fraction_after_slow_capture(time_max * 100, dwell_time, workspace);
-    d_log_time = (log(time_max) - log(time_min)) / (n_intp - 1);
-    double time_i;
+    d_log_time_capture = (log(time_max) - log(time_min)) / (n_intp_capture - 1);
+    inv_d_log_time_capture = 1.0 / d_log_time_capture;
 
-    // Tabulate the values corresponding to the equally log-spaced inputs
-    for (int i = 0; i < n_intp; i++) {
-        time_i = exp(log(time_max) - i * d_log_time);
-        fill_fraction_capture_table[i] =
-            fill_fraction_after_slow_capture(time_i, dwell_time, workspace);
-    }
+    return capture_table_max_error;
 }
 
 /*
@@ -960,23 +1292,10 @@ double TrapSlowCaptureContinuum::fill_fraction_after_slow_capture_table(
     else if (time_elapsed == -1.0)
         return 0.0;
 
-    // Get the index and interpolation factor
-    double intp = (log(time_max) - log(time_elapsed)) / d_log_time;
-    int idx = (int)std::floor(intp);
-    intp = intp - idx;
-
-    // Extrapolate if outside the table
-    if (idx < 0) {
-        intp += idx;
-        idx = 0;
-    } else if (idx >= n_intp - 1) {
-        intp += idx - (n_intp - 2);
-        idx = n_intp - 2;
-    }
-
-    // Interpolate
-    double fill = (1.0 - intp) * fill_fraction_capture_table[idx] +
-                  intp * fill_fraction_capture_table[idx + 1];
+    // Interpolate at the position in the table
+    double fill = interpolate_table(
+        fill_fraction_capture_table, fill_fraction_capture_slopes,
+        (log_time_max_capture - log(time_elapsed)) * inv_d_log_time_capture);
 
     return clamp(fill, 0.0, 1.0);
 }
@@ -2,9 +2,17 @@
 #include "util.hpp"
 
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
 #include <string>
 #include <valarray>
 #include <vector>
@@ -188,6 +196,38 @@ std::valarray<std::valarray<double> > transpose(
     return array_T;
 }
 
+/*
+    Copy a 2D valarray into a contiguous, row-major buffer of
+    n_rows * n_columns values, e.g. for the flat-buffer clocking functions.
+*/
+void copy_image_to_buffer(
+    std::valarray<std::valarray<double> >& image, double* buffer) {
+    int n_rows = image.size();
+    int n_columns = image[0].size();
+
+    for (int i_row = 0; i_row < n_rows; i_row++) {
+        for (int i_col = 0; i_col < n_columns; i_col++) {
+            buffer[i_row * n_columns + i_col] = image[i_row][i_col];
+        }
+    }
+}
+
+/*
+    Copy a contiguous, row-major buffer back into an existing 2D valarray of
+    the same shape. The inverse of copy_image_to_buffer().
+*/
+void copy_buffer_to_image(
+    const double* buffer, std::valarray<std::valarray<double> >& image) {
+    int n_rows = image.size();
+    int n_columns = image[0].size();
+
+    for (int i_row = 0; i_row < n_rows; i_row++) {
+        for (int i_col = 0; i_col < n_columns; i_col++) {
+            image[i_row][i_col] = buffer[i_row * n_columns + i_col];
+        }
+    }
+}
+
 // ========
 // I/O
 // ========
@@ -278,6 +318,409 @@ void save_image_to_txt(
     return;
 }
 
+/*
+    The format of an image file from its extension: .bin for raw binary, .fits
+    (or .fit, .fts) for FITS, and otherwise text.
+*/
+int image_format_from_filename(const char* filename) {
+    const char* extension = strrchr(filename, '.');
+    if (extension == nullptr) return image_format_txt;
+    if (strcmp(extension, ".bin") == 0) return image_format_binary;
+    if ((strcmp(extension, ".fits") == 0) || (strcmp(extension, ".fit") == 0) ||
+        (strcmp(extension, ".fts") == 0))
+        return image_format_fits;
+    return image_format_txt;
+}
+
+/*
+    Open an image file to read, or create (or overwrite) one to write, in
+    binary mode.
+*/
+static FILE* open_image_file(const char* filename, const char* mode) {
+    FILE* f = fopen(filename, mode);
+    if (!f) error("Failed to open image file '%s'", filename);
+    return f;
+}
+
+/*
+    The size of an open file, in bytes.
+*/
+static long file_size(FILE* f, const char* filename) {
+    struct stat file_stat;
+    if (fstat(fileno(f), &file_stat) != 0) error("Failed to stat file '%s'", filename);
+    return file_stat.st_size;
+}
+
+/*
+    Read exactly n_bytes from a file into a buffer, e.g. straight into an
+    image's own memory.
+*/
+static void read_bytes(FILE* f, void* bytes, long n_bytes, const char* filename) {
+    if ((n_bytes > 0) && (fread(bytes, 1, n_bytes, f) != (size_t)n_bytes))
+        error("Failed to read %ld bytes from '%s'", n_bytes, filename);
+}
+
+/*
+    Write exactly n_bytes from a buffer to a file.
+*/
+static void write_bytes(FILE* f, const void* bytes, long n_bytes, const char* filename) {
+    if ((n_bytes > 0) && (fwrite(bytes, 1, n_bytes, f) != (size_t)n_bytes))
+        error("Failed to write %ld bytes to '%s'", n_bytes, filename);
+}
+
+/*
+    Load a 2D image from a raw binary file, reading the pixels straight into
+    the image without an intermediate copy.
+
+    File contents:
+        n_rows, n_columns as int32, then the row-major pixel values as float64,
+        all in the native byte order, e.g. from numpy:
+            np.array(image.shape, dtype=np.int32).tofile(f)
+            image.astype(np.float64).tofile(f)
+
+    Parameters
+    ----------
+    filename : str
+        The path to the file to load.
+
+    n_rows, n_columns : int&
+        Set to the dimensions of the image.
+
+    Returns
+    -------
+    image : std::vector<double>
+        The loaded row-major image.
+*/
+std::vector<double> load_image_from_binary(
+    const char* filename, int& n_rows, int& n_columns) {
+    FILE* f = open_image_file(filename, "rb");
+    long size = file_size(f, filename);
+
+    int32_t dimensions[2];
+    if (size < (long)sizeof(dimensions))
+        error("Failed to read n_rows, n_columns '%s'", filename);
+    read_bytes(f, dimensions, sizeof(dimensions), filename);
+    n_rows = dimensions[0];
+    n_columns = dimensions[1];
+
+    long n_pixels = (long)n_rows * n_columns;
+    if ((n_rows < 0) || (n_columns < 0) ||
+        (size != (long)sizeof(dimensions) + n_pixels * (long)sizeof(double)))
+        error(
+            "File size (%ld) doesn't match the image [%d, %d] '%s'", size, n_rows,
+            n_columns, filename);
+
+    std::vector<double> image(n_pixels);
+    read_bytes(f, image.data(), n_pixels * sizeof(double), filename);
+    fclose(f);
+
+    return image;
+}
+
+/*
+    Save a 2D image to a raw binary file. See load_image_from_binary() for the
+    file contents.
+
+    Parameters
+    ----------
+    filename : str
+        The path to the file to save.
+
+    image : const double*
+        The row-major image to save.
+
+    n_rows, n_columns : int
+        The dimensions of the image.
+*/
+void save_image_to_binary(
+    const char* filename, const double* image, int n_rows, int n_columns) {
+    int32_t dimensions[2] = {n_rows, n_columns};
+    long n_pixels = (long)n_rows * n_columns;
+    FILE* f = open_image_file(filename, "wb");
+
+    write_bytes(f, dimensions, sizeof(dimensions), filename);
+    write_bytes(f, image, n_pixels * sizeof(double), filename);
+    if (fclose(f) != 0) error("Failed to write file '%s'", filename);
+}
+
+// FITS files are made of blocks of 2880 bytes, with 80-character header cards
+static const long fits_block_size = 2880;
+static const int fits_card_size = 80;
+
+/*
+    Read a big-endian value of n_bytes from a FITS data array.
+*/
+static uint64_t read_big_endian(const unsigned char* bytes, int n_bytes) {
+    uint64_t value = 0;
+    for (int i_byte = 0; i_byte < n_bytes; i_byte++)
+        value = (value << 8) | bytes[i_byte];
+    return value;
+}
+
+/*
+    Parse the logical value of a FITS header card, i.e. the characters after
+    "= ". The fixed format puts T or F in byte 30 of the card, but any leading
+    spaces are allowed, followed by nothing but spaces or a "/" comment.
+
+    Parameters
+    ----------
+    value : const char*
+        The card's value and comment, from byte 11.
+
+    Returns
+    -------
+    is_true : bool
+        Whether the value is T, false for F or an invalid value.
+*/
+bool fits_logical_value(const char* value) {
+    while (*value == ' ') value++;
+    if (*value != 'T') return false;
+    value++;
+    while (*value == ' ') value++;
+    return (*value == '\0') || (*value == '/');
+}
+
+/*
+    Load a 2D image from the primary array of a FITS file.
+
+    Supports every BITPIX (8, 16, 32, 64, -32, -64), with BSCALE and BZERO.
+    Any extensions after the primary array are ignored. The big-endian data
+    are read straight into the image's memory and converted there in place,
+    without an intermediate copy.
+
+    Parameters
+    ----------
+    filename : str
+        The path to the file to load.
+
+    n_rows, n_columns : int&
+        Set to the dimensions of the image, i.e. NAXIS2 and NAXIS1.
+
+    Returns
+    -------
+    image : std::vector<double>
+        The loaded row-major image.
+*/
+std::vector<double> load_image_from_fits(
+    const char* filename, int& n_rows, int& n_columns) {
+    FILE* f = open_image_file(filename, "rb");
+    long size = file_size(f, filename);
+
+    // Read the header cards up to END, one block at a time
+    std::vector<char> header;
+    int bitpix = 0;
+    int n_axes = -1;
+    long axis_lengths[3] = {0, 0, 1};
+    double bscale = 1.0;
+    double bzero = 0.0;
+    bool is_simple = false;
+    bool is_end = false;
+    long header_size = 0;
+    char keyword[9];
+    char value[fits_card_size];
+    for (long i_byte = 0; !is_end; i_byte += fits_card_size) {
+        if (i_byte + fits_card_size > (long)header.size()) {
+            long n_bytes = std::min(fits_block_size, size - (long)header.size());
+            if (n_bytes < fits_card_size)
+                error("Failed to find the end of the FITS header '%s'", filename);
+            header.resize(header.size() + n_bytes);
+            read_bytes(f, &header[header.size() - n_bytes], n_bytes, filename);
+        }
+        const char* card = header.data() + i_byte;
+
+        memcpy(keyword, card, 8);
+        keyword[8] = '\0';
+        for (int i = 7; (i >= 0) && (keyword[i] == ' '); i--) keyword[i] = '\0';
+        memcpy(value, card + 10, fits_card_size - 10);
+        value[fits_card_size - 10] = '\0';
+
+        if (strcmp(keyword, "END") == 0) {
+            is_end = true;
+            header_size = (i_byte / fits_block_size + 1) * fits_block_size;
+        } else if (strncmp(card + 8, "= ", 2) != 0)
+            continue;
+        else if (strcmp(keyword, "SIMPLE") == 0)
+            is_simple = fits_logical_value(value);
+        else if (strcmp(keyword, "BITPIX") == 0)
+            bitpix = atoi(value);
+        else if (strcmp(keyword, "NAXIS") == 0)
+            n_axes = atoi(value);
+        else if (strcmp(keyword, "NAXIS1") == 0)
+            axis_lengths[0] = atol(value);
+        else if (strcmp(keyword, "NAXIS2") == 0)
+            axis_lengths[1] = atol(value);
+        else if (strcmp(keyword, "NAXIS3") == 0)
+            axis_lengths[2] = atol(value);
+        else if (strcmp(keyword, "BSCALE") == 0)
+            bscale = atof(value);
+        else if (strcmp(keyword, "BZERO") == 0)
+            bzero = atof(value);
+    }
+    if (!is_simple) error("Not a standard FITS file '%s'", filename);
+    if ((n_axes != 2) && !((n_axes == 3) && (axis_lengths[2] == 1)))
+        error("FITS primary array must be 2D, not NAXIS = %d '%s'", n_axes, filename);
+    n_columns = axis_lengths[0];
+    n_rows = axis_lengths[1];
+
+    // Read and scale the big-endian data
+    int n_bytes = abs(bitpix) / 8;
+    if ((n_bytes != 1) && (n_bytes != 2) && (n_bytes != 4) && (n_bytes != 8))
+        error("Unsupported FITS BITPIX = %d '%s'", bitpix, filename);
+    long n_pixels = (long)n_rows * n_columns;
+    if (header_size + n_pixels * n_bytes > size)
+        error(
+            "FITS file is too short for the image [%d, %d] '%s'", n_rows, n_columns,
+            filename);
+
+    // Convert each pixel in place from the last one, since the converted
+    // pixels take at least as many bytes as the raw ones they overwrite
+    std::vector<double> image(n_pixels);
+    unsigned char* data = (unsigned char*)image.data();
+    if (fseek(f, header_size, SEEK_SET) != 0)
+        error("Failed to find the FITS data '%s'", filename);
+    read_bytes(f, data, n_pixels * n_bytes, filename);
+    fclose(f);
+    for (long i_pixel = n_pixels - 1; i_pixel >= 0; i_pixel--) {
+        uint64_t bits = read_big_endian(data + i_pixel * n_bytes, n_bytes);
+        double pixel;
+        if (bitpix == -64) {
+            memcpy(&pixel, &bits, sizeof(pixel));
+        } else if (bitpix == -32) {
+            uint32_t bits_32 = bits;
+            float pixel_32;
+            memcpy(&pixel_32, &bits_32, sizeof(pixel_32));
+            pixel = pixel_32;
+        } else if (bitpix == 8) {
+            pixel = (uint8_t)bits;
+        } else if (bitpix == 16) {
+            pixel = (int16_t)bits;
+        } else if (bitpix == 32) {
+            pixel = (int32_t)bits;
+        } else {
+            pixel = (int64_t)bits;
+        }
+        image[i_pixel] = bzero + bscale * pixel;
+    }
+
+    return image;
+}
+
+/*
+    Save a 2D image to a FITS file as its primary array of float64 pixels
+    (BITPIX = -64).
+
+    Parameters
+    ----------
+    filename : str
+        The path to the file to save.
+
+    image : const double*
+        The row-major image to save.
+
+    n_rows, n_columns : int
+        The dimensions of the image, i.e. NAXIS2 and NAXIS1.
+*/
+void save_image_to_fits(
+    const char* filename, const double* image, int n_rows, int n_columns) {
+    long n_pixels = (long)n_rows * n_columns;
+    FILE* f = open_image_file(filename, "wb");
+
+    // The header cards, padded with spaces
+    char block[fits_block_size];
+    memset(block, ' ', fits_block_size);
+    char card[fits_card_size + 1];
+    const char* keywords[] = {"SIMPLE", "BITPIX", "NAXIS", "NAXIS1", "NAXIS2"};
+    std::string values[] = {
+        "T", "-64", "2", std::to_string(n_columns), std::to_string(n_rows)};
+    for (int i_card = 0; i_card < 5; i_card++) {
+        int n_chars = snprintf(
+            card, sizeof(card), "%-8s= %20s", keywords[i_card], values[i_card].c_str());
+        memcpy(block + i_card * fits_card_size, card, n_chars);
+    }
+    memcpy(block + 5 * fits_card_size, "END", 3);
+    write_bytes(f, block, fits_block_size, filename);
+
+    // The big-endian data, one block at a time, padded with zeros
+    long n_block_pixels = fits_block_size / sizeof(double);
+    for (long i_start = 0; i_start < n_pixels; i_start += n_block_pixels) {
+        memset(block, 0, fits_block_size);
+        for (long i_pixel = i_start;
+             i_pixel < std::min(i_start + n_block_pixels, n_pixels); i_pixel++) {
+            uint64_t bits;
+            memcpy(&bits, &image[i_pixel], sizeof(bits));
+            for (int i_byte = 0; i_byte < 8; i_byte++)
+                block[(i_pixel - i_start) * 8 + i_byte] =
+                    (bits >> (8 * (7 - i_byte))) & 0xff;
+        }
+        write_bytes(f, block, fits_block_size, filename);
+    }
+    if (fclose(f) != 0) error("Failed to write file '%s'", filename);
+}
+
+/*
+    Load a 2D image from a text, raw binary, or FITS file, see
+    image_format_from_filename().
+
+    Parameters
+    ----------
+    filename : str
+        The path to the file to load.
+
+    n_rows, n_columns : int&
+        Set to the dimensions of the image.
+
+    Returns
+    -------
+    image : std::vector<double>
+        The loaded row-major image.
+*/
+std::vector<double> load_image(const char* filename, int& n_rows, int& n_columns) {
+    switch (image_format_from_filename(filename)) {
+        case image_format_binary:
+            return load_image_from_binary(filename, n_rows, n_columns);
+        case image_format_fits:
+            return load_image_from_fits(filename, n_rows, n_columns);
+        default: {
+            std::valarray<std::valarray<double> > image = load_image_from_txt(filename);
+            n_rows = image.size();
+            n_columns = (n_rows > 0) ? image[0].size() : 0;
+            return flatten(image);
+        }
+    }
+}
+
+/*
+    Save a 2D image to a text, raw binary, or FITS file, see
+    image_format_from_filename().
+
+    Parameters
+    ----------
+    filename : str
+        The path to the file to save.
+
+    image : const double*
+        The row-major image to save.
+
+    n_rows, n_columns : int
+        The dimensions of the image.
+*/
+void save_image(const char* filename, const double* image, int n_rows, int n_columns) {
+    switch (image_format_from_filename(filename)) {
+        case image_format_binary:
+            save_image_to_binary(filename, image, n_rows, n_columns);
+            break;
+        case image_format_fits:
+            save_image_to_fits(filename, image, n_rows, n_columns);
+            break;
+        default: {
+            std::valarray<std::valarray<double> > image_2D(
+                std::valarray<double>(n_columns), n_rows);
+            copy_buffer_to_image(image, image_2D);
+            save_image_to_txt(filename, image_2D);
+        }
+    }
+}
+
 // ========
 // Misc
 // ========
@@ -312,3 +755,27 @@ double gettimelapsed(struct timeval start, struct timeval end) {
 
     return seconds + microseconds;
 }
+
+/*
+    The maximum number of threads that an OpenMP parallel region could use, or
+    1 if compiled without OpenMP.
+*/
+int get_n_threads_max() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/*
+    The index of the current thread within an OpenMP parallel region, or 0 if
+    outside one or compiled without OpenMP.
+*/
+int get_thread_index() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
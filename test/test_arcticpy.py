@@ -843,6 +843,96 @@ class TestRemoveCTI:
             tolerance = 10 ** (1 - n_iterations)
             assert image_remove_cti == pytest.approx(image_pre_cti, abs=tolerance)
 
+    def test__add_and_remove_cti__strided_views_and_out(self):
+        image_pre_cti = np.zeros((12, 5))
+        image_pre_cti[2, 1] = 800.0
+        image_pre_cti[6, 3] = 300.0
+
+        roe = cti.ROE()
+        ccd = cti.CCD(phases=[cti.CCDPhase(full_well_depth=1e4, well_fill_power=0.8)])
+        traps = [cti.TrapInstantCapture(density=10.0, release_timescale=2.0)]
+        parameters = dict(
+            parallel_roe=roe,
+            parallel_ccd=ccd,
+            parallel_traps=traps,
+            serial_roe=roe,
+            serial_ccd=ccd,
+            serial_traps=traps,
+            verbosity=0,
+        )
+
+        image_add_cti = cti.add_cti(image=image_pre_cti, **parameters)
+        image_remove_cti = cti.remove_cti(
+            image=image_add_cti, n_iterations=3, **parameters
+        )
+
+        # In place, directly in a transposed and reversed view's memory
+        image_view = np.ascontiguousarray(image_pre_cti.T[::-1])[::-1].T
+        result = cti.add_cti(image=image_view, out=image_view, **parameters)
+        assert np.shares_memory(result, image_view)
+        assert image_view == pytest.approx(image_add_cti, rel=1e-12)
+        cti.remove_cti(image=image_view, n_iterations=3, out=image_view, **parameters)
+        assert image_view == pytest.approx(image_remove_cti, rel=1e-9, abs=1e-9)
+
+        # Via a copy for an out array that can't be clocked directly
+        image_swapped = np.zeros(image_pre_cti.shape, dtype=">f8")
+        cti.add_cti(image=image_pre_cti, out=image_swapped, **parameters)
+        assert image_swapped == pytest.approx(image_add_cti, rel=1e-12)
+        assert image_pre_cti[2, 1] == 800.0
+
+
+class TestCTIModel:
+    def test__model__same_as_add_and_remove_cti__reused_and_in_place(self):
+        image_pre_cti = np.zeros((12, 5))
+        image_pre_cti[2, 1] = 800.0
+        image_pre_cti[6, 3] = 300.0
+
+        roe = cti.ROE()
+        ccd = cti.CCD(phases=[cti.CCDPhase(full_well_depth=1e4, well_fill_power=0.8)])
+        parallel_traps = [
+            cti.TrapInstantCapture(density=10.0, release_timescale=2.0),
+            cti.TrapSlowCapture(density=5.0, release_timescale=4.0, capture_timescale=0.2),
+        ]
+        serial_traps = [cti.TrapInstantCapture(density=5.0, release_timescale=1.0)]
+        parameters = dict(
+            parallel_roe=roe,
+            parallel_ccd=ccd,
+            parallel_traps=parallel_traps,
+            parallel_express=3,
+            serial_roe=roe,
+            serial_ccd=ccd,
+            serial_traps=serial_traps,
+            serial_express=2,
+        )
+
+        image_add_cti = cti.add_cti(image=image_pre_cti, verbosity=0, **parameters)
+        image_remove_cti = cti.remove_cti(
+            image=image_add_cti, n_iterations=4, verbosity=0, **parameters
+        )
+
+        model = cti.CTIModel(**parameters)
+
+        # The same results for repeated calls, leaving the input unchanged
+        for i in range(2):
+            assert model.add(image_pre_cti) == pytest.approx(image_add_cti, rel=1e-12)
+            assert model.remove(image_add_cti, 4) == pytest.approx(
+                image_remove_cti, rel=1e-9, abs=1e-9
+            )
+        assert image_pre_cti[2, 1] == 800.0
+
+        # A stack of images
+        images = model.add(np.array([image_pre_cti, image_pre_cti[::-1]]))
+        assert images[0] == pytest.approx(image_add_cti, rel=1e-12)
+
+        # In place, in a non-contiguous view of a larger image
+        image_large = np.zeros((5, 30))
+        image_view = image_large[:, 3:27:2].T
+        image_view[:] = image_pre_cti
+        result = model.add(image_view, out=image_view)
+        assert result is image_view
+        assert image_large[:, 3:27:2].T == pytest.approx(image_add_cti, rel=1e-12)
+        assert image_large[:, 4] == pytest.approx(0.0)
+
 
 class TestCTIModelForHSTACS:
     def test__CTI_model_for_HST_ACS(self):
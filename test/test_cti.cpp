@@ -1,12 +1,16 @@
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
+#include <string>
 #include <valarray>
 #include <vector>
 
 #include "catch2/catch.hpp"
 #include "ccd.hpp"
 #include "cti.hpp"
+#include "profile.hpp"
 #include "roe.hpp"
 #include "trap_managers.hpp"
 #include "traps.hpp"
@@ -313,6 +317,351 @@ TEST_CASE("Test add CTI", "[cti]") {
     }
 }
 
+TEST_CASE("Test add CTI, flat image buffer", "[cti]") {
+    set_verbosity(0);
+
+    std::valarray<double> dwell_times = {1.0};
+    int express = 0;
+    int offset = 0;
+    int start = 0;
+    int stop = -1;
+    int time_start = 0;
+    int time_stop = -1;
+    TrapInstantCapture trap(10.0, -1.0 / log(0.5));
+    std::valarray<TrapInstantCapture> traps_ic = {trap};
+    std::valarray<TrapSlowCapture> traps_sc = {};
+    std::valarray<TrapInstantCaptureContinuum> traps_ic_co = {};
+    std::valarray<TrapSlowCaptureContinuum> traps_sc_co = {};
+    ROE roe(dwell_times, 0, -1, true, false, true, true);
+    CCD ccd(CCDPhase(1e3, 0.0, 1.0));
+    std::valarray<std::valarray<double> > image_pre_cti, image_post_cti;
+    image_pre_cti = {
+        // clang-format off
+        {0.0,   0.0,   0.0,   0.0,   0.0},
+        {200.0, 0.0,   0.0,   0.0,   0.0},
+        {0.0,   200.0, 0.0,   0.0,   0.0},
+        {0.0,   0.0,   200.0, 0.0,   0.0},
+        {0.0,   0.0,   0.0,   0.0,   300.0},
+        {0.0,   0.0,   0.0,   0.0,   0.0},
+        // clang-format on
+    };
+    int n_rows = image_pre_cti.size();
+    int n_columns = image_pre_cti[0].size();
+    image_post_cti = add_cti(
+        image_pre_cti, &roe, &ccd, &traps_ic, &traps_sc, &traps_ic_co, &traps_sc_co,
+        express, offset, start, stop, time_start, time_stop, 0, 0, &roe, &ccd,
+        &traps_ic, &traps_sc, &traps_ic_co, &traps_sc_co, express, offset, start,
+        stop, time_start, time_stop, 0, 0);
+
+    SECTION("Contiguous buffer, same result as valarray image") {
+        std::vector<double> image = flatten(image_pre_cti);
+        add_cti(
+            image.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+            &traps_sc, &traps_ic_co, &traps_sc_co, express, offset, start, stop,
+            time_start, time_stop, 0, 0, &roe, &ccd, &traps_ic, &traps_sc,
+            &traps_ic_co, &traps_sc_co, express, offset, start, stop, time_start,
+            time_stop, 0, 0);
+        REQUIRE_THAT(image, Catch::Approx(flatten(image_post_cti)));
+
+        // Clock charge directly, parallel only
+        std::valarray<std::valarray<double> > image_clock =
+            clock_charge_in_one_direction(
+                image_pre_cti, &roe, &ccd, &traps_ic, &traps_sc, &traps_ic_co,
+                &traps_sc_co, express);
+        image = flatten(image_pre_cti);
+        clock_charge_in_one_direction(
+            image.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+            &traps_sc, &traps_ic_co, &traps_sc_co, express);
+        REQUIRE_THAT(image, Catch::Approx(flatten(image_clock)));
+    }
+
+    SECTION("Strided buffers, same result as valarray image") {
+        std::vector<double> answer = flatten(image_post_cti);
+        std::vector<double> image, test;
+
+        // Column-major (Fortran-ordered) buffer
+        image = std::vector<double>(n_rows * n_columns, 0.0);
+        for (int i_row = 0; i_row < n_rows; i_row++) {
+            for (int i_col = 0; i_col < n_columns; i_col++) {
+                image[i_col * n_rows + i_row] = image_pre_cti[i_row][i_col];
+            }
+        }
+        add_cti(
+            image.data(), n_rows, n_columns, 1, n_rows, &roe, &ccd, &traps_ic,
+            &traps_sc, &traps_ic_co, &traps_sc_co, express, offset, start, stop,
+            time_start, time_stop, 0, 0, &roe, &ccd, &traps_ic, &traps_sc,
+            &traps_ic_co, &traps_sc_co, express, offset, start, stop, time_start,
+            time_stop, 0, 0);
+        test.clear();
+        for (int i_row = 0; i_row < n_rows; i_row++) {
+            for (int i_col = 0; i_col < n_columns; i_col++) {
+                test.push_back(image[i_col * n_rows + i_row]);
+            }
+        }
+        REQUIRE_THAT(test, Catch::Approx(answer));
+
+        // Padded rows, with the padding left untouched
+        int row_stride = n_columns + 3;
+        image = std::vector<double>(n_rows * row_stride, -1.0);
+        for (int i_row = 0; i_row < n_rows; i_row++) {
+            for (int i_col = 0; i_col < n_columns; i_col++) {
+                image[i_row * row_stride + i_col] = image_pre_cti[i_row][i_col];
+            }
+        }
+        add_cti(
+            image.data(), n_rows, n_columns, row_stride, 1, &roe, &ccd, &traps_ic,
+            &traps_sc, &traps_ic_co, &traps_sc_co, express, offset, start, stop,
+            time_start, time_stop, 0, 0, &roe, &ccd, &traps_ic, &traps_sc,
+            &traps_ic_co, &traps_sc_co, express, offset, start, stop, time_start,
+            time_stop, 0, 0);
+        test.clear();
+        for (int i_row = 0; i_row < n_rows; i_row++) {
+            for (int i_col = 0; i_col < n_columns; i_col++) {
+                test.push_back(image[i_row * row_stride + i_col]);
+            }
+            for (int i_col = n_columns; i_col < row_stride; i_col++) {
+                REQUIRE(image[i_row * row_stride + i_col] == -1.0);
+            }
+        }
+        REQUIRE_THAT(test, Catch::Approx(answer));
+    }
+
+    SECTION("Serial transfer axis and column tiles, same result as transposing") {
+        // Enough columns for more than one tile, plus a window that doesn't
+        // start at a tile boundary
+        image_pre_cti = std::valarray<std::valarray<double> >(
+            std::valarray<double>(0.0, 19), 13);
+        for (int i_row = 0; i_row < 13; i_row++) {
+            for (int i_col = 0; i_col < 19; i_col++) {
+                image_pre_cti[i_row][i_col] = (i_row * 7 + i_col * 13) % 23 * 10.0;
+            }
+        }
+        std::valarray<std::valarray<double> > image_T, image_clock;
+
+        // Parallel, with tile buffers for the row-major image
+        image_post_cti = clock_charge_in_one_direction(
+            image_pre_cti, &roe, &ccd, &traps_ic, &traps_sc, &traps_ic_co,
+            &traps_sc_co, express, offset, 1, 12, 3, 17);
+        image_T = transpose(image_pre_cti);
+        image_clock = clock_charge_in_one_direction(
+            image_T, &roe, &ccd, &traps_ic, &traps_sc, &traps_ic_co, &traps_sc_co,
+            express, offset, 1, 12, 3, 17, time_start, time_stop, 1e-10, 20, 1, -1,
+            transfer_axis_serial);
+        image_clock = transpose(image_clock);
+        REQUIRE_THAT(flatten(image_post_cti), Catch::Approx(flatten(image_clock)));
+
+        // Serial, on contiguous rows
+        image_post_cti = clock_charge_in_one_direction(
+            image_T, &roe, &ccd, &traps_ic, &traps_sc, &traps_ic_co, &traps_sc_co,
+            express, offset, 2, 18, 1, 10);
+        image_post_cti = transpose(image_post_cti);
+        image_clock = clock_charge_in_one_direction(
+            image_pre_cti, &roe, &ccd, &traps_ic, &traps_sc, &traps_ic_co,
+            &traps_sc_co, express, offset, 2, 18, 1, 10, time_start, time_stop,
+            1e-10, 20, 1, -1, transfer_axis_serial);
+        REQUIRE_THAT(flatten(image_post_cti), Catch::Approx(flatten(image_clock)));
+    }
+
+    SECTION("Multiple phases, no charge released past the end of each row") {
+        // Traps in the leading phases of the last pixel in each row release
+        // towards the next pixel, which isn't in the row
+        std::valarray<double> dwell_times_3(1.0 / 3.0, 3);
+        ROE roe_3(dwell_times_3, 0, -1, true, false, true, false);
+        CCDPhase phase(1e3, 0.0, 1.0);
+        std::valarray<CCDPhase> phases = {phase, phase, phase};
+        std::valarray<double> fraction_of_traps_per_phase(1.0 / 3.0, 3);
+        CCD ccd_3(phases, fraction_of_traps_per_phase);
+        std::vector<double> image(3 * 4, 0.0);
+        for (int i_row = 0; i_row < 3; i_row++) image[i_row * 4 + 3] = 200.0;
+
+        add_cti(
+            image.data(), 3, 4, 4, 1, nullptr, nullptr, nullptr, nullptr, nullptr,
+            nullptr, express, offset, start, stop, time_start, time_stop, 0, 0,
+            &roe_3, &ccd_3, &traps_ic, nullptr, nullptr, nullptr, express, offset,
+            start, stop, time_start, time_stop, 0, 0);
+
+        for (int i_row = 0; i_row < 3; i_row++) {
+            REQUIRE(image[i_row * 4 + 3] < 200.0);
+            for (int i_col = 0; i_col < 3; i_col++)
+                REQUIRE(image[i_row * 4 + i_col] == 0.0);
+        }
+    }
+
+    SECTION("Traps not emptied between columns, watermark memory limit") {
+        // Many narrow columns, with the trap states carried between them
+        ROE roe_no_reset(dwell_times, 0, -1, true, false, true, false);
+        std::valarray<TrapSlowCapture> traps_sc_2 = {TrapSlowCapture(5.0, 3.0, 0.2)};
+        int n_rows_2 = 9;
+        int n_columns_2 = 40;
+        std::vector<double> image_pre(n_rows_2 * n_columns_2);
+        for (int i_pixel = 0; i_pixel < n_rows_2 * n_columns_2; i_pixel++)
+            image_pre[i_pixel] = (i_pixel * 7) % 23 * 10.0;
+        std::vector<double> image, answer;
+
+        answer = image_pre;
+        clock_charge_in_one_direction(
+            answer.data(), n_rows_2, n_columns_2, 1, n_rows_2, &roe_no_reset, &ccd,
+            &traps_ic, &traps_sc_2, nullptr, nullptr, express);
+
+        // Plenty of memory, same result
+        set_watermark_memory_limit(1e9);
+        image = image_pre;
+        clock_charge_in_one_direction(
+            image.data(), n_rows_2, n_columns_2, 1, n_rows_2, &roe_no_reset, &ccd,
+            &traps_ic, &traps_sc_2, nullptr, nullptr, express);
+        REQUIRE_THAT(image, Catch::Approx(answer));
+
+        // Too little memory for all the watermarks, so some are merged
+        set_watermark_memory_limit(1.0);
+        image = image_pre;
+        clock_charge_in_one_direction(
+            image.data(), n_rows_2, n_columns_2, 1, n_rows_2, &roe_no_reset, &ccd,
+            &traps_ic, &traps_sc_2, nullptr, nullptr, express);
+        set_watermark_memory_limit(0.0);
+        double total = 0.0;
+        double total_answer = 0.0;
+        for (int i_pixel = 0; i_pixel < n_rows_2 * n_columns_2; i_pixel++) {
+            REQUIRE(image[i_pixel] >= 0.0);
+            total += image[i_pixel];
+            total_answer += answer[i_pixel];
+        }
+        REQUIRE(total == Approx(total_answer).epsilon(0.001));
+    }
+
+    SECTION("Trap manager workspace pool, same result when reused") {
+        TrapManagerManagerPool pool;
+        std::vector<double> image, answer;
+
+        answer = flatten(image_pre_cti);
+        clock_charge_in_one_direction(
+            answer.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+            &traps_sc, &traps_ic_co, &traps_sc_co, express);
+
+        for (int i_call = 0; i_call < 3; i_call++) {
+            image = flatten(image_pre_cti);
+            clock_charge_in_one_direction(
+                image.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+                &traps_sc, &traps_ic_co, &traps_sc_co, express, offset, start, stop,
+                start, stop, time_start, time_stop, 1e-10, 20, 1, -1,
+                transfer_axis_parallel, &pool);
+            REQUIRE_THAT(image, Catch::Approx(answer));
+        }
+        REQUIRE(pool.workspaces.size() >= 1);
+
+        // The same prepared trap managers, so the workspaces are only reset,
+        // not copied again, as shown by marking an attribute that's unused
+        // while clocking with preallocated watermarks
+        TrapManagerManager trap_manager_manager = prepare_clocking(
+            &roe, &ccd, &traps_ic, &traps_sc, &traps_ic_co, &traps_sc_co, n_rows,
+            n_rows, express, offset);
+        for (int i_call = 0; i_call < 3; i_call++) {
+            image = flatten(image_pre_cti);
+            double* image_pointer = image.data();
+            clock_charge_in_images(
+                &image_pointer, 1, n_rows, n_columns, n_columns, 1, &roe, &ccd,
+                trap_manager_manager, 0, n_rows, 0, n_columns, 1e-10, 20, 1, &pool);
+            REQUIRE_THAT(image, Catch::Approx(answer));
+
+            for (TrapManagerManager& workspace : pool.workspaces) {
+                if (workspace.setup_id != trap_manager_manager.setup_id) continue;
+                if (i_call > 0) REQUIRE(workspace.max_n_transfers == -1);
+                workspace.max_n_transfers = -1;
+            }
+        }
+    }
+
+    SECTION("Split time range with trap state snapshots, same result") {
+        std::valarray<TrapSlowCapture> traps_sc_2 = {TrapSlowCapture(5.0, 3.0, 0.2)};
+        std::vector<double> image, answer;
+
+        answer = flatten(image_pre_cti);
+        clock_charge_in_one_direction(
+            answer.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+            &traps_sc_2, nullptr, nullptr, express);
+
+        for (int time_split : {1, 3, n_rows}) {
+            // The first transfers, saving the trap states
+            TrapStateSnapshot snapshot_out, snapshot_in;
+            image = flatten(image_pre_cti);
+            clock_charge_in_one_direction(
+                image.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+                &traps_sc_2, nullptr, nullptr, express, offset, start, stop, start,
+                stop, 0, time_split, 1e-10, 20, 1, -1, transfer_axis_parallel,
+                nullptr, column_schedule_static, nullptr, &snapshot_out);
+            REQUIRE(snapshot_out.time == time_split);
+            REQUIRE(snapshot_out.n_columns == n_columns);
+
+            // Via a file
+            char dir[] = "/tmp/arctic_test_snapshot_XXXXXX";
+            REQUIRE(mkdtemp(dir) != nullptr);
+            std::string path = std::string(dir) + "/snapshot.bin";
+            snapshot_out.write(path.c_str());
+            snapshot_in.read(path.c_str());
+            remove(path.c_str());
+            rmdir(dir);
+            REQUIRE(snapshot_in.states == snapshot_out.states);
+
+            // The remaining transfers, resuming from the saved trap states
+            clock_charge_in_one_direction(
+                image.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+                &traps_sc_2, nullptr, nullptr, express, offset, start, stop, start,
+                stop, time_split, -1, 1e-10, 20, 1, -1, transfer_axis_parallel,
+                nullptr, column_schedule_static, &snapshot_in);
+
+            for (int i_pixel = 0; i_pixel < n_rows * n_columns; i_pixel++)
+                REQUIRE(image[i_pixel] == answer[i_pixel]);
+        }
+    }
+
+    SECTION("Column schedules, same result as static") {
+        // Enough columns for several tiles, with a bright column to reorder
+        image_pre_cti = std::valarray<std::valarray<double> >(
+            std::valarray<double>(0.0, 37), 11);
+        for (int i_row = 0; i_row < 11; i_row++) {
+            for (int i_col = 0; i_col < 37; i_col++) {
+                image_pre_cti[i_row][i_col] = (i_row * 5 + i_col * 3) % 17 * 10.0;
+            }
+            image_pre_cti[i_row][30] = 1e4;
+        }
+        std::valarray<double> tile_costs;
+        std::vector<double> image = flatten(image_pre_cti);
+        tile_costs = estimate_tile_costs(image.data(), 37, 1, 0, 11, 0, 37, &ccd);
+        REQUIRE(tile_costs.size() == 5);
+        REQUIRE(tile_costs.max() == tile_costs[3]);
+
+        std::valarray<std::valarray<double> > image_static, image_clock;
+        image_static = clock_charge_in_one_direction(
+            image_pre_cti, &roe, &ccd, &traps_ic, &traps_sc, &traps_ic_co,
+            &traps_sc_co, express, offset, 0, -1, 2, 35);
+
+        for (int column_schedule :
+             {column_schedule_dynamic, column_schedule_guided, column_schedule_cost}) {
+            image_clock = clock_charge_in_one_direction(
+                image_pre_cti, &roe, &ccd, &traps_ic, &traps_sc, &traps_ic_co,
+                &traps_sc_co, express, offset, 0, -1, 2, 35, time_start, time_stop,
+                1e-10, 20, 1, -1, transfer_axis_parallel, column_schedule);
+            REQUIRE_THAT(flatten(image_clock), Catch::Approx(flatten(image_static)));
+        }
+    }
+
+    SECTION("Remove CTI in place, same result as valarray image") {
+        int n_iterations = 3;
+        std::valarray<std::valarray<double> > image_remove_cti = remove_cti(
+            image_post_cti, n_iterations, &roe, &ccd, &traps_ic, &traps_sc,
+            &traps_ic_co, &traps_sc_co, express, offset, start, stop, time_start,
+            time_stop, 0, 0, &roe, &ccd, &traps_ic, &traps_sc, &traps_ic_co,
+            &traps_sc_co, express, offset, start, stop, time_start, time_stop, 0, 0);
+        std::vector<double> image = flatten(image_post_cti);
+        remove_cti(
+            image.data(), n_rows, n_columns, n_columns, 1, n_iterations, &roe, &ccd,
+            &traps_ic, &traps_sc, &traps_ic_co, &traps_sc_co, express, offset, start,
+            stop, time_start, time_stop, 0, 0, &roe, &ccd, &traps_ic, &traps_sc,
+            &traps_ic_co, &traps_sc_co, express, offset, start, stop, time_start,
+            time_stop, 0, 0);
+        REQUIRE_THAT(image, Catch::Approx(flatten(image_remove_cti)));
+    }
+}
+
 TEST_CASE("Test add CTI, compare trap species", "[cti]") {
     set_verbosity(0);
 
@@ -512,6 +861,54 @@ TEST_CASE("Test remove CTI", "[cti]") {
     }
 }
 
+TEST_CASE("Test sparse image, skipped pixels with empty traps", "[cti]") {
+    set_verbosity(0);
+
+    // A few sources on an empty background, with parts of it before any
+    // charge reaches the traps and after they've released it all
+    int n_rows = 40;
+    int n_columns = 5;
+    std::vector<double> image_pre(n_rows * n_columns, 0.0);
+    image_pre[12 * n_columns + 0] = 1000.0;
+    image_pre[12 * n_columns + 1] = 50.0;
+    image_pre[13 * n_columns + 1] = 2.0;
+    image_pre[30 * n_columns + 3] = 400.0;
+    image_pre[31 * n_columns + 4] = 1e-3;
+    std::valarray<double> dwell_times = {1.0};
+    CCD ccd(CCDPhase(1e3, 0.0, 1.0));
+    std::valarray<TrapInstantCapture> traps_ic = {TrapInstantCapture(10.0, 2.0)};
+    std::valarray<TrapSlowCapture> traps_sc = {TrapSlowCapture(5.0, 4.0, 0.5)};
+
+    for (int express : {0, 5}) {
+        for (bool empty_traps_between_columns : {true, false}) {
+            ROE roe(dwell_times, 0, -1, empty_traps_between_columns);
+            std::vector<double> image = image_pre;
+            std::vector<double> answer = image_pre;
+
+            clock_charge_in_one_direction(
+                image.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+                &traps_sc, nullptr, nullptr, express);
+
+            // The trace version of the column kernel models every pixel, with
+            // its printing discarded
+            fflush(stdout);
+            int stdout_copy = dup(fileno(stdout));
+            REQUIRE(freopen("/dev/null", "w", stdout) != nullptr);
+            set_verbosity(2);
+            clock_charge_in_one_direction(
+                answer.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+                &traps_sc, nullptr, nullptr, express);
+            set_verbosity(0);
+            fflush(stdout);
+            dup2(stdout_copy, fileno(stdout));
+            close(stdout_copy);
+
+            REQUIRE(image != image_pre);
+            REQUIRE(image == answer);
+        }
+    }
+}
+
 TEST_CASE("Test offset and windows", "[cti]") {
     set_verbosity(0);
 
@@ -856,4 +1253,40 @@ TEST_CASE("Test trap pumping ROE, add CTI", "[cti]") {
         REQUIRE(image_post_cti[3][0] == image_pre_cti[3][0]);
         REQUIRE(image_post_cti[4][0] == image_pre_cti[4][0]);
     }
+
+    SECTION("Many pumps, watermarks fit in the arrays") {
+        // The traps aren't reset between pumps, so the watermarks must have
+        // room for the capture events of every pump, several per phase
+        std::valarray<double> dwell_times(1.0 / 6.0, 6);
+        ROETrapPumping roe(dwell_times, 20);
+        std::valarray<double> fraction_of_traps_per_phase = {0.4, 0.3, 0.3};
+        CCDPhase phase(1e4, 0.0, 0.8);
+        std::valarray<CCDPhase> phases = {phase, phase, phase};
+        CCD ccd(phases, fraction_of_traps_per_phase);
+        std::valarray<TrapSlowCapture> traps_sc_pump = {
+            TrapSlowCapture(10.0, -1.0 / log(0.5), 0.3)};
+        std::valarray<std::valarray<double> > image_pre_cti, image_post_cti;
+        image_pre_cti = std::valarray<std::valarray<double> >(
+            std::valarray<double>(100.0, 1), n_rows);
+
+        set_profiling(1);
+        reset_profile();
+        image_post_cti = add_cti(
+            image_pre_cti, &roe, &ccd, &traps_ic, &traps_sc_pump, &traps_ic_co,
+            &traps_sc_co, express, offset, 2, 3);
+        ClockingProfile clocking = get_profile().clockings[0];
+        set_profiling(0);
+
+        for (int i_phase = 0; i_phase < 3; i_phase++) {
+            REQUIRE(
+                clocking.max_n_active_watermarks_sc[i_phase] <
+                clocking.n_watermarks_sc[i_phase]);
+            REQUIRE(
+                clocking.max_n_active_watermarks_ic[i_phase] <
+                clocking.n_watermarks_ic[i_phase]);
+        }
+        REQUIRE(image_post_cti[2][0] < image_pre_cti[2][0]);
+        REQUIRE(image_post_cti[0][0] == image_pre_cti[0][0]);
+        REQUIRE(image_post_cti[4][0] == image_pre_cti[4][0]);
+    }
 }
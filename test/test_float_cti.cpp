@@ -0,0 +1,213 @@
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <valarray>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "ccd.hpp"
+#include "cti.hpp"
+#include "model.hpp"
+#include "roe.hpp"
+#include "trap_managers.hpp"
+#include "traps.hpp"
+#include "util.hpp"
+
+/*
+    Add or remove CTI (parallel then serial) for a row-major image buffer with
+    the same model for both directions, in the precision of the buffer.
+*/
+template <typename real>
+static std::vector<real> clock_with_precision(
+    std::vector<real> image, int n_rows, int n_columns, ROE* roe, CCD* ccd,
+    std::valarray<TrapInstantCapture>* traps_ic,
+    std::valarray<TrapSlowCapture>* traps_sc,
+    std::valarray<TrapInstantCaptureContinuum>* traps_ic_co, int express,
+    int offset, int window_start, int window_stop, int n_iterations = 0,
+    int allow_negative_pixels = 1) {
+    std::valarray<TrapSlowCaptureContinuum> traps_sc_co = {};
+
+    if (n_iterations == 0)
+        add_cti(
+            image.data(), n_rows, n_columns, n_columns, 1, roe, ccd, traps_ic,
+            traps_sc, traps_ic_co, &traps_sc_co, express, offset, window_start,
+            window_stop, 0, -1, 1e-10, 20, roe, ccd, traps_ic, traps_sc,
+            traps_ic_co, &traps_sc_co, express, offset, 0, -1, 0, -1, 1e-10, 20,
+            allow_negative_pixels);
+    else
+        remove_cti(
+            image.data(), n_rows, n_columns, n_columns, 1, n_iterations, roe, ccd,
+            traps_ic, traps_sc, traps_ic_co, &traps_sc_co, express, offset,
+            window_start, window_stop, 0, -1, 1e-10, 20, roe, ccd, traps_ic,
+            traps_sc, traps_ic_co, &traps_sc_co, express, offset, 0, -1, 0, -1,
+            1e-10, 20, allow_negative_pixels);
+
+    return image;
+}
+
+/*
+    The largest or root-mean-square difference between two results, e.g. float
+    and double, relative to the CTI trails in the first one, i.e. its change
+    from the input image.
+*/
+template <typename real>
+static double max_difference(
+    std::vector<double>& image, std::vector<double>& image_a,
+    std::vector<real>& image_b) {
+    double max_change = 0.0;
+    double max_difference = 0.0;
+    for (unsigned int i = 0; i < image.size(); i++) {
+        max_change = std::max(max_change, fabs(image_a[i] - image[i]));
+        max_difference = std::max(max_difference, fabs(image_b[i] - image_a[i]));
+    }
+    return max_difference / max_change;
+}
+
+template <typename real>
+static double rms_difference(
+    std::vector<double>& image, std::vector<double>& image_a,
+    std::vector<real>& image_b) {
+    double sum_change = 0.0;
+    double sum_difference = 0.0;
+    for (unsigned int i = 0; i < image.size(); i++) {
+        sum_change += (image_a[i] - image[i]) * (image_a[i] - image[i]);
+        sum_difference += (image_b[i] - image_a[i]) * (image_b[i] - image_a[i]);
+    }
+    return sqrt(sum_difference / sum_change);
+}
+
+TEST_CASE("Test float clocking, same results as double", "[float]") {
+    set_verbosity(0);
+
+    // Sparse sources and some noise on a background
+    int n_rows = 60;
+    int n_columns = 17;
+    std::vector<double> image(n_rows * n_columns, 0.0);
+    srand(20);
+    for (int i = 0; i < n_rows * n_columns; i++) {
+        if (rand() % 4 == 0) image[i] = (rand() % 1000) / 10.0 - 5.0;
+        if (rand() % 40 == 0) image[i] = 100.0 + rand() % 5000;
+    }
+    std::vector<float> image_in_float(image.begin(), image.end());
+    std::vector<double> image_in(image_in_float.begin(), image_in_float.end());
+
+    std::valarray<double> dwell_times = {1.0};
+    ROE roe(dwell_times);
+    CCD ccd(CCDPhase(1e4, 0.0, 0.5));
+    std::valarray<TrapInstantCapture> traps_ic = {
+        TrapInstantCapture(2.0, 0.5), TrapInstantCapture(5.0, 3.0)};
+    std::valarray<TrapSlowCapture> traps_sc = {
+        TrapSlowCapture(3.0, 1.5, 0.2), TrapSlowCapture(1.0, 10.0, 0.0)};
+    std::valarray<TrapInstantCapture> no_traps_ic = {};
+    std::valarray<TrapSlowCapture> no_traps_sc = {};
+    std::valarray<TrapInstantCaptureContinuum> no_traps_ic_co = {};
+    std::vector<double> image_double;
+    std::vector<float> image_float;
+
+    SECTION("One direction, the double results rounded to float") {
+        // Clocked in double, so the only difference is the final rounding
+        std::valarray<TrapSlowCaptureContinuum> no_traps_sc_co = {};
+        for (int express : {0, 5}) {
+            image_double = image_in;
+            image_float = image_in_float;
+            clock_charge_in_one_direction(
+                image_double.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd,
+                &traps_ic, &traps_sc, &no_traps_ic_co, &no_traps_sc_co, express);
+            clock_charge_in_one_direction(
+                image_float.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd,
+                &traps_ic, &traps_sc, &no_traps_ic_co, &no_traps_sc_co, express);
+            for (int i = 0; i < n_rows * n_columns; i++)
+                REQUIRE(image_float[i] == (float)image_double[i]);
+        }
+    }
+
+    SECTION("Instant capture") {
+        for (int express : {0, 1, 5}) {
+            image_double = clock_with_precision(
+                image_in, n_rows, n_columns, &roe, &ccd, &traps_ic, &no_traps_sc,
+                &no_traps_ic_co, express, 0, 0, -1);
+            image_float = clock_with_precision(
+                image_in_float, n_rows, n_columns, &roe, &ccd, &traps_ic,
+                &no_traps_sc, &no_traps_ic_co, express, 0, 0, -1);
+            REQUIRE(max_difference(image_in, image_double, image_float) < 1e-5);
+        }
+    }
+
+    SECTION("Offset and window, no negative pixels") {
+        image_double = clock_with_precision(
+            image_in, n_rows, n_columns, &roe, &ccd, &traps_ic, &no_traps_sc,
+            &no_traps_ic_co, 4, 10, 5, 50, 0, 0);
+        image_float = clock_with_precision(
+            image_in_float, n_rows, n_columns, &roe, &ccd, &traps_ic, &no_traps_sc,
+            &no_traps_ic_co, 4, 10, 5, 50, 0, 0);
+        REQUIRE(max_difference(image_in, image_double, image_float) < 1e-5);
+    }
+
+    SECTION("Remove CTI") {
+        image_double = clock_with_precision(
+            image_in, n_rows, n_columns, &roe, &ccd, &traps_ic, &no_traps_sc,
+            &no_traps_ic_co, 3, 0, 0, -1, 3);
+        image_float = clock_with_precision(
+            image_in_float, n_rows, n_columns, &roe, &ccd, &traps_ic, &no_traps_sc,
+            &no_traps_ic_co, 3, 0, 0, -1, 3);
+        REQUIRE(max_difference(image_in, image_double, image_float) < 1e-5);
+    }
+
+    SECTION("Slow capture, within the double results' own sensitivity") {
+        // Whether a new watermark reaches exactly to the cloud or just above
+        // it depends on the rounding, so the slow-capture results can change
+        // by much more than the rounding error, even in double. With the image
+        // rounded to float between the parallel and serial clocking, compare
+        // with the difference from perturbing the input image by ~float epsilon
+        std::vector<double> image_in_perturbed(image_in);
+        for (double& pixel : image_in_perturbed) pixel *= 1.0 + 1e-7;
+
+        for (int express : {0, 1, 5}) {
+            for (std::valarray<TrapInstantCapture>* traps_ic_test :
+                 {&no_traps_ic, &traps_ic}) {
+                image_double = clock_with_precision(
+                    image_in, n_rows, n_columns, &roe, &ccd, traps_ic_test,
+                    &traps_sc, &no_traps_ic_co, express, 0, 0, -1);
+                image_float = clock_with_precision(
+                    image_in_float, n_rows, n_columns, &roe, &ccd, traps_ic_test,
+                    &traps_sc, &no_traps_ic_co, express, 0, 0, -1);
+                std::vector<double> image_double_perturbed = clock_with_precision(
+                    image_in_perturbed, n_rows, n_columns, &roe, &ccd, traps_ic_test,
+                    &traps_sc, &no_traps_ic_co, express, 0, 0, -1);
+
+                REQUIRE(
+                    rms_difference(image_in, image_double, image_float) <
+                    2.0 * rms_difference(
+                              image_in, image_double, image_double_perturbed) +
+                        1e-4);
+            }
+        }
+    }
+
+    SECTION("Prepared model, batch of images") {
+        CTIModel model(
+            ClockingModel(&roe, &ccd, &traps_ic, nullptr, nullptr, nullptr, 5),
+            ClockingModel(&roe, &ccd, &traps_ic, nullptr, nullptr, nullptr, 5));
+        std::vector<double> images_double(image_in);
+        images_double.insert(images_double.end(), image_in.rbegin(), image_in.rend());
+        std::vector<float> images_float(images_double.begin(), images_double.end());
+        std::vector<double> images_in(images_double);
+        double* images_double_pointers[2] = {
+            &images_double[0], &images_double[n_rows * n_columns]};
+        float* images_float_pointers[2] = {
+            &images_float[0], &images_float[n_rows * n_columns]};
+
+        add_cti_batch(
+            images_double_pointers, 2, n_rows, n_columns, n_columns, 1, model);
+        add_cti_batch(images_float_pointers, 2, n_rows, n_columns, n_columns, 1, model);
+        REQUIRE(max_difference(images_in, images_double, images_float) < 1e-5);
+
+        std::vector<double> images_trailed(images_double);
+        remove_cti_batch(
+            images_double_pointers, 2, n_rows, n_columns, n_columns, 1, 3, model);
+        remove_cti_batch(
+            images_float_pointers, 2, n_rows, n_columns, n_columns, 1, 3, model);
+        REQUIRE(max_difference(images_trailed, images_double, images_float) < 1e-5);
+    }
+}
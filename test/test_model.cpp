@@ -0,0 +1,551 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <valarray>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "ccd.hpp"
+#include "cti.hpp"
+#include "model.hpp"
+#include "roe.hpp"
+#include "trap_managers.hpp"
+#include "traps.hpp"
+#include "util.hpp"
+
+TEST_CASE("Test prepared model, same results as add and remove CTI", "[model]") {
+    set_verbosity(0);
+
+    std::valarray<double> dwell_times = {1.0};
+    std::valarray<TrapInstantCapture> traps_ic = {TrapInstantCapture(10.0, 1.5)};
+    std::valarray<TrapSlowCapture> traps_sc = {TrapSlowCapture(5.0, 3.0, 0.2)};
+    ROE parallel_roe(dwell_times, 0, -1, true, false, true, false);
+    ROE serial_roe(dwell_times, 0, -1, true, false, true, false);
+    CCD ccd(CCDPhase(1e3, 0.0, 1.0));
+    int express = 3;
+    int n_rows = 12;
+    int n_columns = 11;
+    int n_images = 3;
+
+    // Different images with the same size
+    std::vector<std::vector<double> > images_pre_cti(
+        n_images, std::vector<double>(n_rows * n_columns));
+    for (int i_image = 0; i_image < n_images; i_image++) {
+        for (int i_pixel = 0; i_pixel < n_rows * n_columns; i_pixel++) {
+            images_pre_cti[i_image][i_pixel] =
+                (i_pixel * (i_image + 3) + 7 * i_image) % 19 * 10.0;
+        }
+    }
+
+    // The same results using the standard functions
+    std::vector<std::vector<double> > answers_add = images_pre_cti;
+    std::vector<std::vector<double> > answers_remove = images_pre_cti;
+    for (int i_image = 0; i_image < n_images; i_image++) {
+        add_cti(
+            answers_add[i_image].data(), n_rows, n_columns, n_columns, 1,
+            &parallel_roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, express, 0,
+            1, 10, 0, -1, 1e-10, 20, &serial_roe, &ccd, &traps_ic, nullptr, nullptr,
+            nullptr, express, 0, 2, 9);
+        remove_cti(
+            answers_remove[i_image].data(), n_rows, n_columns, n_columns, 1, 3,
+            &parallel_roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, express, 0,
+            1, 10, 0, -1, 1e-10, 20, &serial_roe, &ccd, &traps_ic, nullptr, nullptr,
+            nullptr, express, 0, 2, 9);
+    }
+
+    CTIModel model(
+        ClockingModel(
+            &parallel_roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, express, 0, 1,
+            10),
+        ClockingModel(
+            &serial_roe, &ccd, &traps_ic, nullptr, nullptr, nullptr, express, 0, 2, 9));
+
+    SECTION("One image at a time, reusing the model") {
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            std::vector<double> image = images_pre_cti[i_image];
+            add_cti(image.data(), n_rows, n_columns, n_columns, 1, model);
+            REQUIRE_THAT(image, Catch::Approx(answers_add[i_image]));
+        }
+        REQUIRE(model.parallel.is_prepared);
+        REQUIRE(model.serial.prepared_n_rows == n_columns);
+
+        std::vector<double> image = images_pre_cti[1];
+        remove_cti(image.data(), n_rows, n_columns, n_columns, 1, 3, model);
+        REQUIRE_THAT(image, Catch::Approx(answers_remove[1]));
+    }
+
+    SECTION("Batch of images") {
+        std::vector<std::vector<double> > images = images_pre_cti;
+        std::vector<double*> image_pointers;
+        for (int i_image = 0; i_image < n_images; i_image++)
+            image_pointers.push_back(images[i_image].data());
+
+        for (int column_schedule : {column_schedule_static, column_schedule_cost}) {
+            model.column_schedule = column_schedule;
+            images = images_pre_cti;
+            add_cti_batch(
+                image_pointers.data(), n_images, n_rows, n_columns, n_columns, 1, model);
+            for (int i_image = 0; i_image < n_images; i_image++)
+                REQUIRE_THAT(images[i_image], Catch::Approx(answers_add[i_image]));
+        }
+
+        images = images_pre_cti;
+        remove_cti_batch(
+            image_pointers.data(), n_images, n_rows, n_columns, n_columns, 1, 3, model);
+        for (int i_image = 0; i_image < n_images; i_image++)
+            REQUIRE_THAT(images[i_image], Catch::Approx(answers_remove[i_image]));
+    }
+
+    SECTION("Different image sizes and a shared ROE, prepared again") {
+        CTIModel model_shared_roe(
+            ClockingModel(
+                &parallel_roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, express, 0,
+                1, 10),
+            ClockingModel(
+                &parallel_roe, &ccd, &traps_ic, nullptr, nullptr, nullptr, express, 0, 2,
+                9));
+        REQUIRE(model_shared_roe.parallel.roe_is_shared);
+
+        std::vector<double> image = images_pre_cti[0];
+        add_cti(image.data(), n_rows, n_columns, n_columns, 1, model_shared_roe);
+        REQUIRE_THAT(image, Catch::Approx(answers_add[0]));
+
+        // A taller image with the same data in its first rows
+        std::vector<double> image_tall = images_pre_cti[0];
+        image_tall.resize((n_rows + 4) * n_columns, 0.0);
+        std::vector<double> answer_tall = image_tall;
+        add_cti(
+            answer_tall.data(), n_rows + 4, n_columns, n_columns, 1, &parallel_roe,
+            &ccd, &traps_ic, &traps_sc, nullptr, nullptr, express, 0, 1, 10, 0, -1,
+            1e-10, 20, &parallel_roe, &ccd, &traps_ic, nullptr, nullptr, nullptr,
+            express, 0, 2, 9);
+        add_cti(image_tall.data(), n_rows + 4, n_columns, n_columns, 1, model_shared_roe);
+        REQUIRE(model_shared_roe.parallel.prepared_n_rows == n_rows + 4);
+        REQUIRE_THAT(image_tall, Catch::Approx(answer_tall));
+    }
+}
+
+TEST_CASE("Test remove CTI until converged", "[model]") {
+    set_verbosity(0);
+
+    std::valarray<double> dwell_times = {1.0};
+    std::valarray<TrapInstantCapture> traps_ic = {TrapInstantCapture(0.5, 1.5)};
+    std::valarray<TrapSlowCapture> traps_sc = {TrapSlowCapture(0.3, 3.0, 0.2)};
+    ROE roe(dwell_times, 0, -1, false, false, true, false);
+    ROE roe_empty(dwell_times, 0, -1, true, false, true, false);
+    CCD ccd(CCDPhase(1e4, 0.0, 1.0));
+    int express = 3;
+    int n_rows = 12;
+    int n_columns = 11;
+    int n_images = 2;
+
+    // Some empty columns and rows, which converge straight away
+    std::vector<std::vector<double> > images_pre_cti(
+        n_images, std::vector<double>(n_rows * n_columns, 0.0));
+    for (int i_image = 0; i_image < n_images; i_image++) {
+        for (int row_index = 0; row_index < n_rows - 4; row_index++) {
+            for (int column_index = 0; column_index < n_columns - 3; column_index++) {
+                int i_pixel = row_index * n_columns + column_index;
+                images_pre_cti[i_image][i_pixel] =
+                    (i_pixel * (i_image + 3) + 7 * i_image) % 19 * 100.0;
+            }
+        }
+    }
+
+    std::vector<double*> image_pointers(n_images);
+
+    SECTION("Fixed-point update, same as remove CTI") {
+        for (ROE* model_roe : {&roe, &roe_empty}) {
+            // Parallel only, serial only, and both
+            for (int directions = 1; directions <= 3; directions++) {
+                // Without traps, still use the window for the other direction
+                ClockingModel parallel(
+                    model_roe, &ccd, (directions & 1) ? &traps_ic : nullptr,
+                    (directions & 1) ? &traps_sc : nullptr, nullptr, nullptr, express,
+                    0, 1, 10);
+                ClockingModel serial(
+                    model_roe, &ccd, (directions & 2) ? &traps_ic : nullptr, nullptr,
+                    nullptr, nullptr, express, 0, 2, 9);
+                CTIModel model(parallel, serial);
+
+                std::vector<std::vector<double> > answers = images_pre_cti;
+                std::vector<std::vector<double> > images = images_pre_cti;
+                for (int i_image = 0; i_image < n_images; i_image++) {
+                    add_cti(
+                        answers[i_image].data(), n_rows, n_columns, n_columns, 1, model);
+                    images[i_image] = answers[i_image];
+                    image_pointers[i_image] = answers[i_image].data();
+                }
+                remove_cti_batch(
+                    image_pointers.data(), n_images, n_rows, n_columns, n_columns, 1, 4,
+                    model);
+                for (int i_image = 0; i_image < n_images; i_image++)
+                    image_pointers[i_image] = images[i_image].data();
+
+                std::valarray<int> n_iterations = remove_cti_batch_until_converged(
+                    image_pointers.data(), n_images, n_rows, n_columns, n_columns, 1, 4,
+                    0.0, model, remove_cti_update_fixed_point);
+                for (int i_image = 0; i_image < n_images; i_image++)
+                    REQUIRE(images[i_image] == answers[i_image]);
+
+                // Independent columns or rows inside the other window, if the
+                // traps are emptied between them, otherwise whole images
+                bool lines = (model_roe == &roe_empty) && (directions != 3);
+                int n_lines = (!lines) ? 1 : (directions == 1) ? n_columns : n_rows;
+                REQUIRE(n_iterations.size() == n_images * n_lines);
+                for (int i_line = 0; i_line < n_lines; i_line++) {
+                    int n_expected = 4;
+                    if (lines && (directions == 1)) {
+                        if ((i_line < 2) || (i_line >= 9)) n_expected = 0;
+                        else if (i_line >= n_columns - 3) n_expected = 1;
+                    } else if (lines) {
+                        if ((i_line < 1) || (i_line >= 10)) n_expected = 0;
+                        else if (i_line >= n_rows - 4) n_expected = 1;
+                    }
+                    REQUIRE(n_iterations[i_line] == n_expected);
+                }
+            }
+        }
+    }
+
+    SECTION("Converged columns within tolerance") {
+        CTIModel model(ClockingModel(
+            &roe_empty, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, 0));
+        std::vector<std::vector<double> > images_with_cti = images_pre_cti;
+        for (int i_image = 0; i_image < n_images; i_image++)
+            add_cti(
+                images_with_cti[i_image].data(), n_rows, n_columns, n_columns, 1, model);
+
+        double tolerance = 1e-3;
+        std::vector<std::vector<double> > images_fixed_point = images_with_cti;
+        for (int i_image = 0; i_image < n_images; i_image++)
+            image_pointers[i_image] = images_fixed_point[i_image].data();
+        std::valarray<int> n_iterations = remove_cti_batch_until_converged(
+            image_pointers.data(), n_images, n_rows, n_columns, n_columns, 1, 20,
+            tolerance, model, remove_cti_update_fixed_point);
+        REQUIRE(n_iterations.max() < 20);
+        REQUIRE(n_iterations.min() == 1);
+
+        // Each column the same as removing CTI with its number of iterations
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            for (int column_index = 0; column_index < n_columns; column_index++) {
+                std::vector<double> image = images_with_cti[i_image];
+                remove_cti(
+                    image.data(), n_rows, n_columns, n_columns, 1,
+                    n_iterations[i_image * n_columns + column_index], model);
+                for (int row_index = 0; row_index < n_rows; row_index++) {
+                    int i_pixel = row_index * n_columns + column_index;
+                    REQUIRE(image[i_pixel] == images_fixed_point[i_image][i_pixel]);
+                }
+            }
+        }
+
+        // Similar results with the accelerated update
+        std::vector<std::vector<double> > images_anderson = images_with_cti;
+        for (int i_image = 0; i_image < n_images; i_image++)
+            image_pointers[i_image] = images_anderson[i_image].data();
+        n_iterations = remove_cti_batch_until_converged(
+            image_pointers.data(), n_images, n_rows, n_columns, n_columns, 1, 20,
+            tolerance, model, remove_cti_update_anderson);
+        REQUIRE(n_iterations.max() < 20);
+        for (int i_image = 0; i_image < n_images; i_image++)
+            REQUIRE_THAT(
+                images_anderson[i_image],
+                Catch::Approx(images_fixed_point[i_image]).margin(0.1));
+    }
+}
+
+TEST_CASE("Test checkpoints, same results as without", "[model]") {
+    set_verbosity(0);
+
+    std::valarray<double> dwell_times = {1.0};
+    std::valarray<TrapInstantCapture> traps_ic = {TrapInstantCapture(0.5, 1.5)};
+    std::valarray<TrapSlowCapture> traps_sc = {TrapSlowCapture(0.3, 3.0, 0.2)};
+    ROE roe(dwell_times, 0, -1, true, false, true, false);
+    ROE roe_empty_first(dwell_times, 0, -1, true, true, true, false);
+    CCD ccd(CCDPhase(1e4, 0.0, 1.0));
+    int n_rows = 30;
+    int n_columns = 7;
+
+    // A few bright pixels in an empty background, none in the last column
+    std::vector<double> image_pre_cti(n_rows * n_columns, 0.0);
+    for (int column_index = 0; column_index < n_columns - 1; column_index++) {
+        image_pre_cti[(3 + 4 * column_index) * n_columns + column_index] = 1e3;
+        image_pre_cti[(20 + column_index) * n_columns + column_index] = 5e2;
+    }
+
+    for (ROE* model_roe : {&roe, &roe_empty_first}) {
+        for (int express : {0, 1, 4}) {
+            for (int window_start : {0, 5}) {
+                CTIModel model(ClockingModel(
+                    model_roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, express,
+                    0, window_start));
+                CTIModel model_checkpoints(ClockingModel(
+                    model_roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, express,
+                    0, window_start, -1, 0, -1, 1e-10, 20, 4));
+
+                std::vector<double> answer = image_pre_cti;
+                add_cti(answer.data(), n_rows, n_columns, n_columns, 1, model);
+                std::vector<double> image = image_pre_cti;
+                add_cti(image.data(), n_rows, n_columns, n_columns, 1, model_checkpoints);
+                REQUIRE(image == answer);
+                REQUIRE(model_checkpoints.parallel.n_rows_reused == 0);
+
+                // Unchanged columns reused in full, the others from the last
+                // checkpoint before the change
+                std::vector<double> image_changed = image_pre_cti;
+                image_changed[25 * n_columns + 1] += 10.0;
+                image_changed[17 * n_columns + 2] += 10.0;
+                answer = image_changed;
+                add_cti(answer.data(), n_rows, n_columns, n_columns, 1, model);
+                image = image_changed;
+                add_cti(image.data(), n_rows, n_columns, n_columns, 1, model_checkpoints);
+                REQUIRE(image == answer);
+                int n_active_rows = n_rows - window_start;
+                REQUIRE(
+                    model_checkpoints.parallel.n_rows_reused ==
+                    (n_columns - 2) * n_active_rows +
+                        (25 - window_start) / 4 * 4 + (17 - window_start) / 4 * 4);
+
+                // Removing CTI, with the checkpoints kept between iterations
+                answer = image;
+                remove_cti(answer.data(), n_rows, n_columns, n_columns, 1, 4, model);
+                remove_cti(image.data(), n_rows, n_columns, n_columns, 1, 4, model_checkpoints);
+                REQUIRE(image == answer);
+                REQUIRE(model_checkpoints.parallel.n_rows_reused > 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("Test regions of interest", "[model]") {
+    set_verbosity(0);
+
+    std::valarray<double> dwell_times = {1.0};
+    std::valarray<TrapInstantCapture> traps_ic = {TrapInstantCapture(1.0, 2.0)};
+    std::valarray<TrapSlowCapture> traps_sc = {TrapSlowCapture(0.5, 1.0, 0.2)};
+    ROE roe(dwell_times, 0, -1, true, false, true, false);
+    CCD ccd(CCDPhase(1e4, 0.0, 1.0));
+    int n_rows = 40;
+    int n_columns = 30;
+
+    // Bright pixels scattered across the image
+    std::vector<double> image_pre_cti(n_rows * n_columns, 0.0);
+    for (int i_pixel = 0; i_pixel < n_rows * n_columns; i_pixel += 37)
+        image_pre_cti[i_pixel] = 1e3;
+
+    std::vector<RegionOfInterest> regions = {
+        RegionOfInterest(30, 36, 20, 26), RegionOfInterest(5, 12, 3, 9),
+        RegionOfInterest(32, 40, 24, 30), RegionOfInterest(0, 40, 0, 1)};
+
+    CTIModel model(
+        ClockingModel(&roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, 0, 3, 2, 38),
+        ClockingModel(&roe, &ccd, &traps_ic, nullptr, nullptr, nullptr, 0, 1, 1));
+
+    SECTION("Trail length") {
+        // exp(-n_transfers / 2) <= 1e-3 for 2 ln(1e3) = 13.8 transfers
+        REQUIRE(model.parallel.trail_length(1e-3, n_rows) == 14);
+        REQUIRE(model.parallel.trail_length(1e-3, 10) == 10);
+        REQUIRE(model.serial.trail_length(0.5, n_columns) == 2);
+        REQUIRE(CTIModel().parallel.trail_length(1e-3, n_rows) == 0);
+    }
+
+    SECTION("Same as the whole image with the full trails") {
+        std::vector<double> answer_add = image_pre_cti;
+        add_cti(answer_add.data(), n_rows, n_columns, n_columns, 1, model);
+        std::vector<double> answer_remove = image_pre_cti;
+        remove_cti(answer_remove.data(), n_rows, n_columns, n_columns, 1, 3, model);
+
+        std::vector<double> image_add = image_pre_cti;
+        add_cti_regions(
+            image_add.data(), n_rows, n_columns, n_columns, 1, regions, model, 0.0,
+            n_rows, n_columns);
+        std::vector<double> image_remove = image_pre_cti;
+        remove_cti_regions(
+            image_remove.data(), n_rows, n_columns, n_columns, 1, 3, regions, model,
+            0.0, n_rows, n_columns);
+
+        // Only the pixels in the regions are modified
+        for (int row_index = 0; row_index < n_rows; row_index++) {
+            for (int column_index = 0; column_index < n_columns; column_index++) {
+                int i_pixel = row_index * n_columns + column_index;
+                bool in_region = false;
+                for (RegionOfInterest& region : regions) {
+                    if ((row_index >= region.row_start) &&
+                        (row_index < region.row_stop) &&
+                        (column_index >= region.column_start) &&
+                        (column_index < region.column_stop))
+                        in_region = true;
+                }
+                if (in_region) {
+                    REQUIRE(image_add[i_pixel] == Approx(answer_add[i_pixel]));
+                    REQUIRE(image_remove[i_pixel] == Approx(answer_remove[i_pixel]));
+                } else {
+                    REQUIRE(image_add[i_pixel] == image_pre_cti[i_pixel]);
+                    REQUIRE(image_remove[i_pixel] == image_pre_cti[i_pixel]);
+                }
+            }
+        }
+    }
+
+    SECTION("Close to the whole image with truncated trails") {
+        std::vector<double> answer = image_pre_cti;
+        add_cti(answer.data(), n_rows, n_columns, n_columns, 1, model);
+
+        std::vector<double> image = image_pre_cti;
+        add_cti_regions(
+            image.data(), n_rows, n_columns, n_columns, 1, regions, model, 1e-4);
+        for (RegionOfInterest& region : regions) {
+            for (int row_index = region.row_start; row_index < region.row_stop;
+                 row_index++) {
+                for (int column_index = region.column_start;
+                     column_index < region.column_stop; column_index++) {
+                    int i_pixel = row_index * n_columns + column_index;
+                    REQUIRE(image[i_pixel] == Approx(answer[i_pixel]).margin(0.1));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Test streaming, same results as the whole image", "[model]") {
+    set_verbosity(0);
+
+    std::valarray<double> dwell_times = {1.0};
+    std::valarray<TrapInstantCapture> traps_ic = {TrapInstantCapture(0.5, 1.5)};
+    std::valarray<TrapSlowCapture> traps_sc = {TrapSlowCapture(0.3, 3.0, 0.2)};
+    ROE roe(dwell_times, 0, -1, true, false, true, false);
+    ROE roe_empty_first(dwell_times, 0, -1, true, true, true, false);
+    CCD ccd(CCDPhase(1e4, 0.0, 1.0));
+    int n_rows = 37;
+    int n_columns = 6;
+
+    // Bright pixels scattered across the image
+    std::vector<double> image_pre_cti(n_rows * n_columns, 0.0);
+    for (int i_pixel = 0; i_pixel < n_rows * n_columns; i_pixel += 11)
+        image_pre_cti[i_pixel] = 1e3 + i_pixel;
+
+    for (ROE* model_roe : {&roe, &roe_empty_first}) {
+        for (int express : {0, 1, 4}) {
+            for (int window_start : {0, 5}) {
+                CTIModel model(
+                    ClockingModel(
+                        model_roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr,
+                        express, 2, window_start, 33),
+                    ClockingModel(
+                        &roe, &ccd, &traps_ic, nullptr, nullptr, nullptr, 0, 1, 1));
+
+                std::vector<double> answer = image_pre_cti;
+                add_cti(answer.data(), n_rows, n_columns, n_columns, 1, model);
+
+                for (int n_rows_per_chunk : {1, 4, 10, 50}) {
+                    // Read from and write to separate images, in order
+                    std::vector<double> image(n_rows * n_columns, 0.0);
+                    int next_row = 0;
+                    add_cti_streaming(
+                        [&](double* rows, int row_start, int n_chunk_rows) {
+                            REQUIRE(row_start == next_row);
+                            std::copy(
+                                image_pre_cti.begin() + row_start * n_columns,
+                                image_pre_cti.begin() +
+                                    (row_start + n_chunk_rows) * n_columns,
+                                rows);
+                        },
+                        [&](const double* rows, int row_start, int n_chunk_rows) {
+                            REQUIRE(row_start == next_row);
+                            std::copy(
+                                rows, rows + n_chunk_rows * n_columns,
+                                image.begin() + row_start * n_columns);
+                            next_row += n_chunk_rows;
+                        },
+                        n_rows, n_columns, n_rows_per_chunk, model);
+
+                    REQUIRE(next_row == n_rows);
+                    REQUIRE(image == answer);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Test trap density sweep, same results as separate models", "[model]") {
+    set_verbosity(0);
+
+    int n_rows = 17;
+    int n_columns = 13;
+    int n_models = 4;
+    std::vector<double> image_pre_cti(n_rows * n_columns, 0.0);
+    for (int i_pixel = 0; i_pixel < n_rows * n_columns; i_pixel += 5)
+        image_pre_cti[i_pixel] = (i_pixel % 7 + 1) * 100.0;
+
+    // Instant-capture (including non-uniform) then slow-capture densities
+    std::vector<double> parallel_densities(n_models * 3);
+    std::vector<double> serial_densities(n_models * 1);
+    for (int i_model = 0; i_model < n_models; i_model++) {
+        parallel_densities[i_model * 3 + 0] = 1.0 + i_model;
+        parallel_densities[i_model * 3 + 1] = 2.0 + 0.5 * i_model;
+        parallel_densities[i_model * 3 + 2] = 3.0 - 0.5 * i_model;
+        serial_densities[i_model] = 0.5 + 2.0 * i_model;
+    }
+
+    // Single-phase pixels, and multiple phases and clock-sequence steps
+    for (int n_phases : {1, 3}) {
+        std::valarray<double> dwell_times(1.0 / n_phases, n_phases);
+        ROE roe(dwell_times, 0, -1, true, false, true, false);
+        std::valarray<CCDPhase> phases(CCDPhase(1e3, 0.0, 1.0), n_phases);
+        std::valarray<double> fraction_of_traps_per_phase(1.0 / n_phases, n_phases);
+        CCD ccd(phases, fraction_of_traps_per_phase);
+
+        for (int express : {0, 3}) {
+            // Separate models with each set of densities
+            std::vector<std::vector<double> > answers(n_models, image_pre_cti);
+            for (int i_model = 0; i_model < n_models; i_model++) {
+                std::valarray<TrapInstantCapture> traps_ic = {
+                    TrapInstantCapture(parallel_densities[i_model * 3 + 0], 1.5),
+                    TrapInstantCapture(
+                        parallel_densities[i_model * 3 + 1], 4.0, 0.2, 0.8)};
+                std::valarray<TrapSlowCapture> traps_sc = {
+                    TrapSlowCapture(parallel_densities[i_model * 3 + 2], 3.0, 0.2)};
+                std::valarray<TrapInstantCapture> serial_traps_ic = {
+                    TrapInstantCapture(serial_densities[i_model], 2.0)};
+                CTIModel model(
+                    ClockingModel(
+                        &roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, express,
+                        0, 1, 15),
+                    ClockingModel(
+                        &roe, &ccd, &serial_traps_ic, nullptr, nullptr, nullptr,
+                        express, 0, 2, 12));
+                add_cti(
+                    answers[i_model].data(), n_rows, n_columns, n_columns, 1, model);
+            }
+
+            // All together, with other densities in the base model
+            std::valarray<TrapInstantCapture> traps_ic = {
+                TrapInstantCapture(9.0, 1.5), TrapInstantCapture(9.0, 4.0, 0.2, 0.8)};
+            std::valarray<TrapSlowCapture> traps_sc = {TrapSlowCapture(9.0, 3.0, 0.2)};
+            std::valarray<TrapInstantCapture> serial_traps_ic = {
+                TrapInstantCapture(9.0, 2.0)};
+            CTIModel model(
+                ClockingModel(
+                    &roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, express, 0, 1,
+                    15),
+                ClockingModel(
+                    &roe, &ccd, &serial_traps_ic, nullptr, nullptr, nullptr, express,
+                    0, 2, 12));
+
+            // Twice, to reuse the prepared model
+            for (int repeat = 0; repeat < 2; repeat++) {
+                std::vector<std::vector<double> > images(n_models, image_pre_cti);
+                std::vector<double*> image_pointers(n_models);
+                for (int i_model = 0; i_model < n_models; i_model++)
+                    image_pointers[i_model] = images[i_model].data();
+                add_cti_density_sweep(
+                    image_pointers.data(), n_models, n_rows, n_columns, n_columns, 1,
+                    model, parallel_densities.data(), serial_densities.data());
+
+                for (int i_model = 0; i_model < n_models; i_model++)
+                    REQUIRE(images[i_model] == answers[i_model]);
+            }
+        }
+    }
+}
@@ -0,0 +1,121 @@
+
+#ifdef ARCTIC_MPI
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <valarray>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "ccd.hpp"
+#include "cti.hpp"
+#include "model.hpp"
+#include "mpi_cti.hpp"
+#include "roe.hpp"
+#include "traps.hpp"
+#include "util.hpp"
+
+TEST_CASE("Test MPI blocks", "[mpi]") {
+    std::vector<int> block_starts = mpi_block_starts(10, 4);
+    REQUIRE(block_starts == std::vector<int>({0, 2, 5, 7, 10}));
+
+    block_starts = mpi_block_starts(2, 3);
+    REQUIRE(block_starts == std::vector<int>({0, 0, 1, 2}));
+}
+
+TEST_CASE("Test add and remove CTI with MPI, same results", "[mpi]") {
+    set_verbosity(0);
+
+    // Run with any number of ranks, e.g. mpirun -n 3 ./test_arctic [mpi]
+    int is_initialised;
+    MPI_Initialized(&is_initialised);
+    if (!is_initialised) {
+        MPI_Init(nullptr, nullptr);
+        atexit([] { MPI_Finalize(); });
+    }
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    std::valarray<double> dwell_times = {1.0};
+    std::valarray<TrapInstantCapture> traps_ic = {TrapInstantCapture(10.0, 1.5)};
+    std::valarray<TrapSlowCapture> traps_sc = {TrapSlowCapture(5.0, 3.0, 0.2)};
+    ROE roe(dwell_times, 0, -1, true, false, true, false);
+    CCD ccd(CCDPhase(1e3, 0.0, 1.0));
+    int n_rows = 12;
+    int n_columns = 11;
+    int n_images = 2;
+
+    std::vector<std::vector<double> > images_pre_cti(
+        n_images, std::vector<double>(n_rows * n_columns));
+    for (int i_image = 0; i_image < n_images; i_image++) {
+        for (int i_pixel = 0; i_pixel < n_rows * n_columns; i_pixel++) {
+            images_pre_cti[i_image][i_pixel] =
+                (i_pixel * (i_image + 3) + 7 * i_image) % 19 * 10.0;
+        }
+    }
+
+    // Parallel only, serial only, and both, with windows
+    for (int directions = 1; directions <= 3; directions++) {
+        CTIModel model(
+            ClockingModel(
+                &roe, &ccd, (directions & 1) ? &traps_ic : nullptr,
+                (directions & 1) ? &traps_sc : nullptr, nullptr, nullptr, 3, 0, 1, 10),
+            ClockingModel(
+                &roe, &ccd, (directions & 2) ? &traps_ic : nullptr, nullptr, nullptr,
+                nullptr, 3, 0, 2, 9));
+
+        // The same results without MPI
+        std::vector<std::vector<double> > answers_add = images_pre_cti;
+        std::vector<std::vector<double> > answers_remove = images_pre_cti;
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            add_cti(answers_add[i_image].data(), n_rows, n_columns, n_columns, 1, model);
+            remove_cti(
+                answers_remove[i_image].data(), n_rows, n_columns, n_columns, 1, 3,
+                model);
+        }
+
+        // Column-major images
+        std::vector<std::vector<double> > images_add(
+            n_images, std::vector<double>(n_rows * n_columns));
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            for (int row_index = 0; row_index < n_rows; row_index++) {
+                for (int column_index = 0; column_index < n_columns; column_index++)
+                    images_add[i_image][column_index * n_rows + row_index] =
+                        images_pre_cti[i_image][row_index * n_columns + column_index];
+            }
+        }
+        std::vector<std::vector<double> > images_remove = images_add;
+        std::vector<double*> image_pointers_add(n_images);
+        std::vector<double*> image_pointers_remove(n_images);
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            image_pointers_add[i_image] = images_add[i_image].data();
+            image_pointers_remove[i_image] = images_remove[i_image].data();
+        }
+
+        add_cti_batch_mpi(
+            image_pointers_add.data(), n_images, n_rows, n_columns, 1, n_rows, model);
+        remove_cti_batch_mpi(
+            image_pointers_remove.data(), n_images, n_rows, n_columns, 1, n_rows, 3,
+            model);
+
+        if (rank != 0) continue;
+        for (int i_image = 0; i_image < n_images; i_image++) {
+            for (int row_index = 0; row_index < n_rows; row_index++) {
+                for (int column_index = 0; column_index < n_columns; column_index++) {
+                    int i_pixel = row_index * n_columns + column_index;
+                    int i_pixel_T = column_index * n_rows + row_index;
+                    REQUIRE(
+                        images_add[i_image][i_pixel_T] ==
+                        Approx(answers_add[i_image][i_pixel]));
+                    REQUIRE(
+                        images_remove[i_image][i_pixel_T] ==
+                        Approx(answers_remove[i_image][i_pixel]));
+                }
+            }
+        }
+    }
+}
+
+#endif  // ARCTIC_MPI
@@ -0,0 +1,190 @@
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <valarray>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "ccd.hpp"
+#include "model.hpp"
+#include "pixel_bounce.hpp"
+#include "roe.hpp"
+#include "traps.hpp"
+#include "util.hpp"
+
+/*
+    Pixel bounce as modelled by PixelBounce.perturb_bias() and add_pixel_bounce()
+    in pixel_bounce.py, one row at a time.
+*/
+std::vector<double> reference_add_pixel_bounce(
+    const std::vector<double>& image, int n_rows, int n_columns,
+    const std::vector<PixelBounce>& pixel_bounces, int row_start, int row_stop,
+    int column_start, int column_stop) {
+    std::vector<double> bias_total(n_rows * n_columns, 0.0);
+    for (const PixelBounce& pixel_bounce : pixel_bounces) {
+        double coeff_A = 2 * exp(-1 * pixel_bounce.gamma) * cos(pixel_bounce.omega);
+        double coeff_B = exp(-2 * pixel_bounce.gamma);
+        for (int row = row_start; row < row_stop; row++) {
+            std::vector<double> bias(n_columns, 0.0);
+            double biasm1 = 0.0;
+            for (int column = column_start + 1; column < column_stop; column++) {
+                double biasm2 = biasm1;
+                biasm1 = bias[column - 1];
+                double delta =
+                    image[row * n_columns + column] - image[row * n_columns + column - 1];
+                biasm1 += (pixel_bounce.kA - pixel_bounce.kv) * delta;
+                biasm2 += (pixel_bounce.kA - 2 * pixel_bounce.kv) * delta;
+                bias[column] = coeff_A * biasm1 - coeff_B * biasm2;
+            }
+            for (int column = 0; column < n_columns; column++)
+                bias_total[row * n_columns + column] += bias[column];
+        }
+    }
+
+    std::vector<double> image_bounced = image;
+    for (int i = 0; i < n_rows * n_columns; i++) image_bounced[i] -= bias_total[i];
+    return image_bounced;
+}
+
+TEST_CASE("Test add pixel bounce", "[pixel_bounce]") {
+    set_verbosity(0);
+
+    int n_rows = 13;
+    int n_columns = 17;
+    std::vector<double> image(n_rows * n_columns, 0.0);
+    for (int row = 0; row < n_rows; row++) {
+        for (int column = 3 + row % 4; column < 9; column++)
+            image[row * n_columns + column] = 1e3 + 10.0 * row;
+    }
+    std::vector<PixelBounce> pixel_bounces = {
+        PixelBounce(0.01, 0.02, 0.3, 0.8), PixelBounce(-0.005, 0.001, 1.2, 2.0)};
+
+    SECTION("Same as python version") {
+        for (int row_start : {0, 2}) {
+            for (int column_start : {0, 4}) {
+                int row_stop = n_rows - row_start;
+                int column_stop = n_columns - column_start / 2;
+                std::vector<double> answer = reference_add_pixel_bounce(
+                    image, n_rows, n_columns, pixel_bounces, row_start, row_stop,
+                    column_start, column_stop);
+
+                std::vector<double> image_bounced = image;
+                double* image_pointer = image_bounced.data();
+                add_pixel_bounce(
+                    &image_pointer, 1, n_columns, 1, row_start, row_stop, column_start,
+                    column_stop, pixel_bounces);
+
+                for (int i = 0; i < n_rows * n_columns; i++)
+                    REQUIRE(image_bounced[i] == Approx(answer[i]).epsilon(1e-12));
+            }
+        }
+    }
+
+    SECTION("Transposed and float images") {
+        std::vector<double> answer = reference_add_pixel_bounce(
+            image, n_rows, n_columns, pixel_bounces, 0, n_rows, 0, n_columns);
+
+        // Column-major
+        std::vector<double> image_transposed(n_rows * n_columns);
+        for (int row = 0; row < n_rows; row++) {
+            for (int column = 0; column < n_columns; column++)
+                image_transposed[column * n_rows + row] = image[row * n_columns + column];
+        }
+        double* image_pointer = image_transposed.data();
+        add_pixel_bounce(
+            &image_pointer, 1, 1, n_rows, 0, n_rows, 0, n_columns, pixel_bounces);
+
+        std::vector<float> image_float(image.begin(), image.end());
+        float* image_float_pointer = image_float.data();
+        add_pixel_bounce(
+            &image_float_pointer, 1, n_columns, 1, 0, n_rows, 0, n_columns,
+            pixel_bounces);
+
+        for (int row = 0; row < n_rows; row++) {
+            for (int column = 0; column < n_columns; column++) {
+                REQUIRE(
+                    image_transposed[column * n_rows + row] ==
+                    Approx(answer[row * n_columns + column]).epsilon(1e-12));
+                REQUIRE(
+                    image_float[row * n_columns + column] ==
+                    Approx(answer[row * n_columns + column]).epsilon(1e-5));
+            }
+        }
+    }
+
+    SECTION("No bounce without changes") {
+        std::vector<double> image_flat(n_rows * n_columns, 100.0);
+        double* image_pointer = image_flat.data();
+        add_pixel_bounce(
+            &image_pointer, 1, n_columns, 1, 0, n_rows, 0, n_columns, pixel_bounces);
+        for (int i = 0; i < n_rows * n_columns; i++) REQUIRE(image_flat[i] == 100.0);
+    }
+}
+
+TEST_CASE("Test add CTI with pixel bounce", "[pixel_bounce]") {
+    set_verbosity(0);
+
+    std::valarray<double> dwell_times = {1.0};
+    std::valarray<TrapInstantCapture> traps_ic = {TrapInstantCapture(1.0, 1.5)};
+    std::valarray<TrapSlowCapture> traps_sc = {TrapSlowCapture(0.5, 3.0, 0.2)};
+    ROE roe(dwell_times, 0, -1, true, false, true, false);
+    CCD ccd(CCDPhase(1e4, 0.0, 1.0));
+    int n_rows = 21;
+    int n_columns = 15;
+    std::vector<double> image_pre_cti(n_rows * n_columns, 0.0);
+    for (int i_pixel = 0; i_pixel < n_rows * n_columns; i_pixel += 7)
+        image_pre_cti[i_pixel] = 1e3 + i_pixel;
+    std::vector<PixelBounce> pixel_bounces = {PixelBounce(0.01, 0.02, 0.3, 0.8)};
+
+    // The serial clocking, with bounce added to each row as it is clocked or
+    // with checkpoints afterwards, or pixel bounce alone
+    for (int serial_checkpoint_interval : {0, 4}) {
+        for (bool use_serial : {true, false}) {
+            ClockingModel parallel(
+                &roe, &ccd, &traps_ic, &traps_sc, nullptr, nullptr, 0, 0, 2, 19);
+            ClockingModel serial(
+                use_serial ? &roe : nullptr, use_serial ? &ccd : nullptr,
+                use_serial ? &traps_ic : nullptr, nullptr, nullptr, nullptr, 0, 0, 1,
+                14, 0, -1, 1e-10, 20, serial_checkpoint_interval);
+            CTIModel model(parallel, serial);
+            CTIModel model_bounce(
+                parallel, serial, 1, column_schedule_static, pixel_bounces);
+
+            // Separate pixel bounce after CTI
+            std::vector<double> answer = image_pre_cti;
+            add_cti(answer.data(), n_rows, n_columns, n_columns, 1, model);
+            double* answer_pointer = answer.data();
+            add_pixel_bounce(
+                &answer_pointer, 1, n_columns, 1, 2, 19, 1, 14, pixel_bounces);
+
+            // Twice, to also reuse any checkpoints
+            for (int repeat = 0; repeat < 2; repeat++) {
+                std::vector<double> image = image_pre_cti;
+                add_cti(image.data(), n_rows, n_columns, n_columns, 1, model_bounce);
+
+                for (int i = 0; i < n_rows * n_columns; i++)
+                    REQUIRE(image[i] == answer[i]);
+            }
+
+            // Streaming
+            std::vector<double> image(n_rows * n_columns, 0.0);
+            add_cti_streaming(
+                [&](double* rows, int row_start, int n_chunk_rows) {
+                    std::copy(
+                        image_pre_cti.begin() + row_start * n_columns,
+                        image_pre_cti.begin() + (row_start + n_chunk_rows) * n_columns,
+                        rows);
+                },
+                [&](const double* rows, int row_start, int n_chunk_rows) {
+                    std::copy(
+                        rows, rows + n_chunk_rows * n_columns,
+                        image.begin() + row_start * n_columns);
+                },
+                n_rows, n_columns, 5, model_bounce);
+            for (int i = 0; i < n_rows * n_columns; i++)
+                REQUIRE(image[i] == Approx(answer[i]).margin(1e-9));
+        }
+    }
+}
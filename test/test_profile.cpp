@@ -0,0 +1,132 @@
+#include <stdio.h>
+
+#include <valarray>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "ccd.hpp"
+#include "cti.hpp"
+#include "profile.hpp"
+#include "roe.hpp"
+#include "trap_managers.hpp"
+#include "traps.hpp"
+#include "util.hpp"
+
+TEST_CASE("Test profiling add CTI", "[profile]") {
+    set_verbosity(0);
+
+    std::valarray<double> dwell_times = {1.0};
+    std::valarray<TrapInstantCapture> traps_ic = {TrapInstantCapture(10.0, 1.5)};
+    std::valarray<TrapSlowCapture> traps_sc = {TrapSlowCapture(5.0, 3.0, 0.2)};
+    ROE roe(dwell_times, 0, -1, true, false, true, false);
+    CCD ccd(CCDPhase(1e3, 0.0, 1.0));
+    int express = 3;
+    int n_rows = 12;
+    int n_columns = 11;
+    std::vector<double> image_pre_cti(n_rows * n_columns);
+    for (int i_pixel = 0; i_pixel < n_rows * n_columns; i_pixel++)
+        image_pre_cti[i_pixel] = (i_pixel * 7) % 19 * 10.0;
+
+    std::vector<double> answer = image_pre_cti;
+    add_cti(
+        answer.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+        &traps_sc, nullptr, nullptr, express, 0, 0, -1, 0, -1, 1e-10, 4, &roe, &ccd,
+        &traps_ic, nullptr, nullptr, nullptr, express, 0, 0, -1, 0, -1);
+
+    SECTION("Nothing recorded unless profiling") {
+        reset_profile();
+        std::vector<double> image = image_pre_cti;
+        add_cti(
+            image.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+            &traps_sc, nullptr, nullptr, express);
+        REQUIRE(get_profile().clockings.size() == 0);
+    }
+
+    SECTION("Parallel and serial profiles, same result") {
+        set_profiling(1);
+        reset_profile();
+        std::vector<double> image = image_pre_cti;
+        add_cti(
+            image.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+            &traps_sc, nullptr, nullptr, express, 0, 0, -1, 0, -1, 1e-10, 4, &roe,
+            &ccd, &traps_ic, nullptr, nullptr, nullptr, express, 0, 0, -1, 0, -1);
+        set_profiling(0);
+        REQUIRE_THAT(image, Catch::Approx(answer));
+
+        CTIProfile profile = get_profile();
+        REQUIRE(profile.clockings.size() == 2);
+        ClockingProfile& parallel = profile.clockings[0];
+        ClockingProfile& serial = profile.clockings[1];
+
+        // The clocked columns, with the rows and columns swapped for serial
+        REQUIRE(parallel.transfer_axis == transfer_axis_parallel);
+        REQUIRE(serial.transfer_axis == transfer_axis_serial);
+        REQUIRE(parallel.n_active_rows == n_rows);
+        REQUIRE(parallel.n_active_columns == n_columns);
+        REQUIRE(serial.n_active_rows == n_columns);
+        REQUIRE(serial.n_active_columns == n_rows);
+        int n_thread_columns = 0;
+        for (int n : parallel.thread_n_columns) n_thread_columns += n;
+        REQUIRE(n_thread_columns == n_columns);
+        REQUIRE(parallel.thread_times.size() == parallel.thread_n_columns.size());
+        REQUIRE(parallel.wall_time > 0.0);
+
+        // One restore per express pass of each column
+        REQUIRE(parallel.n_express_passes == express);
+        REQUIRE(parallel.n_express_passes_clocked == express * n_columns);
+        REQUIRE(parallel.n_restores == parallel.n_express_passes_clocked);
+        REQUIRE(parallel.n_stores >= n_columns);
+
+        // Watermarks for each phase of each family present
+        REQUIRE(parallel.n_watermarks_ic.size() == 1);
+        REQUIRE(parallel.n_watermarks_sc.size() == 1);
+        REQUIRE(parallel.n_watermarks_ic_co.size() == 0);
+        REQUIRE(serial.n_watermarks_sc.size() == 0);
+        REQUIRE(parallel.max_n_active_watermarks_ic[0] > 0);
+        REQUIRE(
+            parallel.max_n_active_watermarks_ic[0] <= parallel.n_watermarks_ic[0]);
+        REQUIRE(
+            parallel.max_n_active_watermarks_sc[0] <= parallel.n_watermarks_sc[0]);
+
+        // Pruned every 4 rows
+        REQUIRE(parallel.n_prunes > 0);
+        REQUIRE(serial.n_prunes == 0);
+
+        // Accumulated until reset
+        add_cti(
+            image.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+            &traps_sc, nullptr, nullptr, express);
+        REQUIRE(get_profile().clockings.size() == 2);
+        set_profiling(1);
+        add_cti(
+            image.data(), n_rows, n_columns, n_columns, 1, &roe, &ccd, &traps_ic,
+            &traps_sc, nullptr, nullptr, express);
+        set_profiling(0);
+        REQUIRE(get_profile().clockings.size() == 3);
+        reset_profile();
+        REQUIRE(get_profile().clockings.size() == 0);
+    }
+
+    SECTION("Remove CTI, workspaces only copied in the first iteration") {
+        int n_iterations = 3;
+        set_profiling(1);
+        reset_profile();
+        std::vector<double> image = answer;
+        remove_cti(
+            image.data(), n_rows, n_columns, n_columns, 1, n_iterations, &roe, &ccd,
+            &traps_ic, &traps_sc, nullptr, nullptr, express, 0, 0, -1, 0, -1, 1e-10,
+            4, &roe, &ccd, &traps_ic, nullptr, nullptr, nullptr, express, 0, 0, -1, 0,
+            -1);
+        set_profiling(0);
+
+        // Parallel then serial for each iteration, with the same trap managers
+        CTIProfile profile = get_profile();
+        REQUIRE(profile.clockings.size() == 2 * n_iterations);
+        for (int i_clocking = 0; i_clocking < 2 * n_iterations; i_clocking++) {
+            if (i_clocking < 2)
+                REQUIRE(profile.clockings[i_clocking].n_workspace_copies > 0);
+            else
+                REQUIRE(profile.clockings[i_clocking].n_workspace_copies == 0);
+        }
+    }
+}
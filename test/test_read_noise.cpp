@@ -0,0 +1,334 @@
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <valarray>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "ccd.hpp"
+#include "model.hpp"
+#include "read_noise.hpp"
+#include "roe.hpp"
+#include "traps.hpp"
+#include "util.hpp"
+
+/*
+    A direct per-pixel version of the S+R read noise model, with a separate
+    difference image, to test the single-pass version against.
+*/
+std::vector<double> reference_read_noise_model(
+    const std::vector<double>& image_in, const std::vector<double>& image_out,
+    int rows, int cols, double amp, double fraction, int smooth_col) {
+    double mod_clip = amp * fraction;
+    double amp_2 = amp * amp;
+    std::vector<double> dval0(rows * cols);
+    for (int i = 0; i < rows * cols; i++) dval0[i] = image_in[i] - image_out[i];
+
+    std::vector<double> output(rows * cols);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            int idx = i * cols + j;
+            double dval9 = dval0[idx];
+            int n_pixels = 1;
+            int neighbours[8][2] = {{1, 1},  {1, 0},  {1, -1},  {0, 1},
+                                    {0, -1}, {-1, 1}, {-1, 0}, {-1, -1}};
+            for (int k = 0; k < 8; k++) {
+                int ii = i + neighbours[k][0];
+                int jj = j + neighbours[k][1];
+                if ((ii < 0) || (ii >= rows) || (jj < 0) || (jj >= cols)) continue;
+                dval9 += dval0[ii * cols + jj];
+                n_pixels++;
+            }
+            dval9 /= n_pixels;
+
+            double mods[4] = {
+                (i > 0) ? image_out[idx - cols] - image_out[idx] : 0.0,
+                (i < rows - 1) ? image_out[idx + cols] - image_out[idx] : 0.0,
+                (j > 0) ? image_out[idx - 1] - image_out[idx] : 0.0,
+                (j < cols - 1) ? image_out[idx + 1] - image_out[idx] : 0.0};
+
+            double model = fmin(1.0, fmax(-1.0, dval0[idx])) * dval0[idx] *
+                           dval0[idx] / (dval0[idx] * dval0[idx] + 4.0 * amp_2);
+            model += fmax(fmin(dval9, mod_clip), -mod_clip) * dval9 * dval9 /
+                     (dval9 * dval9 + 18.0 * amp_2);
+            int n_mods = smooth_col ? 4 : 2;
+            for (int k = 0; k < n_mods; k++)
+                model += fmax(fmin(mods[k], mod_clip), -mod_clip) * 4 * amp_2 /
+                         (mods[k] * mods[k] + 4.0 * amp_2);
+            output[idx] = model / (smooth_col ? 6.0 : 4.0);
+        }
+    }
+
+    return output;
+}
+
+/*
+    A noisy test image, with some pixels below the rms threshold.
+*/
+std::vector<double> test_read_noise_image(int rows, int cols) {
+    std::vector<double> image(rows * cols);
+    for (int i = 0; i < rows * cols; i++)
+        image[i] = 20.0 + 5.0 * sin(1.3 * i) + ((i * 7) % 11) - ((i % 13 == 0) ? 30.0 : 0.0);
+    return image;
+}
+
+TEST_CASE("Test determine read noise model", "[read_noise]") {
+    set_verbosity(0);
+
+    double amp = 4.0;
+    double fraction = 0.2;
+
+    SECTION("Same as reference, various shapes") {
+        int shapes[6][2] = {{1, 1}, {1, 7}, {7, 1}, {2, 2}, {3, 5}, {17, 23}};
+        for (int i_shape = 0; i_shape < 6; i_shape++) {
+            int rows = shapes[i_shape][0];
+            int cols = shapes[i_shape][1];
+            std::vector<double> image_in = test_read_noise_image(rows, cols);
+            std::vector<double> image_out(rows * cols);
+            for (int i = 0; i < rows * cols; i++)
+                image_out[i] = image_in[i] - 3.0 * cos(0.7 * i);
+
+            for (int smooth_col = 0; smooth_col < 2; smooth_col++) {
+                std::vector<double> answer = reference_read_noise_model(
+                    image_in, image_out, rows, cols, amp, fraction, smooth_col);
+                std::vector<double> output(rows * cols, -1.0);
+                determine_read_noise_model(
+                    image_in.data(), image_out.data(), rows, cols, amp, fraction,
+                    smooth_col, output.data());
+
+                for (int i = 0; i < rows * cols; i++)
+                    REQUIRE(output[i] == Approx(answer[i]).epsilon(1e-12));
+            }
+        }
+    }
+}
+
+TEST_CASE("Test generate S+R frames", "[read_noise]") {
+    set_verbosity(0);
+
+    int rows = 20;
+    int cols = 15;
+    double amp = 4.0;
+    double fraction = 0.2;
+    double out_scale = 1.0;
+    int n_iterations = 200;
+    std::vector<double> image_in = test_read_noise_image(rows, cols);
+
+    // The iteration from ReadNoise.generate_SR_frames_from_image()
+    std::vector<double> answer_out = image_in;
+    std::vector<double> answer_noise(rows * cols);
+    double answer_rms = 0.0;
+    int smoother = 1;
+    for (int iteration = 0; iteration < n_iterations; iteration++) {
+        double old_check = amp - answer_rms;
+        std::vector<double> adjustment = reference_read_noise_model(
+            image_in, answer_out, rows, cols, amp, fraction, 1);
+        double sum_squares = 0.0;
+        int n_rms = 0;
+        for (int i = 0; i < rows * cols; i++) {
+            if (amp - answer_rms > 0)
+                answer_out[i] += adjustment[i] * out_scale / smoother;
+            else
+                answer_out[i] -= adjustment[i] * out_scale / smoother;
+            answer_noise[i] = image_in[i] - answer_out[i];
+            if ((image_in[i] > 0.1) || (answer_out[i] > 0.1)) {
+                sum_squares += answer_noise[i] * answer_noise[i];
+                n_rms++;
+            }
+        }
+        answer_rms = sqrt(sum_squares / n_rms);
+        if ((amp - answer_rms) * old_check < 0) smoother++;
+        if (fabs(amp - answer_rms) < 0.0001) break;
+    }
+
+    SECTION("Same as reference, with and without scratch") {
+        std::vector<double> scratch(rows * cols);
+        for (int i_scratch = 0; i_scratch < 2; i_scratch++) {
+            std::vector<double> image_out(rows * cols);
+            std::vector<double> image_noise(rows * cols);
+            double rms = generate_sr_frames(
+                image_in.data(), rows, cols, amp, fraction, 1, out_scale, n_iterations,
+                image_out.data(), image_noise.data(),
+                (i_scratch == 0) ? nullptr : scratch.data());
+
+            REQUIRE(rms == Approx(answer_rms).epsilon(1e-9));
+            REQUIRE(fabs(rms - amp) < 0.0001);
+            for (int i = 0; i < rows * cols; i++) {
+                REQUIRE(image_out[i] == Approx(answer_out[i]).epsilon(1e-9));
+                REQUIRE(image_noise[i] == Approx(answer_noise[i]).margin(1e-9));
+                REQUIRE(image_out[i] + image_noise[i] == Approx(image_in[i]));
+            }
+        }
+    }
+}
+
+TEST_CASE("Test covariance matrix from image", "[read_noise]") {
+    set_verbosity(0);
+
+    int n_rows = 23;
+    int n_columns = 19;
+    std::vector<double> image = test_read_noise_image(n_rows, n_columns);
+
+    SECTION("Same as reference") {
+        int matrix_shapes[3][2] = {{5, 5}, {3, 3}, {3, 5}};
+        int borders[2][4] = {{5, 5, 0, 0}, {0, 2, 3, 1}};
+        for (int i_shape = 0; i_shape < 3; i_shape++) {
+            for (int i_border = 0; i_border < 2; i_border++) {
+                int matrix_n_rows = matrix_shapes[i_shape][0];
+                int matrix_n_columns = matrix_shapes[i_shape][1];
+                int* border = borders[i_border];
+                std::vector<double> covariance(matrix_n_rows * matrix_n_columns);
+                covariance_matrix_from_image(
+                    image.data(), n_rows, n_columns, matrix_n_rows, matrix_n_columns,
+                    border[0], border[1], border[2], border[3], covariance.data());
+
+                // The sub image and its pixels not rolled over, as by numpy
+                int sub_n_rows = n_rows - border[0] - border[2] - 1;
+                int sub_n_columns = n_columns - border[1] - border[3] - 1;
+                int middle_row = matrix_n_rows / 2;
+                int middle_column = matrix_n_columns / 2;
+                int start = std::max(middle_row, 1);
+                int stop = std::max(middle_column, 1);
+                for (int i = -middle_row; i <= middle_row; i++) {
+                    for (int j = -middle_column; j <= middle_column; j++) {
+                        std::vector<double> x, y;
+                        for (int row = start; row < sub_n_rows - stop; row++) {
+                            for (int column = start; column < sub_n_columns - stop;
+                                 column++) {
+                                int row_y = (row + j + sub_n_rows) % sub_n_rows;
+                                int column_y =
+                                    (column + i + sub_n_columns) % sub_n_columns;
+                                x.push_back(
+                                    image[(border[0] + row) * n_columns + border[1] +
+                                          column]);
+                                y.push_back(
+                                    image[(border[0] + row_y) * n_columns +
+                                          border[1] + column_y]);
+                            }
+                        }
+                        double mean_x = 0.0, mean_y = 0.0, answer = 0.0;
+                        for (unsigned int k = 0; k < x.size(); k++) {
+                            mean_x += x[k] / x.size();
+                            mean_y += y[k] / y.size();
+                        }
+                        for (unsigned int k = 0; k < x.size(); k++)
+                            answer += (x[k] - mean_x) * (y[k] - mean_y) / x.size();
+
+                        REQUIRE(
+                            covariance
+                                [(middle_row + i) * matrix_n_columns + middle_column +
+                                 j] == Approx(answer).epsilon(1e-9));
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("Checkerboard image") {
+        // Alternating pixels are perfectly anticorrelated with their neighbours
+        std::vector<double> image_checks(n_rows * n_columns);
+        for (int row = 0; row < n_rows; row++) {
+            for (int column = 0; column < n_columns; column++)
+                image_checks[row * n_columns + column] = ((row + column) % 2) ? 1.0 : -1.0;
+        }
+        std::vector<double> covariance(9);
+        covariance_matrix_from_image(
+            image_checks.data(), n_rows, n_columns, 3, 3, 2, 2, 0, 0,
+            covariance.data());
+        REQUIRE(covariance[4] == Approx(1.0).epsilon(1e-2));
+        REQUIRE(covariance[1] == Approx(-1.0).epsilon(1e-2));
+        REQUIRE(covariance[0] == Approx(1.0).epsilon(1e-2));
+    }
+}
+
+TEST_CASE("Test estimate residual covariances", "[read_noise]") {
+    set_verbosity(0);
+
+    std::valarray<double> dwell_times = {1.0};
+    std::valarray<TrapInstantCapture> traps_ic = {TrapInstantCapture(1.0, 2.0)};
+    ROE roe(dwell_times, 0, -1, true, false, true, false);
+    CCD ccd(CCDPhase(1e4, 0.0, 1.0));
+    CTIModel model(
+        ClockingModel(&roe, &ccd, &traps_ic),
+        ClockingModel(&roe, &ccd, &traps_ic));
+
+    int n_realisations = 2;
+    int n_rows = 16;
+    int n_columns = 14;
+    int n_pixels = n_rows * n_columns;
+    int matrix_size = 3;
+    int fpr_size = 2;
+    double amp = 4.0;
+    std::vector<double> sky_frames(n_realisations * n_pixels);
+    std::vector<double> noise_frames(n_realisations * n_pixels);
+    for (int i = 0; i < n_realisations * n_pixels; i++) {
+        sky_frames[i] = 200.0 + 20.0 * sin(2.1 * i);
+        noise_frames[i] = amp * cos(3.7 * i);
+    }
+    std::vector<double> sr_fractions = {0.0, 0.5, 1.0};
+    int n_sr_fractions = sr_fractions.size();
+
+    std::vector<double> covariances(n_sr_fractions * matrix_size * matrix_size);
+    std::vector<double> covariance_benchmark(matrix_size * matrix_size);
+    estimate_residual_covariances(
+        sky_frames.data(), noise_frames.data(), n_realisations, n_rows, n_columns,
+        model, amp, 0.2, 1, 1.0, 200, sr_fractions.data(), n_sr_fractions,
+        matrix_size, fpr_size, covariances.data(), covariance_benchmark.data());
+
+    SECTION("Same as each step separately") {
+        std::vector<double> answers(n_sr_fractions * matrix_size * matrix_size, 0.0);
+        std::vector<double> answer_benchmark(matrix_size * matrix_size, 0.0);
+        std::vector<double> covariance(matrix_size * matrix_size);
+        for (int i_real = 0; i_real < n_realisations; i_real++) {
+            std::vector<double> image(
+                sky_frames.begin() + i_real * n_pixels,
+                sky_frames.begin() + (i_real + 1) * n_pixels);
+            std::vector<double> image_clean = image;
+            add_cti(image.data(), n_rows, n_columns, n_columns, 1, model);
+            for (int i = 0; i < n_pixels; i++) {
+                image[i] += noise_frames[i_real * n_pixels + i];
+                image_clean[i] += noise_frames[i_real * n_pixels + i];
+            }
+
+            covariance_matrix_from_image(
+                image_clean.data(), n_rows, n_columns, matrix_size, matrix_size,
+                fpr_size, fpr_size, 0, 0, covariance.data());
+            for (int i = 0; i < matrix_size * matrix_size; i++)
+                answer_benchmark[i] += covariance[i] / n_realisations;
+
+            std::vector<double> s_frame(n_pixels), r_frame(n_pixels);
+            generate_sr_frames(
+                image.data(), n_rows, n_columns, amp, 0.2, 1, 1.0, 200,
+                s_frame.data(), r_frame.data());
+
+            for (int i_frac = 0; i_frac < n_sr_fractions; i_frac++) {
+                std::vector<double> image_corrected(n_pixels);
+                for (int i = 0; i < n_pixels; i++)
+                    image_corrected[i] =
+                        s_frame[i] + (1.0 - sr_fractions[i_frac]) * r_frame[i];
+                remove_cti(
+                    image_corrected.data(), n_rows, n_columns, n_columns, 1, 1, model);
+                for (int i = 0; i < n_pixels; i++)
+                    image_corrected[i] += sr_fractions[i_frac] * r_frame[i];
+
+                covariance_matrix_from_image(
+                    image_corrected.data(), n_rows, n_columns, matrix_size,
+                    matrix_size, fpr_size, fpr_size, 0, 0, covariance.data());
+                for (int i = 0; i < matrix_size * matrix_size; i++)
+                    answers[i_frac * matrix_size * matrix_size + i] +=
+                        covariance[i] / n_realisations;
+            }
+        }
+
+        for (int i = 0; i < matrix_size * matrix_size; i++)
+            REQUIRE(covariance_benchmark[i] == Approx(answer_benchmark[i]));
+        for (int i = 0; i < n_sr_fractions * matrix_size * matrix_size; i++)
+            REQUIRE(covariances[i] == Approx(answers[i]));
+    }
+
+    SECTION("Covariance depends on the fraction") {
+        REQUIRE(covariances[4] != Approx(covariances[2 * 9 + 4]));
+    }
+}
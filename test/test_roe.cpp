@@ -704,6 +704,87 @@ TEST_CASE("Test store trap states matrix", "[roe]") {
     }
 }
 
+TEST_CASE("Test express schedule", "[roe]") {
+    int n_rows = 12;
+    std::valarray<double> dwell_times = {1.0};
+    std::valarray<double> dwell_times_pump = {0.5, 0.5};
+    ROE roe_standard(dwell_times, 0, -1, true, false, true, false);
+    ROE roe_first_transfers(dwell_times, 0, -1, true, true, true, false);
+    ROE roe_integer(dwell_times, 2, 9, true, false, true, true);
+    ROEChargeInjection roe_charge_injection(dwell_times, 1, -1, true, true, true);
+    ROETrapPumping roe_trap_pumping(dwell_times_pump, 5, false, false);
+    std::vector<ROE*> roes = {
+        &roe_standard, &roe_first_transfers, &roe_integer, &roe_charge_injection,
+        &roe_trap_pumping};
+
+    SECTION("Same transfers as the express and store trap states matrices") {
+        for (ROE* roe : roes) {
+            for (int express : {0, 1, 3, 7}) {
+                for (int offset : {0, 4}) {
+                    roe->set_express_matrix_from_rows_and_express(n_rows, express, offset);
+                    roe->set_store_trap_states_matrix();
+                    std::valarray<double> express_matrix = roe->express_matrix;
+                    std::valarray<bool> store_trap_states_matrix =
+                        roe->store_trap_states_matrix;
+                    int n_columns = express_matrix.size() / roe->n_express_passes;
+                    roe->set_express_schedule();
+
+                    REQUIRE(roe->express_matrix.size() == 0);
+                    REQUIRE(
+                        roe->express_schedule_starts.size() ==
+                        roe->n_express_passes + 1);
+
+                    // Rebuild the matrices from the schedule
+                    std::valarray<double> test_express(0.0, express_matrix.size());
+                    std::valarray<bool> test_store(false, express_matrix.size());
+                    for (int express_index = 0; express_index < roe->n_express_passes;
+                         express_index++) {
+                        int row_previous = -1;
+                        for (int i_transfer = roe->express_schedule_starts[express_index];
+                             i_transfer < roe->express_schedule_starts[express_index + 1];
+                             i_transfer++) {
+                            ROEExpressTransfer& transfer =
+                                roe->express_schedule[i_transfer];
+                            REQUIRE(transfer.row_index > row_previous);
+                            REQUIRE(
+                                ((transfer.express_multiplier != 0.0) ||
+                                 transfer.store_trap_states));
+                            row_previous = transfer.row_index;
+                            test_express[express_index * n_columns + transfer.row_index] =
+                                transfer.express_multiplier;
+                            test_store[express_index * n_columns + transfer.row_index] =
+                                transfer.store_trap_states;
+                        }
+                    }
+                    for (unsigned int i = 0; i < express_matrix.size(); i++) {
+                        REQUIRE(test_express[i] == express_matrix[i]);
+                        REQUIRE(test_store[i] == store_trap_states_matrix[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("Express passes that depend on earlier rows") {
+        roe_standard.set_express_matrix_from_rows_and_express(n_rows, 3, 0);
+        roe_standard.set_store_trap_states_matrix();
+        roe_standard.set_express_schedule();
+        // Multipliers 1,2,3,4,4,...; then 0,0,0,0,1,2,...; and
+        // 0,...,0,1,2,3,4, storing at rows 3 and 7
+        REQUIRE(roe_standard.express_schedule_first(0, 0) == 0);
+        REQUIRE(roe_standard.express_schedule_first(1, 0) == n_rows);
+        REQUIRE(roe_standard.express_schedule_first(1, 5) == n_rows + 1);
+        REQUIRE(roe_standard.express_schedule_first(2, 9) == 2 * n_rows - 4 + 1);
+
+        REQUIRE(roe_standard.express_pass_depends_on_rows(0, 0, 1));
+        REQUIRE(roe_standard.express_pass_depends_on_rows(1, 0, 4));
+        REQUIRE_FALSE(roe_standard.express_pass_depends_on_rows(1, 0, 3));
+        REQUIRE(roe_standard.express_pass_depends_on_rows(1, 3, 5));
+        REQUIRE(roe_standard.express_pass_depends_on_rows(2, 7, 8));
+        REQUIRE_FALSE(roe_standard.express_pass_depends_on_rows(2, 0, 7));
+    }
+}
+
 TEST_CASE("Test clock sequence", "[roe]") {
     bool empty_traps_between_columns = true;
     bool empty_traps_for_first_transfers = true;
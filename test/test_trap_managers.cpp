@@ -398,8 +398,11 @@ TEST_CASE("Test utilities", "[trap_managers]") {
         trap_manager_ic_co.prepare_interpolation_tables();
 
         REQUIRE(
-            trap_manager_ic_co.traps[0].fill_fraction_table.size() ==
+            trap_manager_ic_co.traps[0].fill_fraction_table.size() <=
             trap_manager_ic_co.n_intp);
+        REQUIRE(
+            trap_manager_ic_co.traps[0].table_max_error <=
+            trap_manager_ic_co.traps[0].table_tolerance);
 
         // Slow-capture continuum traps
         TrapManagerSlowCaptureContinuum trap_manager_sc_co(
@@ -407,8 +410,14 @@ TEST_CASE("Test utilities", "[trap_managers]") {
         trap_manager_sc_co.prepare_interpolation_tables();
 
         REQUIRE(
-            trap_manager_sc_co.traps[0].fill_fraction_table.size() ==
+            trap_manager_sc_co.traps[0].fill_fraction_table.size() <=
             trap_manager_sc_co.n_intp);
+        REQUIRE(
+            trap_manager_sc_co.traps[0].table_max_error <=
+            trap_manager_sc_co.traps[0].table_tolerance);
+        REQUIRE(
+            trap_manager_sc_co.traps[0].capture_table_max_error <=
+            trap_manager_sc_co.traps[0].table_tolerance);
     }
 
     SECTION("Watermark index above cloud") {
@@ -527,6 +536,106 @@ TEST_CASE("Test utilities", "[trap_managers]") {
             std::begin(trap_manager.watermark_fills),
             std::end(trap_manager.watermark_fills));
         REQUIRE_THAT(test, Catch::Approx(answer));
+
+        // Restore after more watermarks were used, which must be emptied again
+        trap_manager.n_active_watermarks = 5;
+        trap_manager.watermark_volumes[5] = 0.4;
+        trap_manager.watermark_fills[10] = 0.7;
+        trap_manager.watermark_fills[11] = 0.6;
+        trap_manager.restore_trap_states();
+
+        REQUIRE(trap_manager.n_active_watermarks == 3);
+        REQUIRE(trap_manager.i_first_active_wmk == 1);
+        answer.assign(std::begin(volumes), std::end(volumes));
+        test.assign(
+            std::begin(trap_manager.watermark_volumes),
+            std::end(trap_manager.watermark_volumes));
+        REQUIRE_THAT(test, Catch::Approx(answer));
+        answer.assign(std::begin(fills), std::end(fills));
+        test.assign(
+            std::begin(trap_manager.watermark_fills),
+            std::end(trap_manager.watermark_fills));
+        REQUIRE_THAT(test, Catch::Approx(answer));
+    }
+
+    SECTION("Watermark capacity on demand") {
+        TrapManagerInstantCapture trap_manager(
+            std::valarray<TrapInstantCapture>{trap_1, trap_2}, 3, ccd_phase,
+            dwell_time);
+        trap_manager.initialise_trap_states();
+        REQUIRE(trap_manager.n_watermarks == 4);
+        std::vector<double> test, answer;
+
+        // Enough room already
+        trap_manager.n_active_watermarks = 2;
+        trap_manager.i_first_active_wmk = 1;
+        trap_manager.watermark_volumes = {0.1, 0.3, 0.2, 0.0};
+        trap_manager.watermark_fills = {0.1, 0.1, 0.8, 0.3, 0.4, 0.2, 0.0, 0.0};
+        trap_manager.ensure_watermark_capacity(0);
+        REQUIRE(trap_manager.i_first_active_wmk == 1);
+        REQUIRE(trap_manager.n_watermarks == 4);
+
+        // Move the watermarks down to the start
+        trap_manager.ensure_watermark_capacity(1);
+        REQUIRE(trap_manager.i_first_active_wmk == 0);
+        REQUIRE(trap_manager.n_active_watermarks == 2);
+        REQUIRE(trap_manager.n_watermarks == 4);
+        answer = {0.3, 0.2, 0.0, 0.0};
+        test.assign(
+            std::begin(trap_manager.watermark_volumes),
+            std::end(trap_manager.watermark_volumes));
+        REQUIRE_THAT(test, Catch::Approx(answer));
+        answer = {0.8, 0.3, 0.4, 0.2, 0.0, 0.0, 0.0, 0.0};
+        test.assign(
+            std::begin(trap_manager.watermark_fills),
+            std::end(trap_manager.watermark_fills));
+        REQUIRE_THAT(test, Catch::Approx(answer));
+
+        // Grow the arrays
+        trap_manager.n_active_watermarks = 3;
+        trap_manager.watermark_volumes[2] = 0.1;
+        trap_manager.watermark_fills[4] = 0.2;
+        trap_manager.watermark_fills[5] = 0.1;
+        trap_manager.ensure_watermark_capacity(1);
+        REQUIRE(trap_manager.n_watermarks == 8);
+        REQUIRE(trap_manager.watermark_fills.size() == 16);
+        answer = {0.3, 0.2, 0.1, 0.0, 0.0, 0.0, 0.0, 0.0};
+        test.assign(
+            std::begin(trap_manager.watermark_volumes),
+            std::end(trap_manager.watermark_volumes));
+        REQUIRE_THAT(test, Catch::Approx(answer));
+
+        // Merge the smallest watermark into the one below at the cap
+        trap_manager.max_n_watermarks = 8;
+        trap_manager.n_active_watermarks = 5;
+        trap_manager.watermark_volumes = {0.3, 0.2, 0.1, 0.1, 0.2, 0.0, 0.0, 0.0};
+        trap_manager.watermark_fills = {
+            // clang-format off
+            0.8, 0.3,
+            0.4, 0.2,
+            0.2, 0.1,
+            0.1, 0.0,
+            0.4, 0.4,
+            0.0, 0.0,
+            0.0, 0.0,
+            0.0, 0.0,
+            // clang-format on
+        };
+        double n_trapped_electrons = trap_manager.n_trapped_electrons_total();
+        trap_manager.ensure_watermark_capacity(3);
+        REQUIRE(trap_manager.n_watermarks == 8);
+        REQUIRE(trap_manager.n_active_watermarks == 4);
+        REQUIRE(trap_manager.n_trapped_electrons_total() == Approx(n_trapped_electrons));
+        answer = {0.3, 0.2, 0.2, 0.2};
+        test.assign(
+            std::begin(trap_manager.watermark_volumes),
+            std::begin(trap_manager.watermark_volumes) + 4);
+        REQUIRE_THAT(test, Catch::Approx(answer));
+        answer = {0.8, 0.3, 0.4, 0.2, 0.15, 0.05, 0.4, 0.4};
+        test.assign(
+            std::begin(trap_manager.watermark_fills),
+            std::begin(trap_manager.watermark_fills) + 8);
+        REQUIRE_THAT(test, Catch::Approx(answer));
     }
 }
 
@@ -1121,6 +1230,49 @@ TEST_CASE("Test manager manager", "[trap_managers]") {
             REQUIRE_THAT(test, Catch::Approx(answer));
         }
     }
+
+    SECTION("Workspace pool, reuses memory for the same model") {
+        std::valarray<TrapInstantCapture> traps_ic = {trap_1, trap_2};
+        std::valarray<TrapSlowCapture> traps_sc = {trap_3};
+        std::valarray<TrapInstantCaptureContinuum> traps_ic_co = {};
+        std::valarray<TrapSlowCaptureContinuum> traps_sc_co = {};
+        ROE roe;
+        CCD ccd(ccd_phase);
+        TrapManagerManager trap_manager_manager(
+            traps_ic, traps_sc, traps_ic_co, traps_sc_co, max_n_transfers, ccd,
+            roe.dwell_times);
+        TrapManagerManagerPool pool;
+
+        pool.reserve(2);
+        REQUIRE(pool.workspaces.size() == 2);
+        pool.reserve(1);
+        REQUIRE(pool.workspaces.size() == 2);
+
+        // Copies of the prepared trap managers
+        TrapManagerManager& workspace = pool.thread_workspace(1, trap_manager_manager);
+        REQUIRE(workspace.n_traps_ic == 2);
+        REQUIRE(workspace.n_traps_sc == 1);
+        REQUIRE(
+            workspace.trap_managers_ic[0].watermark_fills.size() ==
+            trap_manager_manager.trap_managers_ic[0].watermark_fills.size());
+        REQUIRE(
+            &workspace.trap_managers_ic[0].watermark_fills[0] !=
+            &trap_manager_manager.trap_managers_ic[0].watermark_fills[0]);
+
+        // Modify the workspace's trap states, then reinitialise it
+        double* fills = &workspace.trap_managers_ic[0].watermark_fills[0];
+        double* stored_fills = &workspace.trap_managers_sc[0].stored_watermark_fills[0];
+        workspace.trap_managers_ic[0].n_active_watermarks = 2;
+        workspace.trap_managers_ic[0].watermark_fills[0] = 0.5;
+        pool.thread_workspace(1, trap_manager_manager);
+        REQUIRE(workspace.trap_managers_ic[0].n_active_watermarks == 0);
+        REQUIRE(workspace.trap_managers_ic[0].watermark_fills[0] == 0.0);
+
+        // Same memory
+        REQUIRE(&workspace.trap_managers_ic[0].watermark_fills[0] == fills);
+        REQUIRE(
+            &workspace.trap_managers_sc[0].stored_watermark_fills[0] == stored_fills);
+    }
 }
 
 TEST_CASE("Test instant-capture traps: release", "[trap_managers]") {
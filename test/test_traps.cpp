@@ -1,7 +1,13 @@
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
 #include <valarray>
 
 #include "catch2/catch.hpp"
+#include "table_cache.hpp"
 #include "traps.hpp"
 #include "util.hpp"
 
@@ -613,3 +619,158 @@ TEST_CASE("Test slow-capture continuum traps", "[traps]") {
                 std::numeric_limits<double>::max()) == trap_2.fill_capture_long_time);
     }
 }
+
+TEST_CASE("Test cached continuum trap interpolation tables", "[traps]") {
+    int n_intp = 200;
+    double dwell_time = 1.0;
+    double time_min = 0.1;
+    double time_max = 99;
+    TrapSlowCaptureContinuum trap_1(10.0, 1.0, 0.1, 0.1);
+    TrapSlowCaptureContinuum trap_2(10.0, 1.0, 0.1, 0.1);
+    TrapInstantCaptureContinuum trap_3(10.0, 1.0, 0.1);
+    TrapSlowCaptureContinuum trap_4(10.0, 1.0, 0.1, 0.2);
+
+    set_table_cache_dir("");
+    clear_table_cache();
+    trap_1.prep_fill_fraction_and_time_elapsed_tables(time_min, time_max, n_intp);
+    trap_1.prep_fill_fraction_after_slow_capture_tables(
+        dwell_time, time_min, time_max, n_intp);
+
+    SECTION("Same tables from memory") {
+        trap_2.prep_fill_fraction_and_time_elapsed_tables(time_min, time_max, n_intp);
+        trap_2.prep_fill_fraction_after_slow_capture_tables(
+            dwell_time, time_min, time_max, n_intp);
+        trap_3.prep_fill_fraction_and_time_elapsed_tables(time_min, time_max, n_intp);
+
+        REQUIRE((trap_2.fill_fraction_table == trap_1.fill_fraction_table).min());
+        REQUIRE(
+            (trap_2.fill_fraction_capture_table == trap_1.fill_fraction_capture_table)
+                .min());
+        REQUIRE(trap_2.fill_min == trap_1.fill_min);
+        REQUIRE(trap_2.fill_max == trap_1.fill_max);
+        REQUIRE(trap_2.fill_capture_min == trap_1.fill_capture_min);
+        REQUIRE(trap_2.fill_capture_max == trap_1.fill_capture_max);
+        REQUIRE(trap_2.fill_capture_long_time == trap_1.fill_capture_long_time);
+        REQUIRE(trap_2.d_log_time == trap_1.d_log_time);
+
+        // Same release distribution, so same fill fraction table
+        REQUIRE((trap_3.fill_fraction_table == trap_1.fill_fraction_table).min());
+    }
+
+    SECTION("Different parameters not reused") {
+        trap_4.prep_fill_fraction_after_slow_capture_tables(
+            dwell_time, time_min, time_max, n_intp);
+        REQUIRE(
+            trap_4.fill_fraction_capture_table[n_intp / 2] !=
+            trap_1.fill_fraction_capture_table[n_intp / 2]);
+
+        trap_2.prep_fill_fraction_and_time_elapsed_tables(
+            time_min, time_max, n_intp + 1);
+        REQUIRE(trap_2.fill_fraction_table.size() == n_intp + 1);
+        REQUIRE(
+            trap_2.fill_fraction_table[n_intp] ==
+            Approx(trap_2.fill_fraction_from_time_elapsed(time_min)));
+    }
+
+    SECTION("Same tables from disk") {
+        char dir[] = "/tmp/arctic_test_table_cache_XXXXXX";
+        REQUIRE(mkdtemp(dir) != nullptr);
+        set_table_cache_dir(dir);
+        clear_table_cache();
+
+        // Write the files
+        trap_2.prep_fill_fraction_after_slow_capture_tables(
+            dwell_time, time_min, time_max, n_intp);
+        TableKey key(
+            table_kind_fill_fraction_after_slow_capture, 1.0, 0.1, 0.1, dwell_time,
+            time_min, time_max, 0.0, n_intp);
+        char name[64];
+        snprintf(name, sizeof(name), "/arctic_table_%016llx.bin", key.hash());
+        std::string path = std::string(dir) + name;
+        REQUIRE(access(path.c_str(), R_OK) == 0);
+
+        // Read them back
+        clear_table_cache();
+        trap_4 = trap_1;
+        trap_4.fill_fraction_capture_table = 0.0;
+        trap_4.prep_fill_fraction_after_slow_capture_tables(
+            dwell_time, time_min, time_max, n_intp);
+        REQUIRE(
+            (trap_4.fill_fraction_capture_table == trap_1.fill_fraction_capture_table)
+                .min());
+        REQUIRE(trap_4.fill_capture_long_time == trap_1.fill_capture_long_time);
+
+        remove(path.c_str());
+        set_table_cache_dir("");
+        clear_table_cache();
+        rmdir(dir);
+    }
+}
+
+TEST_CASE("Test adaptive continuum trap interpolation tables", "[traps]") {
+    double dwell_time = 1.0;
+    double time_min = 0.1;
+    double time_max = 99;
+    int n_intp_max = 1025;
+    TrapInstantCaptureContinuum trap_1(10.0, 1.0, 0.1);
+    TrapSlowCaptureContinuum trap_2(10.0, 1.0, 0.4, 0.1);
+
+    SECTION("Error within tolerance with fewer values") {
+        for (double tolerance : {1e-4, 1e-5, 1e-6}) {
+            double max_error = trap_1.prep_fill_fraction_and_time_elapsed_tables(
+                time_min, time_max, n_intp_max, tolerance);
+            REQUIRE(max_error == trap_1.table_max_error);
+            REQUIRE(max_error <= tolerance);
+            REQUIRE(trap_1.n_intp < n_intp_max);
+            REQUIRE(trap_1.fill_fraction_table.size() == trap_1.n_intp);
+            REQUIRE(trap_1.inv_d_log_time == Approx(1.0 / trap_1.d_log_time));
+
+            // Check between the table values
+            for (double log10_time = -0.99; log10_time <= 1.99; log10_time += 0.0137) {
+                double time = pow(10, log10_time);
+                REQUIRE(
+                    trap_1.fill_fraction_from_time_elapsed_table(time) ==
+                    Approx(trap_1.fill_fraction_from_time_elapsed(time))
+                        .epsilon(0.0)
+                        .margin(2.0 * tolerance));
+            }
+        }
+
+        double max_error = trap_2.prep_fill_fraction_after_slow_capture_tables(
+            dwell_time, time_min, time_max, n_intp_max, 1e-6);
+        REQUIRE(max_error <= 1e-6);
+        REQUIRE(trap_2.n_intp_capture < n_intp_max);
+        for (double log10_time = -0.99; log10_time <= 1.99; log10_time += 0.0137) {
+            double time = pow(10, log10_time);
+            REQUIRE(
+                trap_2.fill_fraction_after_slow_capture_table(time) ==
+                Approx(trap_2.fill_fraction_after_slow_capture(time, dwell_time))
+                    .epsilon(0.0)
+                    .margin(2e-6));
+        }
+    }
+
+    SECTION("Conversions are exact inverses") {
+        trap_1.prep_fill_fraction_and_time_elapsed_tables(
+            time_min, time_max, n_intp_max, 1e-6);
+        for (double log10_time = -1.5; log10_time <= 2.5; log10_time += 0.0731) {
+            double time = pow(10, log10_time);
+            double fill = trap_1.fill_fraction_from_time_elapsed_table(time);
+            if (fill <= 0.0 || fill >= 1.0) continue;
+            REQUIRE(
+                trap_1.fill_fraction_from_time_elapsed_table(
+                    trap_1.time_elapsed_from_fill_fraction_table(fill)) ==
+                Approx(fill).epsilon(1e-12));
+            REQUIRE(
+                trap_1.time_elapsed_from_fill_fraction_table(fill) ==
+                Approx(time).epsilon(1e-9));
+        }
+    }
+
+    SECTION("Unchecked fixed-size table") {
+        double max_error = trap_1.prep_fill_fraction_and_time_elapsed_tables(
+            time_min, time_max, 100);
+        REQUIRE(max_error == -1.0);
+        REQUIRE(trap_1.n_intp == 100);
+    }
+}
@@ -1,4 +1,9 @@
 
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
 #include <valarray>
 #include <vector>
 
@@ -82,6 +87,103 @@ TEST_CASE("Test transpose", "[util]") {
     }
 }
 
+TEST_CASE("Test image I/O", "[util]") {
+    int n_rows = 3;
+    int n_columns = 4;
+    std::vector<double> image = {
+        0.0, 1.5, -2.25, 3.0, 4e5, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0, 1.0 / 3.0};
+    int n_rows_loaded;
+    int n_columns_loaded;
+
+    SECTION("Formats") {
+        REQUIRE(image_format_from_filename("image.txt") == image_format_txt);
+        REQUIRE(image_format_from_filename("dir.v2/image") == image_format_txt);
+        REQUIRE(image_format_from_filename("image.bin") == image_format_binary);
+        REQUIRE(image_format_from_filename("image.fits") == image_format_fits);
+        REQUIRE(image_format_from_filename("image.fts") == image_format_fits);
+    }
+
+    SECTION("Binary and FITS, exact round trip") {
+        for (const char* filename : {"test_image_io.bin", "test_image_io.fits"}) {
+            save_image(filename, image.data(), n_rows, n_columns);
+            std::vector<double> loaded =
+                load_image(filename, n_rows_loaded, n_columns_loaded);
+            REQUIRE(n_rows_loaded == n_rows);
+            REQUIRE(n_columns_loaded == n_columns);
+            REQUIRE(loaded == image);
+            remove(filename);
+        }
+    }
+
+    SECTION("FITS file size and padding") {
+        save_image_to_fits("test_image_io.fits", image.data(), n_rows, n_columns);
+        FILE* f = fopen("test_image_io.fits", "rb");
+        std::vector<char> header(2880);
+        REQUIRE(fread(header.data(), 1, header.size(), f) == header.size());
+        fseek(f, 0, SEEK_END);
+        REQUIRE(ftell(f) == 2 * 2880);
+        fclose(f);
+        REQUIRE(std::string(header.data(), 80) ==
+                "SIMPLE  =                    T" + std::string(50, ' '));
+        remove("test_image_io.fits");
+    }
+
+    SECTION("FITS logical values") {
+        REQUIRE(fits_logical_value("                   T"));
+        REQUIRE(fits_logical_value("                   T / conforms to FITS"));
+        REQUIRE(fits_logical_value("T"));
+        REQUIRE_FALSE(fits_logical_value("                   F"));
+        REQUIRE_FALSE(fits_logical_value("                   F / not FITS standard"));
+        REQUIRE_FALSE(fits_logical_value("                   F / TBD"));
+        REQUIRE_FALSE(fits_logical_value("                    "));
+        REQUIRE_FALSE(fits_logical_value("                   TRUE"));
+    }
+
+    SECTION("FITS integer pixels, with BSCALE and BZERO") {
+        std::string header;
+        const char* cards[] = {"SIMPLE  =                    T",
+                               "BITPIX  =                   16",
+                               "NAXIS   =                    2",
+                               "NAXIS1  =                    3",
+                               "NAXIS2  =                    2",
+                               "BSCALE  =                  0.5",
+                               "BZERO   =                32768",
+                               "END"};
+        for (const char* card : cards)
+            header += card + std::string(80 - strlen(card), ' ');
+        header += std::string(2880 - header.size(), ' ');
+        std::vector<int16_t> pixels = {0, 1, -1, 1000, -32768, 32767};
+        std::vector<unsigned char> data(2880, 0);
+        for (unsigned int i_pixel = 0; i_pixel < pixels.size(); i_pixel++) {
+            data[2 * i_pixel] = (uint16_t)pixels[i_pixel] >> 8;
+            data[2 * i_pixel + 1] = (uint16_t)pixels[i_pixel] & 0xff;
+        }
+        FILE* f = fopen("test_image_io.fits", "wb");
+        fwrite(header.data(), 1, header.size(), f);
+        fwrite(data.data(), 1, data.size(), f);
+        fclose(f);
+
+        std::vector<double> loaded =
+            load_image("test_image_io.fits", n_rows_loaded, n_columns_loaded);
+        REQUIRE(n_rows_loaded == 2);
+        REQUIRE(n_columns_loaded == 3);
+        std::vector<double> answer = {32768.0, 32768.5, 32767.5,
+                                      33268.0, 16384.0, 49151.5};
+        REQUIRE(loaded == answer);
+        remove("test_image_io.fits");
+    }
+
+    SECTION("Text") {
+        save_image("test_image_io.txt", image.data(), n_rows, n_columns);
+        std::vector<double> loaded =
+            load_image("test_image_io.txt", n_rows_loaded, n_columns_loaded);
+        REQUIRE(n_rows_loaded == n_rows);
+        REQUIRE(n_columns_loaded == n_columns);
+        REQUIRE_THAT(loaded, Catch::Approx(image).epsilon(1e-5));
+        remove("test_image_io.txt");
+    }
+}
+
 TEST_CASE("Demo 2D-style 1D valarray slicing", "[util]") {
     // More of an example reference than a test
     std::vector<double> answer, image_;